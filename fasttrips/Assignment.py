@@ -24,6 +24,8 @@ __license__   = """
 """
 import configparser
 import datetime
+import glob
+import hashlib
 import math
 import multiprocessing
 import os
@@ -35,6 +37,7 @@ import numpy as np
 import pandas as pd
 
 import _fasttrips
+from .Distributed import PathfindingCoordinator
 from .Error import ConfigurationError
 from .Logger import FastTripsLogger, setupLogging
 from .Passenger import Passenger
@@ -150,6 +153,41 @@ class Assignment(object):
     #: pathset quality. (Todo: test/quantify this.)
     STOCH_MAX_STOP_PROCESS_COUNT    = None
 
+    #: Route choice configuration: In labeling, drop stop states whose cost plus a lower bound on
+    #: the cost from their stop to the end TAZ is past the labeling cutoff.  The bounds come from the least
+    #: in-vehicle and transfer walk times and are calculated once per TAZ.  Compare the
+    #: :py:attr:`Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS` and
+    #: :py:attr:`Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES` performance columns with and without. Boolean.
+    PRUNE_WITH_LOWER_BOUNDS         = None
+
+    #: Route choice configuration: Keep each labeling result in the C++ extension and reuse it for later queries
+    #: (including in later iterations) with the same origin, destination, direction, preferred time, value of time,
+    #: user class, purpose and demand modes.  A result is dropped when the times or bump waits of a trip serving one
+    #: of its labeled stops change.  This uses memory for every distinct query; it only helps when the extension
+    #: persists across iterations, as with :py:attr:`Assignment.NUMBER_OF_THREADS` or a single process.
+    #: The memory is bounded by :py:attr:`Assignment.LABELING_CACHE_MB`.
+    #: See :py:attr:`Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT`.  Boolean.
+    LABELING_CACHE                  = None
+
+    #: Route choice configuration: The most memory, in megabytes, the :py:attr:`Assignment.LABELING_CACHE` may take
+    #: up in each process (approximately).  Past it, the least recently used results are dropped, so the reuse falls
+    #: off for demand whose distinct queries don't fit.  Int.
+    LABELING_CACHE_MB               = None
+
+    #: Route choice configuration: For deterministic path finding, label by scanning every trip's hops between
+    #: consecutive stops in time order from the preferred time, instead of expanding the trips at each stop as it
+    #: comes off the label stop queue.  The least cost paths are the same (ties may be broken differently); the C++
+    #: extension keeps another copy of the stop times, sorted for the scan.  Ignored for stochastic path finding.  Boolean.
+    CONNECTION_SCAN                 = None
+
+    #: Route choice configuration: For stochastic path finding, draw each person trip's pathset on this many threads
+    #: after labeling.  The draws are split into blocks, each with its own random number stream, so the pathsets are
+    #: the same for any number of threads, though not the same as with 0, which draws them one by one.  This shortens
+    #: the few very expensive person trips when :py:attr:`Assignment.STOCH_PATHSET_SIZE` is large.  With more than one
+    #: of :py:attr:`Assignment.NUMBER_OF_THREADS` the blocks are drawn on the person trip's own thread instead, since
+    #: those already keep the cores busy.  Traced person trips are drawn one by one.  Int.
+    ENUMERATION_THREADS             = None
+
     #: Route choice configuration: How many stochastic paths will we generate
     #: (not necessarily unique) to define a path choice set?  Int.
     STOCH_PATHSET_SIZE              = None
@@ -187,6 +225,88 @@ class Assignment(object):
     #: Set to positive integer greater than 1 to set a fixed number of processes
     NUMBER_OF_PROCESSES             = None
 
+    #: Number of threads to use for path finding within the C++ extension.
+    #: Threads share a single copy of the network supply, unlike processes.
+    #: Set to 0 to not use threads; path finding then uses :py:attr:`Assignment.NUMBER_OF_PROCESSES`
+    #: Set to less than 0 to use the result of :py:func:`multiprocessing.cpu_count`
+    #: Set to positive integer to set a fixed number of threads (and run in this process)
+    NUMBER_OF_THREADS               = None
+
+    #: Load the network supply in the C++ extension from a binary snapshot in the output directory
+    #: (written by the first process that reads the intermediate text files) instead of parsing the text files.
+    #: The snapshot is memory mapped, so processes on one machine share it, and it's ignored once the contents of the
+    #: text files change, per :py:attr:`Assignment.SNAPSHOT_MANIFEST_FILE`.  Boolean.
+    NETWORK_SNAPSHOT                = None
+
+    #: Manifest of the intermediate text files, in the output directory, written by
+    #: :py:meth:`Assignment.write_snapshot_manifest` once per run.  The network snapshot records it and is only
+    #: read while it matches, so the extension never has to hash the text files itself.
+    SNAPSHOT_MANIFEST_FILE          = "ft_intermediate_snapshot_manifest.txt"
+
+    #: With :py:attr:`Assignment.NUMBER_OF_PROCESSES`, load the network supply into the C++ extension once in this
+    #: process and fork the worker processes from it, so they share its memory copy-on-write instead of each
+    #: building their own copy.  A worker only gets its own copy of what it writes, like the bump waits and the
+    #: caches it builds.  Ignored where processes can't be forked (Windows).  Boolean.
+    SHARE_SUPPLY                    = None
+
+    #: Number of person trips to send to the C++ extension at once when using :py:attr:`Assignment.NUMBER_OF_THREADS`
+    PATHFINDING_BATCH_SIZE          = 5000
+
+    #: When using :py:attr:`Assignment.NUMBER_OF_THREADS`, have the C++ extension append each batch of pathsets
+    #: to a columnar binary file in the output directory as it completes, on a background thread, instead of
+    #: keeping them in each :py:class:`PathSet`.  :py:meth:`Passenger.setup_passenger_pathsets` then reads them
+    #: back one person trip at a time, so only the pathset dataframes have to fit in memory.
+    #: See :py:meth:`Assignment.read_pathset_stream`.
+    STREAM_PATHSETS                 = None
+
+    #: When using :py:attr:`Assignment.NUMBER_OF_THREADS`, label once for each group of person trips in a batch with
+    #: the same origin, destination, direction, preferred time, value of time, user class, purpose and demand modes,
+    #: and enumerate each person trip's pathset from those labels with its own random number stream.
+    #: Person trips are sorted so those groups end up in the same batch.  Traced person trips are labeled on their own.
+    GROUP_LABELING                  = None
+
+    #: With :py:attr:`Assignment.GROUP_LABELING`, preferred times within the same bucket of this many minutes are grouped,
+    #: and the group is labeled with its first person trip's preferred time.  0 means the preferred times must be equal.
+    GROUP_LABELING_TIME_BUCKET      = None
+
+    #: When using :py:attr:`Assignment.NUMBER_OF_THREADS`, hand out the most expensive person trips in each batch first,
+    #: each to the thread with the least predicted work, so the batch doesn't wait on a thread that got the hard ones last.
+    #: A person trip's cost is predicted from how long its last pathfinding took (see the microsecond
+    #: :py:attr:`Performance.PERFORMANCE_PF_COUNTER_COLUMNS`); those not found yet are predicted at the batch average.
+    #: Worker utilization and tail time are written to :py:attr:`Performance.OUTPUT_PERFORMANCE_PF_WORKERS_FILE` regardless.
+    SCHEDULE_BY_COST                = None
+
+    #: Find paths on pathfinding nodes, which may be on other hosts, instead of in this process:
+    #: ``host:port`` to serve batches of :py:attr:`Assignment.PATHFINDING_BATCH_SIZE` person trips from, or None.
+    #: Start each node with ``python -m fasttrips.Distributed host:port authkey``; see :py:class:`Distributed.PathfindingCoordinator`.
+    #: The nodes read the network supply from the output directory, so it must be on a file system they share.
+    DISTRIBUTED_ADDRESS             = None
+
+    #: The key pathfinding nodes must have to connect, with :py:attr:`Assignment.DISTRIBUTED_ADDRESS`.  Required: work and
+    #: results are pickled, so anyone with the key can run code in this process and on the nodes.  Pick a secret one;
+    #: it isn't written to :py:attr:`Assignment.CONFIGURATION_OUTPUT_FILE`.
+    DISTRIBUTED_AUTHKEY             = None
+
+    #: The :py:class:`Distributed.PathfindingCoordinator` for :py:attr:`Assignment.DISTRIBUTED_ADDRESS`, once started
+    distributed_coordinator         = None
+
+    #: Number of batches the C++ extension holds in memory waiting to be written when :py:attr:`Assignment.STREAM_PATHSETS`
+    PATHSET_STREAM_BUFFERED_BATCHES = 2
+
+    #: Pathset stream filename format, in the output directory.  Takes the iteration and pathfinding iteration.
+    PATHSET_STREAM_FILE             = "ft_pathsets_iter%d_pfiter%d.bin"
+
+    #: The pathset stream written by the last :py:meth:`Assignment.generate_pathsets`, or None if it didn't write one
+    pathset_stream_file             = None
+
+    #: Record each pathfinding iteration's queries, with the parameters, stop times and bump waits they ran against,
+    #: to a query corpus in the output directory for replaying with the C++ benchmark in ``src/bench/pathfinder_bench.cpp``.
+    #: Only for pathfinding in this process (threads or not); worker processes don't record.
+    RECORD_QUERIES                  = None
+
+    #: Query corpus filename format, in the output directory.  Takes the iteration and pathfinding iteration.
+    QUERY_RECORD_FILE               = "ft_queries_iter%d_pfiter%d.txt"
+
     #: Extra time so passengers don't get bumped (?). A :py:class:`datetime.timedelta` instance.
     BUMP_BUFFER                     = None
 
@@ -195,6 +315,11 @@ class Assignment(object):
     bump_wait                       = {}
     bump_wait_df                    = None
 
+    #: The stop time index and times arrays last sent to the C++ extension in this process, so later
+    #: iterations can send just the rows that changed.  See :py:meth:`Assignment.initialize_fasttrips_extension`.
+    extension_stoptime_index        = None
+    extension_stoptime_times        = None
+
     #: Simulation: bump one stop at a time (slower, more accurate)
     #:
     #: When addressing capacity constraints in simulation, we look at all the (trip, stop)-pairs
@@ -312,10 +437,24 @@ class Assignment(object):
                       'fare_zone_symmetry'              :'False',
                       'prepend_route_id_to_trip_id'     :'False',
                       'number_of_processes'             :0,
+                      'number_of_threads'               :0,
+                      'network_snapshot'                :'False',
+                      'share_supply'                    :'False',
+                      'stream_pathsets'                 :'False',
+                      'group_labeling'                  :'False',
+                      'group_labeling_time_bucket'      :0,
+                      'record_queries'                  :'False',
+                      'schedule_by_cost'                :'False',
+                      'distributed_address'             :'None',
+                      'distributed_authkey'             :'None',
                       'bump_buffer'                     :5,
                       'bump_one_at_a_time'              :'False',
 
                       # pathfinding
+                      'connection_scan'                  :'False',
+                      'enumeration_threads'              :0,
+                      'labeling_cache'                   :'False',
+                      'labeling_cache_mb'                :256,
                       'max_num_paths'                    :-1,
                       'min_path_probability'             :0.005,
                       'min_transfer_penalty'             :0.1,
@@ -325,6 +464,7 @@ class Assignment(object):
                       'overlap_variable'                 :'count',
                       'pathfinding_type'                 :Assignment.PATHFINDING_TYPE_STOCHASTIC,
                       'pathweights_fixed_width'          :'False',
+                      'prune_with_lower_bounds'          :'False',
                       'utils_conversion_factor'         :1.0,
                       'stochastic_dispersion'            :1.0,
                       'stochastic_max_stop_process_count':20,
@@ -372,6 +512,18 @@ class Assignment(object):
         Assignment.FARE_ZONE_SYMMETRY            = parser.getboolean('fasttrips','fare_zone_symmetry')
         Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID   = parser.getboolean('fasttrips','prepend_route_id_to_trip_id')
         Assignment.NUMBER_OF_PROCESSES           = parser.getint    ('fasttrips','number_of_processes')
+        Assignment.NUMBER_OF_THREADS             = parser.getint    ('fasttrips','number_of_threads')
+        Assignment.NETWORK_SNAPSHOT              = parser.getboolean('fasttrips','network_snapshot')
+        Assignment.SHARE_SUPPLY                  = parser.getboolean('fasttrips','share_supply')
+        Assignment.STREAM_PATHSETS               = parser.getboolean('fasttrips','stream_pathsets')
+        Assignment.GROUP_LABELING                = parser.getboolean('fasttrips','group_labeling')
+        Assignment.GROUP_LABELING_TIME_BUCKET    = parser.getfloat  ('fasttrips','group_labeling_time_bucket')
+        Assignment.RECORD_QUERIES                = parser.getboolean('fasttrips','record_queries')
+        Assignment.SCHEDULE_BY_COST              = parser.getboolean('fasttrips','schedule_by_cost')
+        Assignment.DISTRIBUTED_ADDRESS           = parser.get       ('fasttrips','distributed_address')
+        if Assignment.DISTRIBUTED_ADDRESS in ['None','']: Assignment.DISTRIBUTED_ADDRESS = None
+        Assignment.DISTRIBUTED_AUTHKEY           = parser.get       ('fasttrips','distributed_authkey')
+        if Assignment.DISTRIBUTED_AUTHKEY in ['None','']: Assignment.DISTRIBUTED_AUTHKEY = None
         Assignment.BUMP_BUFFER = datetime.timedelta(
                                          minutes = parser.getfloat  ('fasttrips','bump_buffer'))
         Assignment.BUMP_ONE_AT_A_TIME            = parser.getboolean('fasttrips','bump_one_at_a_time')
@@ -386,6 +538,11 @@ class Assignment(object):
         PathSet.OVERLAP_VARIABLE                 = parser.get       ('pathfinding','overlap_variable')
         Assignment.PATHFINDING_TYPE              = parser.get       ('pathfinding','pathfinding_type')
         PathSet.WEIGHTS_FIXED_WIDTH              = parser.getboolean('pathfinding','pathweights_fixed_width')
+        Assignment.PRUNE_WITH_LOWER_BOUNDS       = parser.getboolean('pathfinding','prune_with_lower_bounds')
+        Assignment.LABELING_CACHE                = parser.getboolean('pathfinding','labeling_cache')
+        Assignment.LABELING_CACHE_MB             = parser.getint    ('pathfinding','labeling_cache_mb')
+        Assignment.CONNECTION_SCAN               = parser.getboolean('pathfinding','connection_scan')
+        Assignment.ENUMERATION_THREADS           = parser.getint    ('pathfinding','enumeration_threads')
         Assignment.STOCH_DISPERSION              = parser.getfloat  ('pathfinding','stochastic_dispersion')
         Assignment.UTILS_CONVERSION              = parser.getfloat  ('pathfinding','utils_conversion_factor')
         Assignment.STOCH_MAX_STOP_PROCESS_COUNT  = parser.getint    ('pathfinding','stochastic_max_stop_process_count')
@@ -554,6 +711,15 @@ class Assignment(object):
         parser.set('fasttrips','fare_zone_symmetry',            'True' if Assignment.FARE_ZONE_SYMMETRY else 'False')
         parser.set('fasttrips','prepend_route_id_to_trip_id',   'True' if Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID else 'False')
         parser.set('fasttrips','number_of_processes',           '%d' % Assignment.NUMBER_OF_PROCESSES)
+        parser.set('fasttrips','number_of_threads',             '%d' % Assignment.NUMBER_OF_THREADS)
+        parser.set('fasttrips','network_snapshot',              'True' if Assignment.NETWORK_SNAPSHOT else 'False')
+        parser.set('fasttrips','share_supply',                  'True' if Assignment.SHARE_SUPPLY else 'False')
+        parser.set('fasttrips','stream_pathsets',               'True' if Assignment.STREAM_PATHSETS else 'False')
+        parser.set('fasttrips','group_labeling',                'True' if Assignment.GROUP_LABELING else 'False')
+        parser.set('fasttrips','group_labeling_time_bucket',    '%f' % Assignment.GROUP_LABELING_TIME_BUCKET)
+        parser.set('fasttrips','record_queries',                'True' if Assignment.RECORD_QUERIES else 'False')
+        parser.set('fasttrips','schedule_by_cost',              'True' if Assignment.SCHEDULE_BY_COST else 'False')
+        parser.set('fasttrips','distributed_address',           '%s' % str(Assignment.DISTRIBUTED_ADDRESS))
         parser.set('fasttrips','bump_buffer',                   '%f' % (Assignment.BUMP_BUFFER.total_seconds()/60.0))
         parser.set('fasttrips','bump_one_at_a_time',            'True' if Assignment.BUMP_ONE_AT_A_TIME else 'False')
 
@@ -568,6 +734,11 @@ class Assignment(object):
         parser.set('pathfinding','overlap_variable',            '%s' % PathSet.OVERLAP_VARIABLE)
         parser.set('pathfinding','pathfinding_type',            Assignment.PATHFINDING_TYPE)
         parser.set('pathfinding','pathweights_fixed_width',     'True' if PathSet.WEIGHTS_FIXED_WIDTH else 'False')
+        parser.set('pathfinding','prune_with_lower_bounds',     'True' if Assignment.PRUNE_WITH_LOWER_BOUNDS else 'False')
+        parser.set('pathfinding','labeling_cache',              'True' if Assignment.LABELING_CACHE else 'False')
+        parser.set('pathfinding','labeling_cache_mb',           '%d' % Assignment.LABELING_CACHE_MB)
+        parser.set('pathfinding','connection_scan',             'True' if Assignment.CONNECTION_SCAN else 'False')
+        parser.set('pathfinding','enumeration_threads',         '%d' % Assignment.ENUMERATION_THREADS)
         parser.set('pathfinding','stochastic_dispersion',       '%f' % Assignment.STOCH_DISPERSION)
         parser.set('pathfinding','utils_conversion_factor',     '%f' % Assignment.UTILS_CONVERSION)
         parser.set('pathfinding','stochastic_max_stop_process_count', '%d' % Assignment.STOCH_MAX_STOP_PROCESS_COUNT)
@@ -587,12 +758,11 @@ class Assignment(object):
         output_file.close()
 
     @staticmethod
-    def initialize_fasttrips_extension(process_number, output_dir, stop_times_df):
+    def extension_stop_time_arrays(stop_times_df):
         """
-        Initialize the C++ fasttrips extension by passing it the network supply.
+        Returns the (stoptime_index, stoptime_times) arrays the C++ extension takes for the given stop times:
+        Nx3 int32 trip id num, stop sequence, stop id num and Nx4 float64 arrival, departure, shape distance traveled, overcap.
         """
-        FastTripsLogger.debug("Initializing fasttrips extension for process number %d" % process_number)
-
         # this may not be set yet if it is iter1
         overcap_col = Trip.SIM_COL_VEH_OVERCAP
         if Assignment.MSA_RESULTS:
@@ -601,31 +771,100 @@ class Assignment(object):
         if overcap_col not in list(stop_times_df.columns.values):
             stop_times_df[overcap_col] = 0
 
-        FastTripsLogger.debug("initialize_fasttrips_extension() overcap sum: %d" % stop_times_df[overcap_col].sum())
-        FastTripsLogger.debug("initialize_fasttrips_extension() STOPTIMES_COLUMN_DEPARTURE_TIME_MIN len: %d mean: %f" % \
+        FastTripsLogger.debug("extension_stop_time_arrays() overcap sum: %d" % stop_times_df[overcap_col].sum())
+        FastTripsLogger.debug("extension_stop_time_arrays() STOPTIMES_COLUMN_DEPARTURE_TIME_MIN len: %d mean: %f" % \
                               (len(stop_times_df), stop_times_df[Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN].mean()))
 
-        _fasttrips.initialize_supply(output_dir, process_number,
-                                     stop_times_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                                    Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                                    Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
-                                     stop_times_df[[Trip.STOPTIMES_COLUMN_ARRIVAL_TIME_MIN,
-                                                    Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN,
-                                                    Trip.STOPTIMES_COLUMN_SHAPE_DIST_TRAVELED,
-                                                    overcap_col]].as_matrix().astype('float64'))
-
-        _fasttrips.initialize_parameters(Assignment.TIME_WINDOW.total_seconds()/ 60.0,
-                                         Assignment.BUMP_BUFFER.total_seconds()/ 60.0,
-                                         Assignment.UTILS_CONVERSION,
-                                         PathSet.DEPART_EARLY_ALLOWED_MIN.total_seconds()/ 60.0,
-                                         PathSet.ARRIVE_LATE_ALLOWED_MIN.total_seconds()/ 60.0,
-                                         Assignment.STOCH_PATHSET_SIZE,
-                                         Assignment.STOCH_DISPERSION,
-                                         Assignment.STOCH_MAX_STOP_PROCESS_COUNT,
-                                         1 if Assignment.TRANSFER_FARE_IGNORE_PATHFINDING else 0,
-                                         1 if Assignment.TRANSFER_FARE_IGNORE_PATHENUM else 0,
-                                         Assignment.MAX_NUM_PATHS,
-                                         Assignment.MIN_PATH_PROBABILITY)
+        stoptime_index = stop_times_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                                        Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
+                                        Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32')
+        stoptime_times = stop_times_df[[Trip.STOPTIMES_COLUMN_ARRIVAL_TIME_MIN,
+                                        Trip.STOPTIMES_COLUMN_DEPARTURE_TIME_MIN,
+                                        Trip.STOPTIMES_COLUMN_SHAPE_DIST_TRAVELED,
+                                        overcap_col]].as_matrix().astype('float64')
+        return (stoptime_index, stoptime_times)
+
+    @staticmethod
+    def write_snapshot_manifest(output_dir):
+        """
+        Writes :py:attr:`Assignment.SNAPSHOT_MANIFEST_FILE`: the size and SHA-1 hash of each intermediate text file
+        in the output directory, for checking the network snapshot against.  Call this once the intermediate files
+        are written and before the extension loads the supply.
+        """
+        manifest_file = os.path.join(output_dir, Assignment.SNAPSHOT_MANIFEST_FILE)
+        with open(manifest_file, 'w') as manifest:
+            for source_file in sorted(glob.glob(os.path.join(output_dir, "ft_intermediate_*.txt"))):
+                if os.path.basename(source_file) == Assignment.SNAPSHOT_MANIFEST_FILE: continue
+                sha1 = hashlib.sha1()
+                with open(source_file, 'rb') as source:
+                    for block in iter(lambda: source.read(1024*1024), b''):
+                        sha1.update(block)
+                manifest.write("%s %d %s\n" % (os.path.basename(source_file), os.path.getsize(source_file), sha1.hexdigest()))
+        FastTripsLogger.debug("Wrote %s" % manifest_file)
+
+    @staticmethod
+    def initialize_fasttrips_extension(process_number, output_dir, stop_times_df, shared_supply=False):
+        """
+        Initialize the C++ fasttrips extension by passing it the network supply.
+
+        If shared_supply, this is a worker process forked from the process that did that with these stop times
+        (see :py:attr:`Assignment.SHARE_SUPPLY`), so the extension already has them.
+        """
+        FastTripsLogger.debug("Initializing fasttrips extension for process number %d" % process_number)
+
+        if shared_supply:
+            _fasttrips.set_process_number(process_number)
+            Assignment.initialize_fasttrips_parameters()
+            return
+
+        (stoptime_index, stoptime_times) = Assignment.extension_stop_time_arrays(stop_times_df)
+
+        # worker processes start fresh, but this process keeps the extension's stop times between iterations
+        # so if it's the same stop times, just send the ones that changed
+        if process_number == 0 and type(Assignment.extension_stoptime_index) != type(None) and \
+           np.array_equal(stoptime_index, Assignment.extension_stoptime_index):
+            changed = np.any(stoptime_times != Assignment.extension_stoptime_times, axis=1)
+            FastTripsLogger.debug("initialize_fasttrips_extension() updating %d changed stop times" % changed.sum())
+            _fasttrips.update_stop_times(stoptime_index[changed], stoptime_times[changed])
+        else:
+            _fasttrips.initialize_supply(output_dir, process_number, stoptime_index, stoptime_times,
+                                         1 if Assignment.NETWORK_SNAPSHOT else 0)
+
+        if process_number == 0:
+            Assignment.extension_stoptime_index = stoptime_index
+            Assignment.extension_stoptime_times = stoptime_times
+
+        Assignment.initialize_fasttrips_parameters()
+
+    @staticmethod
+    def fasttrips_parameters():
+        """
+        Returns the path finding parameters for ``_fasttrips.initialize_parameters``, as a tuple.
+        """
+        return (Assignment.TIME_WINDOW.total_seconds()/ 60.0,
+                Assignment.BUMP_BUFFER.total_seconds()/ 60.0,
+                Assignment.UTILS_CONVERSION,
+                PathSet.DEPART_EARLY_ALLOWED_MIN.total_seconds()/ 60.0,
+                PathSet.ARRIVE_LATE_ALLOWED_MIN.total_seconds()/ 60.0,
+                Assignment.STOCH_PATHSET_SIZE,
+                Assignment.STOCH_DISPERSION,
+                Assignment.STOCH_MAX_STOP_PROCESS_COUNT,
+                1 if Assignment.TRANSFER_FARE_IGNORE_PATHFINDING else 0,
+                1 if Assignment.TRANSFER_FARE_IGNORE_PATHENUM else 0,
+                Assignment.MAX_NUM_PATHS,
+                Assignment.MIN_PATH_PROBABILITY,
+                1 if Assignment.PRUNE_WITH_LOWER_BOUNDS else 0,
+                1 if Assignment.LABELING_CACHE else 0,
+                1 if Assignment.CONNECTION_SCAN else 0,
+                Assignment.ENUMERATION_THREADS,
+                Assignment.LABELING_CACHE_MB)
+
+    @staticmethod
+    def initialize_fasttrips_parameters():
+        """
+        Passes the path finding parameters to the C++ extension.
+        """
+        _fasttrips.initialize_parameters(*Assignment.fasttrips_parameters())
 
     @staticmethod
     def set_fasttrips_bump_wait(bump_wait_df):
@@ -637,10 +876,22 @@ class Assignment(object):
 
         if len(bump_wait_df) == 0: return
 
-        _fasttrips.set_bump_wait(bump_wait_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
-                                               Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
-                                               Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
-                                 bump_wait_df[Passenger.PF_COL_PAX_A_TIME_MIN].values.astype('float64'))
+        _fasttrips.set_bump_wait(*Assignment.extension_bump_wait_arrays(bump_wait_df))
+
+    @staticmethod
+    def extension_bump_wait_arrays(bump_wait_df):
+        """
+        Returns the (bump_wait_index, bump_wait_times) arrays the C++ extension takes for the given bump waits:
+        Nx3 int32 trip id num, stop sequence, stop id num and N float64 arrival time in minutes after midnight.
+        """
+        if type(bump_wait_df)==type(None) or len(bump_wait_df) == 0:
+            return (np.zeros((0,3), dtype=np.int32), np.zeros((0,), dtype=np.float64))
+
+        return (bump_wait_df[[Trip.STOPTIMES_COLUMN_TRIP_ID_NUM,
+                              Trip.STOPTIMES_COLUMN_STOP_SEQUENCE,
+                              Trip.STOPTIMES_COLUMN_STOP_ID_NUM]].as_matrix().astype('int32'),
+                bump_wait_df[Passenger.PF_COL_PAX_A_TIME_MIN].values.astype('float64'))
+
     @staticmethod
     def write_vehicle_trips(output_dir, iteration, pathfinding_iteration, simulation_iteration, veh_trips_df):
         """
@@ -752,6 +1003,12 @@ class Assignment(object):
         """
         # clear any state
         _fasttrips.reset()
+        Assignment.extension_stoptime_index = None
+        Assignment.extension_stoptime_times = None
+
+        # the intermediate files are all written by now
+        if Assignment.NETWORK_SNAPSHOT:
+            Assignment.write_snapshot_manifest(output_dir)
 
         # write the initial load profile, iteration 0
         veh_trips_df     = FT.trips.get_full_trips()
@@ -811,7 +1068,8 @@ class Assignment(object):
                     num_new_paths_found = Assignment.generate_pathsets(FT, pathset_paths_df, veh_trips_df, output_dir, iteration, pathfinding_iteration)
                     (new_pathset_paths_df, new_pathset_links_df) = FT.passengers.setup_passenger_pathsets(iteration, pathfinding_iteration, FT.stops,
                                                                                                           FT.trips.trip_id_df, FT.trips.trips_df, FT.routes.modes_df,
-                                                                                                          FT.transfers, FT.tazs, Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID)
+                                                                                                          FT.transfers, FT.tazs, Assignment.PREPEND_ROUTE_ID_TO_TRIP_ID,
+                                                                                                          Assignment.pathset_stream_file)
                     # write pathfinding results to special PF results file
                     Passenger.write_paths(output_dir, iteration, pathfinding_iteration, -1, new_pathset_paths_df, False,
                                           Assignment.OUTPUT_PATHSET_PER_SIM_ITER, not Assignment.DEBUG_OUTPUT_COLUMNS, False)
@@ -907,6 +1165,10 @@ class Assignment(object):
 
             # end for loop
 
+        if Assignment.distributed_coordinator:
+            Assignment.distributed_coordinator.shutdown()
+            Assignment.distributed_coordinator = None
+
         return {"capacity_gap": capacity_gap,
                 "paths_found": num_paths_found,
                 "passengers_arrived": num_passengers_arrived,
@@ -1058,6 +1320,7 @@ class Assignment(object):
         process_dict        = {}  # workernum -> {"process":process, "alive":alive bool, "done":done bool, "working_on":(person_id, trip_list_num)}
         todo_queue          = None
         done_queue          = None
+        Assignment.pathset_stream_file = None
 
         # We only need to do this once
         if iteration == 1 and pathfinding_iteration == 1:
@@ -1098,34 +1361,87 @@ class Assignment(object):
         if num_processes > est_paths_to_find*3:
             num_processes = int(est_paths_to_find//3)
 
+        # threads replace processes
+        num_threads         = Assignment.NUMBER_OF_THREADS
+        if Assignment.NUMBER_OF_THREADS < 0:
+            num_threads     = multiprocessing.cpu_count()
+        if num_threads > 0:
+            num_processes   = 1
+            FastTripsLogger.info("Finding pathsets using %d threads" % num_threads)
+
+        # and pathfinding nodes replace both; they batch like threads
+        coordinator         = None
+        if Assignment.DISTRIBUTED_ADDRESS:
+            num_processes   = 1
+            if Assignment.distributed_coordinator == None:
+                if not Assignment.DISTRIBUTED_AUTHKEY:
+                    msg = "fasttrips.distributed_address requires fasttrips.distributed_authkey; the nodes are only checked by that key"
+                    FastTripsLogger.fatal(msg)
+                    raise ConfigurationError(Assignment.CONFIGURATION_FILE, msg)
+                (host, port) = Assignment.DISTRIBUTED_ADDRESS.rsplit(":", 1)
+                Assignment.distributed_coordinator = PathfindingCoordinator((host, int(port)), Assignment.DISTRIBUTED_AUTHKEY.encode(),
+                                                                            output_dir, Assignment.NETWORK_SNAPSHOT)
+            coordinator     = Assignment.distributed_coordinator
+            FastTripsLogger.info("Finding pathsets on pathfinding nodes via %s; %d joined so far" % \
+                                 (Assignment.DISTRIBUTED_ADDRESS, coordinator.num_nodes()))
+        batch_pathsets      = [] # list of (pathset, trace) for threads
+
         # this is probalby time consuming... put in a try block
         try:
             # Setup multiprocessing processes
             if num_processes > 1:
-                todo_queue      = multiprocessing.Queue()
-                done_queue      = multiprocessing.Queue()
+                mp_context      = multiprocessing
+                share_supply    = Assignment.SHARE_SUPPLY and sys.platform != "win32"
+                if share_supply:
+                    # the workers are forked once this process has the supply, so they share it
+                    Assignment.initialize_fasttrips_extension(0, output_dir, veh_trips_df)
+                    if hasattr(multiprocessing, "get_context"):
+                        mp_context = multiprocessing.get_context("fork")
+                    FastTripsLogger.info("Sharing the network supply with the worker processes")
+                todo_queue      = mp_context.Queue()
+                done_queue      = mp_context.Queue()
                 for process_idx in range(1, 1+num_processes):
                     FastTripsLogger.info("Starting worker process %2d" % process_idx)
                     process_dict[process_idx] = {
-                        "process":multiprocessing.Process(target=find_trip_based_paths_process_worker,
+                        "process":mp_context.Process(target=find_trip_based_paths_process_worker,
                             args=(iteration, pathfinding_iteration, process_idx, Assignment.INPUT_NETWORK_ARCHIVE, Assignment.INPUT_DEMAND_DIR,
                                   Assignment.CONFIGURATION_FILE, Assignment.CONFIGURATION_FUNCTIONS_FILE,
                                   Assignment.OUTPUT_DIR, todo_queue, done_queue,
                                   Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC,
-                                  Assignment.bump_wait_df, veh_trips_df)),
+                                  Assignment.bump_wait_df, veh_trips_df, share_supply)),
                         "alive":True,
                         "done":False
                     }
                     process_dict[process_idx]["process"].start()
+            elif coordinator:
+                (stoptime_index, stoptime_times)   = Assignment.extension_stop_time_arrays(veh_trips_df)
+                (bump_wait_index, bump_wait_times) = Assignment.extension_bump_wait_arrays(Assignment.bump_wait_df)
+                coordinator.publish_supply(stoptime_index, stoptime_times, bump_wait_index, bump_wait_times,
+                                           Assignment.fasttrips_parameters())
             else:
                 Assignment.initialize_fasttrips_extension(0, output_dir, veh_trips_df)
+                if num_threads > 0 and Assignment.STREAM_PATHSETS:
+                    Assignment.pathset_stream_file = os.path.join(output_dir, Assignment.PATHSET_STREAM_FILE % (iteration, pathfinding_iteration))
+                    _fasttrips.open_pathset_stream(Assignment.pathset_stream_file, Assignment.PATHSET_STREAM_BUFFERED_BATCHES)
+                if Assignment.RECORD_QUERIES:
+                    _fasttrips.open_query_record(os.path.join(output_dir, Assignment.QUERY_RECORD_FILE % (iteration, pathfinding_iteration)))
 
             # process tasks or send tasks to workers for processing
             num_paths_found_prev  = 0
             num_paths_found_now   = 0
             num_paths_sought      = 0
-            path_cols             = list(FT.passengers.pathfind_trip_list_df.columns.values)
-            for path_tuple in FT.passengers.pathfind_trip_list_df.itertuples(index=False):
+            pathfind_trip_list_df = FT.passengers.pathfind_trip_list_df
+            if (num_threads > 0 or coordinator) and Assignment.GROUP_LABELING:
+                # put the person trips that can be labeled together next to each other, so they're batched together
+                pathfind_trip_list_df = pathfind_trip_list_df.sort_values(
+                    by=[Passenger.TRIP_LIST_COLUMN_ORIGIN_TAZ_ID_NUM, Passenger.TRIP_LIST_COLUMN_DESTINATION_TAZ_ID_NUM,
+                        Passenger.TRIP_LIST_COLUMN_TIME_TARGET, Passenger.TRIP_LIST_COLUMN_ARRIVAL_TIME_MIN,
+                        Passenger.TRIP_LIST_COLUMN_DEPARTURE_TIME_MIN, Passenger.TRIP_LIST_COLUMN_USER_CLASS,
+                        Passenger.TRIP_LIST_COLUMN_PURPOSE, Passenger.TRIP_LIST_COLUMN_ACCESS_MODE,
+                        Passenger.TRIP_LIST_COLUMN_TRANSIT_MODE, Passenger.TRIP_LIST_COLUMN_EGRESS_MODE],
+                    kind="mergesort")
+            path_cols             = list(pathfind_trip_list_df.columns.values)
+            for path_tuple in pathfind_trip_list_df.itertuples(index=False):
                 path_dict         = dict(list(zip(path_cols, path_tuple)))
                 trip_list_id      = path_dict[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM]
                 person_id         = path_dict[Passenger.TRIP_LIST_COLUMN_PERSON_ID]
@@ -1150,6 +1466,28 @@ class Assignment(object):
 
                 if num_processes > 1:
                     todo_queue.put( trip_pathset )
+                elif coordinator:
+                    batch_pathsets.append( (trip_pathset, do_trace) )
+                    if len(batch_pathsets) >= Assignment.PATHFINDING_BATCH_SIZE:
+                        coordinator.submit(batch_pathsets, Assignment.batch_path_specs(iteration, pathfinding_iteration, batch_pathsets,
+                                                           Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC))
+                        batch_pathsets = []
+                elif num_threads > 0:
+                    batch_pathsets.append( (trip_pathset, do_trace) )
+                    if len(batch_pathsets) >= Assignment.PATHFINDING_BATCH_SIZE:
+                        (num_sought, num_found) = Assignment.find_trip_based_pathsets_batch(FT, iteration, pathfinding_iteration, batch_pathsets,
+                                                           Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC,
+                                                           num_threads)
+                        num_paths_sought    += num_sought
+                        num_paths_found_now += num_found
+                        batch_pathsets       = []
+
+                        time_elapsed = datetime.datetime.now() - start_time
+                        FastTripsLogger.info(" %6d paths sought, %6d paths found of %d paths total.  Time elapsed: %2dh:%2dm:%2ds" % (
+                                             num_paths_sought, num_paths_found_now, est_paths_to_find,
+                                             int( time_elapsed.total_seconds()/ 3600),
+                                             int( (time_elapsed.total_seconds() % 3600)/ 60),
+                                             time_elapsed.total_seconds() % 60))
                 else:
                     if do_trace:
                         FastTripsLogger.debug("Tracing assignment of person_id %s and trip %s" % (person_id, person_trip_id))
@@ -1175,6 +1513,39 @@ class Assignment(object):
                                              int( (time_elapsed.total_seconds() % 3600)/ 60),
                                              time_elapsed.total_seconds() % 60))
 
+            # pathfinding nodes follow-up: submit the remaining batch and collect them all
+            if coordinator:
+                if len(batch_pathsets) > 0:
+                    coordinator.submit(batch_pathsets, Assignment.batch_path_specs(iteration, pathfinding_iteration, batch_pathsets,
+                                                       Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC))
+                    batch_pathsets = []
+                for (done_pathsets, batch_results) in coordinator.results():
+                    (num_sought, num_found) = Assignment.apply_batch_results(FT, iteration, pathfinding_iteration, done_pathsets,
+                                                       Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC,
+                                                       batch_results)
+                    num_paths_sought    += num_sought
+                    num_paths_found_now += num_found
+
+                    time_elapsed = datetime.datetime.now() - start_time
+                    FastTripsLogger.info(" %6d paths sought, %6d paths found of %d paths total.  Time elapsed: %2dh:%2dm:%2ds" % (
+                                         num_paths_sought, num_paths_found_now, est_paths_to_find,
+                                         int( time_elapsed.total_seconds()/ 3600),
+                                         int( (time_elapsed.total_seconds() % 3600)/ 60),
+                                         time_elapsed.total_seconds() % 60))
+
+            # threads follow-up: do the remaining batch
+            if len(batch_pathsets) > 0:
+                (num_sought, num_found) = Assignment.find_trip_based_pathsets_batch(FT, iteration, pathfinding_iteration, batch_pathsets,
+                                                   Assignment.PATHFINDING_TYPE==Assignment.PATHFINDING_TYPE_STOCHASTIC,
+                                                   num_threads)
+                num_paths_sought    += num_sought
+                num_paths_found_now += num_found
+                batch_pathsets       = []
+            if num_threads > 0 and not coordinator and Assignment.STREAM_PATHSETS:
+                _fasttrips.close_pathset_stream()
+            if num_processes <= 1 and not coordinator and Assignment.RECORD_QUERIES:
+                _fasttrips.close_query_record()
+
             # multiprocessing follow-up
             if num_processes > 1:
                 # we're done, let each process know
@@ -1291,7 +1662,8 @@ class Assignment(object):
                  number of label iterations,
                  max number of times a stop was processed,
                  seconds spent in labeling,
-                 seconds spend in enumeration
+                 seconds spend in enumeration,
+                 the hot path counters in :py:attr:`Performance.PERFORMANCE_PF_COUNTER_COLUMNS`
 
         :param pathset:   the path to fill in
         :type  pathset:   a :py:class:`PathSet` instance
@@ -1307,7 +1679,7 @@ class Assignment(object):
         (ret_ints, ret_doubles, path_costs, process_num, pf_returnstatus,
          label_iterations, num_labeled_stops, max_label_process_count,
          ms_labeling, ms_enumerating,
-         bytes_workingset, bytes_privateusage, mem_timestamp) = \
+         bytes_workingset, bytes_privateusage, mem_timestamp, num_pruned_states, label_cache_hit, counters) = \
             _fasttrips.find_pathset(iteration, pathfinding_iteration, hyperpath, pathset.person_id, pathset.person_trip_id,
                                  pathset.user_class, pathset.purpose, pathset.access_mode, pathset.transit_mode, pathset.egress_mode,
                                  pathset.o_taz_num, pathset.d_taz_num,
@@ -1315,6 +1687,34 @@ class Assignment(object):
                                  1 if trace else 0)
         # FastTripsLogger.debug("C++ extension complete")
         FastTripsLogger.debug("Finished finding path for person %s trip %s" % (pathset.person_id, pathset.person_trip_id))
+        pathdict = Assignment.extension_results_to_pathdict(ret_ints, ret_doubles, path_costs, hyperpath)
+
+        perf_dict = { \
+            Performance.PERFORMANCE_PF_COL_PROCESS_NUM           : process_num,
+            Performance.PERFORMANCE_PF_COL_PATHFINDING_STATUS    : pf_returnstatus,
+            Performance.PERFORMANCE_PF_COL_LABEL_ITERATIONS      : label_iterations,
+            Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS     : num_labeled_stops,
+            Performance.PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT: max_label_process_count,
+            Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES     : num_pruned_states,
+            Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT       : label_cache_hit,
+            Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS      : ms_labeling,
+            Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS   : ms_enumerating,
+            Performance.PERFORMANCE_PF_COL_TRACED                : trace,
+            Performance.PERFORMANCE_PF_COL_WORKING_SET_BYTES     : bytes_workingset,
+            Performance.PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES   : bytes_privateusage,
+            Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP         : datetime.datetime.fromtimestamp(mem_timestamp),
+            Performance.PERFORMANCE_PF_COL_WORKER_THREAD         : 0
+        }
+        perf_dict.update(zip(Performance.PERFORMANCE_PF_COUNTER_COLUMNS, counters))
+        return (pathdict, perf_dict)
+
+    @staticmethod
+    def extension_results_to_pathdict(ret_ints, ret_doubles, path_costs, hyperpath):
+        """
+        Converts the path set arrays returned by the C++ extension for a single person trip into a pathdict.
+
+        Returns pathdict, which maps {pathnum:{PATH_KEY_COST:cost, PATH_KEY_PROBABILITY:probability, PATH_KEY_STATES:[state list]}}
+        """
         pathdict = {}
         row_num  = 0
 
@@ -1379,22 +1779,208 @@ class Assignment(object):
                         Assignment.NETWORK_BUILD_DATE_START_TIME + datetime.timedelta(minutes=ret_doubles[row_num,7])   # arrival/departure time
                     ] ) )
                 row_num += 1
+        return pathdict
 
-        perf_dict = { \
-            Performance.PERFORMANCE_PF_COL_PROCESS_NUM           : process_num,
-            Performance.PERFORMANCE_PF_COL_PATHFINDING_STATUS    : pf_returnstatus,
-            Performance.PERFORMANCE_PF_COL_LABEL_ITERATIONS      : label_iterations,
-            Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS     : num_labeled_stops,
-            Performance.PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT: max_label_process_count,
-            Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS      : ms_labeling,
-            Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS   : ms_enumerating,
-            Performance.PERFORMANCE_PF_COL_TRACED                : trace,
-            Performance.PERFORMANCE_PF_COL_WORKING_SET_BYTES     : bytes_workingset,
-            Performance.PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES   : bytes_privateusage,
-            Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP         : datetime.datetime.fromtimestamp(mem_timestamp)
-        }
-        return (pathdict, perf_dict)
+    @staticmethod
+    def find_trip_based_pathsets_batch(FT, iteration, pathfinding_iteration, batch_pathsets, hyperpath, num_threads):
+        """
+        Perform trip-based path set search for a batch of person trips using threads in the C++ extension.
+        See :py:meth:`Assignment.find_trip_based_pathset`.
+
+        The resulting pathdicts are set on the pathsets (or just their number of paths, if they're going to
+        :py:attr:`Assignment.pathset_stream_file`) and the performance information is added to
+        :py:attr:`FastTrips.performance`.
 
+        Returns (number of paths sought, number of paths found)
+
+        :param batch_pathsets: the paths to fill in
+        :type  batch_pathsets: list of (:py:class:`PathSet` instance, trace bool)
+        :param num_threads:    number of threads to use
+        :type  num_threads:    int
+        """
+        batch_specs   = Assignment.batch_path_specs(iteration, pathfinding_iteration, batch_pathsets, hyperpath)
+        batch_results = _fasttrips.find_pathsets_batch(num_threads, *batch_specs)
+        return Assignment.apply_batch_results(FT, iteration, pathfinding_iteration, batch_pathsets, hyperpath, batch_results,
+                                              streamed=(Assignment.pathset_stream_file != None))
+
+    @staticmethod
+    def batch_path_specs(iteration, pathfinding_iteration, batch_pathsets, hyperpath):
+        """
+        Returns the arguments after the number of threads for ``_fasttrips.find_pathsets_batch`` for the given batch:
+        (spec ints, spec doubles, spec strings, group labeling time bucket, predicted costs or None).
+        These are plain numpy arrays and tuples, so they can be sent to a pathfinding node as is.
+
+        :param batch_pathsets: the paths to find
+        :type  batch_pathsets: list of (:py:class:`PathSet` instance, trace bool)
+        """
+        spec_ints    = np.zeros((len(batch_pathsets), 7), dtype=np.int32)
+        spec_doubles = np.zeros((len(batch_pathsets), 2), dtype=np.float64)
+        spec_strs    = []
+        for (idx, (pathset, trace)) in enumerate(batch_pathsets):
+            spec_ints[idx,:]    = [iteration, pathfinding_iteration, 1 if hyperpath else 0,
+                                   pathset.o_taz_num, pathset.d_taz_num, 1 if pathset.outbound else 0, 1 if trace else 0]
+            spec_doubles[idx,:] = [float(pathset.pref_time_min), pathset.vot]
+            spec_strs.append( (pathset.person_id, pathset.person_trip_id, pathset.user_class, pathset.purpose,
+                               pathset.access_mode, pathset.transit_mode, pathset.egress_mode) )
+
+        # predict from the last pathfinding; the rest get the average
+        spec_costs   = None
+        if Assignment.SCHEDULE_BY_COST:
+            spec_costs = np.array([pathset.pathfinding_us for (pathset, trace) in batch_pathsets], dtype=np.float64)
+            if np.isnan(spec_costs).all():
+                spec_costs = None
+            else:
+                spec_costs[np.isnan(spec_costs)] = np.nanmean(spec_costs)
+
+        return (spec_ints, spec_doubles, spec_strs,
+                Assignment.GROUP_LABELING_TIME_BUCKET if Assignment.GROUP_LABELING else -1,
+                spec_costs)
+
+    @staticmethod
+    def apply_batch_results(FT, iteration, pathfinding_iteration, batch_pathsets, hyperpath, batch_results, streamed=False):
+        """
+        Sets the pathdicts on the pathsets from what ``_fasttrips.find_pathsets_batch`` returned for them,
+        here or on a pathfinding node, and adds the performance information to :py:attr:`FastTrips.performance`.
+        If the extension streamed them, only the number of paths is set; the paths are read back by
+        :py:meth:`Passenger.setup_passenger_pathsets`.
+
+        Returns (number of paths sought, number of paths found)
+
+        :param batch_pathsets: the paths to fill in, in the order they were passed to :py:meth:`Assignment.batch_path_specs`
+        :type  batch_pathsets: list of (:py:class:`PathSet` instance, trace bool)
+        :param batch_results:  (ret_ints, ret_doubles, path_costs, ret_perf, process number, ret_workers)
+        :type  batch_results:  tuple
+        :param streamed:       were these written to :py:attr:`Assignment.pathset_stream_file`?
+        :type  streamed:       bool
+        """
+        (ret_ints, ret_doubles, path_costs, ret_perf, process_num, ret_workers) = batch_results
+        (utilization, tail_ms) = FT.performance.add_worker_info(iteration, pathfinding_iteration, ret_workers)
+        FastTripsLogger.debug("Finished finding paths for batch of %d person trips; %.1f%% thread utilization, %.1f ms tail" % \
+                              (len(batch_pathsets), 100.0*utilization, tail_ms))
+
+        num_found = 0
+        path_row  = 0
+        link_row  = 0
+        for (idx, (pathset, trace)) in enumerate(batch_pathsets):
+            num_paths = ret_perf[idx, 9]
+            num_links = ret_perf[idx,10]
+            if streamed:
+                pathset.pathdict           = {}
+                pathset.num_streamed_paths = int(num_paths)
+            else:
+                pathset.pathdict           = Assignment.extension_results_to_pathdict(ret_ints   [link_row:link_row+num_links,:],
+                                                                                      ret_doubles[link_row:link_row+num_links,:],
+                                                                                      path_costs [path_row:path_row+num_paths,:], hyperpath)
+                pathset.num_streamed_paths = 0
+            path_row += num_paths
+            link_row += num_links
+
+            perf_dict = { \
+                Performance.PERFORMANCE_PF_COL_PROCESS_NUM           : process_num,
+                Performance.PERFORMANCE_PF_COL_PATHFINDING_STATUS    : ret_perf[idx,0],
+                Performance.PERFORMANCE_PF_COL_LABEL_ITERATIONS      : ret_perf[idx,1],
+                Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS     : ret_perf[idx,2],
+                Performance.PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT: ret_perf[idx,3],
+                Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES     : ret_perf[idx,11],
+                Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT       : ret_perf[idx,12],
+                Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS      : ret_perf[idx,4],
+                Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS   : ret_perf[idx,5],
+                Performance.PERFORMANCE_PF_COL_TRACED                : trace,
+                Performance.PERFORMANCE_PF_COL_WORKING_SET_BYTES     : ret_perf[idx,6],
+                Performance.PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES   : ret_perf[idx,7],
+                Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP         : datetime.datetime.fromtimestamp(ret_perf[idx,8]),
+                Performance.PERFORMANCE_PF_COL_WORKER_THREAD         : ret_perf[idx,13]
+            }
+            perf_dict.update(zip(Performance.PERFORMANCE_PF_COUNTER_COLUMNS, ret_perf[idx,14:]))
+            # for Assignment.SCHEDULE_BY_COST next time; the microsecond counters are last
+            pathset.pathfinding_us = float(ret_perf[idx,-4:].sum())
+            FT.performance.add_info(iteration, pathfinding_iteration, pathset.person_id, pathset.person_trip_id, perf_dict)
+
+            if pathset.path_found():
+                num_found += 1
+
+        return (len(batch_pathsets), num_found)
+
+
+    @staticmethod
+    def read_pathset_stream(filename):
+        """
+        Reads a pathset stream written by the C++ extension when :py:attr:`Assignment.STREAM_PATHSETS` is set.
+        See ``src/pathset_writer.h`` for the layout.
+
+        Yields a dictionary for each batch, with keys
+
+        - ``iteration``, ``pathfinding_iteration``: ints
+        - ``person_id``, ``person_trip_id``: lists, one per person trip
+        - ``pathfinding_status``, ``num_paths``, ``num_links``: arrays, one per person trip
+        - ``path_costs``, ``ret_ints``, ``ret_doubles``: the arrays :py:meth:`Assignment.find_trip_based_pathsets_batch`
+          gets from the extension; rows for each person trip are consecutive, in order
+
+        :py:meth:`Assignment.read_streamed_pathdicts` turns these back into pathdicts.
+
+        The arrays are views on a memory map of the file, so only the columns that are used get read from disk.
+        """
+        stream = np.memmap(filename, dtype=np.uint8, mode="r")
+
+        def padded(num_bytes):
+            return (num_bytes + 7)//8*8
+
+        def column(dtype, count, offset):
+            if count == 0: return np.zeros(0, dtype=dtype)
+            return np.frombuffer(stream, dtype=dtype, count=count, offset=offset)
+
+        if stream[:8].tobytes() != b"FTPSTRM\0":
+            raise ValueError("%s is not a pathset stream" % filename)
+        (version, byte_order) = column(np.int32, 2, 8)
+        if version != 1 or byte_order != 0x01020304:
+            raise ValueError("%s is pathset stream version %d with byte order 0x%08x; expected version 1, native" % (filename, version, byte_order))
+
+        pos = 16
+        while pos < len(stream):
+            if stream[pos:pos+4].tobytes() != b"CHNK":
+                raise ValueError("%s: bad pathset stream chunk at byte %d" % (filename, pos))
+            (num_specs, num_paths, num_links, iteration, pathfinding_iteration) = [int(x) for x in column(np.int32, 5, pos+4)]
+            chunk_end = pos + 32 + int(column(np.int64, 1, pos+24)[0])
+            pos      += 32
+
+            chunk = { "iteration":iteration, "pathfinding_iteration":pathfinding_iteration }
+            for key in ["person_id", "person_trip_id"]:
+                header = column(np.int32, num_specs+2, pos)
+                pos   += padded(4*(num_specs+2))
+                raw    = stream[pos:pos+header[0]].tobytes()
+                pos   += padded(int(header[0]))
+                chunk[key] = [raw[header[idx+1]:header[idx+2]].decode("utf-8") for idx in range(num_specs)]
+            for key in ["pathfinding_status", "num_paths", "num_links"]:
+                chunk[key] = column(np.int32, num_specs, pos)
+                pos       += padded(4*num_specs)
+            for (key, dtype, num_rows, num_cols) in [("path_costs",  np.float64, num_paths, 5),
+                                                     ("ret_ints",    np.int32,   num_links, 7),
+                                                     ("ret_doubles", np.float64, num_links, 8)]:
+                chunk[key] = column(dtype, num_rows*num_cols, pos).reshape((num_rows, num_cols), order="F")
+                pos       += padded(np.dtype(dtype).itemsize*num_rows*num_cols)
+            if pos != chunk_end:
+                raise ValueError("%s: pathset stream chunk ends at byte %d; expected %d" % (filename, pos, chunk_end))
+            yield chunk
+
+    @staticmethod
+    def read_streamed_pathdicts(filename, hyperpath):
+        """
+        Reads a pathset stream written by the C++ extension when :py:attr:`Assignment.STREAM_PATHSETS` is set
+        and yields (person_id, person_trip_id, pathdict) for each person trip in it, in the order they were found.
+        Only one batch is paged in and one pathdict built at a time.  See :py:meth:`Assignment.extension_results_to_pathdict`.
+        """
+        for chunk in Assignment.read_pathset_stream(filename):
+            path_row = 0
+            link_row = 0
+            for idx in range(len(chunk["person_id"])):
+                num_paths = chunk["num_paths"][idx]
+                num_links = chunk["num_links"][idx]
+                pathdict  = Assignment.extension_results_to_pathdict(chunk["ret_ints"   ][link_row:link_row+num_links,:],
+                                                                     chunk["ret_doubles"][link_row:link_row+num_links,:],
+                                                                     chunk["path_costs" ][path_row:path_row+num_paths,:], hyperpath)
+                path_row += num_paths
+                link_row += num_links
+                yield (chunk["person_id"][idx], chunk["person_trip_id"][idx], pathdict)
 
     @staticmethod
     def find_passenger_vehicle_times(pathset_links_df, veh_trips_df):
@@ -2198,10 +2784,13 @@ class Assignment(object):
 
 
 def find_trip_based_paths_process_worker(iteration, pathfinding_iteration, worker_num, input_network_dir, input_demand_dir, run_config, func_file,
-                                         output_dir, todo_pathset_queue, done_queue, hyperpath, bump_wait_df, stop_times_df):
+                                         output_dir, todo_pathset_queue, done_queue, hyperpath, bump_wait_df, stop_times_df,
+                                         shared_supply=False):
     """
     Process worker function.  Processes all the paths in queue.
 
+    If shared_supply, this process was forked from one whose C++ extension has the network supply and stop_times_df.
+
     todo_queue has (passenger_id, path object)
     """
     worker_str = "_worker%02d" % worker_num
@@ -2220,7 +2809,7 @@ def find_trip_based_paths_process_worker(iteration, pathfinding_iteration, worke
     Assignment.read_configuration(run_config)
 
     # this passes those read parameters and the stop times to the C++ extension
-    Assignment.initialize_fasttrips_extension(worker_num, output_dir, stop_times_df)
+    Assignment.initialize_fasttrips_extension(worker_num, output_dir, stop_times_df, shared_supply)
 
     # the extension has it now, so we're done
     stop_times_df = None
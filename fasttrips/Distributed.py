@@ -0,0 +1,303 @@
+from __future__ import print_function
+from __future__ import division
+from future import standard_library
+standard_library.install_aliases()
+from builtins import object
+
+__copyright__ = "Copyright 2017 Contributing Entities"
+__license__   = """
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+"""
+import argparse
+import multiprocessing.managers
+import os
+import queue
+import socket
+import sys
+import threading
+import time
+
+import numpy as np
+
+from .Logger import FastTripsLogger, setupLogging
+
+#: Seconds a pathfinding node keeps trying to connect, so nodes can be started before the run
+NODE_CONNECT_TIMEOUT_SEC = 120
+
+class _NodeManager(multiprocessing.managers.BaseManager):
+    """
+    The pathfinding node's side of the connection to a :py:class:`PathfindingCoordinator`.
+    """
+    pass
+
+_NodeManager.register("get_todo_queue")
+_NodeManager.register("get_done_queue")
+_NodeManager.register("get_coordinator")
+
+
+class _CoordinatorState(object):
+    """
+    What the pathfinding nodes can ask a :py:class:`PathfindingCoordinator` for, through a manager proxy.
+    The manager serves each node connection on its own thread, so this locks.
+    """
+    def __init__(self, output_dir, network_snapshot):
+        self.output_dir = output_dir
+        self.snapshot   = network_snapshot
+        self.lock       = threading.Lock()
+        #: node number => host name
+        self.nodes      = {}
+        #: the supply updates, in order; see :py:meth:`PathfindingCoordinator.publish_supply`
+        self.updates    = []
+
+    def register_node(self, host):
+        """
+        Returns (node number, output directory, network snapshot flag) for a node joining.  Nodes are numbered from 1.
+        """
+        with self.lock:
+            node_num = len(self.nodes) + 1
+            self.nodes[node_num] = host
+        FastTripsLogger.info("Pathfinding node %d joined from %s" % (node_num, host))
+        return (node_num, self.output_dir, self.snapshot)
+
+    def updates_since(self, num_applied):
+        """
+        Returns the supply updates after the first num_applied, for a node to apply in order.
+        """
+        with self.lock:
+            return self.updates[num_applied:]
+
+
+class PathfindingCoordinator(object):
+    """
+    Hands batches of person trips to pathfinding nodes on other hosts and collects their results,
+    for :py:attr:`Assignment.DISTRIBUTED_ADDRESS`.
+
+    The coordinator serves a work queue, a results queue and the supply updates over TCP with
+    :py:class:`multiprocessing.managers.BaseManager`, from a thread in the assignment process.
+    Each node (see :py:func:`run_pathfinding_node`) pulls batches from the work queue, so nodes can join at any time
+    and faster nodes take more batches.  Before a batch labels, the node applies the supply updates published since
+    it last looked: the full stop times once, then only the stop times and bump waits that changed.
+    The rest of the supply comes from the intermediate files (or snapshot) in the output directory,
+    so that has to be on a file system the nodes share.
+
+    The batches and results are the arrays :py:meth:`Assignment.batch_path_specs` makes and
+    ``_fasttrips.find_pathsets_batch`` returns, pickled and authenticated with the authkey.  Only run nodes you trust,
+    since that's all the manager checks.
+    """
+
+    def __init__(self, address, authkey, output_dir, network_snapshot):
+        """
+        Starts serving at address, a (host, port) tuple.  The nodes read the supply from output_dir,
+        from the network snapshot if network_snapshot (see :py:attr:`Assignment.NETWORK_SNAPSHOT`).
+        """
+        self.todo_queue   = queue.Queue()
+        self.done_queue   = queue.Queue()
+        self.state        = _CoordinatorState(output_dir, network_snapshot)
+
+        #: what the nodes have been told, to send them only what changed
+        self.sent_stoptime_index = None
+        self.sent_stoptime_times = None
+        self.sent_bump_wait      = {}
+        self.sent_parameters     = None
+
+        #: batch number => the batch_pathsets waiting for results
+        self.outstanding  = {}
+        self.num_batches  = 0
+
+        class CoordinatorManager(multiprocessing.managers.BaseManager):
+            pass
+        CoordinatorManager.register("get_todo_queue",  callable=lambda: self.todo_queue)
+        CoordinatorManager.register("get_done_queue",  callable=lambda: self.done_queue)
+        CoordinatorManager.register("get_coordinator", callable=lambda: self.state)
+
+        self.manager = CoordinatorManager(address=address, authkey=authkey)
+        self.server  = self.manager.get_server()
+        self.thread  = threading.Thread(target=self.server.serve_forever, name="PathfindingCoordinator")
+        self.thread.daemon = True
+        self.thread.start()
+        FastTripsLogger.info("Pathfinding coordinator listening on %s:%d" % self.server.address)
+
+    def num_nodes(self):
+        """
+        Returns the number of nodes that have joined.
+        """
+        with self.state.lock:
+            return len(self.state.nodes)
+
+    def publish_supply(self, stoptime_index, stoptime_times, bump_wait_index, bump_wait_times, parameters):
+        """
+        Publishes the supply for the next pathfinding iteration to the nodes, as the changes since the last one.
+        The arguments are what ``_fasttrips.initialize_supply``, ``_fasttrips.set_bump_wait`` and
+        ``_fasttrips.initialize_parameters`` take.
+        """
+        update = {}
+        if type(self.sent_stoptime_index) != type(None) and np.array_equal(stoptime_index, self.sent_stoptime_index):
+            changed = np.any(stoptime_times != self.sent_stoptime_times, axis=1)
+            update["stoptime_full"]  = False
+            update["stoptime_index"] = stoptime_index[changed]
+            update["stoptime_times"] = stoptime_times[changed]
+        else:
+            update["stoptime_full"]  = True
+            update["stoptime_index"] = stoptime_index
+            update["stoptime_times"] = stoptime_times
+            # the nodes start over with these, so send all the bump waits too
+            self.sent_bump_wait      = {}
+        self.sent_stoptime_index = stoptime_index
+        self.sent_stoptime_times = stoptime_times
+
+        # bump waits only change as whole entries; a negative time removes one
+        bump_wait = dict(zip([tuple(row) for row in bump_wait_index], bump_wait_times))
+        changed   = [(key, time) for (key, time) in bump_wait.items() if self.sent_bump_wait.get(key) != time]
+        changed  += [(key, -1.0) for key in self.sent_bump_wait if key not in bump_wait]
+        update["bump_wait_index"] = np.array([key for (key, time) in changed], dtype=np.int32).reshape((len(changed), 3))
+        update["bump_wait_times"] = np.array([time for (key, time) in changed], dtype=np.float64)
+        self.sent_bump_wait       = bump_wait
+
+        update["parameters"] = None if parameters == self.sent_parameters else parameters
+        self.sent_parameters = parameters
+
+        with self.state.lock:
+            self.state.updates.append(update)
+            num_updates = len(self.state.updates)
+        FastTripsLogger.debug("publish_supply() update %d: %s %d stop times, %d bump waits" % \
+                              (num_updates, "all" if update["stoptime_full"] else "changed", len(update["stoptime_index"]), len(changed)))
+
+    def submit(self, batch_pathsets, batch_specs):
+        """
+        Queues a batch for the nodes.
+
+        :param batch_pathsets: the paths to fill in, kept here until the results come back
+        :type  batch_pathsets: list of (:py:class:`PathSet` instance, trace bool)
+        :param batch_specs:    the batch from :py:meth:`Assignment.batch_path_specs`
+        :type  batch_specs:    tuple
+        """
+        self.num_batches += 1
+        with self.state.lock:
+            num_updates = len(self.state.updates)
+        self.outstanding[self.num_batches] = batch_pathsets
+        self.todo_queue.put( (self.num_batches, num_updates, batch_specs) )
+
+    def results(self, timeout_sec=60):
+        """
+        Yields (batch_pathsets, batch results) for each submitted batch as its results come back, until none are left.
+        Logs what's outstanding every timeout_sec while waiting, and raises if a node reports an exception.
+        """
+        while len(self.outstanding) > 0:
+            try:
+                result = self.done_queue.get(True, timeout_sec)
+            except queue.Empty:
+                FastTripsLogger.info("Waiting on %d batches from %d pathfinding nodes" % (len(self.outstanding), self.num_nodes()))
+                continue
+
+            if result[0] == "EXCEPTION":
+                raise Exception("Pathfinding node %d failed: %s" % (result[1], result[2]))
+            (batch_num, node_num, batch_results) = result
+            yield (self.outstanding.pop(batch_num), batch_results)
+
+    def shutdown(self):
+        """
+        Tells the nodes there's no more work and stops taking new connections.
+        The nodes still connected get their 'DONE' on the connections they have.
+        """
+        for node_num in range(self.num_nodes()):
+            self.todo_queue.put('DONE')
+        self.server.stop_event.set()
+        self.server.listener.close()
+
+
+def run_pathfinding_node(address, authkey, num_threads):
+    """
+    Runs a pathfinding node for the :py:class:`PathfindingCoordinator` at address, a (host, port) tuple,
+    labeling each batch with num_threads threads (less than 1 means the hardware concurrency).
+    Returns when the coordinator says there's no more work.
+    """
+    import _fasttrips
+
+    manager = _NodeManager(address=address, authkey=authkey)
+    for attempt in range(NODE_CONNECT_TIMEOUT_SEC):
+        try:
+            manager.connect()
+            break
+        except socket.error:
+            if attempt == NODE_CONNECT_TIMEOUT_SEC-1: raise
+            time.sleep(1)
+    coordinator = manager.get_coordinator()
+    todo_queue  = manager.get_todo_queue()
+    done_queue  = manager.get_done_queue()
+
+    (node_num, output_dir, network_snapshot) = coordinator.register_node(socket.gethostname())
+    node_str = "_node%02d" % node_num
+
+    from .FastTrips import FastTrips
+    setupLogging(infoLogFilename  = None,
+                 debugLogFilename = os.path.join(output_dir, FastTrips.DEBUG_LOG % node_str),
+                 logToConsole     = True)
+    FastTripsLogger.info("Pathfinding node %d connected to %s:%d" % (node_num, address[0], address[1]))
+
+    num_applied = 0
+    while True:
+        todo = todo_queue.get()
+        if todo == 'DONE':
+            FastTripsLogger.info("Pathfinding node %d done" % node_num)
+            return
+
+        (batch_num, num_updates, batch_specs) = todo
+        try:
+            # catch up on the supply this batch was submitted against
+            if num_applied < num_updates:
+                for update in coordinator.updates_since(num_applied)[:num_updates-num_applied]:
+                    if update["stoptime_full"]:
+                        _fasttrips.initialize_supply(output_dir, node_num, update["stoptime_index"], update["stoptime_times"],
+                                                     1 if network_snapshot else 0)
+                    else:
+                        _fasttrips.update_stop_times(update["stoptime_index"], update["stoptime_times"])
+                    if update["parameters"] != None:
+                        _fasttrips.initialize_parameters(*update["parameters"])
+                    if len(update["bump_wait_index"]) > 0:
+                        _fasttrips.update_bump_wait(update["bump_wait_index"], update["bump_wait_times"])
+                    FastTripsLogger.debug("Applied supply update %d: %d stop times, %d bump waits" % \
+                                          (num_applied+1, len(update["stoptime_index"]), len(update["bump_wait_index"])))
+                    num_applied += 1
+
+            FastTripsLogger.debug("Finding paths for batch %d of %d person trips" % (batch_num, len(batch_specs[2])))
+            batch_results = _fasttrips.find_pathsets_batch(num_threads, *batch_specs)
+            done_queue.put( (batch_num, node_num, batch_results) )
+        except:
+            FastTripsLogger.exception("Exception")
+            done_queue.put( ("EXCEPTION", node_num, str(sys.exc_info())) )
+            return
+
+
+USAGE = r"""
+
+  python -m fasttrips.Distributed [--num_threads N] host:port authkey
+
+  Runs a pathfinding node for the fast-trips run coordinating at host:port; see Assignment.DISTRIBUTED_ADDRESS.
+
+"""
+
+def main():
+    """
+    Does arg parsing for the pathfinding node command line interface.
+    """
+    parser = argparse.ArgumentParser(usage=USAGE)
+    parser.add_argument('--num_threads', type=int, default=0, help="Threads to label with.  Less than 1 means the hardware concurrency.")
+    parser.add_argument("address",       type=str, help="host:port of the coordinator")
+    parser.add_argument("authkey",       type=str, help="The coordinator's authkey")
+    args = parser.parse_args(sys.argv[1:])
+
+    (host, port) = args.address.rsplit(":", 1)
+    run_pathfinding_node((host, int(port)), args.authkey.encode(), args.num_threads)
+
+if __name__ == "__main__":
+    main()
@@ -545,11 +545,42 @@ class Passenger(object):
         return (pathset_paths_df, pathset_links_df)
 
 
+    def found_pathdicts(self, pathset_stream_file=None):
+        """
+        Yields (trip list ID num, :py:class:`PathSet`, pathdict) for each person trip in :py:attr:`Passenger.pathfind_trip_list_df`
+        for which paths were just found.  The pathdicts are :py:attr:`PathSet.pathdict` unless pathset_stream_file is given,
+        in which case they're read from it one at a time, in the order they were found.
+        """
+        from .Assignment import Assignment
+
+        if pathset_stream_file == None:
+            trip_list_id_nums = self.pathfind_trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].tolist()
+
+            for trip_list_id,pathset in self.id_to_pathset.items():
+                # only process if we just did pathfinding for this person trip
+                if trip_list_id not in trip_list_id_nums: continue
+
+                if not pathset.goes_somewhere():   continue
+                if not pathset.path_found():       continue
+
+                yield (trip_list_id, pathset, pathset.pathdict)
+            return
+
+        # the stream only has the person trips we just sought
+        trip_list_ids = dict(zip(zip(self.pathfind_trip_list_df[Passenger.TRIP_LIST_COLUMN_PERSON_ID     ].astype(str),
+                                     self.pathfind_trip_list_df[Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID].astype(str)),
+                                 self.pathfind_trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM]))
+        hyperpath = (Assignment.PATHFINDING_TYPE == Assignment.PATHFINDING_TYPE_STOCHASTIC)
+        for (person_id, person_trip_id, pathdict) in Assignment.read_streamed_pathdicts(pathset_stream_file, hyperpath):
+            if len(pathdict) == 0: continue
+            trip_list_id = trip_list_ids[(person_id, person_trip_id)]
+            yield (trip_list_id, self.id_to_pathset[trip_list_id], pathdict)
+
     def setup_passenger_pathsets(self, iteration, pathfinding_iteration, stops, trip_id_df, trips_df, modes_df,
-                                 transfers, tazs, prepend_route_id_to_trip_id):
+                                 transfers, tazs, prepend_route_id_to_trip_id, pathset_stream_file=None):
         """
-        Converts pathfinding results (which is stored in each Passenger :py:class:`PathSet`) into two
-        :py:class:`pandas.DataFrame` instances.
+        Converts pathfinding results (which is stored in each Passenger :py:class:`PathSet`, or in pathset_stream_file
+        if given; see :py:attr:`Assignment.STREAM_PATHSETS`) into two :py:class:`pandas.DataFrame` instances.
 
         Returns two :py:class:`pandas.DataFrame` instances: pathset_paths_df and pathset_links_df.
         These only include pathsets for person trips which have just been sought (e.g. those in
@@ -619,16 +650,9 @@ class Passenger(object):
         pathlist = []
         linklist = []
 
-        trip_list_id_nums = self.pathfind_trip_list_df[Passenger.TRIP_LIST_COLUMN_TRIP_LIST_ID_NUM].tolist()
-
-        for trip_list_id,pathset in self.id_to_pathset.items():
-            # only process if we just did pathfinding for this person trip
-            if trip_list_id not in trip_list_id_nums: continue
-
-            if not pathset.goes_somewhere():   continue
-            if not pathset.path_found():       continue
+        for (trip_list_id, pathset, pathdict) in self.found_pathdicts(pathset_stream_file):
 
-            for pathnum in range(pathset.num_paths()):
+            for pathnum in range(len(pathdict)):
                 # OUTBOUND passengers have states like this:
                 #    stop:          label    departure   dep_mode  successor linktime
                 # orig_taz                                 Access    b stop1
@@ -661,7 +685,7 @@ class Passenger(object):
                 prev_linkmode = None
                 prev_state_id = None
 
-                state_list = pathset.pathdict[pathnum][PathSet.PATH_KEY_STATES]
+                state_list = pathdict[pathnum][PathSet.PATH_KEY_STATES]
                 if not pathset.outbound: state_list = list(reversed(state_list))
 
                 pathlist.append([\
@@ -673,11 +697,11 @@ class Passenger(object):
                     pathset.mode,
                     0.01*pathfinding_iteration+iteration,
                     pathnum,
-                    pathset.pathdict[pathnum][PathSet.PATH_KEY_COST],
-                    pathset.pathdict[pathnum][PathSet.PATH_KEY_FARE],
-                    pathset.pathdict[pathnum][PathSet.PATH_KEY_PROBABILITY],
-                    pathset.pathdict[pathnum][PathSet.PATH_KEY_INIT_COST],
-                    pathset.pathdict[pathnum][PathSet.PATH_KEY_INIT_FARE]
+                    pathdict[pathnum][PathSet.PATH_KEY_COST],
+                    pathdict[pathnum][PathSet.PATH_KEY_FARE],
+                    pathdict[pathnum][PathSet.PATH_KEY_PROBABILITY],
+                    pathdict[pathnum][PathSet.PATH_KEY_INIT_COST],
+                    pathdict[pathnum][PathSet.PATH_KEY_INIT_FARE]
                 ])
 
                 link_num   = 0
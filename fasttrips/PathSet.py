@@ -210,6 +210,13 @@ class PathSet(object):
         #: Dict of path-num -> { cost:, probability:, states: [List of (stop_id, stop_state)]}
         self.pathdict = {}
 
+        #: Number of paths found when they're in the pathset stream instead of :py:attr:`PathSet.pathdict`;
+        #: see :py:attr:`Assignment.STREAM_PATHSETS`
+        self.num_streamed_paths = 0
+
+        #: Microseconds the last threaded pathfinding for this took, for :py:attr:`Assignment.SCHEDULE_BY_COST`
+        self.pathfinding_us = np.nan
+
     def goes_somewhere(self):
         """
         Does this path go somewhere?  Does the destination differ from the origin?
@@ -220,19 +227,20 @@ class PathSet(object):
         """
         Was a a transit path found from the origin to the destination with the constraints?
         """
-        return len(self.pathdict) > 0
+        return self.num_paths() > 0
 
     def num_paths(self):
         """
         Number of paths in the PathSet
         """
-        return len(self.pathdict)
+        return len(self.pathdict) + self.num_streamed_paths
 
     def reset(self):
         """
         Delete my states, something went wrong and it won't work out.
         """
-        self.pathdict = []
+        self.pathdict           = []
+        self.num_streamed_paths = 0
 
     @staticmethod
     def set_user_class(trip_list_df, new_colname):
@@ -48,6 +48,10 @@ class Performance(object):
     PERFORMANCE_PF_COL_NUM_LABELED_STOPS      = "num labeled stops"
     #: Performance column: Maximum number of times a stop was processed
     PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT = "max stop process count"
+    #: Performance column: Number of stop states pruned by :py:attr:`Assignment.PRUNE_WITH_LOWER_BOUNDS`
+    PERFORMANCE_PF_COL_NUM_PRUNED_STATES      = "num pruned states"
+    #: Performance column: 1 if the labels were reused via :py:attr:`Assignment.LABELING_CACHE`, else 0
+    PERFORMANCE_PF_COL_LABEL_CACHE_HIT        = "label cache hit"
     #: Performance column: Time spent labeling (timedelta)
     PERFORMANCE_PF_COL_TIME_LABELING          = "time labeling"
     #: Performance column: Time spent labeling (milliseconds)
@@ -64,9 +68,52 @@ class Performance(object):
     PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES    = "private usage bytes"
     #: Performance column: Timestamp of memory query, in a datetime.datetime
     PERFORMANCE_PF_COL_MEM_TIMESTAMP          = "mem_timestamp"
+    #: Performance column: Thread within the process that found the pathset, when using :py:attr:`Assignment.NUMBER_OF_THREADS`
+    PERFORMANCE_PF_COL_WORKER_THREAD          = "worker thread"
+
+    #: Performance columns: The hot path counters from the C++ extension, in the order of ``fasttrips::QueryCounter``
+    #: in ``src/query_counters.h``.  Merged pushes are for a stop already in the label stop queue; trips scanned
+    #: are the vehicle trips in the time window at a labeled stop, and trips used the ones that could be labeled from.
+    #: The microseconds split the query into initializing, labeling, enumerating (drawing and costing paths)
+    #: and finalizing (path probabilities).
+    PERFORMANCE_PF_COUNTER_COLUMNS            = ["queue pushes",
+                                                 "queue pops",
+                                                 "queue merged pushes",
+                                                 "links added",
+                                                 "links rejected",
+                                                 "links pruned",
+                                                 "trips scanned",
+                                                 "trips used",
+                                                 "link cost tallies",
+                                                 "fare lookups",
+                                                 "path draws",
+                                                 "unique paths",
+                                                 "time initializing microseconds",
+                                                 "time labeling microseconds",
+                                                 "time finalizing microseconds",
+                                                 "time enumerating microseconds"]
 
     #: File to write performance results
     OUTPUT_PERFORMANCE_PF_FILE                = 'ft_output_performance_pathfinding.csv'
+    #: File to write the pathfinding performance summed by iteration, pathfinding iteration, process and worker thread
+    OUTPUT_PERFORMANCE_PF_SUMMARY_FILE        = 'ft_output_performance_pathfinding_summary.csv'
+    #: Performance summary column: Number of person trips
+    PERFORMANCE_PF_COL_NUM_TRIPS              = "num person trips"
+
+    #: File to write how busy each worker thread was in each threaded pathfinding batch
+    OUTPUT_PERFORMANCE_PF_WORKERS_FILE        = 'ft_output_performance_pathfinding_workers.csv'
+    #: Worker performance column: Batch number within the pathfinding iteration. Integer.
+    PERFORMANCE_PF_COL_BATCH                  = "batch"
+    #: Worker performance column: Labeling tasks (person trips, or groups of them) the thread ran. Integer.
+    PERFORMANCE_PF_COL_NUM_TASKS              = "num tasks"
+    #: Worker performance column: Milliseconds the thread spent running tasks. Float.
+    PERFORMANCE_PF_COL_BUSY_MS                = "busy milliseconds"
+    #: Worker performance column: Milliseconds the batch took, start to slowest thread. Float.
+    PERFORMANCE_PF_COL_BATCH_MS               = "batch milliseconds"
+    #: Worker performance column: Milliseconds the thread sat idle at the end waiting for the rest. Float.
+    PERFORMANCE_PF_COL_TAIL_MS                = "tail milliseconds"
+    #: Worker performance column: Busy milliseconds over batch milliseconds. Float.
+    PERFORMANCE_PF_COL_UTILIZATION            = "utilization"
 
     #: For general performance (not pathfinding)
     #: Performance column: Step name (e.g. read inputs). String.
@@ -102,14 +149,34 @@ class Performance(object):
             Performance.PERFORMANCE_PF_COL_TRACED                   :[],
             Performance.PERFORMANCE_PF_COL_LABEL_ITERATIONS         :[],
             Performance.PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT   :[],
+            Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES        :[],
+            Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT          :[],
             Performance.PERFORMANCE_PF_COL_TIME_LABELING            :[],
             Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS         :[],
             Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING         :[],
             Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS      :[],
             Performance.PERFORMANCE_PF_COL_WORKING_SET_BYTES        :[],
             Performance.PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES      :[],
-            Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP            :[]
+            Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP            :[],
+            Performance.PERFORMANCE_PF_COL_WORKER_THREAD            :[]
+        }
+        for key in Performance.PERFORMANCE_PF_COUNTER_COLUMNS:
+            self.performance_pf_dict[key] = []
+
+        # one row per worker thread per threaded batch
+        self.performance_worker_dict = {
+            Performance.PERFORMANCE_PF_COL_ITERATION                :[],
+            Performance.PERFORMANCE_PF_COL_PATHFINDING_ITERATION    :[],
+            Performance.PERFORMANCE_PF_COL_BATCH                    :[],
+            Performance.PERFORMANCE_PF_COL_WORKER_THREAD            :[],
+            Performance.PERFORMANCE_PF_COL_NUM_TASKS                :[],
+            Performance.PERFORMANCE_PF_COL_BUSY_MS                  :[],
+            Performance.PERFORMANCE_PF_COL_BATCH_MS                 :[],
+            Performance.PERFORMANCE_PF_COL_TAIL_MS                  :[],
+            Performance.PERFORMANCE_PF_COL_UTILIZATION              :[]
         }
+        # (iteration, pathfinding_iteration) => number of batches so far
+        self.num_batches = {}
 
         # maps PERFORMANCE_COLUMN* to arrays of values
         self.step_record_dict = {
@@ -143,17 +210,49 @@ class Performance(object):
                     Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS,
                     Performance.PERFORMANCE_PF_COL_TRACED,
                     Performance.PERFORMANCE_PF_COL_MAX_STOP_PROCESS_COUNT,
+                    Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES,
+                    Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT,
                     Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS,
                     Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS,
                     Performance.PERFORMANCE_PF_COL_WORKING_SET_BYTES,
                     Performance.PERFORMANCE_PF_COL_PRIVATE_USAGE_BYTES,
-                    Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP]:
+                    Performance.PERFORMANCE_PF_COL_MEM_TIMESTAMP,
+                    Performance.PERFORMANCE_PF_COL_WORKER_THREAD] + Performance.PERFORMANCE_PF_COUNTER_COLUMNS:
             self.performance_pf_dict[key].append(perf_dict[key])
 
         # convert milliseconds time to timedeltas
         self.performance_pf_dict[Performance.PERFORMANCE_PF_COL_TIME_LABELING   ].append(datetime.timedelta(milliseconds=perf_dict[Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS   ]))
         self.performance_pf_dict[Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING].append(datetime.timedelta(milliseconds=perf_dict[Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS]))
 
+    def add_worker_info(self, iteration, pathfinding_iteration, worker_stats):
+        """
+        Add the worker thread stats for a threaded pathfinding batch, as returned by ``_fasttrips.find_pathsets_batch``:
+        one row per thread of (tasks run, microseconds busy, microseconds until it ran out of tasks).
+
+        Returns (utilization, tail milliseconds) for the batch: the busy fraction of all the threads over the batch time,
+        and how long the first thread to finish waited for the last.
+        """
+        batch_num = self.num_batches.get((iteration, pathfinding_iteration), 0) + 1
+        self.num_batches[(iteration, pathfinding_iteration)] = batch_num
+        if len(worker_stats) == 0:
+            return (0.0, 0.0)
+
+        batch_ms  = max(worker_stats[:,2].max()/1000.0, 0.001)
+        for thread_num in range(len(worker_stats)):
+            busy_ms = worker_stats[thread_num,1]/1000.0
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_ITERATION].append(iteration)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_PATHFINDING_ITERATION].append(pathfinding_iteration)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_BATCH].append(batch_num)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_WORKER_THREAD].append(thread_num)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_NUM_TASKS].append(worker_stats[thread_num,0])
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_BUSY_MS].append(busy_ms)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_BATCH_MS].append(batch_ms)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_TAIL_MS].append(batch_ms - worker_stats[thread_num,2]/1000.0)
+            self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_UTILIZATION].append(busy_ms/batch_ms)
+
+        return (worker_stats[:,1].sum()/1000.0/(batch_ms*len(worker_stats)),
+                batch_ms - worker_stats[:,2].min()/1000.0)
+
     def record_step_start(self, iteration, pathfinding_iteration, simulation_iteration, step_name):
         """
         Records the step start.
@@ -196,15 +295,39 @@ class Performance(object):
 
     def write_pathfinding(self, output_dir, append):
         """
-        Writes the pathfinding results to OUTPUT_PERFORMANCE_PF_FILE as a csv.
+        Writes the pathfinding results to OUTPUT_PERFORMANCE_PF_FILE as a csv, and their sums by
+        iteration, pathfinding iteration, process and worker thread to OUTPUT_PERFORMANCE_PF_SUMMARY_FILE.
+        The worker thread stats from :py:meth:`Performance.add_worker_info` go to OUTPUT_PERFORMANCE_PF_WORKERS_FILE.
         """
         performance_df = pd.DataFrame.from_dict(self.performance_pf_dict)
 
         Util.write_dataframe(performance_df, "performance_df", os.path.join(output_dir, Performance.OUTPUT_PERFORMANCE_PF_FILE), append=append)
 
-        # reset dict to blank
+        group_cols   = [Performance.PERFORMANCE_PF_COL_ITERATION,
+                        Performance.PERFORMANCE_PF_COL_PATHFINDING_ITERATION,
+                        Performance.PERFORMANCE_PF_COL_PROCESS_NUM,
+                        Performance.PERFORMANCE_PF_COL_WORKER_THREAD]
+        sum_cols     = [Performance.PERFORMANCE_PF_COL_LABEL_ITERATIONS,
+                        Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS,
+                        Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES,
+                        Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT,
+                        Performance.PERFORMANCE_PF_COL_TIME_LABELING_MS,
+                        Performance.PERFORMANCE_PF_COL_TIME_ENUMERATING_MS] + Performance.PERFORMANCE_PF_COUNTER_COLUMNS
+        summary_df   = performance_df.groupby(group_cols)[sum_cols].sum()
+        summary_df[Performance.PERFORMANCE_PF_COL_NUM_TRIPS] = performance_df.groupby(group_cols).size()
+        summary_df.reset_index(inplace=True)
+        Util.write_dataframe(summary_df, "summary_df", os.path.join(output_dir, Performance.OUTPUT_PERFORMANCE_PF_SUMMARY_FILE), append=append)
+
+        # threaded batches only
+        if len(self.performance_worker_dict[Performance.PERFORMANCE_PF_COL_BATCH]) > 0:
+            worker_df = pd.DataFrame.from_dict(self.performance_worker_dict)
+            Util.write_dataframe(worker_df, "worker_df", os.path.join(output_dir, Performance.OUTPUT_PERFORMANCE_PF_WORKERS_FILE), append=append)
+
+        # reset dicts to blank
         for key in list(self.performance_pf_dict.keys()):
             self.performance_pf_dict[key] = []
+        for key in list(self.performance_worker_dict.keys()):
+            self.performance_worker_dict[key] = []
 
     def write(self, output_dir):
         """
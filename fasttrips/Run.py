@@ -63,6 +63,11 @@ def run_setup(input_network_dir,
         pf_iters -- Integer. If specified, will set the maximum number of pathfinding iterations(default: 10)
         dispersion -- theta parameter; essentially the nesting parameter. Good value is between 0.5-1. (default: 1.0)
         max_stop_process_count = maximum number of times you will re-processe a node (default: 20)
+        prune_with_lower_bounds = Boolean. In labeling, prune stop states using lower bounds on the cost to the end TAZ (default: False)
+        labeling_cache = Boolean. Reuse labeling results for identical queries, including across iterations (default: False)
+        labeling_cache_mb = Most memory in megabytes the labeling cache may use before dropping the least recently used (default: 256)
+        connection_scan = Boolean. Label deterministic path finding by scanning trip hops in time order (default: False)
+        enumeration_threads = Number of threads drawing each stochastic pathset; 0 to draw them one by one (default: 0)
         capacity -- Boolean to activate capacity constraints (default: False)
 
         overlap_variable -- One of ['None','count','distance','time']. Variable to use for overlap penalty calculation (default: 'count')
@@ -72,6 +77,16 @@ def run_setup(input_network_dir,
         transfer_fare_ignore_pathfinding = Boolean. In path-finding, suppress trying to adjust fares using transfer rules.  For performance.
         transfer_fare_ignore_pathenum = Boolean. In path-enumeration, suppress trying to adjust fares using transfer rules.  For performance.
         number_of_processes = Integer. Number of processes to run at once (default: 1)
+        number_of_threads = Integer. Number of threads to use within the C++ extension instead of processes (default: 0)
+        network_snapshot = Boolean. Load the network supply in the extension from a binary snapshot in the output directory (default: False)
+        share_supply = Boolean. With number_of_processes, fork the workers from one copy of the network supply (default: False)
+        group_labeling = Boolean. With number_of_threads, label once for each group of trips that label identically (default: False)
+        group_labeling_time_bucket = Float. With group_labeling, minutes within which preferred times label together; 0 means equal (default: 0)
+        stream_pathsets = Boolean. With number_of_threads, stream the pathsets to disk instead of keeping them in memory (default: False)
+        record_queries = Boolean. Record each pathfinding iteration's queries to a corpus for src/bench/pathfinder_bench.cpp (default: False)
+        schedule_by_cost = Boolean. With number_of_threads, start each batch with the trips whose pathfinding took longest last time (default: False)
+        distributed_address = String. host:port to serve pathfinding to nodes started with python -m fasttrips.Distributed (default: None)
+        distributed_authkey = String. The secret key those nodes connect with; required with distributed_address
         output_pathset_per_sim_iter = Boolean. Output pathsets per simulation iteration?  (default: false)
 
         debug_output_columnns -- boolean to activate extra columns for debugging (default: False)
@@ -140,6 +155,36 @@ def run_setup(input_network_dir,
     if "number_of_processes" in kwargs:
         fasttrips.Assignment.NUMBER_OF_PROCESSES = kwargs["number_of_processes"]
 
+    if "number_of_threads" in kwargs:
+        fasttrips.Assignment.NUMBER_OF_THREADS = kwargs["number_of_threads"]
+
+    if "network_snapshot" in kwargs:
+        fasttrips.Assignment.NETWORK_SNAPSHOT = kwargs["network_snapshot"]
+
+    if "share_supply" in kwargs:
+        fasttrips.Assignment.SHARE_SUPPLY = kwargs["share_supply"]
+
+    if "group_labeling" in kwargs:
+        fasttrips.Assignment.GROUP_LABELING = kwargs["group_labeling"]
+
+    if "group_labeling_time_bucket" in kwargs:
+        fasttrips.Assignment.GROUP_LABELING_TIME_BUCKET = kwargs["group_labeling_time_bucket"]
+
+    if "stream_pathsets" in kwargs:
+        fasttrips.Assignment.STREAM_PATHSETS = kwargs["stream_pathsets"]
+
+    if "record_queries" in kwargs:
+        fasttrips.Assignment.RECORD_QUERIES = kwargs["record_queries"]
+
+    if "schedule_by_cost" in kwargs:
+        fasttrips.Assignment.SCHEDULE_BY_COST = kwargs["schedule_by_cost"]
+
+    if "distributed_address" in kwargs:
+        fasttrips.Assignment.DISTRIBUTED_ADDRESS = kwargs["distributed_address"]
+
+    if "distributed_authkey" in kwargs:
+        fasttrips.Assignment.DISTRIBUTED_AUTHKEY = kwargs["distributed_authkey"]
+
     if "trace_ids" in list(kwargs.keys()):
         fasttrips.Assignment.TRACE_IDS = kwargs["trace_ids"]
 
@@ -160,6 +205,21 @@ def run_setup(input_network_dir,
 
         fasttrips.Assignment.STOCH_MAX_STOP_PROCESS_COUNT = kwargs["max_stop_process_count"]
 
+    if "prune_with_lower_bounds" in list(kwargs.keys()):
+        fasttrips.Assignment.PRUNE_WITH_LOWER_BOUNDS = kwargs["prune_with_lower_bounds"]
+
+    if "labeling_cache" in list(kwargs.keys()):
+        fasttrips.Assignment.LABELING_CACHE = kwargs["labeling_cache"]
+
+    if "labeling_cache_mb" in list(kwargs.keys()):
+        fasttrips.Assignment.LABELING_CACHE_MB = kwargs["labeling_cache_mb"]
+
+    if "connection_scan" in list(kwargs.keys()):
+        fasttrips.Assignment.CONNECTION_SCAN = kwargs["connection_scan"]
+
+    if "enumeration_threads" in list(kwargs.keys()):
+        fasttrips.Assignment.ENUMERATION_THREADS = kwargs["enumeration_threads"]
+
     if "debug_output_columns" in list(kwargs.keys()):
         fasttrips.Assignment.DEBUG_OUTPUT_COLUMNS = kwargs["debug_output_columns"]
 
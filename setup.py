@@ -1,5 +1,5 @@
 import os,sys
-from setuptools import setup, Extension
+from setuptools import setup, Command, Extension
 import sysconfig
 import numpy
 
@@ -15,20 +15,80 @@ else:
 #compile_args = sysconfig.get_config_var('CFLAGS').split()
 compile_args=["-std=c++11"]#+compile_args
 
+link_args=[]
+
 if sys.platform == 'darwin':
     compile_args+=["-mmacosx-version-min=10.9"]
 
+# for std::thread
+if sys.platform != 'win32':
+    compile_args+=["-pthread"]
+    link_args   +=["-pthread"]
+
+# the path finder, without the python and numpy interface
+pathfinder_sources = ['src/hyperlink.cpp',
+                      'src/access_egress.cpp',
+                      'src/path.cpp',
+                      'src/pathfinder.cpp',
+                      'src/threadpool.cpp',
+                      'src/stop_times.cpp',
+                      'src/network.cpp',
+                      'src/labeling_cache.cpp',
+                      'src/query_corpus.cpp',
+                      'src/link_cost.cpp',
+                      'src/lower_bounds.cpp',
+                      'src/snapshot.cpp',
+                      'src/connection_scan.cpp',
+                      'src/transfer_table.cpp',
+                      'src/trace_sink.cpp',
+                      ]
+
 extension = Extension('_fasttrips',
                       sources=['src/fasttrips.cpp',
-                               'src/hyperlink.cpp',
-                               'src/access_egress.cpp',
-                               'src/path.cpp',
-                               'src/pathfinder.cpp',
-                               ],
+                               'src/path_results.cpp',
+                               'src/pathset_writer.cpp',
+                               ] + pathfinder_sources,
                       extra_compile_args = compile_args,
+                      extra_link_args    = link_args,
                       include_dirs=[numpy.get_include()],
                       )
 
+# executable name -> sources
+benchmarks = { 'pathfinder_bench'      : ['src/bench/pathfinder_bench.cpp'] + pathfinder_sources,
+               'label_stop_queue_bench': ['src/bench/label_stop_queue_bench.cpp'] }
+
+class build_bench(Command):
+    """
+    Builds the native benchmarks in src/bench, which replay recorded path finding outside of python.
+    Usage: python setup.py build_bench [--build-dir build/bench]
+    """
+    description  = "build the native benchmarks in src/bench"
+    user_options = [('build-dir=', 'b', "directory for the benchmark executables (default: build/bench)")]
+
+    def initialize_options(self):
+        self.build_dir = None
+
+    def finalize_options(self):
+        if self.build_dir is None:
+            self.build_dir = os.path.join('build', 'bench')
+
+    def run(self):
+        from distutils import ccompiler
+        from distutils.sysconfig import customize_compiler
+
+        compiler = ccompiler.new_compiler()
+        customize_compiler(compiler)
+        if sys.platform != 'win32':
+            # link with the c++ driver so the standard library comes along
+            compiler.set_executables(linker_exe=sysconfig.get_config_var('CXX') or 'c++')
+
+        # hyperlink.cpp includes Python.h, though it doesn't use python
+        include_dirs = ['src', sysconfig.get_paths()['include']]
+        for (name, sources) in sorted(benchmarks.items()):
+            objects = compiler.compile(sources, output_dir=os.path.join(self.build_dir, 'obj'), include_dirs=include_dirs,
+                                       extra_postargs=compile_args+(["-O2"] if sys.platform != 'win32' else ["/O2"]))
+            compiler.link_executable(objects, name, output_dir=self.build_dir, extra_postargs=link_args)
+
 setup(name          = 'fasttrips',
       version       = '1.0b2',
       author        = 'MTC, SFCTA & PSRC',
@@ -70,5 +130,6 @@ setup(name          = 'fasttrips',
       entry_points  = { 'console_scripts': ['run_fasttrips=fasttrips.Run:main']},
       scripts       = [ 'scripts/create_tableau_path_map.py',
                         'scripts/run_example.py'],
-      ext_modules   = [extension]
+      ext_modules   = [extension],
+      cmdclass      = { 'build_bench':build_bench }
       )
@@ -1,6 +1,14 @@
+#include <algorithm>
 #include <cassert>
 #include <exception>
+#include <fstream>
+#include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "network.h"
+#include "query_counters.h"
 
 // Uncomment for debug detail for LabelStopQueue
 // #define DEBUG_LSQ
@@ -58,58 +66,92 @@ namespace fasttrips {
      * This is to save work; if we mark a stop for processing by adding it onto the queue, and then do that again shortly
      * after, we don't actually want to process twice.  We only want to process it once, for the lowest label.
      *
+     * This is implemented as an indexed 4-ary heap: position_ maps each (stop ID, is trip bool), as stop_id*2+is_trip,
+     * to its index in heap_, so pushing a lower label for a stop that's already queued is a decrease-key
+     * rather than another entry.  The heap never contains stale entries.
+     *
      **/
     class LabelStopQueue
     {
 
     private:
-        // underlying priority queue, contains (label, stop id, is trip bool)
-        std::priority_queue<LabelStop, std::vector<LabelStop>, struct LabelStopCompare> labelstop_priority_queue_;
+        /// Number of children per heap node.  4 is shallower than binary and keeps the children in one cache line.
+        static const int ARITY = 4;
+
+        /// the heap, contains (label, stop id, is trip bool), lowest label first
+        std::vector<LabelStop> heap_;
 
-        typedef struct {
-            double label_;  ///< lowest label for this stop in the labelstop_priority_queue_ (e.g. the only valid one)
-            bool   valid_;  ///< is this stop valid in the queue?
-            int    count_;  ///< number of instances of this stop in the labelstop_priority_queue_ (valid and invalid)
-        } LabelCount;
+        /// stop_id*2+is_trip -> index in heap_, or -1 if it's not queued
+        std::vector<int> position_;
 
-        /** Keep track of the lowest label and the count for each (stop, is_trip bool) */
-        std::map< std::pair<int, bool>, LabelCount> labelstop_map_;
+        static int fullStopId(const LabelStop& ls) { return 2*ls.stop_id_ + (ls.is_trip_ ? 1 : 0); }
 
-        int valid_count_;
+        /// Should ls1 come out of the queue before ls2?
+        static bool before(const LabelStop& ls1, const LabelStop& ls2) { return LabelStopCompare()(ls2, ls1); }
+
+        /// Put ls at heap_[idx] and update its position
+        void place(const LabelStop& ls, size_t idx) {
+            heap_[idx] = ls;
+            position_[fullStopId(ls)] = (int)idx;
+        }
+
+        /// Move the element at idx up until its parent comes before it
+        void siftUp(size_t idx) {
+            LabelStop ls = heap_[idx];
+            while (idx > 0) {
+                size_t parent = (idx-1)/ARITY;
+                if (!before(ls, heap_[parent])) { break; }
+                place(heap_[parent], idx);
+                idx = parent;
+            }
+            place(ls, idx);
+        }
+
+        /// Move the element at idx down until it comes before its children
+        void siftDown(size_t idx) {
+            LabelStop ls = heap_[idx];
+            while (true) {
+                size_t first_child = ARITY*idx + 1;
+                if (first_child >= heap_.size()) { break; }
+                size_t last_child = std::min(first_child + ARITY, heap_.size());
+
+                size_t best_child = first_child;
+                for (size_t child = first_child+1; child < last_child; ++child) {
+                    if (before(heap_[child], heap_[best_child])) { best_child = child; }
+                }
+                if (!before(heap_[best_child], ls)) { break; }
+                place(heap_[best_child], idx);
+                idx = best_child;
+            }
+            place(ls, idx);
+        }
 
     public:
-        LabelStopQueue() : valid_count_(0) {}
+        LabelStopQueue() {}
         ~LabelStopQueue() {}
 
         void push(const LabelStop& val) {
-            // if the stop is not in here, no problem!
-            std::pair<int,bool> full_stop_id = std::make_pair(val.stop_id_, val.is_trip_);
-
-            if (labelstop_map_.find(full_stop_id) == labelstop_map_.end()) {
-                labelstop_priority_queue_.push(val);
-                LabelCount lc = { val.label_, true, 1 };
-                labelstop_map_[full_stop_id] = lc;
-                valid_count_++;
-                return;
+            countQuery(COUNT_QUEUE_PUSHES);
+            int full_stop_id = fullStopId(val);
+            if (full_stop_id >= (int)position_.size()) {
+                position_.resize(std::max(full_stop_id+1, 2*(int)position_.size()), -1);
             }
 
-            // if not valid in the queue, then we've popped out all valid instances from the priority queue so it's like it's not here
-            if (!labelstop_map_[full_stop_id].valid_) {
-                labelstop_priority_queue_.push(val);
-                labelstop_map_[full_stop_id].label_     = val.label_;
-                labelstop_map_[full_stop_id].valid_     = true;
-                labelstop_map_[full_stop_id].count_    += 1;
-                valid_count_++;
+            // if the stop is not in here, no problem!
+            int idx = position_[full_stop_id];
+            if (idx < 0) {
+                heap_.push_back(val);
+                position_[full_stop_id] = (int)heap_.size()-1;
+                siftUp(heap_.size()-1);
                 return;
             }
 
-            // The stop is in the queue, valid.  Look at the label.
-            // If the label is smaller, add this one and invalidate the other
-            if (val.label_ < labelstop_map_[full_stop_id].label_) {
-                labelstop_priority_queue_.push(val);
-                labelstop_map_[full_stop_id].label_ = val.label_;
-                labelstop_map_[full_stop_id].count_ += 1;
-                // no additional valid counts
+            // The stop is in the queue.  Look at the label.
+            countQuery(COUNT_QUEUE_MERGES);
+            // If the label is smaller, replace it
+            if (val.label_ < heap_[idx].label_) {
+                heap_[idx].label_ = val.label_;
+                siftUp(idx);
             }
             // otherwise the label is bigger -- don't add it since the smaller one will cause reprocessing
             else {
@@ -117,86 +159,42 @@ namespace fasttrips {
             }
         }
 
-        /** Pop the top *valid* LabelStop */
-        LabelStop pop_top(const std::map<int, Stop>& stop_num_to_stop, bool trace, std::ofstream& trace_file) {
-            // this will crash if labelstop_priority_queue_ is empty.  I'm terrible.
-
-            while (true) {
-                // get the lowest cost stop
-                const LabelStop& ls = labelstop_priority_queue_.top();
-                std::pair<int, bool> full_stop_id = std::make_pair(ls.stop_id_, ls.is_trip_);
-
-                std::map< std::pair<int, bool>, LabelCount>::iterator ls_iter = labelstop_map_.find(full_stop_id);
-
-                // assert we have the count info
-                if (ls_iter == labelstop_map_.end()) {
-                    std::cerr << "LabelStopQueueError FATAL ERROR 1" << std::endl;
-                    throw LabelStopQueueError("FATAL ERROR 1");
-                }
-
-                // assert that the count is positive
-                if (ls_iter->second.count_ <= 0) {
-                    std::cerr << "LabelStopQueueError FATAL ERROR 2" << std::endl;
-                    throw LabelStopQueueError("FATAL ERROR 2");
-                }
-
-                // if it's not valid then continue
-                if (!ls_iter->second.valid_) {
-                    D_LSQ(
-                        trace_file << "Skipping stop A (" << stop_num_to_stop.find(ls.stop_id_)->second.stop_str_ << "," << ls.is_trip_ << ")";
-                        trace_file << "; valid " << ls_iter->second.valid_;
-                        trace_file << "; count " << ls_iter->second.count_;
-                        trace_file << "; map label " << ls_iter->second.label_;
-                        trace_file << "; priq label " << ls.label_;
-                        trace_file << "; priq size " << labelstop_priority_queue_.size() << std::endl;
-                    );
-                    ls_iter->second.count_ -= 1;
-                    labelstop_priority_queue_.pop();
-                    continue;
-                }
-
-                // this stop id is in the queue as valid
-                // but only the matching label is valid
-                if (ls_iter->second.label_ != ls.label_) {
-                    D_LSQ(
-                        trace_file << "Skipping stop B (" << stop_num_to_stop.find(ls.stop_id_)->second.stop_str_ << "," << ls.is_trip_ << ")";
-                        trace_file << "; valid " << ls_iter->second.valid_;
-                        trace_file << "; count " << ls_iter->second.count_;
-                        trace_file << "; map label " << ls_iter->second.label_;
-                        trace_file << "; priq label " << ls.label_;
-                        trace_file << "; priq size " << labelstop_priority_queue_.size() << std::endl;
-                    );
-                    ls_iter->second.count_ -= 1;
-                    labelstop_priority_queue_.pop();
-                    continue;
-                }
-
-                D_LSQ(
-                    trace_file << "LabelStopQueue returning (" << stop_num_to_stop.find(ls.stop_id_)->second.stop_str_ << "," << ls.is_trip_ << ")";
-                    trace_file << "; valid " << ls_iter->second.valid_;
-                    trace_file << "; count " << ls_iter->second.count_;
-                    trace_file << "; map label " << ls_iter->second.label_;
-                    trace_file << "; priq label " << ls.label_;
-                    trace_file << "; priq size " << labelstop_priority_queue_.size();
-                    trace_file << "; valid count " << valid_count_ << std::endl;
-                );
-                // else the map label is equal to the priority queue one, it's the valid one -- return it
-                LabelStop to_ret = ls;
-                labelstop_priority_queue_.pop();
-                ls_iter->second.valid_  = false; // not valid any longer
-                ls_iter->second.count_ -= 1;     // decrement count
-                valid_count_ -= 1;
-                return to_ret;
+        /** Pop the top LabelStop */
+        LabelStop pop_top(const IdVector<Stop>& stop_num_to_stop, bool trace, std::ostream& trace_file) {
+            if (heap_.empty()) {
+                std::cerr << "LabelStopQueueError FATAL ERROR pop_top called on empty queue" << std::endl;
+                throw LabelStopQueueError("pop_top called on empty queue");
+            }
 
+            countQuery(COUNT_QUEUE_POPS);
+            LabelStop to_ret = heap_[0];
+            D_LSQ(
+                trace_file << "LabelStopQueue returning (" << stop_num_to_stop.find(to_ret.stop_id_)->stop_str_ << "," << to_ret.is_trip_ << ")";
+                trace_file << "; label " << to_ret.label_;
+                trace_file << "; heap size " << heap_.size() << std::endl;
+            );
+            position_[fullStopId(to_ret)] = -1;
+
+            LabelStop last = heap_.back();
+            heap_.pop_back();
+            if (!heap_.empty()) {
+                place(last, 0);
+                siftDown(0);
             }
+            return to_ret;
+        }
+
+        /** The LabelStop pop_top() would return.  The queue must not be empty. */
+        const LabelStop& top() const {
+            return heap_[0];
         }
 
         size_t size() const {
-            return valid_count_;
+            return heap_.size();
         }
 
         bool empty() const {
-            return (valid_count_ == 0);
+            return heap_.empty();
         }
     };
 
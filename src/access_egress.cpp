@@ -1,8 +1,9 @@
 #include "access_egress.h"
 #include "path.h"
+#include "snapshot.h"
 
+#include <algorithm>
 #include <fstream>
-#include <limits.h>
 #include <ios>
 #include <iomanip>
 #include <string>
@@ -14,12 +15,18 @@ namespace fasttrips {
         return os << aelk.taz_id_ << " " << aelk.supply_mode_num_ << " " << aelk.stop_id_ << " " << aelk.start_time_ << " " << aelk.end_time_;
     }
 
-    AccessEgressLinks::AccessEgressLinks() :
-        supply_mode_num_min_(INT_MAX),
-        supply_mode_num_max_(INT_MIN),
-        stop_id_min_(INT_MAX),
-        stop_id_max_(INT_MIN)
-    {}
+    static bool entryBeforeStop(const AccessEgressLinkEntry& entry, int stop_id) { return entry.first.stop_id_ < stop_id; }
+    static bool stopBeforeEntry(int stop_id, const AccessEgressLinkEntry& entry) { return stop_id < entry.first.stop_id_; }
+    static bool timeBeforeSlice(double time, const AccessEgressTimeSlice& slice) { return time < slice.start_time_; }
+
+    void AccessEgressLinks::clear()
+    {
+        links_.clear();
+        taz_offsets_.clear();
+        mode_links_.clear();
+        time_slices_.clear();
+        slice_links_.clear();
+    }
 
     void AccessEgressLinks::readLinks(std::ifstream& accegr_file, bool debug_out) {
         // reset
@@ -42,90 +49,203 @@ namespace fasttrips {
         }
         int attrs_read = 0;
         AccessEgressLinkKey aelk;
+        AccessEgressLinkAttr link_map;
         while (accegr_file >> aelk.taz_id_ >> aelk.supply_mode_num_ >> aelk.stop_id_ >> aelk.start_time_ >> aelk.end_time_ >> attr_name >> attr_value) {
-            map_[aelk][attr_name] = attr_value;
+            link_map[aelk].attributes_[attr_name] = attr_value;
             attrs_read++;
-
-            supply_mode_num_min_ = std::min(supply_mode_num_min_, aelk.supply_mode_num_);
-            supply_mode_num_max_ = std::max(supply_mode_num_max_, aelk.supply_mode_num_);
-            stop_id_min_         = std::min(stop_id_min_,         aelk.stop_id_        );
-            stop_id_max_         = std::max(stop_id_max_,         aelk.stop_id_        );
         }
+        // the map is sorted by key
+        links_.assign(link_map.begin(), link_map.end());
+        buildIndex();
+
         if (debug_out) {
-            std::cout << " => Read " << attrs_read << " attributes for " << map_.size() << " links" << std::endl;
-            // std::cout << " supply_mode_num_ in [" << supply_mode_num_min_ << ", " << supply_mode_num_max_ << "]" << std::endl;
-            // std::cout << " stop_id_         in [" << stop_id_min_         << ", " << stop_id_max_         << "]" << std::endl;
-
-            // for (AccessEgressLinkAttr::const_iterator it=map_.begin(); it != map_.end(); ++it) {
-            //     const AccessEgressLinkKey& aelk = it->first;
-            //     std::cout << aelk << " => " << it->second.size() << std::endl;
-            // }
+            std::cout << " => Read " << attrs_read << " attributes for " << links_.size() << " links";
+            std::cout << " in " << time_slices_.size() << " time slices" << std::endl;
         }
     }
 
-    bool AccessEgressLinks::hasLinksForTaz(int taz_id) const {
+    void AccessEgressLinks::writeSnapshot(SnapshotWriter& writer) const
+    {
+        writer.writeTag("ACEG");
+        writer.writeInt((int32_t)links_.size());
+        for (std::vector<AccessEgressLinkEntry>::const_iterator it = links_.begin(); it != links_.end(); ++it) {
+            writer.writeInt   (it->first.taz_id_         );
+            writer.writeInt   (it->first.supply_mode_num_);
+            writer.writeInt   (it->first.stop_id_        );
+            writer.writeDouble(it->first.start_time_     );
+            writer.writeDouble(it->first.end_time_       );
+            writer.writeAttributes(it->second.attributes_);
+        }
+    }
 
-        // Returns an iterator pointing to the first element in the container whose key is not considered to go before k (i.e., either it is equivalent or goes after).
-        AccessEgressLinkAttr::const_iterator iter_low = map_.lower_bound( AccessEgressLinkKey(taz_id, supply_mode_num_min_-1, 0, 0, 0) );
-        // no keys >= given key
-        if (iter_low == map_.end()) {
-            return false;
+    void AccessEgressLinks::readSnapshot(SnapshotReader& reader)
+    {
+        clear();
+        if (!reader.expectTag("ACEG")) { return; }
+        int num_links = reader.readInt();
+        if (num_links < 0) { reader.markBad(); }
+        if (!reader.ok()) { return; }
+
+        links_.resize(num_links);
+        AccessEgressLinkCompare compare;
+        for (int link_num = 0; reader.ok() && (link_num < num_links); ++link_num) {
+            AccessEgressLinkKey& aelk = links_[link_num].first;
+            aelk.taz_id_          = reader.readInt();
+            aelk.supply_mode_num_ = reader.readInt();
+            aelk.stop_id_         = reader.readInt();
+            aelk.start_time_      = reader.readDouble();
+            aelk.end_time_        = reader.readDouble();
+            reader.readAttributes(links_[link_num].second.attributes_);
+            // they're written in order, and the index depends on it
+            if ((aelk.taz_id_ < 0) || ((link_num > 0) && !compare(links_[link_num-1].first, aelk))) { reader.markBad(); }
         }
-        // Returns an iterator pointing to the first element in the container whose key is considered to go after k.
-        AccessEgressLinkAttr::const_iterator iter_hi  = map_.upper_bound( AccessEgressLinkKey(taz_id, supply_mode_num_max_+1, 0, 0, 0) );
-        if (iter_hi == map_.end()) {
-            // this is ok if they're at the end
+        if (!reader.ok()) {
+            clear();
+            return;
         }
+        buildIndex();
+    }
 
-        /** Suppose the links are the following and the taz_id is 13, then iter_lo and iter_hi would point to the following.
-         *  11 101 5 0 1440 => 2
-         *  11 104 1 0 1440 => 10
-         *  12 101 1 0 1440 => 2
-         *  12 101 4 0 1440 => 2
-         *  14 101 3 0 1440 => 2    <- iter_lo, iter_hi
-         *  14 104 8 0 1440 => 10
-        **/
-        if (iter_low == iter_hi) {
-            return false;
+    void AccessEgressLinks::buildIndex()
+    {
+        taz_offsets_.clear();
+        mode_links_.clear();
+        time_slices_.clear();
+        slice_links_.clear();
+        if (links_.empty()) { return; }
+
+        // sorted, so the last one has the max taz id
+        taz_offsets_.assign(links_.back().first.taz_id_+2, 0);
+
+        int num_links = (int)links_.size();
+        std::vector<double> breakpoints;
+        std::vector<const AccessEgressLinkEntry*> valid_links;
+        for (int group_begin = 0; group_begin < num_links; ) {
+            const AccessEgressLinkKey& first_key = links_[group_begin].first;
+            int group_end = group_begin;
+            breakpoints.clear();
+            while ((group_end < num_links) &&
+                   (links_[group_end].first.taz_id_          == first_key.taz_id_) &&
+                   (links_[group_end].first.supply_mode_num_ == first_key.supply_mode_num_)) {
+                breakpoints.push_back(links_[group_end].first.start_time_);
+                breakpoints.push_back(links_[group_end].first.end_time_);
+                group_end++;
+            }
+            std::sort(breakpoints.begin(), breakpoints.end());
+            breakpoints.erase(std::unique(breakpoints.begin(), breakpoints.end()), breakpoints.end());
+
+            AccessEgressModeLinks mode_links = { first_key.supply_mode_num_, group_begin, group_end, (int)time_slices_.size(), 0 };
+
+            // a link is valid for a whole slice if it's valid at the start of it, since the slices are split at every end time
+            for (size_t bp_num = 0; bp_num+1 < breakpoints.size(); ++bp_num) {
+                valid_links.clear();
+                for (int link_num = group_begin; link_num < group_end; ++link_num) {
+                    const AccessEgressLinkKey& aelk = links_[link_num].first;
+                    if ((aelk.start_time_ <= breakpoints[bp_num]) && (breakpoints[bp_num] < aelk.end_time_)) {
+                        valid_links.push_back(&links_[link_num]);
+                    }
+                }
+                if (valid_links.empty()) { continue; }
+
+                // extend the previous slice if it's adjacent and has the same links
+                if ((int)time_slices_.size() > mode_links.slices_begin_) {
+                    AccessEgressTimeSlice& prev_slice = time_slices_.back();
+                    if ((prev_slice.end_time_ == breakpoints[bp_num]) &&
+                        (prev_slice.links_end_ - prev_slice.links_begin_ == (int)valid_links.size()) &&
+                        std::equal(valid_links.begin(), valid_links.end(), slice_links_.begin() + prev_slice.links_begin_)) {
+                        prev_slice.end_time_ = breakpoints[bp_num+1];
+                        continue;
+                    }
+                }
+                AccessEgressTimeSlice slice = { breakpoints[bp_num], breakpoints[bp_num+1], (int)slice_links_.size(), 0 };
+                slice_links_.insert(slice_links_.end(), valid_links.begin(), valid_links.end());
+                slice.links_end_ = (int)slice_links_.size();
+                time_slices_.push_back(slice);
+            }
+            mode_links.slices_end_ = (int)time_slices_.size();
+            mode_links_.push_back(mode_links);
+            taz_offsets_[first_key.taz_id_+1] += 1;
+
+            group_begin = group_end;
+        }
+        for (size_t idx = 1; idx < taz_offsets_.size(); ++idx) {
+            taz_offsets_[idx] += taz_offsets_[idx-1];
         }
-        return true;
     }
 
-    AccessEgressLinkAttr::const_iterator AccessEgressLinks::lower_bound(int taz_id, int supply_mode_num) const
+    void AccessEgressLinks::compileAttributes(const AttributeSlots& slots)
     {
-        return map_.lower_bound( AccessEgressLinkKey(taz_id, supply_mode_num, stop_id_min_-1, 0, 0));
+        for (std::vector<AccessEgressLinkEntry>::iterator it = links_.begin(); it != links_.end(); ++it) {
+            it->second.slots_ = LinkAttributes(it->second.attributes_, slots);
+        }
     }
 
-    AccessEgressLinkAttr::const_iterator AccessEgressLinks::upper_bound(int taz_id, int supply_mode_num) const
+    bool AccessEgressLinks::hasLinksForTaz(int taz_id) const
     {
-        return map_.upper_bound( AccessEgressLinkKey(taz_id, supply_mode_num, stop_id_max_+1, 0, 0));
+        if ((taz_id < 0) || (taz_id+1 >= (int)taz_offsets_.size())) { return false; }
+        return taz_offsets_[taz_id] != taz_offsets_[taz_id+1];
     }
 
-    AccessEgressLinkAttr::const_iterator AccessEgressLinks::lower_bound(int taz_id, int supply_mode_num, int stop_id) const
+    const AccessEgressModeLinks* AccessEgressLinks::findModeLinks(int taz_id, int supply_mode_num) const
     {
-        return map_.lower_bound( AccessEgressLinkKey(taz_id, supply_mode_num, stop_id, -100*24, -100*24));
+        if ((taz_id < 0) || (taz_id+1 >= (int)taz_offsets_.size())) { return NULL; }
+        // there are only a few supply modes per taz
+        for (int idx = taz_offsets_[taz_id]; idx < taz_offsets_[taz_id+1]; ++idx) {
+            if (mode_links_[idx].supply_mode_num_ == supply_mode_num) { return &mode_links_[idx]; }
+        }
+        return NULL;
     }
 
-    AccessEgressLinkAttr::const_iterator AccessEgressLinks::upper_bound(int taz_id, int supply_mode_num, int stop_id) const
+    AccessEgressLinkRange AccessEgressLinks::linksFor(int taz_id) const
     {
-        return map_.upper_bound( AccessEgressLinkKey(taz_id, supply_mode_num, stop_id, 100*24,  100*24));
+        if (!hasLinksForTaz(taz_id)) { return AccessEgressLinkRange(); }
+        // the links are sorted by taz first, so its supply modes' links are adjacent
+        return AccessEgressLinkRange(links_.data() + mode_links_[taz_offsets_[taz_id]  ].links_begin_,
+                                     links_.data() + mode_links_[taz_offsets_[taz_id+1]-1].links_end_);
     }
 
-    /// Accessor
-    const Attributes* AccessEgressLinks::getAccessAttributes(int taz_id, int supply_mode_num, int stop_id, double tp_time) const
+    AccessEgressLinkRange AccessEgressLinks::linksFor(int taz_id, int supply_mode_num) const
+    {
+        const AccessEgressModeLinks* mode_links = findModeLinks(taz_id, supply_mode_num);
+        if (mode_links == NULL) { return AccessEgressLinkRange(); }
+        return AccessEgressLinkRange(links_.data() + mode_links->links_begin_, links_.data() + mode_links->links_end_);
+    }
+
+    AccessEgressLinkRange AccessEgressLinks::linksFor(int taz_id, int supply_mode_num, int stop_id) const
     {
+        AccessEgressLinkRange mode_range = linksFor(taz_id, supply_mode_num);
+        const AccessEgressLinkEntry* range_begin = std::lower_bound(mode_range.begin(), mode_range.end(), stop_id, entryBeforeStop);
+        const AccessEgressLinkEntry* range_end   = std::upper_bound(range_begin,        mode_range.end(), stop_id, stopBeforeEntry);
+        return AccessEgressLinkRange(range_begin, range_end);
+    }
 
-        AccessEgressLinkAttr::const_iterator iter_lo = map_.lower_bound(AccessEgressLinkKey(taz_id, supply_mode_num, stop_id, -100*24, -100*24));
+    AccessEgressLinkPtrRange AccessEgressLinks::linksAt(int taz_id, int supply_mode_num, double tp_time) const
+    {
+        const AccessEgressModeLinks* mode_links = findModeLinks(taz_id, supply_mode_num);
+        if (mode_links == NULL) { return AccessEgressLinkPtrRange(); }
+
+        // the last slice starting at or before tp_time
+        const AccessEgressTimeSlice* slices_begin = time_slices_.data() + mode_links->slices_begin_;
+        const AccessEgressTimeSlice* slices_end   = time_slices_.data() + mode_links->slices_end_;
+        const AccessEgressTimeSlice* slice        = std::upper_bound(slices_begin, slices_end, tp_time, timeBeforeSlice);
+        if (slice == slices_begin) { return AccessEgressLinkPtrRange(); }
+        --slice;
+        if (tp_time >= slice->end_time_) { return AccessEgressLinkPtrRange(); }
+        return AccessEgressLinkPtrRange(slice_links_.data() + slice->links_begin_, slice_links_.data() + slice->links_end_);
+    }
 
-        AccessEgressLinkAttr::const_iterator iter_hi = map_.lower_bound(AccessEgressLinkKey(taz_id, supply_mode_num, stop_id,  100*24,  100*24));
+    /// Accessor
+    const Attributes* AccessEgressLinks::getAccessAttributes(int taz_id, int supply_mode_num, int stop_id, double tp_time) const
+    {
+        AccessEgressLinkRange range = linksFor(taz_id, supply_mode_num, stop_id);
 
         double tp_time_024 = fix_time_range(tp_time);
-        for (AccessEgressLinkAttr::const_iterator iter = iter_lo; iter != iter_hi; ++iter) {
-            if ((iter->first.start_time_ <= tp_time_024) && (tp_time_024 < iter->first.end_time_)) {
-                return &(iter->second);
+        for (const AccessEgressLinkEntry* link = range.begin(); link != range.end(); ++link) {
+            if ((link->first.start_time_ <= tp_time_024) && (tp_time_024 < link->first.end_time_)) {
+                return &(link->second.attributes_);
             }
         }
         return NULL;
     }
 
-}
\ No newline at end of file
+}
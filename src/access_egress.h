@@ -3,14 +3,22 @@
  *
  * Defines the access/egress link lookup structure
  */
+#include <cstddef>
 #include <ios>
 #include <iostream>
 #include <map>
 #include <ostream>
+#include <utility>
+#include <vector>
+
+#include "link_cost.h"
+
+#ifndef ACCESS_EGRESS_H
+#define ACCESS_EGRESS_H
 
 namespace fasttrips {
-    /// Generic attributes
-    typedef std::map<std::string, double> Attributes;
+    class SnapshotReader;
+    class SnapshotWriter;
 
     /// Key for access egress links map
     struct AccessEgressLinkKey {
@@ -62,41 +70,131 @@ namespace fasttrips {
         }
     };
 
-    typedef std::map<AccessEgressLinkKey, Attributes, struct AccessEgressLinkCompare > AccessEgressLinkAttr;
+    /// Access/egress link attributes, by name and in attribute slots
+    typedef struct {
+        Attributes      attributes_;
+        LinkAttributes  slots_;         ///< Set by AccessEgressLinks::compileAttributes()
+    } AccessEgressLink;
+
+    /// Used while reading the links, to collect the attributes for each key
+    typedef std::map<AccessEgressLinkKey, AccessEgressLink, struct AccessEgressLinkCompare > AccessEgressLinkAttr;
+
+    /// An access/egress link with its key; fasttrips::AccessEgressLinks stores these sorted by key
+    typedef std::pair<AccessEgressLinkKey, AccessEgressLink> AccessEgressLinkEntry;
+
+    /**
+     * A contiguous, read-only range of fasttrips::AccessEgressLinkEntry instances, in key order.
+     * This points into the fasttrips::AccessEgressLinks storage, so nothing is copied.
+     */
+    struct AccessEgressLinkRange {
+        const AccessEgressLinkEntry* begin_;
+        const AccessEgressLinkEntry* end_;
+
+        AccessEgressLinkRange() : begin_(NULL), end_(NULL) {}
+        AccessEgressLinkRange(const AccessEgressLinkEntry* b, const AccessEgressLinkEntry* e) : begin_(b), end_(e) {}
+
+        const AccessEgressLinkEntry* begin() const { return begin_; }
+        const AccessEgressLinkEntry* end()   const { return end_;   }
+        size_t size()                        const { return end_ - begin_; }
+        bool   empty()                       const { return begin_ == end_; }
+    };
+
+    /**
+     * A contiguous, read-only range of pointers to fasttrips::AccessEgressLinkEntry instances, in key order.
+     * This points into the fasttrips::AccessEgressLinks storage, so nothing is copied.
+     */
+    struct AccessEgressLinkPtrRange {
+        const AccessEgressLinkEntry* const* begin_;
+        const AccessEgressLinkEntry* const* end_;
+
+        AccessEgressLinkPtrRange() : begin_(NULL), end_(NULL) {}
+        AccessEgressLinkPtrRange(const AccessEgressLinkEntry* const* b, const AccessEgressLinkEntry* const* e) : begin_(b), end_(e) {}
+
+        const AccessEgressLinkEntry* const* begin() const { return begin_; }
+        const AccessEgressLinkEntry* const* end()   const { return end_;   }
+        size_t size()                               const { return end_ - begin_; }
+        bool   empty()                              const { return begin_ == end_; }
+    };
 
+    /// A time period [start_time_, end_time_) in which the same access/egress links for a TAZ and supply mode are valid
+    typedef struct {
+        double  start_time_;
+        double  end_time_;
+        int     links_begin_;           ///< Index of its first link in AccessEgressLinks::slice_links_
+        int     links_end_;
+    } AccessEgressTimeSlice;
+
+    /// The access/egress links for one TAZ and supply mode
+    typedef struct {
+        int     supply_mode_num_;
+        int     links_begin_;           ///< Index of its first link in AccessEgressLinks::links_
+        int     links_end_;
+        int     slices_begin_;          ///< Index of its first time slice in AccessEgressLinks::time_slices_
+        int     slices_end_;
+    } AccessEgressModeLinks;
+
+    /**
+     * The access/egress links, stored contiguously and indexed by TAZ, supply mode, stop and time period.
+     *
+     * The links are in one vector sorted by key, so the links for a TAZ and supply mode are a contiguous range
+     * sorted by stop, and the links for a stop within those are sorted by time period.  The TAZ index is in CSR form:
+     * the supply modes for TAZ id t are at [taz_offsets_[t], taz_offsets_[t+1]) in mode_links_.
+     *
+     * For each TAZ and supply mode, the time periods are also split at every link start and end time into time slices,
+     * each with the (pointers to the) links that are valid for all of it, so the links valid at a time are a binary
+     * search away.
+     */
     class AccessEgressLinks {
     private:
-        int supply_mode_num_min_;
-        int supply_mode_num_max_;
-        int stop_id_min_;
-        int stop_id_max_;
-
-        // The primary data store
-        AccessEgressLinkAttr map_;
+        /// All the links, sorted by key
+        std::vector<AccessEgressLinkEntry>          links_;
+        /// TAZ id -> index of its first supply mode in mode_links_.  Size is max taz id + 2.
+        std::vector<int>                            taz_offsets_;
+        /// supply modes grouped by TAZ, sorted by supply mode
+        std::vector<AccessEgressModeLinks>          mode_links_;
+        /// time slices grouped by TAZ and supply mode, sorted by time
+        std::vector<AccessEgressTimeSlice>          time_slices_;
+        /// links valid for each time slice
+        std::vector<const AccessEgressLinkEntry*>   slice_links_;
+
+        /// Builds the index from links_, which must be sorted by key
+        void buildIndex();
+        /// The links for the given taz and supply mode, or NULL if there aren't any
+        const AccessEgressModeLinks* findModeLinks(int taz_id, int supply_mode_num) const;
 
     public:
         /// Constructor
-        AccessEgressLinks();
+        AccessEgressLinks() {}
         /// Destructor
         ~AccessEgressLinks() {}
 
-        void clear() { map_.clear(); }
+        void clear();
 
         void readLinks(std::ifstream& accegr_file, bool debug_out);
+        /// Write the links to a network snapshot
+        void writeSnapshot(SnapshotWriter& writer) const;
+        /// Read the links from a network snapshot.  Check the reader afterwards.
+        void readSnapshot(SnapshotReader& reader);
+
+        /// Sets the attribute slots for each link.  Call this once the weights are read.
+        void compileAttributes(const AttributeSlots& slots);
 
         /// Are there access or egress links for the given taz?
         bool hasLinksForTaz(int taz_id) const;
 
-        /// Iterate through the links for the taz id and supply mode
-        AccessEgressLinkAttr::const_iterator lower_bound(int taz_id, int supply_mode_num) const;
-        AccessEgressLinkAttr::const_iterator upper_bound(int taz_id, int supply_mode_num) const;
-
-        /// Iterate through the links for the taz id, supply mode and stop
-        AccessEgressLinkAttr::const_iterator lower_bound(int taz_id, int supply_mode_num, int stop_id) const;
-        AccessEgressLinkAttr::const_iterator upper_bound(int taz_id, int supply_mode_num, int stop_id) const;
+        /// All the links for the taz id, sorted by supply mode, stop and then time period
+        AccessEgressLinkRange linksFor(int taz_id) const;
+        /// The links for the taz id and supply mode, sorted by stop and then time period
+        AccessEgressLinkRange linksFor(int taz_id, int supply_mode_num) const;
+        /// The links for the taz id, supply mode and stop, sorted by time period
+        AccessEgressLinkRange linksFor(int taz_id, int supply_mode_num, int stop_id) const;
+        /// The links for the taz id and supply mode with tp_time in [start_time_, end_time_), sorted by stop
+        AccessEgressLinkPtrRange linksAt(int taz_id, int supply_mode_num, double tp_time) const;
 
         /// accessor
         const Attributes* getAccessAttributes(int taz_id, int supply_mode_num, int stop_id, double tp_time) const;
     };
 
 }
+
+#endif
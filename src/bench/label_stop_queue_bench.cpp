@@ -0,0 +1,241 @@
+/**
+ * \file label_stop_queue_bench.cpp
+ *
+ * Microbenchmark for fasttrips::LabelStopQueue against the previous lazy-invalidation implementation.
+ *
+ * The input is a LabelStopQueue operation trace: one operation per line, either
+ *
+ *     LSQ push <stop_id> <is_trip> <label>
+ *     LSQ pop
+ *
+ * Other lines are ignored, so a trace log written with RECORD_LSQ defined in pathfinder.cpp can be used directly.
+ * Without an input file, a synthetic trace with frequent relabeling (like stochastic path finding with a high
+ * STOCH_MAX_STOP_PROCESS_COUNT) is generated.
+ *
+ * Build and run from the repository root:
+ *
+ *     python setup.py build_bench
+ *     build/bench/label_stop_queue_bench [trace_file [repetitions]]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "LabelStopQueue.h"
+
+using namespace fasttrips;
+
+/**
+ * This is the LabelStopQueue implementation before the indexed heap: a std::priority_queue plus a
+ * std::map from (stop ID, is trip bool) to the lowest label, with stale entries skipped on pop.
+ */
+class LazyLabelStopQueue
+{
+private:
+    std::priority_queue<LabelStop, std::vector<LabelStop>, struct LabelStopCompare> labelstop_priority_queue_;
+
+    typedef struct {
+        double label_;
+        bool   valid_;
+        int    count_;
+    } LabelCount;
+
+    std::map< std::pair<int, bool>, LabelCount> labelstop_map_;
+
+    int valid_count_;
+
+public:
+    LazyLabelStopQueue() : valid_count_(0) {}
+
+    void push(const LabelStop& val) {
+        std::pair<int,bool> full_stop_id = std::make_pair(val.stop_id_, val.is_trip_);
+
+        if (labelstop_map_.find(full_stop_id) == labelstop_map_.end()) {
+            labelstop_priority_queue_.push(val);
+            LabelCount lc = { val.label_, true, 1 };
+            labelstop_map_[full_stop_id] = lc;
+            valid_count_++;
+            return;
+        }
+        if (!labelstop_map_[full_stop_id].valid_) {
+            labelstop_priority_queue_.push(val);
+            labelstop_map_[full_stop_id].label_     = val.label_;
+            labelstop_map_[full_stop_id].valid_     = true;
+            labelstop_map_[full_stop_id].count_    += 1;
+            valid_count_++;
+            return;
+        }
+        if (val.label_ < labelstop_map_[full_stop_id].label_) {
+            labelstop_priority_queue_.push(val);
+            labelstop_map_[full_stop_id].label_ = val.label_;
+            labelstop_map_[full_stop_id].count_ += 1;
+        }
+    }
+
+    LabelStop pop_top() {
+        while (true) {
+            const LabelStop& ls = labelstop_priority_queue_.top();
+            std::map< std::pair<int, bool>, LabelCount>::iterator ls_iter = labelstop_map_.find(std::make_pair(ls.stop_id_, ls.is_trip_));
+
+            if (!ls_iter->second.valid_ || (ls_iter->second.label_ != ls.label_)) {
+                ls_iter->second.count_ -= 1;
+                labelstop_priority_queue_.pop();
+                continue;
+            }
+            LabelStop to_ret = ls;
+            labelstop_priority_queue_.pop();
+            ls_iter->second.valid_  = false;
+            ls_iter->second.count_ -= 1;
+            valid_count_ -= 1;
+            return to_ret;
+        }
+    }
+
+    bool empty() const { return (valid_count_ == 0); }
+};
+
+/// One recorded queue operation
+typedef struct {
+    bool        is_push_;
+    LabelStop   label_stop_;
+} QueueOp;
+
+static bool readTrace(const char* filename, std::vector<QueueOp>& ops)
+{
+    std::ifstream trace_file(filename);
+    if (!trace_file.is_open()) { return false; }
+
+    std::string line, tag, op;
+    while (std::getline(trace_file, line)) {
+        std::istringstream iss(line);
+        if (!(iss >> tag >> op) || (tag != "LSQ")) { continue; }
+
+        QueueOp qo = { op == "push", { 0.0, 0, false } };
+        if (qo.is_push_) {
+            int is_trip;
+            if (!(iss >> qo.label_stop_.stop_id_ >> is_trip >> qo.label_stop_.label_)) { continue; }
+            qo.label_stop_.is_trip_ = (is_trip != 0);
+        } else if (op != "pop") {
+            continue;
+        }
+        ops.push_back(qo);
+    }
+    return true;
+}
+
+/// Labels only go up as we pop, but each processed stop relabels a handful of others, often lower than before.
+static void syntheticTrace(std::vector<QueueOp>& ops)
+{
+    const int num_stops = 20000;
+    const int num_pops  = 200000;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int>     stop_dist(0, num_stops-1);
+    std::uniform_int_distribution<int>     fanout_dist(1, 12);
+    std::uniform_real_distribution<double> cost_dist(0.5, 30.0);
+
+    std::vector<double> labels(2*num_stops, 1.0e9);
+    LabelStopQueue queue;
+    for (int idx = 0; idx < 50; ++idx) {
+        LabelStop ls = { cost_dist(rng), stop_dist(rng), false };
+        QueueOp qo = { true, ls };
+        ops.push_back(qo);
+        queue.push(ls);
+    }
+    IdVector<Stop> no_stops;
+    std::ofstream no_trace;
+    for (int pops = 0; (pops < num_pops) && !queue.empty(); ++pops) {
+        LabelStop current = queue.pop_top(no_stops, false, no_trace);
+        QueueOp pop_op = { false, current };
+        ops.push_back(pop_op);
+
+        int fanout = fanout_dist(rng);
+        for (int idx = 0; idx < fanout; ++idx) {
+            LabelStop ls = { current.label_ + cost_dist(rng), stop_dist(rng), (idx % 2) == 0 };
+            int full_stop_id = 2*ls.stop_id_ + (ls.is_trip_ ? 1 : 0);
+            // stochastic labels aren't monotone; sometimes the new label is worse and is still pushed
+            if ((ls.label_ >= labels[full_stop_id]) && (rng() % 4 != 0)) { continue; }
+            labels[full_stop_id] = std::min(labels[full_stop_id], ls.label_);
+            QueueOp push_op = { true, ls };
+            ops.push_back(push_op);
+            queue.push(ls);
+        }
+    }
+}
+
+template <class Replay>
+static double timeReplay(const std::vector<QueueOp>& ops, int repetitions, Replay replay, std::vector<LabelStop>& popped)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < repetitions; ++rep) {
+        popped.clear();
+        replay(ops, popped);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+}
+
+static void replayIndexed(const std::vector<QueueOp>& ops, std::vector<LabelStop>& popped)
+{
+    LabelStopQueue queue;
+    IdVector<Stop> no_stops;
+    std::ofstream no_trace;
+    for (std::vector<QueueOp>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+        if (it->is_push_)       { queue.push(it->label_stop_); }
+        else if (!queue.empty()) { popped.push_back(queue.pop_top(no_stops, false, no_trace)); }
+    }
+}
+
+static void replayLazy(const std::vector<QueueOp>& ops, std::vector<LabelStop>& popped)
+{
+    LazyLabelStopQueue queue;
+    for (std::vector<QueueOp>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+        if (it->is_push_)       { queue.push(it->label_stop_); }
+        else if (!queue.empty()) { popped.push_back(queue.pop_top()); }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<QueueOp> ops;
+    if (argc > 1) {
+        if (!readTrace(argv[1], ops)) {
+            std::cerr << "Couldn't read " << argv[1] << std::endl;
+            return 2;
+        }
+    } else {
+        syntheticTrace(ops);
+    }
+    int repetitions = (argc > 2) ? std::atoi(argv[2]) : 10;
+    if (repetitions < 1) { repetitions = 1; }
+
+    size_t num_pushes = 0;
+    for (std::vector<QueueOp>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+        if (it->is_push_) { num_pushes++; }
+    }
+    std::cout << "Replaying " << num_pushes << " pushes and " << ops.size() - num_pushes << " pops";
+    std::cout << " x " << repetitions << std::endl;
+
+    std::vector<LabelStop> popped_lazy, popped_indexed;
+    double ms_lazy    = timeReplay(ops, repetitions, replayLazy,    popped_lazy);
+    double ms_indexed = timeReplay(ops, repetitions, replayIndexed, popped_indexed);
+
+    // they should pop exactly the same sequence
+    bool same = (popped_lazy.size() == popped_indexed.size());
+    for (size_t idx = 0; same && (idx < popped_lazy.size()); ++idx) {
+        same = (popped_lazy[idx].stop_id_ == popped_indexed[idx].stop_id_) &&
+               (popped_lazy[idx].is_trip_ == popped_indexed[idx].is_trip_) &&
+               (popped_lazy[idx].label_   == popped_indexed[idx].label_  );
+    }
+
+    std::cout << "  lazy priority_queue + map: " << ms_lazy    << " ms" << std::endl;
+    std::cout << "  indexed 4-ary heap:        " << ms_indexed << " ms" << std::endl;
+    std::cout << "  pop sequences " << (same ? "match" : "DIFFER") << std::endl;
+    return same ? 0 : 1;
+}
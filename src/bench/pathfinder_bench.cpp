@@ -0,0 +1,165 @@
+/**
+ * \file pathfinder_bench.cpp
+ *
+ * Benchmark for fasttrips::PathFinder::findPathSet() that replays a recorded query corpus (see query_corpus.h)
+ * against the network supply in an output directory, outside of python.
+ *
+ * Record a corpus by running fast-trips with the record_queries option; each pathfinding iteration writes
+ * ft_queries_iter<iteration>_pfiter<pathfinding iteration>.txt to the output directory, with the parameters,
+ * stop times and bump waits the queries ran against.  Then replay it against the same output directory,
+ * which has the intermediate files (or the network snapshot) for the rest of the supply.
+ *
+ * Reported are the throughput, the p50 and p99 latency, the mean labeled stops and max process count
+ * and the mean number of heap allocations per query, overall and by search type.
+ *
+ * Build and run from the repository root:
+ *
+ *     python setup.py build_bench
+ *     build/bench/pathfinder_bench output_dir corpus_file [repetitions]
+ *
+ * tests/test_pathfinder_bench.py records a corpus from the Springfield example and replays it this way.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "pathfinder.h"
+#include "query_corpus.h"
+
+using namespace fasttrips;
+
+/// Number of calls to operator new, so allocations per query can be reported
+static size_t num_allocations = 0;
+
+void* operator new(size_t size)
+{
+    num_allocations++;
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == NULL) { throw std::bad_alloc(); }
+    return ptr;
+}
+void* operator new[](size_t size)       { return operator new(size); }
+void  operator delete(void* ptr)        noexcept { std::free(ptr); }
+void  operator delete[](void* ptr)      noexcept { std::free(ptr); }
+
+/// The results of one query
+typedef struct {
+    double  microseconds_;
+    size_t  allocations_;
+    int     num_labeled_stops_;
+    int     max_process_count_;
+    int     status_;
+} QueryResult;
+
+/// The given percentile of the sorted latencies
+static double percentile(const std::vector<double>& sorted, double pct)
+{
+    if (sorted.empty()) { return 0; }
+    size_t idx = (size_t)(pct/100.0*(sorted.size()-1) + 0.5);
+    return sorted[idx];
+}
+
+/// Prints one line of the report for the given results
+static void report(const std::string& name, const std::vector<QueryResult>& results)
+{
+    if (results.empty()) { return; }
+    std::vector<double> latencies;
+    double total_us = 0, labeled_stops = 0, process_count = 0, allocations = 0;
+    int    num_found = 0;
+    for (std::vector<QueryResult>::const_iterator it = results.begin(); it != results.end(); ++it) {
+        latencies.push_back(it->microseconds_);
+        total_us      += it->microseconds_;
+        labeled_stops += it->num_labeled_stops_;
+        process_count += it->max_process_count_;
+        allocations   += it->allocations_;
+        if (it->status_ == PathFinder::RET_SUCCESS) { num_found++; }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double n = (double)results.size();
+
+    std::cout << std::left  << std::setw(24) << name << std::right
+              << std::setw(9)  << results.size()
+              << std::setw(9)  << num_found
+              << std::setw(12) << std::fixed << std::setprecision(1) << n/(total_us/1.0e6)
+              << std::setw(11) << std::setprecision(3) << percentile(latencies, 50)/1000.0
+              << std::setw(11) << percentile(latencies, 99)/1000.0
+              << std::setw(12) << std::setprecision(1) << labeled_stops/n
+              << std::setw(10) << process_count/n
+              << std::setw(12) << allocations/n << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " output_dir corpus_file [repetitions]" << std::endl;
+        return 2;
+    }
+    std::string output_dir(argv[1]);
+    QueryCorpus corpus;
+    if (!readQueryCorpus(argv[2], corpus)) { return 2; }
+    int repetitions = (argc > 3) ? std::atoi(argv[3]) : 1;
+    if (repetitions < 1) { repetitions = 1; }
+
+    if (corpus.parameters_.size() != 16) {
+        std::cerr << argv[2] << " has " << corpus.parameters_.size() << " parameters; expected 16" << std::endl;
+        return 2;
+    }
+    const std::vector<double>& p = corpus.parameters_;
+
+    PathFinder pathfinder;
+    pathfinder.initializeParameters(p[0], p[1], p[2], p[3], p[4], (int)p[5], p[6], (int)p[7],
+                                    p[8] != 0, p[9] != 0, (int)p[10], p[11], p[12] != 0, p[13] != 0,
+                                    p[14] != 0, (int)p[15]);
+    pathfinder.initializeSupply(output_dir.c_str(), 0, corpus.stoptime_index_.data(), corpus.stoptime_times_.data(),
+                                corpus.numStopTimes(), true);
+    if (corpus.numBumpWaits() > 0) {
+        pathfinder.setBumpWait(corpus.bw_index_.data(), corpus.bw_data_.data(), corpus.numBumpWaits());
+    }
+    std::cout << "Replaying " << corpus.queries_.size() << " queries x " << repetitions << std::endl;
+
+    // by hyperpath * 2 + outbound
+    const char* category_names[] = { "deterministic inbound", "deterministic outbound", "hyperpath inbound", "hyperpath outbound" };
+    std::vector<QueryResult> all_results;
+    std::vector<QueryResult> category_results[4];
+
+    // reused across queries, as a path finding thread does
+    StopStates stop_states;
+    for (int rep = 0; rep < repetitions; ++rep) {
+        for (std::vector<PathSpecification>::const_iterator it = corpus.queries_.begin(); it != corpus.queries_.end(); ++it) {
+            PathSet         pathset;
+            PerformanceInfo perf_info = { 0, 0, 0, 0, 0, 0, 0 };
+
+            size_t allocations_before = num_allocations;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            int status = pathfinder.findPathSet(*it, pathset, perf_info, stop_states);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+            QueryResult result = { std::chrono::duration<double, std::micro>(end - start).count(),
+                                   num_allocations - allocations_before,
+                                   perf_info.num_labeled_stops_, perf_info.max_process_count_, status };
+            all_results.push_back(result);
+            category_results[(it->hyperpath_ ? 2 : 0) + (it->outbound_ ? 1 : 0)].push_back(result);
+        }
+    }
+
+    std::cout << std::left  << std::setw(24) << "" << std::right
+              << std::setw(9)  << "queries"
+              << std::setw(9)  << "found"
+              << std::setw(12) << "queries/s"
+              << std::setw(11) << "p50 ms"
+              << std::setw(11) << "p99 ms"
+              << std::setw(12) << "labeled"
+              << std::setw(10) << "process"
+              << std::setw(12) << "allocs" << std::endl;
+    report("all", all_results);
+    for (int category = 0; category < 4; ++category) {
+        report(category_names[category], category_results[category]);
+    }
+    return 0;
+}
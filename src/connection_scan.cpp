@@ -0,0 +1,75 @@
+#include "connection_scan.h"
+
+#include <algorithm>
+
+namespace fasttrips {
+
+    /// Earlier departure first; for the same departure, earlier arrival first, so zero-minute hops come before what they feed
+    static bool departsBefore(const Connection& c1, const Connection& c2) {
+        if (c1.depart_time_ != c2.depart_time_) { return c1.depart_time_ < c2.depart_time_; }
+        return c1.arrive_time_ < c2.arrive_time_;
+    }
+
+    /// Later arrival first; for the same arrival, later departure first
+    static bool arrivesAfter(const Connection& c1, const Connection& c2) {
+        if (c1.arrive_time_ != c2.arrive_time_) { return c1.arrive_time_ > c2.arrive_time_; }
+        return c1.depart_time_ > c2.depart_time_;
+    }
+
+    static bool departureBeforeTime(const Connection& conn, double time) { return conn.depart_time_ < time; }
+    static bool arrivalAfterTime(const Connection& conn, double time) { return conn.arrive_time_ > time; }
+
+    void ConnectionTimetable::build(const TripStopTimes& trip_stop_times)
+    {
+        clear();
+
+        for (int trip_id = 0; trip_id <= trip_stop_times.maxTripId(); ++trip_id) {
+            TripStopTimeRange stop_times = trip_stop_times.forTrip(trip_id);
+            if (stop_times.size() < 2) { continue; }
+
+            // unwrap the times along the trip: a day later each time the schedule goes back
+            size_t first_conn = by_departure_.size();
+            double day_offset  = 0;
+            double last_time   = stop_times.begin()->arrive_time_;
+            double depart_time = 0;
+            for (int idx = 0; idx < (int)stop_times.size(); ++idx) {
+                const TripStopTime& stt = stop_times.begin()[idx];
+                double arrive_time = stt.arrive_time_ + day_offset;
+                if (arrive_time < last_time) { day_offset += 24*60; arrive_time += 24*60; }
+                if (idx > 0) {
+                    Connection conn = { depart_time, arrive_time, trip_id, idx-1, stop_times.begin()[idx-1].stop_id_, stt.stop_id_ };
+                    by_departure_.push_back(conn);
+                }
+                depart_time = stt.depart_time_ + day_offset;
+                if (depart_time < arrive_time) { day_offset += 24*60; depart_time += 24*60; }
+                last_time = depart_time;
+            }
+
+            // the arrival order keeps the last stop's time as scheduled instead
+            for (size_t conn_num = first_conn; conn_num < by_departure_.size(); ++conn_num) {
+                Connection conn = by_departure_[conn_num];
+                conn.depart_time_ -= day_offset;
+                conn.arrive_time_ -= day_offset;
+                by_arrival_.push_back(conn);
+            }
+        }
+        std::stable_sort(by_departure_.begin(), by_departure_.end(), departsBefore);
+        std::stable_sort(by_arrival_.begin(),   by_arrival_.end(),   arrivesAfter);
+    }
+
+    void ConnectionTimetable::clear()
+    {
+        by_departure_.clear();
+        by_arrival_.clear();
+    }
+
+    const Connection* ConnectionTimetable::departingFrom(double earliest) const
+    {
+        return by_departure_.data() + (std::lower_bound(by_departure_.begin(), by_departure_.end(), earliest, departureBeforeTime) - by_departure_.begin());
+    }
+
+    const Connection* ConnectionTimetable::arrivingBy(double latest) const
+    {
+        return by_arrival_.data() + (std::lower_bound(by_arrival_.begin(), by_arrival_.end(), latest, arrivalAfterTime) - by_arrival_.begin());
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * \file connection_scan.h
+ *
+ * Defines the time-sorted connection timetable that PathFinder::scanConnections() labels deterministic
+ * path specifications with, instead of expanding each trip from the label stop queue.
+ *
+ * A connection is one hop of a trip between consecutive stops.  The timetable keeps every connection twice,
+ * sorted by departure time (for inbound labeling, forwards in time) and by arrival time, latest first (for outbound
+ * labeling, backwards in time), so labeling is a sequential scan from the preferred time.
+ *
+ * Trips that cross midnight are unwrapped along the trip: in the departure order the times after the first stop
+ * are made later by a day where the schedule wraps, and in the arrival order the times before the last stop are made
+ * earlier by a day.  So boarding a trip after it has crossed midnight matches the unwrapped time.
+ */
+#include <vector>
+
+#include "stop_times.h"
+
+#ifndef CONNECTION_SCAN_H
+#define CONNECTION_SCAN_H
+
+namespace fasttrips {
+
+    /// A trip's hop between consecutive stops
+    typedef struct {
+        double  depart_time_;       ///< Departure from the first stop, minutes after midnight (unwrapped)
+        double  arrive_time_;       ///< Arrival at the second stop, minutes after midnight (unwrapped)
+        int     trip_id_;           ///< Trip ID
+        int     depart_index_;      ///< Index of the first stop's fasttrips::TripStopTime in the trip's stop times; the second is next
+        int     depart_stop_id_;    ///< First stop
+        int     arrive_stop_id_;    ///< Second stop
+    } Connection;
+
+    /// Where PathFinder::scanConnections() got on (inbound) or off (outbound) a trip, if it has
+    typedef struct {
+        unsigned int    epoch_;             ///< The fasttrips::StopStates epoch this is for; anything else is stale
+        bool            allowed_;           ///< Is the trip's supply mode allowed for the user class/demand mode?
+        bool            on_;                ///< Boarded (inbound) or alighted (outbound) yet?
+        int             stop_index_;        ///< Index of the boarding/alighting stop in the trip's stop times
+        double          deparr_time_;       ///< Trip departure (inbound) or arrival (outbound) there, unwrapped like the connections
+        double          nt_deparr_time_;    ///< Passenger arrival (inbound) or departure (outbound) there
+        double          nt_cost_;           ///< Cost of the non-trip state there
+    } TripHop;
+
+    /**
+     * The connections of all trips, in the two scan orders.
+     * This is built from the fasttrips::TripStopTimes and must be rebuilt whenever the stop times change.
+     */
+    class ConnectionTimetable
+    {
+    private:
+        /// Sorted by departure time, earliest first
+        std::vector<Connection>     by_departure_;
+        /// Sorted by arrival time, latest first
+        std::vector<Connection>     by_arrival_;
+
+    public:
+        /// Builds from the given trip stop times
+        void build(const TripStopTimes& trip_stop_times);
+        /// Clears data
+        void clear();
+        /// Is there anything to scan?
+        bool empty() const { return by_departure_.empty(); }
+
+        /// Connections departing at or after the given time, in order of departure time
+        const Connection* departingFrom(double earliest) const;
+        const Connection* departingEnd() const { return by_departure_.data() + by_departure_.size(); }
+        /// Connections arriving at or before the given time, latest arrival first
+        const Connection* arrivingBy(double latest) const;
+        const Connection* arrivingEnd() const { return by_arrival_.data() + by_arrival_.size(); }
+    };
+}
+
+#endif
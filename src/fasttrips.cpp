@@ -7,17 +7,34 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <numpy/arrayobject.h>
 
+#include "path_results.h"
 #include "pathfinder.h"
+#include "pathset_writer.h"
+#include "threadpool.h"
+#include <fstream>
+#include <map>
+#include <memory>
 #include <string>
 #include <queue>
+#include <vector>
 
 static PyObject *pyError;
 
 
 
-// global variable
+// global variable.  This holds the network supply; per-query state is in a fasttrips::PathFinderContext
+// so findPathSet() may be called on it from multiple threads.
 fasttrips::PathFinder pathfinder;
 
+// Labeling memory for find_pathset(), reused across calls.  That runs with the GIL held, so only one thread uses it.
+fasttrips::StopStates single_query_stop_states;
+
+// If open, find_pathsets_batch() also appends its results here.  See open_pathset_stream().
+std::unique_ptr<fasttrips::PathSetStreamWriter> pathset_stream;
+
+// If open, find_pathset() and find_pathsets_batch() record their queries here.  See open_query_record().
+std::unique_ptr<std::ofstream> query_record;
+
 static PyObject *
 _fasttrips_initialize_parameters(PyObject *self, PyObject *args)
 {
@@ -33,17 +50,26 @@ _fasttrips_initialize_parameters(PyObject *self, PyObject *args)
     int        transfer_fare_ignore_pe;
     int        max_num_paths;
     double     min_path_probability;
+    int        prune_with_lower_bounds = 0;
+    int        labeling_cache = 0;
+    int        connection_scan = 0;
+    int        enumeration_threads = 0;
+    int        labeling_cache_mb = 256;
 
-    if (!PyArg_ParseTuple(args, "dddddidiiiid", &time_window, &bump_buffer, &utils_conversion, &depart_early_allowed_min,
+    if (!PyArg_ParseTuple(args, "dddddidiiiid|iiiii", &time_window, &bump_buffer, &utils_conversion, &depart_early_allowed_min,
                                                &arrive_late_allowed_min, &stoch_pathset_size, &stoch_dispersion,
                                                &stoch_max_stop_process_count, &transfer_fare_ignore_pf,
-                                               &transfer_fare_ignore_pe, &max_num_paths, &min_path_probability)) {
+                                               &transfer_fare_ignore_pe, &max_num_paths, &min_path_probability,
+                                               &prune_with_lower_bounds, &labeling_cache, &connection_scan,
+                                               &enumeration_threads, &labeling_cache_mb)) {
         return NULL;
     }
     pathfinder.initializeParameters(time_window, bump_buffer, utils_conversion, depart_early_allowed_min, arrive_late_allowed_min, stoch_pathset_size,
                                     stoch_dispersion, stoch_max_stop_process_count,
                                     (transfer_fare_ignore_pf==1), (transfer_fare_ignore_pe==1),
-                                    max_num_paths, min_path_probability);
+                                    max_num_paths, min_path_probability, (prune_with_lower_bounds==1),
+                                    (labeling_cache==1), (connection_scan==1), enumeration_threads,
+                                    labeling_cache_mb);
     Py_RETURN_NONE;
 
 }
@@ -54,9 +80,10 @@ _fasttrips_initialize_supply(PyObject *self, PyObject *args)
     PyArrayObject *pyo;
     const char* output_dir;
     int proc_num;
+    int use_snapshot = 0;
     PyObject *input3, *input4, *input5, *input6;
-    if (!PyArg_ParseTuple(args, "siOO", &output_dir, &proc_num,
-                          &input3, &input4)) {
+    if (!PyArg_ParseTuple(args, "siOO|i", &output_dir, &proc_num,
+                          &input3, &input4, &use_snapshot)) {
         return NULL;
     }
 
@@ -79,7 +106,8 @@ _fasttrips_initialize_supply(PyObject *self, PyObject *args)
 
     // keep them
     pathfinder.initializeSupply(output_dir, proc_num,
-                                stop_indexes, stop_times, num_stop_ind);
+                                stop_indexes, stop_times, num_stop_ind,
+                                (use_snapshot==1));
 
     if (proc_num <= 1) {
         //std::cout << "RAND_MAX = " << RAND_MAX << std::endl;
@@ -87,6 +115,36 @@ _fasttrips_initialize_supply(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+_fasttrips_update_stop_times(PyObject *self, PyObject *args)
+{
+    PyArrayObject *pyo;
+    PyObject *input1, *input2;
+    if (!PyArg_ParseTuple(args, "OO", &input1, &input2)) {
+        return NULL;
+    }
+
+    // changed trip stop times index: trip id, sequence, stop id
+    pyo                 = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo == NULL) return NULL;
+    int* stop_indexes   = (int*)PyArray_DATA(pyo);
+    int num_stop_ind    = PyArray_DIMS(pyo)[0];
+    assert(3 == PyArray_DIMS(pyo)[1]);
+
+    // changed trip stop times data: arrival time, departure time, shape_dist_traveled, overcap
+    pyo                 = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_DOUBLE, 2, 2);
+    if (pyo == NULL) return NULL;
+    double* stop_times  = (double*)PyArray_DATA(pyo);
+    int num_stop_times  = PyArray_DIMS(pyo)[0];
+    assert(4 == PyArray_DIMS(pyo)[1]);
+
+    // these better be the same length
+    assert(num_stop_ind == num_stop_times);
+
+    pathfinder.updateStopTimes(stop_indexes, stop_times, num_stop_ind);
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 _fasttrips_set_bump_wait(PyObject* self, PyObject *args)
 {
@@ -114,6 +172,84 @@ _fasttrips_set_bump_wait(PyObject* self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+_fasttrips_update_bump_wait(PyObject* self, PyObject *args)
+{
+    PyObject *input1, *input2;
+    if (!PyArg_ParseTuple(args, "OO", &input1, &input2)) {
+        return NULL;
+    }
+    PyArrayObject *pyo;
+
+    // bump wait index: trip id, stop sequence, stop id
+    pyo             = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo == NULL) return NULL;
+    int* bw_index = (int*)PyArray_DATA(pyo);
+    int num_bw    = PyArray_DIMS(pyo)[0];
+    assert(3 == PyArray_DIMS(pyo)[1]);
+
+    // bump wait data: arrival time, or negative to remove
+    pyo             = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_DOUBLE, 1, 1);
+    if (pyo == NULL) return NULL;
+    double* bw_times= (double*)PyArray_DATA(pyo);
+    int num_times   = PyArray_DIMS(pyo)[0];
+    assert(num_times == num_bw);
+
+    pathfinder.updateBumpWait(bw_index, bw_times, num_bw);
+    Py_RETURN_NONE;
+}
+
+static void
+_fasttrips_free_results(PyObject *capsule)
+{
+    delete (std::shared_ptr<fasttrips::PathSetResults>*)PyCapsule_GetPointer(capsule, "fasttrips.PathSetResults");
+}
+
+/**
+ * Wraps one of the column-major blocks of a fasttrips::PathSetResults as a Fortran-ordered numpy array, without copying.
+ * The array holds a reference to the capsule that owns the results, so they're freed when the last array goes.
+ */
+static PyObject *
+_fasttrips_results_array(PyObject *capsule, void *data, npy_intp num_rows, int num_cols, int typenum)
+{
+    npy_intp dims[2] = { num_rows, num_cols };
+    PyObject *arr = PyArray_New(&PyArray_Type, 2, dims, typenum, NULL, data, 0, NPY_ARRAY_FARRAY, NULL);
+    if (arr == NULL) { return NULL; }
+    Py_INCREF(capsule);
+    if (PyArray_SetBaseObject((PyArrayObject*)arr, capsule) < 0) {
+        Py_DECREF(arr);
+        return NULL;
+    }
+    return arr;
+}
+
+/**
+ * Hands the given results to python as (ret_int, ret_double, ret_paths) arrays that share its memory.
+ * The arrays share ownership of results.  Returns false (with the python error set) on failure.
+ */
+static bool
+_fasttrips_results_to_arrays(const std::shared_ptr<fasttrips::PathSetResults>& results, PyObject **ret_int, PyObject **ret_double, PyObject **ret_paths)
+{
+    std::shared_ptr<fasttrips::PathSetResults> *owner = new std::shared_ptr<fasttrips::PathSetResults>(results);
+    PyObject *capsule = PyCapsule_New(owner, "fasttrips.PathSetResults", _fasttrips_free_results);
+    if (capsule == NULL) {
+        delete owner;
+        return false;
+    }
+    *ret_int    = _fasttrips_results_array(capsule, results->linkInts(),    results->numLinks(), fasttrips::NUM_LINK_INT_COLUMNS,    NPY_INT32);
+    *ret_double = _fasttrips_results_array(capsule, results->linkDoubles(), results->numLinks(), fasttrips::NUM_LINK_DOUBLE_COLUMNS, NPY_DOUBLE);
+    *ret_paths  = _fasttrips_results_array(capsule, results->pathDoubles(), results->numPaths(), fasttrips::NUM_PATH_DOUBLE_COLUMNS, NPY_DOUBLE);
+    // the arrays have their own references now
+    Py_DECREF(capsule);
+    if ((*ret_int == NULL) || (*ret_double == NULL) || (*ret_paths == NULL)) {
+        Py_XDECREF(*ret_int);
+        Py_XDECREF(*ret_double);
+        Py_XDECREF(*ret_paths);
+        return false;
+    }
+    return true;
+}
+
 static PyObject *
 _fasttrips_find_pathset(PyObject *self, PyObject *args)
 {
@@ -137,75 +273,368 @@ _fasttrips_find_pathset(PyObject *self, PyObject *args)
     path_spec.access_mode_    = access_mode;
     path_spec.transit_mode_   = transit_mode;
     path_spec.egress_mode_    = egress_mode;
+    if (query_record) { fasttrips::writeCorpusQuery(*query_record, path_spec); }
 
     fasttrips::PathSet pathset;
-    fasttrips::PerformanceInfo perf_info = { 0, 0, 0, 0, 0, 0};
-    int pf_returnstatus = pathfinder.findPathSet(path_spec, pathset, perf_info);
-
-    // count links
-    int num_links = 0;
-    for (fasttrips::PathSet::const_iterator psi=pathset.begin(); psi != pathset.end(); ++psi) {
-        num_links += (int)psi->first.size();
-    }
-
-    // package for returning.  We'll separate ints and doubles.
-    npy_intp dims_int[2];
-    dims_int[0] = num_links;
-    dims_int[1] = 7; // path_num, stop_id, deparr_mode_, trip_id_, stop_succpred_, seq_, seq_succpred_
-    PyArrayObject *ret_int = (PyArrayObject *)PyArray_SimpleNew(2, dims_int, NPY_INT32);
-
-    npy_intp dims_double[2];
-    dims_double[0] = num_links;
-    dims_double[1] = 8; // label_, deparr_time_, link_time_, link_cost_, link_dist_, cost_, arrdep_time_
-    PyArrayObject *ret_double = (PyArrayObject *)PyArray_SimpleNew(2, dims_double, NPY_DOUBLE);
-
-    // cost, fare, probability, initial cost, initial fare
-    npy_intp dims_paths[2];
-    dims_paths[0] = pathset.size();
-    dims_paths[1] = 5;
-    PyArrayObject *ret_paths = (PyArrayObject*)PyArray_SimpleNew(2, dims_paths, NPY_DOUBLE);
-
-    int ind      = 0;
-    int path_num = 0;
-    for (fasttrips::PathSet::const_iterator psi=pathset.begin(); psi != pathset.end(); ++psi) {
-        const fasttrips::Path& path = psi->first;
-
-        *(npy_double*)PyArray_GETPTR2(ret_paths, path_num, 0) = path.cost();
-        *(npy_double*)PyArray_GETPTR2(ret_paths, path_num, 1) = path.fare();
-        *(npy_double*)PyArray_GETPTR2(ret_paths, path_num, 2) = psi->second.probability_;
-        *(npy_double*)PyArray_GETPTR2(ret_paths, path_num, 3) = path.initialCost();
-        *(npy_double*)PyArray_GETPTR2(ret_paths, path_num, 4) = path.initialFare();
-
-        for (int link_num = 0; link_num < path.size(); ++link_num) {
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 0) = path_num;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 1) = path[link_num].first;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 2) = path[link_num].second.deparr_mode_;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 3) = path[link_num].second.trip_id_;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 4) = path[link_num].second.stop_succpred_;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 5) = path[link_num].second.seq_;
-            *(npy_int32*)PyArray_GETPTR2(ret_int, ind, 6) = path[link_num].second.seq_succpred_;
-
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 0) = 0.0; // TODO: label
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 1) = path[link_num].second.deparr_time_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 2) = path[link_num].second.link_time_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 3) = path[link_num].second.link_fare_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 4) = path[link_num].second.link_cost_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 5) = path[link_num].second.link_dist_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 6) = path[link_num].second.cost_;
-            *(npy_double*)PyArray_GETPTR2(ret_double, ind, 7) = path[link_num].second.arrdep_time_;
-
-            ind += 1;
-        }
-        path_num += 1;
+    fasttrips::PerformanceInfo perf_info = { 0, 0, 0, 0, 0, 0, 0};
+    int pf_returnstatus = pathfinder.findPathSet(path_spec, pathset, perf_info, single_query_stop_states);
+    // the trace files are written in the background; make sure they're complete before python looks at them
+    if (path_spec.trace_) { fasttrips::TraceSink::instance().flush(); }
+
+    // package for returning.  The arrays are views on the results' columns.
+    std::shared_ptr<fasttrips::PathSetResults> results(new fasttrips::PathSetResults());
+    results->build(pathset);
+    PyObject *ret_int, *ret_double, *ret_paths;
+    if (!_fasttrips_results_to_arrays(results, &ret_int, &ret_double, &ret_paths)) { return NULL; }
+
+    // the hot path counters, indexed by fasttrips::QueryCounter
+    npy_intp dims_counters[1] = { fasttrips::NUM_QUERY_COUNTERS };
+    PyArrayObject *ret_counters = (PyArrayObject *)PyArray_SimpleNew(1, dims_counters, NPY_INT64);
+    for (int counter = 0; counter < fasttrips::NUM_QUERY_COUNTERS; ++counter) {
+        *(npy_int64*)PyArray_GETPTR1(ret_counters, counter) = perf_info.counters_.counts_[counter];
     }
 
-    PyObject *returnobj = Py_BuildValue("(OOOiiiiilllll)",ret_int,ret_double,ret_paths, pathfinder.processNumber(), pf_returnstatus,
+    PyObject *returnobj = Py_BuildValue("(NNNiiiiillllliiN)",ret_int,ret_double,ret_paths, pathfinder.processNumber(), pf_returnstatus,
                                         perf_info.label_iterations_, perf_info.num_labeled_stops_, perf_info.max_process_count_,
                                         perf_info.milliseconds_labeling_, perf_info.milliseconds_enumerating_,
-                                        perf_info.workingset_bytes_, perf_info.privateusage_bytes_, perf_info.mem_timestamp_);
+                                        perf_info.workingset_bytes_, perf_info.privateusage_bytes_, perf_info.mem_timestamp_,
+                                        perf_info.num_pruned_states_, perf_info.label_cache_hit_, ret_counters);
     return returnobj;
 }
 
+/**
+ * Find path sets for a batch of person trips, spreading them over a pool of threads which all
+ * share the (read-only during path finding) global pathfinder.  The GIL is released while they run.
+ *
+ * Arguments are:
+ * - number of threads (less than 1 means use the hardware concurrency)
+ * - path spec ints, Nx7 int32: iteration, pathfinding_iteration, hyperpath, origin_taz_id, destination_taz_id, outbound, trace
+ * - path spec doubles, Nx2 double: preferred_time, value_of_time
+ * - path spec strings, sequence of N tuples: (person_id, person_trip_id, user_class, purpose, access_mode, transit_mode, egress_mode)
+ * - optionally, the group labeling time bucket in minutes.  If it's not negative, path specs that label identically
+ *   (see fasttrips::LabelingSignatureCompare) are labeled once per group with fasttrips::PathFinder::findPathSetGroup().
+ *   Traced path specs are always labeled on their own.  Defaults to -1, labeling each path spec.
+ * - optionally, N predicted costs (any unit, e.g. microseconds in the last iteration) or None.  If given, the most
+ *   expensive groups (by the sum of their path specs' costs) are handed out first; see fasttrips::WorkStealingPool.
+ *
+ * Returns (ret_int, ret_double, ret_paths, ret_perf, process number, ret_workers) where ret_int, ret_double and ret_paths
+ * are the same as for find_pathset(), concatenated in batch order.  Those three are Fortran-ordered views on one
+ * fasttrips::PathSetResults buffer, so nothing is copied and each column is contiguous.  ret_perf is
+ * Nx(14+fasttrips::NUM_QUERY_COUNTERS) int64, with columns pathfinding status, label iterations, num labeled stops,
+ * max process count, milliseconds labeling, milliseconds enumerating, working set bytes, private usage bytes, mem timestamp,
+ * number of paths, number of links, num pruned states, label cache hit, worker thread number, then the fasttrips::QueryCounter
+ * counters in order.  The number of paths and links are for slicing the concatenated results back into the individual path sets.
+ * ret_workers is (number of threads)x3 int64, with each thread's tasks run, microseconds busy and microseconds until it
+ * ran out of tasks; see fasttrips::WorkStealingPool::WorkerStats.
+ */
+static PyObject *
+_fasttrips_find_pathsets_batch(PyObject *self, PyObject *args)
+{
+    int       num_threads;
+    PyObject *input1, *input2, *input3;
+    double    group_time_bucket = -1;
+    PyObject *input4 = Py_None;
+    if (!PyArg_ParseTuple(args, "iOOO|dO", &num_threads, &input1, &input2, &input3, &group_time_bucket, &input4)) {
+        return NULL;
+    }
+
+    PyArrayObject *pyo_ints = (PyArrayObject*)PyArray_ContiguousFromObject(input1, NPY_INT32, 2, 2);
+    if (pyo_ints == NULL) return NULL;
+    PyArrayObject *pyo_doubles = (PyArrayObject*)PyArray_ContiguousFromObject(input2, NPY_DOUBLE, 2, 2);
+    if (pyo_doubles == NULL) { Py_DECREF(pyo_ints); return NULL; }
+    PyObject *seq_strs = PySequence_Fast(input3, "find_pathsets_batch: path spec strings must be a sequence");
+    if (seq_strs == NULL) { Py_DECREF(pyo_ints); Py_DECREF(pyo_doubles); return NULL; }
+
+    int num_specs = (int)PyArray_DIMS(pyo_ints)[0];
+    if ((PyArray_DIMS(pyo_ints)[1] != 7) || (PyArray_DIMS(pyo_doubles)[1] != 2) ||
+        (PyArray_DIMS(pyo_doubles)[0] != num_specs) || (PySequence_Fast_GET_SIZE(seq_strs) != num_specs)) {
+        PyErr_SetString(pyError, "find_pathsets_batch: path spec arrays must be Nx7 int, Nx2 double and N string tuples");
+        Py_DECREF(pyo_ints); Py_DECREF(pyo_doubles); Py_DECREF(seq_strs);
+        return NULL;
+    }
+
+    // build the path specifications while we still have the GIL
+    std::vector<fasttrips::PathSpecification> path_specs(num_specs);
+    int*    spec_ints    = (int*)PyArray_DATA(pyo_ints);
+    double* spec_doubles = (double*)PyArray_DATA(pyo_doubles);
+    for (int i = 0; i < num_specs; ++i) {
+        fasttrips::PathSpecification& path_spec = path_specs[i];
+        char *person_id, *person_trip_id, *user_class, *purpose, *access_mode, *transit_mode, *egress_mode;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq_strs, i), "sssssss", &person_id, &person_trip_id,
+                              &user_class, &purpose, &access_mode, &transit_mode, &egress_mode)) {
+            Py_DECREF(pyo_ints); Py_DECREF(pyo_doubles); Py_DECREF(seq_strs);
+            return NULL;
+        }
+        path_spec.iteration_              = spec_ints[7*i];
+        path_spec.pathfinding_iteration_  = spec_ints[7*i+1];
+        path_spec.hyperpath_              = (spec_ints[7*i+2] != 0);
+        path_spec.origin_taz_id_          = spec_ints[7*i+3];
+        path_spec.destination_taz_id_     = spec_ints[7*i+4];
+        path_spec.outbound_               = (spec_ints[7*i+5] != 0);
+        path_spec.trace_                  = (spec_ints[7*i+6] != 0);
+        path_spec.preferred_time_         = spec_doubles[2*i];
+        path_spec.value_of_time_          = spec_doubles[2*i+1];
+        path_spec.person_id_              = person_id;
+        path_spec.person_trip_id_         = person_trip_id;
+        path_spec.user_class_             = user_class;
+        path_spec.purpose_                = purpose;
+        path_spec.access_mode_            = access_mode;
+        path_spec.transit_mode_           = transit_mode;
+        path_spec.egress_mode_            = egress_mode;
+        if (query_record) { fasttrips::writeCorpusQuery(*query_record, path_spec); }
+    }
+    Py_DECREF(pyo_ints);
+    Py_DECREF(pyo_doubles);
+    Py_DECREF(seq_strs);
+
+    std::vector<double> spec_costs;
+    if (input4 != Py_None) {
+        PyArrayObject *pyo_costs = (PyArrayObject*)PyArray_ContiguousFromObject(input4, NPY_DOUBLE, 1, 1);
+        if (pyo_costs == NULL) return NULL;
+        if ((int)PyArray_DIMS(pyo_costs)[0] != num_specs) {
+            PyErr_SetString(pyError, "find_pathsets_batch: predicted costs must have one per path spec");
+            Py_DECREF(pyo_costs);
+            return NULL;
+        }
+        double* costs = (double*)PyArray_DATA(pyo_costs);
+        spec_costs.assign(costs, costs + num_specs);
+        Py_DECREF(pyo_costs);
+    }
+
+    // path spec numbers that are labeled together, in batch order of their first path spec
+    std::vector< std::vector<int> > groups;
+    if (group_time_bucket < 0) {
+        groups.resize(num_specs, std::vector<int>(1));
+        for (int i = 0; i < num_specs; ++i) { groups[i][0] = i; }
+    } else {
+        std::map<fasttrips::PathSpecification, int, fasttrips::LabelingSignatureCompare> group_for_signature(
+            (fasttrips::LabelingSignatureCompare(group_time_bucket)));
+        for (int i = 0; i < num_specs; ++i) {
+            if (path_specs[i].trace_) {
+                groups.push_back(std::vector<int>(1, i));
+                continue;
+            }
+            std::pair<std::map<fasttrips::PathSpecification, int, fasttrips::LabelingSignatureCompare>::iterator, bool> inserted =
+                group_for_signature.insert(std::make_pair(path_specs[i], (int)groups.size()));
+            if (inserted.second) { groups.push_back(std::vector<int>()); }
+            groups[inserted.first->second].push_back(i);
+        }
+    }
+
+    std::vector<fasttrips::PathSet>         pathsets(num_specs);
+    std::vector<fasttrips::PerformanceInfo> perf_infos(num_specs);  // value-initialized to zeros
+    std::vector<int>                        pf_returnstatus(num_specs, -1);
+    std::vector<int>                        spec_thread(num_specs, 0);
+    std::vector<fasttrips::WorkStealingPool::WorkerStats> worker_stats;
+    std::string                             error_msg;
+
+    // a group costs what its path specs did
+    std::vector<double> group_costs;
+    if (!spec_costs.empty()) {
+        group_costs.resize(groups.size(), 0.0);
+        for (size_t group_num = 0; group_num < groups.size(); ++group_num) {
+            for (std::vector<int>::const_iterator spec_num = groups[group_num].begin(); spec_num != groups[group_num].end(); ++spec_num) {
+                group_costs[group_num] += spec_costs[*spec_num];
+            }
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        fasttrips::WorkStealingPool pool(num_threads);
+        // labeling memory for each thread, reused across that thread's queries
+        std::vector<fasttrips::StopStates> thread_stop_states(pool.numThreads());
+        pool.run((int)groups.size(), [&](int group_num, int thread_num) {
+            pathfinder.findPathSetGroup(path_specs, groups[group_num], pathsets, perf_infos, pf_returnstatus,
+                                        thread_stop_states[thread_num]);
+            for (std::vector<int>::const_iterator spec_num = groups[group_num].begin(); spec_num != groups[group_num].end(); ++spec_num) {
+                spec_thread[*spec_num] = thread_num;
+            }
+        }, group_costs.empty() ? NULL : &group_costs);
+        worker_stats = pool.workerStats();
+        // the trace files are written in the background; make sure they're complete before python looks at them
+        for (std::vector<fasttrips::PathSpecification>::const_iterator it = path_specs.begin(); it != path_specs.end(); ++it) {
+            if (it->trace_) { fasttrips::TraceSink::instance().flush(); break; }
+        }
+    }
+    catch (const std::exception& e) {
+        error_msg = e.what();
+        if (error_msg.empty()) { error_msg = "unknown error"; }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error_msg.empty()) {
+        PyErr_SetString(pyError, error_msg.c_str());
+        return NULL;
+    }
+
+    std::shared_ptr<fasttrips::PathSetResults> results(new fasttrips::PathSetResults());
+    results->build(pathsets);
+    // the path sets can go before we hand back the results
+    std::vector<fasttrips::PathSet>().swap(pathsets);
+
+    if (pathset_stream) {
+        fasttrips::PathSetChunk chunk;
+        chunk.iteration_             = num_specs > 0 ? path_specs[0].iteration_             : 0;
+        chunk.pathfinding_iteration_ = num_specs > 0 ? path_specs[0].pathfinding_iteration_ : 0;
+        chunk.pathfinding_status_    = pf_returnstatus;
+        chunk.results_               = results;
+        for (int i = 0; i < num_specs; ++i) {
+            chunk.person_ids_.push_back(path_specs[i].person_id_);
+            chunk.person_trip_ids_.push_back(path_specs[i].person_trip_id_);
+        }
+        // this waits if the flush thread is behind
+        Py_BEGIN_ALLOW_THREADS
+        pathset_stream->append(chunk);
+        Py_END_ALLOW_THREADS
+    }
+
+    npy_intp dims_perf[2]   = { num_specs, 14 + fasttrips::NUM_QUERY_COUNTERS };
+    PyArrayObject *ret_perf   = (PyArrayObject *)PyArray_SimpleNew(2, dims_perf,   NPY_INT64);
+    for (int i = 0; i < num_specs; ++i) {
+        const fasttrips::PerformanceInfo& perf_info = perf_infos[i];
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  0) = pf_returnstatus[i];
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  1) = perf_info.label_iterations_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  2) = perf_info.num_labeled_stops_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  3) = perf_info.max_process_count_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  4) = perf_info.milliseconds_labeling_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  5) = perf_info.milliseconds_enumerating_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  6) = perf_info.workingset_bytes_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  7) = perf_info.privateusage_bytes_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  8) = perf_info.mem_timestamp_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i,  9) = results->numPaths(i);
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i, 10) = results->numLinks(i);
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i, 11) = perf_info.num_pruned_states_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i, 12) = perf_info.label_cache_hit_;
+        *(npy_int64*)PyArray_GETPTR2(ret_perf, i, 13) = spec_thread[i];
+        for (int counter = 0; counter < fasttrips::NUM_QUERY_COUNTERS; ++counter) {
+            *(npy_int64*)PyArray_GETPTR2(ret_perf, i, 14+counter) = perf_info.counters_.counts_[counter];
+        }
+    }
+
+    npy_intp dims_workers[2] = { (npy_intp)worker_stats.size(), 3 };
+    PyArrayObject *ret_workers = (PyArrayObject *)PyArray_SimpleNew(2, dims_workers, NPY_INT64);
+    for (int thread_num = 0; thread_num < (int)worker_stats.size(); ++thread_num) {
+        *(npy_int64*)PyArray_GETPTR2(ret_workers, thread_num, 0) = worker_stats[thread_num].num_tasks_;
+        *(npy_int64*)PyArray_GETPTR2(ret_workers, thread_num, 1) = worker_stats[thread_num].busy_us_;
+        *(npy_int64*)PyArray_GETPTR2(ret_workers, thread_num, 2) = worker_stats[thread_num].finish_us_;
+    }
+
+    PyObject *ret_int, *ret_double, *ret_paths;
+    if (!_fasttrips_results_to_arrays(results, &ret_int, &ret_double, &ret_paths)) {
+        Py_DECREF(ret_perf);
+        Py_DECREF(ret_workers);
+        return NULL;
+    }
+    return Py_BuildValue("(NNNNiN)", ret_int, ret_double, ret_paths, ret_perf, pathfinder.processNumber(), ret_workers);
+}
+
+/**
+ * Starts streaming the results of find_pathsets_batch() to the given file.  See fasttrips::PathSetStreamWriter.
+ *
+ * Arguments are the filename and the maximum number of batches to hold in memory waiting to be written.
+ */
+static PyObject *
+_fasttrips_open_pathset_stream(PyObject *self, PyObject *args)
+{
+    char *filename;
+    int   max_buffered_chunks;
+    if (!PyArg_ParseTuple(args, "si", &filename, &max_buffered_chunks)) {
+        return NULL;
+    }
+    if (pathset_stream) { pathset_stream->close(); }
+    pathset_stream.reset(new fasttrips::PathSetStreamWriter(filename, max_buffered_chunks));
+    if (!pathset_stream->isOpen()) {
+        pathset_stream.reset();
+        PyErr_Format(PyExc_IOError, "Failed to open pathset stream %s", filename);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * Writes the remaining batches and closes the pathset stream, if it's open.
+ */
+static PyObject *
+_fasttrips_close_pathset_stream(PyObject *self, PyObject *args)
+{
+    if (!pathset_stream) { Py_RETURN_NONE; }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = pathset_stream->close();
+    Py_END_ALLOW_THREADS
+    pathset_stream.reset();
+    if (!ok) {
+        PyErr_SetString(PyExc_IOError, "Failed to write pathset stream");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * Starts recording the queries made with find_pathset() and find_pathsets_batch() to a query corpus
+ * (see query_corpus.h), for replaying with src/bench/pathfinder_bench.cpp.  Call this after the parameters,
+ * supply and bump wait are set, since those are written first.
+ *
+ * The argument is the filename.
+ */
+static PyObject *
+_fasttrips_open_query_record(PyObject *self, PyObject *args)
+{
+    char *filename;
+    if (!PyArg_ParseTuple(args, "s", &filename)) {
+        return NULL;
+    }
+    query_record.reset(new std::ofstream(filename));
+    if (!query_record->is_open()) {
+        query_record.reset();
+        PyErr_Format(PyExc_IOError, "Failed to open query record %s", filename);
+        return NULL;
+    }
+    pathfinder.writeQueryCorpusHeader(*query_record);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Closes the query record, if it's open.
+ */
+static PyObject *
+_fasttrips_close_query_record(PyObject *self, PyObject *args)
+{
+    if (!query_record) { Py_RETURN_NONE; }
+    query_record->close();
+    bool ok = !query_record->fail();
+    query_record.reset();
+    if (!ok) {
+        PyErr_SetString(PyExc_IOError, "Failed to write query record");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+_fasttrips_write_snapshot(PyObject *self, PyObject *args)
+{
+    // call after initialize_supply
+    if (!pathfinder.writeSnapshot()) {
+        PyErr_SetString(PyExc_IOError, "Failed to write network snapshot");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+_fasttrips_set_process_number(PyObject *self, PyObject *args)
+{
+    // for worker processes forked after initialize_supply; they have the supply already
+    int proc_num;
+    if (!PyArg_ParseTuple(args, "i", &proc_num)) {
+        return NULL;
+    }
+    pathfinder.setProcessNumber(proc_num);
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 _fasttrips_reset(PyObject *self, PyObject *args)
 {
@@ -217,8 +646,17 @@ _fasttrips_reset(PyObject *self, PyObject *args)
 static PyMethodDef fasttripsMethods[] = {
     {"initialize_parameters",   _fasttrips_initialize_parameters, METH_VARARGS, "Initialize path finding parameters" },
     {"initialize_supply",       _fasttrips_initialize_supply,     METH_VARARGS, "Initialize network supply" },
+    {"update_stop_times",       _fasttrips_update_stop_times,     METH_VARARGS, "Update changed stop times in place" },
+    {"set_process_number",      _fasttrips_set_process_number,    METH_VARARGS, "Set the process number of a worker forked with the supply" },
     {"set_bump_wait",           _fasttrips_set_bump_wait,         METH_VARARGS, "Update bump wait"          },
+    {"update_bump_wait",        _fasttrips_update_bump_wait,      METH_VARARGS, "Update changed bump waits in place" },
     {"find_pathset",            _fasttrips_find_pathset,          METH_VARARGS, "Find trip-based path set"  },
+    {"find_pathsets_batch",     _fasttrips_find_pathsets_batch,   METH_VARARGS, "Find trip-based path sets for a batch of trips using threads" },
+    {"write_snapshot",          _fasttrips_write_snapshot,        METH_VARARGS, "Write the network supply to a binary snapshot" },
+    {"open_pathset_stream",     _fasttrips_open_pathset_stream,   METH_VARARGS, "Start streaming batch path sets to a file" },
+    {"close_pathset_stream",    _fasttrips_close_pathset_stream,  METH_VARARGS, "Finish streaming batch path sets" },
+    {"open_query_record",       _fasttrips_open_query_record,     METH_VARARGS, "Start recording path finding queries to a corpus" },
+    {"close_query_record",      _fasttrips_close_query_record,    METH_VARARGS, "Finish recording path finding queries" },
     {"reset",                   _fasttrips_reset,                 METH_VARARGS, "Reset pathfinder - done"   },
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
@@ -0,0 +1,128 @@
+/**
+ * \file flat_map.h
+ *
+ * Defines sorted-vector replacements for the std::map and std::multimap used to hold the links in a Hyperlink.
+ *
+ * Link sets are small and are rebuilt for every query, so node-based containers spend most of their time
+ * allocating and freeing nodes.  These keep their elements in one contiguous vector whose capacity survives
+ * clear(), so a reused container stops allocating once it's warm.  Iteration order is the same as the
+ * std counterparts (including insertion order among equal keys in the multimap), so results don't change.
+ *
+ * Only the parts of the std interface the path finder uses are here.  Unlike the std containers,
+ * inserting or erasing invalidates iterators and references to other elements.
+ */
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+namespace fasttrips {
+
+    /// Compares vector elements by key, for the binary searches.
+    template <typename K, typename V>
+    struct FlatKeyCompare {
+        bool operator()(const std::pair<K,V>& elem, const K& key) const { return elem.first < key; }
+        bool operator()(const K& key, const std::pair<K,V>& elem) const { return key < elem.first; }
+    };
+
+    /**
+     * A map from K to V stored as a vector of pairs sorted by key.  Keys are unique.
+     */
+    template <typename K, typename V>
+    class FlatMap
+    {
+    public:
+        typedef std::pair<K,V>                          value_type;
+        typedef typename std::vector<value_type>::iterator        iterator;
+        typedef typename std::vector<value_type>::const_iterator  const_iterator;
+
+    private:
+        std::vector<value_type> elems_;
+
+    public:
+        iterator       begin()       { return elems_.begin(); }
+        iterator       end()         { return elems_.end();   }
+        const_iterator begin() const { return elems_.begin(); }
+        const_iterator end()   const { return elems_.end();   }
+
+        size_t size()  const { return elems_.size();  }
+        bool   empty() const { return elems_.empty(); }
+        /// Removes all the elements but keeps the capacity
+        void   clear()       { elems_.clear(); }
+
+        iterator find(const K& key) {
+            iterator it = std::lower_bound(elems_.begin(), elems_.end(), key, FlatKeyCompare<K,V>());
+            if ((it == elems_.end()) || (key < it->first)) { return elems_.end(); }
+            return it;
+        }
+        const_iterator find(const K& key) const {
+            const_iterator it = std::lower_bound(elems_.begin(), elems_.end(), key, FlatKeyCompare<K,V>());
+            if ((it == elems_.end()) || (key < it->first)) { return elems_.end(); }
+            return it;
+        }
+
+        /// Inserts the value if the key isn't here yet.  Returns the element with that key and true iff it was inserted.
+        std::pair<iterator, bool> insert(const value_type& value) {
+            iterator it = std::lower_bound(elems_.begin(), elems_.end(), value.first, FlatKeyCompare<K,V>());
+            if ((it != elems_.end()) && !(value.first < it->first)) { return std::make_pair(it, false); }
+            return std::make_pair(elems_.insert(it, value), true);
+        }
+
+        /// Returns the value for the given key, inserting a default one if it's not here.
+        V& operator[](const K& key) {
+            return insert(value_type(key, V())).first->second;
+        }
+
+        /// Erases the element with the given key.  Returns the number erased.
+        size_t erase(const K& key) {
+            iterator it = find(key);
+            if (it == elems_.end()) { return 0; }
+            elems_.erase(it);
+            return 1;
+        }
+    };
+
+    /**
+     * A multimap from K to V stored as a vector of pairs sorted by key.  Elements with equal keys
+     * are kept in insertion order.
+     */
+    template <typename K, typename V>
+    class FlatMultimap
+    {
+    public:
+        typedef std::pair<K,V>                          value_type;
+        typedef typename std::vector<value_type>::iterator        iterator;
+        typedef typename std::vector<value_type>::const_iterator  const_iterator;
+
+    private:
+        std::vector<value_type> elems_;
+
+    public:
+        iterator       begin()       { return elems_.begin(); }
+        iterator       end()         { return elems_.end();   }
+        const_iterator begin() const { return elems_.begin(); }
+        const_iterator end()   const { return elems_.end();   }
+
+        size_t size()  const { return elems_.size();  }
+        bool   empty() const { return elems_.empty(); }
+        /// Removes all the elements but keeps the capacity
+        void   clear()       { elems_.clear(); }
+
+        /// Inserts after any elements with an equal key, like std::multimap.
+        iterator insert(const value_type& value) {
+            iterator it = std::upper_bound(elems_.begin(), elems_.end(), value.first, FlatKeyCompare<K,V>());
+            return elems_.insert(it, value);
+        }
+
+        std::pair<iterator, iterator> equal_range(const K& key) {
+            return std::equal_range(elems_.begin(), elems_.end(), key, FlatKeyCompare<K,V>());
+        }
+
+        void erase(iterator it) { elems_.erase(it); }
+    };
+}
+
+#endif
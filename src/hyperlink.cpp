@@ -9,6 +9,7 @@
 
 #include <Python.h>
 #include <math.h>
+#include <algorithm>
 #include <ios>
 #include <iostream>
 #include <iomanip>
@@ -62,6 +63,56 @@ namespace fasttrips {
         this->clear(false);
     }
 
+    LowCostLabel::LowCostLabel(int stop_id, const StopStateKey& ssk, double cost) :
+        parent_(-1), stop_id_(stop_id), ssk_(ssk), cost_(cost), last_fare_period_(NULL), num_fare_periods_(0)
+    {}
+
+    LowCostLabel::LowCostLabel(const LowCostLabel& parent, int parent_index, int stop_id, const StopStateKey& ssk, double link_cost) :
+        LowCostLabel(parent)
+    {
+        parent_  = parent_index;
+        stop_id_ = stop_id;
+        ssk_     = ssk;
+        cost_   += link_cost;
+    }
+
+    void LowCostLabel::addBoard(const FarePeriod* fare_period)
+    {
+        last_fare_period_ = fare_period;
+        for (int fp_num = 0; fp_num < num_fare_periods_; ++fp_num) {
+            if (board_fare_periods_[fp_num]->fare_period_num_ == fare_period->fare_period_num_) {
+                if (boards_[fp_num] < 255) { boards_[fp_num] += 1; }
+                return;
+            }
+        }
+        if (num_fare_periods_ == MAX_LABEL_FARE_PERIODS) { return; }
+        board_fare_periods_[num_fare_periods_] = fare_period;
+        boards_[num_fare_periods_]             = 1;
+        num_fare_periods_++;
+    }
+
+    int LowCostLabel::boardsForFarePeriod(int fare_period_num) const
+    {
+        for (int fp_num = 0; fp_num < num_fare_periods_; ++fp_num) {
+            if (board_fare_periods_[fp_num]->fare_period_num_ == fare_period_num) { return boards_[fp_num]; }
+        }
+        return 0;
+    }
+
+    // Make this an empty hyperlink for the given stop, keeping the link set capacity
+    void Hyperlink::reset(int stop_id, bool outbound)
+    {
+        stop_id_ = stop_id;
+        this->clear(true);
+        this->clear(false);
+
+        // as the LinkSet constructor leaves them
+        linkset_trip_.hyperpath_cost_    = MAX_COST;
+        linkset_nontrip_.hyperpath_cost_ = MAX_COST;
+        linkset_trip_.process_count_     = 0;
+        linkset_nontrip_.process_count_  = 0;
+    }
+
     // Remove the given stop state from cost_map_
     void Hyperlink::removeFromCostMap(const StopStateKey& ssk, const StopState& ss)
     {
@@ -118,6 +169,7 @@ namespace fasttrips {
     void Hyperlink::updateLowCostPath(
         const StopStateKey& ssk,
         const Hyperlink* prev_link,
+        StopStates& stop_states,
         std::ostream& trace_file,
         const PathSpecification& path_spec,
         const PathFinder& pf)
@@ -130,10 +182,9 @@ namespace fasttrips {
         if (( path_spec.outbound_ && ssk.deparr_mode_ == MODE_EGRESS) ||
             (!path_spec.outbound_ && ssk.deparr_mode_ == MODE_ACCESS))
         {
-            if (ss.low_cost_path_ != NULL) { std::cerr << "updateLowCostPath error1" << std::endl; return; }
+            if (ss.low_cost_label_ >= 0) { std::cerr << "updateLowCostPath error1" << std::endl; return; }
             // initialize it
-            ss.low_cost_path_ = new Path(path_spec.outbound_, false); // labeling, not enumerating
-            ss.low_cost_path_->addLink(stop_id_, ss, trace_file, path_spec, pf);
+            ss.low_cost_label_ = stop_states.addLowCostLabel(LowCostLabel(stop_id_, ssk, ss.link_cost_));
             return;
         }
 
@@ -141,35 +192,33 @@ namespace fasttrips {
         if (prev_link == NULL) { std::cerr << "updateLowCostPath error2" << std::endl; return; }
 
         // pull trips (for non-trip links) or non-trips for trip links
+        // The candidate cost is just additive; Path::calculateCost() on the rebuilt path has the fare transfer details.
+        int    best_parent = -1;
+        double best_cost   = 0;
         const StopStateMap& prev_link_map = prev_link->getStopStateMap(!isTrip(ssk.deparr_mode_));
         for (StopStateMap::const_iterator it = prev_link_map.begin(); it != prev_link_map.end(); ++it)
         {
-            const StopStateKey& prev_ssk = it->first;
-            const StopState&    prev_ss  = it->second;
-
-            if (prev_ss.low_cost_path_ == NULL) { continue; }
+            const StopState& prev_ss = it->second;
+            if (prev_ss.low_cost_label_ < 0) { continue; }
 
-            Path path_candidate = *(prev_ss.low_cost_path_);
-            // we shouldn't add a non-start state onto an empty path
-            if (path_candidate.size() == 0) { continue; }
-            bool feasible = path_candidate.addLink(stop_id_, ss, trace_file, path_spec, pf);
-            if (!feasible) { continue; }
-
-            // todo -- make this unnecessary?  if additive then the path.addLink() could take care of costs properly
-            path_candidate.calculateCost(trace_file, path_spec, pf, true);
-
-            if (path_spec.trace_) {
-                trace_file << "Path candidate cost " << path_candidate.cost();
-                trace_file << " compared to current cost " << (ss.low_cost_path_ ? ss.low_cost_path_->cost() : -999) << std::endl;
-                path_candidate.print(trace_file, path_spec, pf);
+            double candidate_cost = stop_states.lowCostLabel(prev_ss.low_cost_label_).cost_ + ss.link_cost_;
+            if ((best_parent < 0) || (candidate_cost < best_cost)) {
+                best_parent = prev_ss.low_cost_label_;
+                best_cost   = candidate_cost;
             }
+        }
+        if (best_parent < 0) { return; }
 
-            // keep it?
-            if (ss.low_cost_path_ == NULL) {
-                ss.low_cost_path_ = new Path(path_candidate);
-            } else if (ss.low_cost_path_->cost() > path_candidate.cost()) {
-                *ss.low_cost_path_ = path_candidate;
-            }
+        if (path_spec.trace_) {
+            trace_file << "Path candidate cost " << best_cost;
+            trace_file << " compared to current cost " << (ss.low_cost_label_ >= 0 ? stop_states.lowCostLabel(ss.low_cost_label_).cost_ : -999) << std::endl;
+        }
+
+        // keep it?  Labels are never changed in place since other paths may go through them.
+        if ((ss.low_cost_label_ < 0) || (stop_states.lowCostLabel(ss.low_cost_label_).cost_ > best_cost)) {
+            LowCostLabel label(stop_states.lowCostLabel(best_parent), best_parent, stop_id_, ssk, ss.link_cost_);
+            if (ss.fare_period_) { label.addBoard(ss.fare_period_); }
+            ss.low_cost_label_ = stop_states.addLowCostLabel(label);
         }
     }
 
@@ -192,34 +241,52 @@ namespace fasttrips {
         return linkset.stop_state_map_;
     }
 
-    // Accessor for the low cost path
-    const Path* Hyperlink::getLowCostPath(bool of_trip_links) const
+    // Rebuild the low cost path
+    bool Hyperlink::getLowCostPath(
+        bool of_trip_links,
+        const StopStates& stop_states,
+        Path& path,
+        std::ostream& trace_file,
+        const PathSpecification& path_spec,
+        const PathFinder& pf) const
     {
-        const Path* low_cost_path = NULL;
-        double low_cost = 0;
+        int low_cost_label = -1;
 
         const LinkSet& linkset = (of_trip_links ? linkset_trip_ : linkset_nontrip_);
         for (StopStateMap::const_iterator it = linkset.stop_state_map_.begin(); it != linkset.stop_state_map_.end(); ++it)
         {
             const StopState& ss = it->second;
 
-            if (ss.low_cost_path_ == NULL) { continue; }
+            if (ss.low_cost_label_ < 0) { continue; }
 
-            if (low_cost_path == NULL) {
-                low_cost_path = ss.low_cost_path_;
-                low_cost      = ss.low_cost_path_->cost();
-                continue;
+            if ((low_cost_label < 0) ||
+                (stop_states.lowCostLabel(low_cost_label).cost_ > stop_states.lowCostLabel(ss.low_cost_label_).cost_)) {
+                low_cost_label = ss.low_cost_label_;
             }
+        }
+        if (low_cost_label < 0) { return false; }
 
-            if (low_cost_path->cost() > ss.low_cost_path_->cost()) {
-                low_cost_path = ss.low_cost_path_;
-                low_cost      = ss.low_cost_path_->cost();
-            }
+        // the labels go from this link back to the start; the path goes the other way
+        std::vector<int> chain;
+        for (int label_index = low_cost_label; label_index >= 0; label_index = stop_states.lowCostLabel(label_index).parent_) {
+            chain.push_back(label_index);
         }
+        for (std::vector<int>::const_reverse_iterator riter = chain.rbegin(); riter != chain.rend(); ++riter) {
+            const LowCostLabel& label = stop_states.lowCostLabel(*riter);
+            const Hyperlink* hyperlink = stop_states.find(label.stop_id_);
+            if (hyperlink == NULL) { return false; }
+
+            const StopStateMap& ssm = hyperlink->getStopStateMap(isTrip(label.ssk_.deparr_mode_));
+            StopStateMap::const_iterator ssm_iter = ssm.find(label.ssk_);
+            if ((ssm_iter == ssm.end()) || (ssm_iter->second.low_cost_label_ != *riter)) { return false; }
 
-        return low_cost_path;
+            if (!path.addLink(label.stop_id_, ssm_iter->second, trace_file, path_spec, pf)) { return false; }
+        }
+        path.calculateCost(trace_file, path_spec, pf, true);
+        return true;
     }
 
+    template <class Mode>
     bool Hyperlink::addLink(const StopState& ss, const Hyperlink* prev_link, bool& rejected,
                             std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf)
     {
@@ -230,7 +297,7 @@ namespace fasttrips {
         LinkSet& linkset = (isTrip(ssk.deparr_mode_) ? linkset_trip_ : linkset_nontrip_);
 
         // deterministic -- we only keep one, the low cost link
-        if (path_spec.hyperpath_ == false)
+        if (Mode::hyperpath_ == false)
         {
             // if the cost isn't better, reject
             if ((linkset.cost_map_.size() > 0) && (ss.cost_ >= linkset.cost_map_.begin()->first))
@@ -238,7 +305,7 @@ namespace fasttrips {
                 rejected = true;
 
                 // log it
-                if (path_spec.trace_) {
+                if (Mode::trace_) {
                     trace_file << "  + new ";
                     Hyperlink::printStopState(trace_file, stop_id_, ss, path_spec, pf);
                     trace_file << " (rejected)" << std::endl;
@@ -266,31 +333,29 @@ namespace fasttrips {
             linkset.cost_map_.insert (std::pair<double, StopStateKey>(ss.cost_,ssk));
 
             // log it
-            if (path_spec.trace_) {
+            if (Mode::trace_) {
                 trace_file << "  + new ";
                 Hyperlink::printStopState(trace_file, stop_id_, linkset.stop_state_map_[ssk], path_spec, pf);
                 trace_file << std::endl;
             }
 
-            // update low-cost path
-            // updateLowCostPath(ssk, prev_link, trace_file, path_spec, pf);
             return true;
         }
         // ========= now we have links in the hyperlink =========
 
         // don't apply window stuff to the last labeling link (access for outbound, egress for inbound)
         bool is_last_link = false;
-        if ( path_spec.outbound_ && (ss.deparr_mode_ == MODE_ACCESS)) { is_last_link = true; }
-        if (!path_spec.outbound_ && (ss.deparr_mode_ == MODE_EGRESS)) { is_last_link = true; }
+        if ( Mode::outbound_ && (ss.deparr_mode_ == MODE_ACCESS)) { is_last_link = true; }
+        if (!Mode::outbound_ && (ss.deparr_mode_ == MODE_EGRESS)) { is_last_link = true; }
 
         // is it too early (outbound) or too late (inbound)? => reject
         if ((!is_last_link) &&
-            (( path_spec.outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
-             (!path_spec.outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_ + TIME_WINDOW_)))) {
+            (( Mode::outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_ - TIME_WINDOW_)) ||
+             (!Mode::outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_ + TIME_WINDOW_)))) {
             rejected = true;
 
             // log it
-            if (path_spec.trace_) {
+            if (Mode::trace_) {
                 trace_file << "  + new ";
                 Hyperlink::printStopState(trace_file, stop_id_, ss, path_spec, pf);
                 trace_file << " (rejected)" << std::endl;
@@ -313,8 +378,8 @@ namespace fasttrips {
 
             // check if the window is updated -- this is a state update
             if ((!is_last_link) &&
-                (( path_spec.outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_)) ||
-                 (!path_spec.outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_))))
+                (( Mode::outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_)) ||
+                 (!Mode::outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_))))
             {
                 linkset.latest_dep_earliest_arr_  = ss.deparr_time_;
                 linkset.lder_ssk_                 = ssk;
@@ -341,13 +406,12 @@ namespace fasttrips {
             setupProbabilities(path_spec, trace_file, pf, isTrip(ssk.deparr_mode_));
 
             // log it
-            if (path_spec.trace_) {
+            if (Mode::trace_) {
                 trace_file << "  + new ";
                 Hyperlink::printStopState(trace_file, stop_id_, linkset.stop_state_map_[ssk], path_spec, pf);
                 trace_file << notes << std::endl;
             }
 
-            // updateLowCostPath(ssk, prev_link, trace_file, path_spec, pf);
             return update_state;
         }
 
@@ -361,12 +425,7 @@ namespace fasttrips {
         // update the cost
         linkset.sum_exp_cost_ -= exp(UTILS_CONVERSION_*-1.0*linkset.stop_state_map_[ssk].cost_/STOCH_DISPERSION_);
 
-        // we're replacing the stopstate so delete the old path
-        if (linkset.stop_state_map_[ssk].low_cost_path_) {
-            delete linkset.stop_state_map_[ssk].low_cost_path_;
-            linkset.stop_state_map_[ssk].low_cost_path_ = NULL;
-        }
-        // and the other state elements
+        // replace the state elements
         linkset.stop_state_map_[ssk] = ss;
         // stop_state_map_[ssk].iteration_ = old_iteration; // remove this
         linkset.sum_exp_cost_ += exp(UTILS_CONVERSION_*-1.0*ss.cost_/STOCH_DISPERSION_);
@@ -374,14 +433,14 @@ namespace fasttrips {
         // if the the latest_dep_earliest_arr_ were set to the previous value, we need to check
         if (linkset.lder_ssk_ == ssk)
         {
-            if (path_spec.trace_) { trace_file << "Resetting lder" << std::endl; }
+            if (Mode::trace_) { trace_file << "Resetting lder" << std::endl; }
             resetLatestDepartureEarliestArrival(isTrip(ssk.deparr_mode_), path_spec);
         }
 
         // check if the window is updated -- this is a state update
         if ((!is_last_link) &&
-            (( path_spec.outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_)) ||
-             (!path_spec.outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_))))
+            (( Mode::outbound_ && (ss.deparr_time_ > linkset.latest_dep_earliest_arr_)) ||
+             (!Mode::outbound_ && (ss.deparr_time_ < linkset.latest_dep_earliest_arr_))))
         {
             linkset.latest_dep_earliest_arr_  = ss.deparr_time_;
             linkset.lder_ssk_                 = ssk;
@@ -405,13 +464,12 @@ namespace fasttrips {
         setupProbabilities(path_spec, trace_file, pf, isTrip(ssk.deparr_mode_));
 
         // log it
-        if (path_spec.trace_) {
+        if (Mode::trace_) {
             trace_file << "  + new ";
             Hyperlink::printStopState(trace_file, stop_id_, linkset.stop_state_map_[ssk], path_spec, pf);
             trace_file << notes << std::endl;
         }
 
-        // updateLowCostPath(ssk, prev_link, trace_file, path_spec, pf);
         return update_state;
     }
 
@@ -421,16 +479,6 @@ namespace fasttrips {
 
         LinkSet& linkset = (of_trip_links ? linkset_trip_ : linkset_nontrip_);
 
-        // this memory needs to be freed
-        for (StopStateMap::iterator it = linkset.stop_state_map_.begin(); it != linkset.stop_state_map_.end(); ++it)
-        {
-            StopState& ss = it->second;
-            if (ss.low_cost_path_) {
-                delete ss.low_cost_path_;
-                ss.low_cost_path_ = NULL;
-            }
-        }
-
         linkset.stop_state_map_.clear();
         linkset.cost_map_.clear();
         linkset.sum_exp_cost_               = 0;
@@ -606,7 +654,7 @@ namespace fasttrips {
         ostr << "  ";
         ostr << std::setw(6) << std::setprecision(4) << std::fixed << std::setfill(' ') << ss.probability_;
         ostr << "  ";
-        ostr << std::setw(6) << ss.cum_prob_i_;
+        ostr << std::setw(6) << std::setprecision(4) << std::fixed << std::setfill(' ') << ss.cum_prob_;
         ostr << "  ";
         ostr << std::setw(25) << (ss.fare_period_ ? ss.fare_period_->fare_period_ : "");
     }
@@ -684,6 +732,7 @@ namespace fasttrips {
         }
 
         if (prune_keys.size() == 0) { return; }
+        countQuery(COUNT_LINKS_PRUNED, (long long)prune_keys.size());
 
         // window-pruning
         while (!prune_keys.empty()) {
@@ -696,19 +745,24 @@ namespace fasttrips {
             }
 
             removeFromCostMap(ssk, linkset.stop_state_map_[ssk]);
-            if (linkset.stop_state_map_[ssk].low_cost_path_) {
-                delete linkset.stop_state_map_[ssk].low_cost_path_;
-                linkset.stop_state_map_[ssk].low_cost_path_ = NULL;
-            }
             linkset.stop_state_map_.erase( ssk );
             prune_keys.pop();
         }
 
     }
 
+    /// Replaces each of the values with exp() of it.  This is a plain loop over contiguous doubles
+    /// so the compiler is free to vectorize it.
+    static void exponentiate(double* values, size_t num_values)
+    {
+        for (size_t idx = 0; idx < num_values; ++idx) {
+            values[idx] = exp(values[idx]);
+        }
+    }
+
     // Set up probabilities for the links in the hyperlink.
     // If path_so_far is passed, then uses that to update trip fares and costs
-    // Return the max cum probability for the linkset
+    // Return the number of links that can be chosen
     // Turn on verbose debug trace with DEBUG_PROBS
     int Hyperlink::setupProbabilities(const PathSpecification& path_spec, std::ostream& trace_file,
                                       const PathFinder& pf, bool trip_linkset,
@@ -723,33 +777,71 @@ namespace fasttrips {
             trace_file << std::endl;
         );
 
-        int    valid_links      = 0;
-        double sum_exp          = 0;
-        linkset.max_cum_prob_i_ = 0;
+        // reset
+        for (CostToStopState::iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter) {
+            StopState& ss   = linkset.stop_state_map_.find(iter->second)->second;
+            ss.probability_ = 0;
+            ss.cum_prob_    = -1; // this means invalid
+        }
 
         // for logging
         std::map<StopStateKey, std::string> ssk_log;
+        int valid_links = setupChoices(path_spec, trace_file, pf, trip_linkset, path_so_far, linkset.choices_,
+                                       path_spec.trace_ ? &ssk_log : NULL);
+
+        // keep them on the links, too
+        for (int idx = 0; idx < valid_links; ++idx) {
+            StopState& ss   = (linkset.stop_state_map_.begin() + linkset.choices_.choices_[idx])->second;
+            // a lone link is certain, but its probability_ has always been left at zero
+            if (valid_links > 1) { ss.probability_ = linkset.choices_.probabilities_[idx]; }
+            ss.cum_prob_    = linkset.choices_.cum_probs_[idx];
+            ss.link_fare_   = linkset.choices_.link_fares_[idx];
+            ss.link_cost_   = linkset.choices_.link_costs_[idx];
+        }
+
+        // ready to log
+        if ((path_spec.trace_) && (path_so_far != NULL)) {
+            for (CostToStopState::iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter) {
+                Hyperlink::printStopState(trace_file, stop_id_, linkset.stop_state_map_.find(iter->second)->second, path_spec, pf);
+                trace_file << " " << ssk_log[iter->second] << std::endl;
+            }
+        }
+        D_PROBS(
+            trace_file << "valid_links=" << valid_links << std::endl;
+        );
+
+        return valid_links;
+    }
+
+    int Hyperlink::setupChoices(const PathSpecification& path_spec, std::ostream& trace_file,
+                                const PathFinder& pf, bool trip_linkset,
+                                const Path* path_so_far, LinkChoices& choices,
+                                std::map<StopStateKey, std::string>* ssk_log) const
+    {
+        const LinkSet& linkset = (trip_linkset ? linkset_trip_ : linkset_nontrip_);
+        choices.clear();
+
         const std::pair<int, StopState>* last_trip = NULL;
         if (path_so_far) { last_trip = path_so_far->lastAddedTrip(); }
+        std::string xfer_type;
 
-
-        // Setup the probabilities
-        for (CostToStopState::iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter)
+        // Find the valid links.  cum_probs_ holds the exponents for now.
+        for (CostToStopState::const_iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter)
         {
-            const StopStateKey& ssk   = iter->second;
-            StopState&           ss   = linkset.stop_state_map_[ssk];
-            ssk_log[ssk]              = "";
+            const StopStateKey&          ssk  = iter->second;
+            StopStateMap::const_iterator ssi  = linkset.stop_state_map_.find(ssk);
+            const StopState&             ss   = ssi->second;
+            double link_fare                  = ss.link_fare_;
+            double link_cost                  = ss.link_cost_;
+            if (ssk_log) { (*ssk_log)[ssk] = ""; }
 
-            // reset
-            ss.probability_ = 0;
-            ss.cum_prob_i_  = -1; // this means invalid
+            // infinite cost is invalid
+            if (ss.cost_ >= fasttrips::MAX_COST) { continue; }
 
             // some checks if we have a previous link -- this will be a two-pass :p
             if (path_so_far != NULL)
             {
                 const StopState& prev_link = path_so_far->back().second;
-                // infinite cost is invalid
-                if (ss.cost_ >= fasttrips::MAX_COST) { continue; }
                 // outbound: we cannot depart before we arrive
                 if ( path_spec.outbound_ && ss.deparr_time_ < prev_link.arrdep_time_) { continue; }
                 // inbound: we cannot arrive after we depart
@@ -767,113 +859,118 @@ namespace fasttrips {
 
                         // for outbound, path enumeration goes forwards  so last_trip is the *previous* trip
                         // for inbound,  path enumeration goes backwards so last_trip is the *next* trip
-                        double link_fare_pre_update = ss.link_fare_;
-                        updateFare(path_spec, trace_file, pf, last_trip_fp, path_spec.outbound_, *path_so_far, ss, ssk_log[ssk]);
-                        if (fabs(link_fare_pre_update - ss.link_fare_) > 0.001) {
+                        StopState updated(ss);
+                        updateFare(path_spec, trace_file, pf, last_trip_fp, path_spec.outbound_, *path_so_far, updated,
+                                   ssk_log ? (*ssk_log)[ssk] : xfer_type);
+                        link_fare = updated.link_fare_;
+                        if (fabs(ss.link_fare_ - link_fare) > 0.001) {
                             // update the link          (60 min/hour)*(hours/vot currency)*(ivt_weight) x (currency)
-                            ss.link_cost_ = ss.link_cost_ + (60.0/path_spec.value_of_time_)*(ss.link_ivtwt_)*(ss.link_fare_-link_fare_pre_update);
+                            link_cost = ss.link_cost_ + (60.0/path_spec.value_of_time_)*(ss.link_ivtwt_)*(link_fare-ss.link_fare_);
                         }
                     }
                 }
-
-                // calculating denominator
-                ss.cum_prob_i_ = 0;
-                sum_exp += exp(UTILS_CONVERSION_*-1.0*ss.cost_/STOCH_DISPERSION_);
-                valid_links += 1;
-            }
-            else
-            {
-                // infinite cost
-                if (ss.cost_ >= fasttrips::MAX_COST) {
-                    // leave it as is -- invalid -- but still log it
-                }
-                else {
-                    // calculating denominator
-                    ss.cum_prob_i_ = 0;
-                    sum_exp += exp(UTILS_CONVERSION_*-1.0*ss.cost_/STOCH_DISPERSION_);
-                    valid_links += 1;
-                }
             }
+
+            choices.choices_.push_back((int)(ssi - linkset.stop_state_map_.begin()));
+            choices.cum_probs_.push_back(UTILS_CONVERSION_*-1.0*ss.cost_/STOCH_DISPERSION_);
+            choices.link_fares_.push_back(link_fare);
+            choices.link_costs_.push_back(link_cost);
         }
 
-        // fail -- nothing is valid
-        if (valid_links == 0) { return linkset.max_cum_prob_i_; }
+        size_t valid_links = choices.choices_.size();
+        choices.probabilities_.resize(valid_links);
 
-        // fail -- nothing is valid because costs are too big
-        if ((valid_links != 1) && (log(sum_exp) != log(sum_exp))) {
-            printf("infinity\n");
-            return linkset.max_cum_prob_i_;
+        if (valid_links == 1) {
+            // no need to exponentiate
+            choices.probabilities_[0] = 1.0;
+            choices.cum_probs_[0]     = 1.0;
         }
-
-        // fix up the probabilities
-        for (CostToStopState::iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter)
-        {
-            const StopStateKey& ssk   = iter->second;
-            StopState&           ss   = linkset.stop_state_map_[ssk];
-
-            if (ss.cum_prob_i_ == -1) {
-                // marked as invalid
-            } else if (valid_links == 1) {
-                ss.cum_prob_i_          = 1.0*fasttrips::INT_MULT;
-                linkset.max_cum_prob_i_ = ss.cum_prob_i_;
-            }
-            else {
-                ss.probability_ = exp(UTILS_CONVERSION_*-1.0*ss.cost_/STOCH_DISPERSION_) / sum_exp;
-                // this will be true if it's not a real number -- e.g. the denom was too small and we ended up doing 0/0
-                if (ss.probability_ != ss.probability_) {
-                    ss.probability_ = 0;
-                } else {
-                    int prob_i      = static_cast<int>(floor(fasttrips::INT_MULT*ss.probability_ + 0.5));
-                    // make cum_prob_i_ cumulative
-                    ss.cum_prob_i_          = linkset.max_cum_prob_i_ + prob_i;
-                    linkset.max_cum_prob_i_ = ss.cum_prob_i_;
-                }
-            //printf("probability,cum_prob_i, max_cum_prob_i: %2.6f %d %d",ss.probability_, ss.cum_prob_i_, linkset.max_cum_prob_i_);
-            //getchar();
+        else if (valid_links > 1) {
+            // calculating denominator
+            double* exp_costs = choices.cum_probs_.data();
+            exponentiate(exp_costs, valid_links);
+            double sum_exp = 0;
+            for (size_t idx = 0; idx < valid_links; ++idx) { sum_exp += exp_costs[idx]; }
+
+            // fail -- nothing is valid because costs are too big
+            if (log(sum_exp) != log(sum_exp)) {
+                printf("infinity\n");
+                valid_links = 0;
             }
 
-            // ready to log
-            if ((path_spec.trace_) && (path_so_far != NULL)) {
-                Hyperlink::printStopState(trace_file, stop_id_, ss, path_spec, pf);
-                trace_file << " " << ssk_log[ssk] << std::endl;
+            // make them cumulative probabilities
+            double cum_prob = 0;
+            for (size_t idx = 0; idx < valid_links; ++idx) {
+                double probability = exp_costs[idx] / sum_exp;
+                // this will be true if it's not a real number -- e.g. the denom was too small and we ended up doing 0/0
+                if (probability != probability) { probability = 0; }
+                cum_prob                     += probability;
+                choices.probabilities_[idx]   = probability;
+                exp_costs[idx]                = cum_prob;
             }
-        } // finish second pass
-        D_PROBS(
-            trace_file << "valid_links=" << valid_links << "; max_cum_prob_i=" << linkset.max_cum_prob_i_ << "; sum_exp=" << sum_exp << std::endl;
-        );
+            // fail -- nothing has any probability
+            if (cum_prob <= 0) { valid_links = 0; }
+        }
+        if (valid_links == 0) {
+            choices.clear();
+        }
+        return (int)valid_links;
+    }
 
-        return linkset.max_cum_prob_i_;
+    size_t Hyperlink::chooseLink(const LinkChoices& choices, const PathSpecification& path_spec,
+                                 std::ostream& trace_file, RandomNumberGenerator& rng)
+    {
+        // scale by the total in case the probabilities don't quite sum to 1
+        double random_num = rng.uniform() * choices.cum_probs_.back();
+        if (path_spec.trace_) { trace_file << "random_num " << random_num << std::endl; }
+
+        // the first link whose cumulative probability is past it; links with zero probability are never first
+        size_t choice = std::upper_bound(choices.cum_probs_.begin(), choices.cum_probs_.end(), random_num) - choices.cum_probs_.begin();
+        if (choice == choices.choices_.size()) { choice -= 1; }
+        return choice;
     }
 
     const StopState& Hyperlink::chooseState(
         const PathSpecification& path_spec,
         std::ostream& trace_file,
+        RandomNumberGenerator& rng,
         const StopState* prev_link) const
     {
         const LinkSet& linkset = (prev_link && !isTrip(prev_link->deparr_mode_) ? linkset_trip_ : linkset_nontrip_);
 
-        int random_num  = rand();
-        //printf("INIT: %d, ",random_num);
-        if (path_spec.trace_) { trace_file << "random_num " << random_num << " -> "; }
+        if (linkset.choices_.choices_.empty()) {
+            // shouldn't get here; setupProbabilities() found nothing to choose
+            printf("PathFinder::chooseState() This should never happen! person_id:[%s] person_trip_id:[%s]\n", path_spec.person_id_.c_str(), path_spec.person_trip_id_.c_str());
+            if (path_spec.trace_) { trace_file << "Fatal: PathFinder::chooseState() This should never happen!" << std::endl; }
+            return linkset.stop_state_map_.begin()->second;
+        }
 
-        // mod it by max prob
-        random_num = random_num % linkset.max_cum_prob_i_;
-        //printf("CUMPROB; NewRand: %d %d",linkset.max_cum_prob_i_,random_num);
-        //getchar();
-        if (path_spec.trace_) { trace_file << random_num << std::endl; }
+        size_t choice = chooseLink(linkset.choices_, path_spec, trace_file, rng);
+        return (linkset.stop_state_map_.begin() + linkset.choices_.choices_[choice])->second;
+    }
 
-        for (CostToStopState::const_iterator iter = linkset.cost_map_.begin(); iter != linkset.cost_map_.end(); ++iter)
-        {
-            const StopStateKey& ssk   = iter->second;
-            const StopState&     ss   = linkset.stop_state_map_.find(ssk)->second;
+    StopState Hyperlink::chooseState(
+        const PathSpecification& path_spec,
+        std::ostream& trace_file,
+        RandomNumberGenerator& rng,
+        bool trip_linkset,
+        const LinkChoices& choices) const
+    {
+        const LinkSet& linkset = (trip_linkset ? linkset_trip_ : linkset_nontrip_);
 
-            if (ss.cum_prob_i_ == 0) { continue; }
-            if (random_num <= ss.cum_prob_i_) { return ss; }
+        if (choices.choices_.empty()) {
+            // shouldn't get here; setupChoices() found nothing to choose
+            printf("PathFinder::chooseState() This should never happen! person_id:[%s] person_trip_id:[%s]\n", path_spec.person_id_.c_str(), path_spec.person_trip_id_.c_str());
+            return linkset.stop_state_map_.begin()->second;
         }
-        // shouldn't get here
-        printf("PathFinder::chooseState() This should never happen! person_id:[%s] person_trip_id:[%s]\n", path_spec.person_id_.c_str(), path_spec.person_trip_id_.c_str());
-        if (path_spec.trace_) { trace_file << "Fatal: PathFinder::chooseState() This should never happen!" << std::endl; }
-        return linkset.stop_state_map_.begin()->second;
+
+        size_t choice = chooseLink(choices, path_spec, trace_file, rng);
+        StopState ss((linkset.stop_state_map_.begin() + choices.choices_[choice])->second);
+        ss.probability_ = (choices.choices_.size() > 1) ? choices.probabilities_[choice] : 0;
+        ss.cum_prob_    = choices.cum_probs_[choice];
+        ss.link_fare_   = choices.link_fares_[choice];
+        ss.link_cost_   = choices.link_costs_[choice];
+        return ss;
     }
 
     void Hyperlink::collectFarePeriodProbabilities(
@@ -930,8 +1027,8 @@ namespace fasttrips {
         if (last_trip_fp)
         {
             // apply fare fare transfer rules
-            const FareTransfer* fare_transfer = pf.getFareTransfer(last_is_prev ? last_trip_fp->fare_period_ : this_fp->fare_period_,
-                                                                   last_is_prev ? this_fp->fare_period_ : last_trip_fp->fare_period_);
+            const FareTransfer* fare_transfer = pf.getFareTransfer(last_is_prev ? last_trip_fp->fare_period_num_ : this_fp->fare_period_num_,
+                                                                   last_is_prev ? this_fp->fare_period_num_ : last_trip_fp->fare_period_num_);
 
             if (fare_transfer) {
 
@@ -949,7 +1046,7 @@ namespace fasttrips {
         }
 
         // apply fare attribute-based free transfers
-        int fare_boardings = path_so_far.boardsForFarePeriod(this_fp->fare_period_);
+        int fare_boardings = path_so_far.boardsForFarePeriod(this_fp->fare_period_num_);
         //  there are free transfers and we've already have a boarding
         if ((this_fp->transfers_ > 0) &&             // there are free transfers
             (fare_boardings > 0) &&                  // we've already have a boarding
@@ -997,7 +1094,7 @@ namespace fasttrips {
         std::ostream& trace_file,
         const PathFinder& pf,
         const FarePeriod& fare_period,
-        const std::map<int, Hyperlink>& stop_states) const
+        const StopStates& stop_states) const
     {
         // if we opted not to do this through configuration, just return the fare
         if (Hyperlink::TRANSFER_FARE_IGNORE_PATHFINDING_) {
@@ -1021,7 +1118,7 @@ namespace fasttrips {
                 // this is a transfer we may have used
                 // we have to look at the trips that feed into it
                 int stop_succpred = ss.stop_succpred_;
-                const Hyperlink& succ_pred_hyperlink = stop_states.find(ss.stop_succpred_)->second;
+                const Hyperlink& succ_pred_hyperlink = *stop_states.find(ss.stop_succpred_);
                 succ_pred_hyperlink.collectFarePeriodProbabilities(path_spec, trace_file, pf, ss.probability_, fare_period_probabilities);
             }
         }
@@ -1058,8 +1155,8 @@ namespace fasttrips {
             // is there a transfer rule?
             // for outbound, pathfinding goes backwards so other_fp is the *next* fare period
             // for inbound,  pathfinding goes forwards  so other_fp is the *previous* fare period
-            const FareTransfer* ft = pf.getFareTransfer(path_spec.outbound_ ? fare_period.fare_period_ : other_fp->fare_period_,
-                                                        path_spec.outbound_ ? other_fp->fare_period_ : fare_period.fare_period_);
+            const FareTransfer* ft = pf.getFareTransfer(path_spec.outbound_ ? fare_period.fare_period_num_ : other_fp->fare_period_num_,
+                                                        path_spec.outbound_ ? other_fp->fare_period_num_ : fare_period.fare_period_num_);
             // start with the price of this fare period and the other fare period
             double price = fare_period.price_;
             // this is the price of the next (outbound) or previous (inbound) fare period
@@ -1141,4 +1238,69 @@ namespace fasttrips {
         }
         return fare_period.price_;
     }
+    Hyperlink& StopStates::add(int stop_id, bool outbound)
+    {
+        if (stop_id >= (int)epochs_.size()) {
+            // deque growth at the end doesn't move the existing hyperlinks
+            hyperlinks_.resize(stop_id+1);
+            epochs_.resize(stop_id+1, 0);
+        }
+        Hyperlink& hyperlink = hyperlinks_[stop_id];
+        if (epochs_[stop_id] != epoch_) {
+            hyperlink.reset(stop_id, outbound);
+            epochs_[stop_id] = epoch_;
+            size_++;
+        }
+        return hyperlink;
+    }
+
+    void StopStates::clear()
+    {
+        size_ = 0;
+        low_cost_labels_.clear();
+        epoch_++;
+        // on wraparound, nothing can be from the current epoch
+        if (epoch_ == 0) {
+            std::fill(epochs_.begin(), epochs_.end(), 0);
+            for (std::vector<TripHop>::iterator hop = trip_hops_.begin(); hop != trip_hops_.end(); ++hop) { hop->epoch_ = 0; }
+            epoch_ = 1;
+        }
+    }
+
+    void StopStates::save(StopStatesCopy& copy) const
+    {
+        copy.stop_ids_.clear();
+        copy.hyperlinks_.clear();
+        copy.stop_ids_.reserve(size_);
+        copy.hyperlinks_.reserve(size_);
+        for (size_t stop_id = 0; stop_id < epochs_.size(); ++stop_id) {
+            if (epochs_[stop_id] != epoch_) { continue; }
+            copy.stop_ids_.push_back((int)stop_id);
+            copy.hyperlinks_.push_back(hyperlinks_[stop_id]);
+        }
+        copy.low_cost_labels_ = low_cost_labels_;
+    }
+
+    void StopStates::restore(const StopStatesCopy& copy, bool outbound)
+    {
+        clear();
+        for (size_t idx = 0; idx < copy.stop_ids_.size(); ++idx) {
+            add(copy.stop_ids_[idx], outbound) = copy.hyperlinks_[idx];
+        }
+        low_cost_labels_ = copy.low_cost_labels_;
+    }
+
+    // PathFinder labels with every combination
+#define INSTANTIATE_ADD_LINK(OUTBOUND, HYPERPATH, TRACE) \
+    template bool Hyperlink::addLink< SearchMode<OUTBOUND, HYPERPATH, TRACE> >(const StopState& ss, const Hyperlink* prev_link, bool& rejected, \
+        std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf);
+    INSTANTIATE_ADD_LINK(false, false, false)
+    INSTANTIATE_ADD_LINK(false, false, true )
+    INSTANTIATE_ADD_LINK(false, true,  false)
+    INSTANTIATE_ADD_LINK(false, true,  true )
+    INSTANTIATE_ADD_LINK(true,  false, false)
+    INSTANTIATE_ADD_LINK(true,  false, true )
+    INSTANTIATE_ADD_LINK(true,  true,  false)
+    INSTANTIATE_ADD_LINK(true,  true,  true )
+#undef INSTANTIATE_ADD_LINK
 }
@@ -3,13 +3,17 @@
  *
  * Defines the Hyperlink class that holds the links (stop states) for a stop.
  */
+#include <deque>
 #include <iostream>
 #include <map>
 #include <set>
 #include <vector>
 
+#include "connection_scan.h"
+#include "flat_map.h"
 #include "pathspec.h"
 #include "path.h"
+#include "rng.h"
 
 #ifndef HYPERLINK_H
 #define HYPERLINK_H
@@ -27,10 +31,6 @@ namespace fasttrips {
     /// Hyperpath cost when no links are there
     const double MAX_COST = 999999;
 
-    /// What we multiply the fractional cumulative probabilities by to get an integer to compare with random numbers
-    /// Must be less than, but close to RAND_MAX for the system, which is 32767 on windows
-    const double INT_MULT = 10000;
-
     // Commenting MIN_COST out for now. If gencost is calculated in terms of IVT mins, negative costs unlikely.
     // This also creates an issue with probabilities not adding up to 1.
     /// Hyperpath minimum cost (zero and negative costs are problematic)
@@ -38,9 +38,30 @@ namespace fasttrips {
 
     bool isTrip(const int& mode);
 
-    typedef std::map<StopStateKey, StopState> StopStateMap;
+    typedef FlatMap<StopStateKey, StopState> StopStateMap;
     // cost to stop state key
-    typedef std::multimap< double, StopStateKey> CostToStopState;
+    typedef FlatMultimap< double, StopStateKey> CostToStopState;
+
+    /**
+     * The links of a fasttrips::LinkSet that can be chosen next while drawing a path, in cost order, as indices into
+     * its stop_state_map_, with their probabilities and the fares and link costs they'd have given the path so far.
+     * Made by Hyperlink::setupChoices().
+     */
+    struct LinkChoices {
+        std::vector<int>    choices_;
+        std::vector<double> probabilities_;
+        std::vector<double> cum_probs_;
+        std::vector<double> link_fares_;
+        std::vector<double> link_costs_;
+
+        void clear() {
+            choices_.clear();
+            probabilities_.clear();
+            cum_probs_.clear();
+            link_fares_.clear();
+            link_costs_.clear();
+        }
+    };
 
     struct LinkSet {
         double          latest_dep_earliest_arr_;  ///< latest departure time from this stop for outbound trips, earliest arrival time to this stop for inbound trips
@@ -48,7 +69,8 @@ namespace fasttrips {
         double          sum_exp_cost_;             ///< sum of the exponentiated cost
         double          hyperpath_cost_;           ///< hyperpath cost for this stop state
         int             process_count_;            ///< increment this every time the stop is processed
-        int             max_cum_prob_i_;           ///< Set by setupProbabilities()
+        /// Set by Hyperlink::setupProbabilities(): the links that can be chosen.  Valid until the links change.
+        LinkChoices     choices_;
 
         StopStateMap    stop_state_map_;           ///< the links.  (or a set of stop states where compare means the key is unique)
         CostToStopState cost_map_;                 ///< multimap of cost -> stop state pointers into the stop_state_set_ above
@@ -57,6 +79,39 @@ namespace fasttrips {
     } ;
 
     class PathFinder;
+    class StopStates;
+
+    /// Maximum number of distinct fare periods whose boards a fasttrips::LowCostLabel counts
+    const int MAX_LABEL_FARE_PERIODS = 4;
+
+    /**
+     * A link on the lowest cost path to a stop state, found during labeling.
+     *
+     * These are appended to an array in fasttrips::StopStates and refer to their parent by index,
+     * so a path is a chain of labels and an improvement is one small append rather than a full
+     * fasttrips::Path copy.  Hyperlink::getLowCostPath() rebuilds the Path on demand.  The fare-relevant parts
+     * of the path are summarized here and carried forward from the parent.
+     */
+    struct LowCostLabel {
+        int               parent_;              ///< Index of the previous label on the path, or -1 for the first link
+        int               stop_id_;             ///< The stop (or TAZ) for this link
+        StopStateKey      ssk_;                 ///< The key for this link in that stop's fasttrips::Hyperlink
+        double            cost_;                ///< Sum of the link costs on the path
+        const FarePeriod* last_fare_period_;    ///< Fare period of the latest trip on the path, or NULL
+        int               num_fare_periods_;    ///< Number of fare periods in board_fare_periods_
+        const FarePeriod* board_fare_periods_[MAX_LABEL_FARE_PERIODS];  ///< Fare periods boarded on the path
+        unsigned char     boards_[MAX_LABEL_FARE_PERIODS];              ///< Boards for each of board_fare_periods_
+
+        /// Constructor for the first link on a path
+        LowCostLabel(int stop_id, const StopStateKey& ssk, double cost);
+        /// Constructor for a link extending the given parent's path
+        LowCostLabel(const LowCostLabel& parent, int parent_index, int stop_id, const StopStateKey& ssk, double link_cost);
+
+        /// Count a board in the given fare period.  Fare periods past MAX_LABEL_FARE_PERIODS aren't counted.
+        void addBoard(const FarePeriod* fare_period);
+        /// Boards for the given fare period, like Path::boardsForFarePeriod()
+        int boardsForFarePeriod(int fare_period_num) const;
+    };
 
     /**
      * Class that encapulates the link (for deterministic) or hyperlink (for stochastic)
@@ -85,10 +140,6 @@ namespace fasttrips {
         /// Reset latest departure/earliest arrival
         void resetLatestDepartureEarliestArrival(bool of_trip_links, const PathSpecification& path_spec);
 
-        /// Update the low cost path for this stop state
-        void updateLowCostPath(const StopStateKey& ssk, const Hyperlink* prev_link,
-                               std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf);
-
     public:
 
         /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.TIME_WINDOW">fasttrips.Assignment.TIME_WINDOW</a>
@@ -110,6 +161,9 @@ namespace fasttrips {
         /// Destructor
         ~Hyperlink();
 
+        /// Makes this an empty hyperlink for the given stop, as if newly constructed, but keeps the link set capacity.
+        void reset(int stop_id, bool outbound);
+
         /// How many links make up the hyperlink?
         size_t size() const;
         /// How many links make up the trip/nontrip hyperlink
@@ -117,8 +171,19 @@ namespace fasttrips {
 
         /// Accessor for stop state map
         const StopStateMap& getStopStateMap(bool of_trip_links) const;
-        /// Accessor for the low cost path
-        const Path* getLowCostPath(bool of_trip_links) const;
+        /**
+         * Rebuilds the lowest cost path found for any of the trip/nontrip links into path, which should be empty.
+         * Returns false if there isn't one, or if a link on it has since been replaced or pruned.
+         */
+        bool getLowCostPath(bool of_trip_links, const StopStates& stop_states, Path& path,
+                            std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf) const;
+
+        /**
+         * Update the low cost path for this stop state, given the hyperlink it was labeled from.
+         * Only done with TRACK_LOW_COST_PATH defined in pathfinder.cpp.
+         */
+        void updateLowCostPath(const StopStateKey& ssk, const Hyperlink* prev_link, StopStates& stop_states,
+                               std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf);
 
         /// Add this link to the hyperlink.
         /// For deterministic: we only keep one link.  Accept it iff the cost is lower.
@@ -126,6 +191,8 @@ namespace fasttrips {
         /// - If it's outside the time window, reject it.
         /// - If it's already here according to the key, then replace the state.
         /// - Return true iff the hyperlink state was affected (e.g. the stop needs to be re-processed)
+        /// Templated on the fasttrips::SearchMode so the labeling loop's checks are resolved at compile time.
+        template <class Mode>
         bool addLink(const StopState& ss, const Hyperlink* prev_link, bool& rejected,
                      std::ostream& trace_file, const PathSpecification& path_spec, const PathFinder& pf);
 
@@ -173,22 +240,50 @@ namespace fasttrips {
 
         /**
          * Setup probabilities for hyperlink's stop states (links)
-         * Return the max cum probability for the linkset
+         * Return the number of links that can be chosen; 0 if none can.
          */
         int setupProbabilities(const PathSpecification& path_spec, std::ostream& trace_file,
                                  const PathFinder& pf, bool trip_linkset,
                                  const Path* path_so_far = NULL);
 
+        /**
+         * Finds the links that can be chosen and their probabilities, as Hyperlink::setupProbabilities() does,
+         * but into the given choices rather than into the hyperlink, so concurrent draws can share it.
+         * If ssk_log is passed, the fare transfer applied to each link is noted there for tracing.
+         * Return the number of links that can be chosen; 0 if none can.
+         */
+        int setupChoices(const PathSpecification& path_spec, std::ostream& trace_file,
+                         const PathFinder& pf, bool trip_linkset,
+                         const Path* path_so_far, LinkChoices& choices,
+                         std::map<StopStateKey, std::string>* ssk_log = NULL) const;
+
         /**
          * Randomly selects one of the links in this hyperlink based on the cumulative probability
-         * set by Hyperlink::setupProbabilities()
+         * set by Hyperlink::setupProbabilities(), using the query's random number generator.
+         * This is a binary search over the cumulative probabilities.
          *
          * @return a const reference to the chosen StopState.
          */
         const StopState& chooseState(const PathSpecification& path_spec,
                                      std::ostream& trace_file,
+                                     RandomNumberGenerator& rng,
                                      const StopState* prev_link = NULL) const;
 
+        /**
+         * Randomly selects one of the links in choices, made by Hyperlink::setupChoices() for the given link set.
+         *
+         * @return a copy of the chosen StopState with its fare, link cost and probability from choices.
+         */
+        StopState chooseState(const PathSpecification& path_spec,
+                              std::ostream& trace_file,
+                              RandomNumberGenerator& rng,
+                              bool trip_linkset,
+                              const LinkChoices& choices) const;
+
+        /// The index into choices of a randomly selected link; a binary search over the cumulative probabilities.
+        static size_t chooseLink(const LinkChoices& choices, const PathSpecification& path_spec,
+                                 std::ostream& trace_file, RandomNumberGenerator& rng);
+
         /**
          * Iterates through the trip links and multiplies transer_probability x probability and sums
          * to the fare period in fp_probs.
@@ -216,14 +311,95 @@ namespace fasttrips {
                                    std::ostream& trace_file,
                                    const PathFinder& pf,
                                    const FarePeriod& fare_period,
-                                   const std::map<int, Hyperlink>& stop_states) const;
+                                   const StopStates& stop_states) const;
 
     };
 
     /**
-     * The path finding algorithm stores StopState data in this structure.
+     * A compact copy of the hyperlinks in a fasttrips::StopStates, made by StopStates::save(), for keeping labels
+     * after the StopStates has moved on to other queries.
      */
-    typedef std::map<int, Hyperlink> StopStates;
+    struct StopStatesCopy {
+        std::vector<int>            stop_ids_;          ///< Labeled stop ids, in increasing order
+        std::vector<Hyperlink>      hyperlinks_;        ///< The hyperlinks for stop_ids_
+        std::vector<LowCostLabel>   low_cost_labels_;   ///< See StopStates::addLowCostLabel()
+    };
+
+    /**
+     * The path finding algorithm stores StopState data in this structure: the fasttrips::Hyperlink
+     * for each labeled stop (or TAZ), indexed by stop id.
+     *
+     * It's meant to be reused across queries by the same thread.  clear() just bumps the epoch, which marks
+     * every hyperlink stale; a stale hyperlink is reset in place by add(), so its link sets keep their
+     * capacity and a warm StopStates doesn't allocate.  Hyperlinks are never moved once they're created,
+     * so references to them stay valid while others are added.
+     */
+    class StopStates
+    {
+    private:
+        /// stop id -> hyperlink; only the ones from the current epoch are valid
+        std::deque<Hyperlink>       hyperlinks_;
+        /// stop id -> epoch in which the hyperlink was added
+        std::vector<unsigned int>   epochs_;
+        /// The current epoch
+        unsigned int                epoch_;
+        /// Number of valid hyperlinks
+        size_t                      size_;
+        /// Labels for the low cost paths, referred to by StopState::low_cost_label_
+        std::vector<LowCostLabel>   low_cost_labels_;
+        /// trip id -> PathFinder::scanConnections() scratch; only the ones from the current epoch are valid
+        std::vector<TripHop>        trip_hops_;
+
+    public:
+        StopStates() : epoch_(1), size_(0) {}
+
+        /// Returns the hyperlink for the given stop, or NULL if it hasn't been added.
+        Hyperlink* find(int stop_id) {
+            if ((stop_id < 0) || (stop_id >= (int)epochs_.size()) || (epochs_[stop_id] != epoch_)) { return NULL; }
+            return &hyperlinks_[stop_id];
+        }
+        /// Returns the hyperlink for the given stop, or NULL if it hasn't been added.
+        const Hyperlink* find(int stop_id) const {
+            if ((stop_id < 0) || (stop_id >= (int)epochs_.size()) || (epochs_[stop_id] != epoch_)) { return NULL; }
+            return &hyperlinks_[stop_id];
+        }
+
+        /// Returns the hyperlink for the given stop, adding an empty one if it hasn't been added.  The stop id must be non-negative.
+        Hyperlink& add(int stop_id, bool outbound);
+
+        /// Returns the hyperlink for a stop that has been added.
+        Hyperlink& operator[](int stop_id) { return hyperlinks_[stop_id]; }
+
+        /// Number of hyperlinks added since the last clear()
+        size_t size() const { return size_; }
+
+        /// Appends the given low cost label and returns its index
+        int addLowCostLabel(const LowCostLabel& label) {
+            low_cost_labels_.push_back(label);
+            return (int)low_cost_labels_.size() - 1;
+        }
+        /// Accessor for the low cost label with the given index
+        const LowCostLabel& lowCostLabel(int index) const { return low_cost_labels_[index]; }
+
+        /// The current epoch; it changes with every clear()
+        unsigned int epoch() const { return epoch_; }
+        /// The connection scan's per-trip scratch, with at least num_trips entries.  Entries not from the current epoch are stale.
+        std::vector<TripHop>& tripHops(size_t num_trips) {
+            if (trip_hops_.size() < num_trips) {
+                TripHop stale = { 0, false, false, 0, 0, 0, 0 };
+                trip_hops_.resize(num_trips, stale);
+            }
+            return trip_hops_;
+        }
+
+        /// Marks all the hyperlinks stale and drops the low cost labels.  Their memory is kept for reuse.
+        void clear();
+
+        /// Copies the hyperlinks added since the last clear() and the low cost labels
+        void save(StopStatesCopy& copy) const;
+        /// Clears, then adds back the hyperlinks and low cost labels from save()
+        void restore(const StopStatesCopy& copy, bool outbound);
+    };
 
 }
 
@@ -0,0 +1,114 @@
+#include "labeling_cache.h"
+
+namespace fasttrips {
+
+    LabelingCache::LabelingCache() : bytes_(0), max_bytes_(0)
+    {}
+
+    size_t LabelingCache::bytesOf(const CachedLabels& labels)
+    {
+        const StopStatesCopy& copy = labels.stop_states_;
+        size_t bytes = sizeof(CachedLabels) + sizeof(PathSpecification) + sizeof(Entry) +
+                       copy.stop_ids_.capacity()        * sizeof(int) +
+                       copy.hyperlinks_.capacity()      * sizeof(Hyperlink) +
+                       copy.low_cost_labels_.capacity() * sizeof(LowCostLabel);
+        for (std::vector<Hyperlink>::const_iterator hyperlink = copy.hyperlinks_.begin(); hyperlink != copy.hyperlinks_.end(); ++hyperlink) {
+            bytes += hyperlink->size() * sizeof(StopStateMap::value_type);
+        }
+        return bytes;
+    }
+
+    LabelingCache::CachedLabelsMap::iterator LabelingCache::erase(CachedLabelsMap::iterator entry)
+    {
+        bytes_ -= entry->second.bytes_;
+        use_order_.erase(entry->second.use_);
+        return entries_.erase(entry);
+    }
+
+    std::shared_ptr<const CachedLabels> LabelingCache::find(const PathSpecification& path_spec)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        CachedLabelsMap::iterator entry = entries_.find(path_spec);
+        if (entry == entries_.end()) { return std::shared_ptr<const CachedLabels>(); }
+        use_order_.splice(use_order_.begin(), use_order_, entry->second.use_);
+        return entry->second.labels_;
+    }
+
+    void LabelingCache::insert(const PathSpecification& path_spec, const std::shared_ptr<const CachedLabels>& labels)
+    {
+        size_t labels_bytes = bytesOf(*labels);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        CachedLabelsMap::iterator entry = entries_.find(path_spec);
+        if (entry != entries_.end()) { erase(entry); }
+        // it would only push out everything else and then itself
+        if (labels_bytes > max_bytes_) { return; }
+
+        entry = entries_.insert(std::make_pair(path_spec, Entry())).first;
+        entry->second.labels_ = labels;
+        entry->second.bytes_  = labels_bytes;
+        entry->second.use_    = use_order_.insert(use_order_.begin(), &(entry->first));
+        bytes_ += labels_bytes;
+
+        while (bytes_ > max_bytes_) {
+            erase(entries_.find(*use_order_.back()));
+        }
+    }
+
+    void LabelingCache::setMaxBytes(size_t max_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_bytes_ = max_bytes;
+        while (bytes_ > max_bytes_) {
+            erase(entries_.find(*use_order_.back()));
+        }
+    }
+
+    void LabelingCache::invalidate(const std::vector<bool>& dirty_stops)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        CachedLabelsMap::iterator entry = entries_.begin();
+        while (entry != entries_.end()) {
+            const std::vector<int>& stop_ids = entry->second.labels_->stop_states_.stop_ids_;
+            bool dirty = false;
+            for (std::vector<int>::const_iterator stop_id = stop_ids.begin(); stop_id != stop_ids.end(); ++stop_id) {
+                if ((*stop_id < (int)dirty_stops.size()) && dirty_stops[*stop_id]) { dirty = true; break; }
+            }
+            if (dirty) {
+                entry = erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    void LabelingCache::setParameters(const std::vector<double>& parameters)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (parameters == parameters_) { return; }
+        parameters_ = parameters;
+        entries_.clear();
+        use_order_.clear();
+        bytes_ = 0;
+    }
+
+    size_t LabelingCache::size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    size_t LabelingCache::bytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    void LabelingCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        use_order_.clear();
+        bytes_ = 0;
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * \file labeling_cache.h
+ *
+ * Defines the cache of labeling results that lets later pathfinding iterations reuse the labels
+ * from earlier ones when nothing they depend on has changed.
+ *
+ * Between iterations only the crowding-related supply changes: stop times (and their overcap) and the bump waits.
+ * A query's labels can only depend on those at the stops it labeled, since labeling only considers trips
+ * boarded, and transfers made, at labeled stops.  So each entry is invalidated when the stop time of a trip serving
+ * one of its labeled stops changes, or when a bump wait on such a trip changes.
+ *
+ * The entries are held to a byte budget; past it, the least recently used ones are dropped.
+ */
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hyperlink.h"
+#include "pathspec.h"
+
+#ifndef LABELING_CACHE_H
+#define LABELING_CACHE_H
+
+namespace fasttrips {
+
+    /// The result of labeling for one query signature
+    typedef struct {
+        int             status_;                ///< What PathFinder::labelPathSet() returned
+        StopStatesCopy  stop_states_;           ///< The labels, if status_ is success
+    } CachedLabels;
+
+    /**
+     * Labeling results by fasttrips::LabelingSignatureCompare, so any query labeling identically may reuse them.
+     * It's shared by the threads running queries, so it's locked.
+     */
+    class LabelingCache
+    {
+    private:
+        /// The cached signatures (keys of entries_), most recently used first
+        typedef std::list<const PathSpecification*> UseOrder;
+
+        typedef struct {
+            std::shared_ptr<const CachedLabels> labels_;
+            size_t                              bytes_;     ///< See LabelingCache::bytesOf()
+            UseOrder::iterator                  use_;       ///< This entry in use_order_
+        } Entry;
+
+        typedef std::map<PathSpecification, Entry, struct LabelingSignatureCompare> CachedLabelsMap;
+
+        CachedLabelsMap         entries_;
+        UseOrder                use_order_;
+        /// Approximate bytes held by entries_, and the most it may hold
+        size_t                  bytes_;
+        size_t                  max_bytes_;
+        /// The parameters the entries were labeled with
+        std::vector<double>     parameters_;
+        std::mutex              mutex_;
+
+        /// Approximately how much memory the given labels take up
+        static size_t bytesOf(const CachedLabels& labels);
+        /// Drops the given entry.  The mutex must be held.
+        CachedLabelsMap::iterator erase(CachedLabelsMap::iterator entry);
+
+    public:
+        LabelingCache();
+
+        /// The labels for the given signature, or an empty pointer if they're not cached
+        std::shared_ptr<const CachedLabels> find(const PathSpecification& path_spec);
+        /// Caches the labels for the given signature, replacing any there, then drops the least recently used entries over budget
+        void insert(const PathSpecification& path_spec, const std::shared_ptr<const CachedLabels>& labels);
+        /// Sets the most memory the entries may take up, dropping the least recently used ones over it
+        void setMaxBytes(size_t max_bytes);
+
+        /// Drops the entries that labeled any stop flagged in dirty_stops, which is indexed by stop id
+        void invalidate(const std::vector<bool>& dirty_stops);
+        /// Drops everything if the given labeling parameters differ from the last ones set
+        void setParameters(const std::vector<double>& parameters);
+        /// Number of cached entries
+        size_t size();
+        /// Approximate bytes held by the cached entries
+        size_t bytes();
+        /// Drops everything.  Call this when the supply is replaced.
+        void clear();
+    };
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include "link_cost.h"
+
+#include <cmath>
+
+namespace fasttrips {
+
+    double weightedAttribute(const Weight& weight, double attr_value)
+    {
+        if (weight.type_ == WEIGHT_LINEAR) {
+            return weight.weight_ * attr_value;
+        } else if (weight.type_ == WEIGHT_EXPONENTIAL) {
+            return (std::pow(1.0+weight.weight_, attr_value) - 1.0) / std::log(1.0 + weight.weight_);
+        } else if (weight.type_ == WEIGHT_LOGARITHMIC) {
+            return weight.weight_ * ((1.0 + attr_value) * std::log(1.0 + attr_value) - attr_value) / std::log(weight.log_base_);
+        } else if (weight.type_ == WEIGHT_LOGISTIC) {
+            double max_integral = (weight.logistic_max_ / weight.weight_) * std::log(std::exp(weight.weight_ * attr_value) + std::exp(weight.weight_ * weight.logistic_mid_));
+            double min_integral = (weight.logistic_max_ / weight.weight_) * std::log(1.0 + std::exp(weight.weight_ * weight.logistic_mid_));
+            return max_integral - min_integral;
+        }
+        return 0.0;
+    }
+
+    static const char* FIXED_ATTRIBUTE_NAMES[NUM_FIXED_ATTRIBUTE_SLOTS] = {
+        "time_min",
+        "drive_time_min",
+        "walk_time_min",
+        "elevation_gain",
+        "depart_early_min",
+        "depart_late_min",
+        "arrive_early_min",
+        "arrive_late_min",
+        "in_vehicle_time_min",
+        "wait_time_min",
+        "overcap",
+        "at_capacity",
+        "fare",
+        "transfer_penalty"
+    };
+
+    AttributeSlots::AttributeSlots()
+    {
+        clear();
+    }
+
+    int AttributeSlots::add(const std::string& name)
+    {
+        std::map<std::string, int>::const_iterator it = slots_.find(name);
+        if (it != slots_.end()) { return it->second; }
+
+        int slot = (int)names_.size();
+        slots_[name] = slot;
+        names_.push_back(name);
+        return slot;
+    }
+
+    int AttributeSlots::find(const std::string& name) const
+    {
+        std::map<std::string, int>::const_iterator it = slots_.find(name);
+        if (it == slots_.end()) { return SLOT_NONE; }
+        return it->second;
+    }
+
+    void AttributeSlots::clear()
+    {
+        slots_.clear();
+        names_.clear();
+        for (int slot = 0; slot < NUM_FIXED_ATTRIBUTE_SLOTS; ++slot) {
+            add(FIXED_ATTRIBUTE_NAMES[slot]);
+        }
+    }
+
+    LinkAttributes::LinkAttributes(const Attributes& attributes, const AttributeSlots& slots) : set_(0)
+    {
+        for (Attributes::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+            set(slots.find(it->first), it->second);
+        }
+    }
+
+    const double* LinkAttributes::findOverflow(int slot) const
+    {
+        for (std::vector< std::pair<int, double> >::const_iterator it = overflow_.begin(); it != overflow_.end(); ++it) {
+            if (it->first == slot) { return &(it->second); }
+        }
+        return NULL;
+    }
+
+    void LinkAttributes::setOverflow(int slot, double value)
+    {
+        for (std::vector< std::pair<int, double> >::iterator it = overflow_.begin(); it != overflow_.end(); ++it) {
+            if (it->first == slot) { it->second = value; return; }
+        }
+        overflow_.push_back(std::make_pair(slot, value));
+    }
+
+    CompiledWeights::CompiledWeights(const NamedWeights& named_weights, AttributeSlots& slots) :
+        required_(0), has_ivt_weight_(false), ivt_weight_(0)
+    {
+        for (NamedWeights::const_iterator it = named_weights.begin(); it != named_weights.end(); ++it) {
+            int slot = slots.add(it->first);
+
+            if (slot < INLINE_ATTRIBUTE_SLOTS) {
+                required_ |= (uint64_t(1) << slot);
+            } else {
+                overflow_required_.push_back(slot);
+            }
+            if (it->second.type_ == WEIGHT_LINEAR) {
+                linear_slots_.push_back(slot);
+                linear_weights_.push_back(it->second.weight_);
+            } else {
+                nonlinear_slots_.push_back(slot);
+                nonlinear_weights_.push_back(it->second);
+            }
+            if (slot == SLOT_IN_VEHICLE_TIME_MIN) {
+                has_ivt_weight_ = true;
+                ivt_weight_     = it->second.weight_;
+            }
+        }
+    }
+}
@@ -0,0 +1,179 @@
+/**
+ * \file link_cost.h
+ *
+ * Defines the link attribute and weight structures used to tally link costs.
+ *
+ * Link attributes and weights are read keyed by name.  For path finding, the attribute names
+ * are interned to integer slots (fasttrips::AttributeSlots), link attributes are stored in fixed-width
+ * arrays (fasttrips::LinkAttributes) and each weight set is compiled into coefficient vectors
+ * (fasttrips::CompiledWeights), so costing a link involves no string compares or allocations.
+ * Any number of attributes may be weighted; past fasttrips::INLINE_ATTRIBUTE_SLOTS of them, the rest
+ * are kept in a (slower) vector alongside the array.
+ */
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifndef LINK_COST_H
+#define LINK_COST_H
+
+namespace fasttrips {
+
+    /// Generic attributes
+    typedef std::map<std::string, double> Attributes;
+
+    enum WeightType {
+        WEIGHT_LINEAR      = 0,  // default
+        WEIGHT_EXPONENTIAL = 1,
+        WEIGHT_LOGARITHMIC = 2,
+        WEIGHT_LOGISTIC    = 3
+    };
+
+    typedef struct  {
+      WeightType type_;          // the type of weight
+      double     weight_;        // this is the primary part -- the weight itself
+      double     log_base_;      // only for WEIGHT_LOGARITHMIC
+      double     logistic_max_;  // oly for WEIGHT_LOGISTIC
+      double     logistic_mid_;  // oly for WEIGHT_LOGISTIC
+    } Weight;
+
+    typedef std::map<std::string, Weight> NamedWeights;
+
+    /// The cost of the given attribute value for the given (non-linear or linear) weight
+    double weightedAttribute(const Weight& weight, double attr_value);
+
+    /// Number of attribute slots kept in fasttrips::LinkAttributes' fixed-width array; the slots past these are kept out of line
+    const int INLINE_ATTRIBUTE_SLOTS = 64;
+
+    /**
+     * Attribute slots for the attributes the path finder sets itself.  These are always interned,
+     * in this order, so the labeling code can set them without looking them up.
+     */
+    enum AttributeSlot {
+        SLOT_NONE = -1,
+        SLOT_TIME_MIN = 0,
+        SLOT_DRIVE_TIME_MIN,
+        SLOT_WALK_TIME_MIN,
+        SLOT_ELEVATION_GAIN,
+        SLOT_DEPART_EARLY_MIN,
+        SLOT_DEPART_LATE_MIN,
+        SLOT_ARRIVE_EARLY_MIN,
+        SLOT_ARRIVE_LATE_MIN,
+        SLOT_IN_VEHICLE_TIME_MIN,
+        SLOT_WAIT_TIME_MIN,
+        SLOT_OVERCAP,
+        SLOT_AT_CAPACITY,
+        SLOT_FARE,
+        SLOT_TRANSFER_PENALTY,
+        NUM_FIXED_ATTRIBUTE_SLOTS
+    };
+
+    /**
+     * Interns attribute names to integer slots.  Only attributes that are weighted
+     * (plus the fasttrips::AttributeSlot ones) get slots; others don't affect cost.
+     */
+    class AttributeSlots
+    {
+    private:
+        std::map<std::string, int>  slots_;
+        std::vector<std::string>    names_;
+
+    public:
+        /// Constructor; interns the fasttrips::AttributeSlot names
+        AttributeSlots();
+
+        /// Returns the slot for the given name, adding it if necessary
+        int add(const std::string& name);
+        /// Returns the slot for the given name, or SLOT_NONE
+        int find(const std::string& name) const;
+        /// Accessor for the name of the given slot
+        const std::string& name(int slot) const { return names_[slot]; }
+        /// Number of slots
+        int size() const { return (int)names_.size(); }
+        /// Back to just the fasttrips::AttributeSlot names
+        void clear();
+    };
+
+    /**
+     * Link attributes as a fixed-width array indexed by attribute slot, with a bitmask of which are set.
+     * This is meant to be copied by value and modified in the labeling loop.
+     *
+     * Slots from INLINE_ATTRIBUTE_SLOTS on are kept as (slot, value) pairs in overflow_ instead, which
+     * stays empty (and so doesn't allocate when copied) unless that many attributes are weighted.
+     */
+    class LinkAttributes
+    {
+    private:
+        double      values_[INLINE_ATTRIBUTE_SLOTS];
+        uint64_t    set_;
+        std::vector< std::pair<int, double> > overflow_;
+
+        /// The overflow_ value for the given slot, or NULL
+        const double* findOverflow(int slot) const;
+        void setOverflow(int slot, double value);
+
+    public:
+        LinkAttributes() : set_(0) {}
+        /// Converts from named attributes.  Attributes without a slot are dropped.
+        LinkAttributes(const Attributes& attributes, const AttributeSlots& slots);
+
+        /// Set the value for the given slot.  Ignores SLOT_NONE.
+        void set(int slot, double value) {
+            if (slot < 0) { return; }
+            if (slot >= INLINE_ATTRIBUTE_SLOTS) { setOverflow(slot, value); return; }
+            values_[slot] = value;
+            set_ |= (uint64_t(1) << slot);
+        }
+        /// Is the given slot set?
+        bool has(int slot) const {
+            if (slot >= INLINE_ATTRIBUTE_SLOTS) { return findOverflow(slot) != NULL; }
+            return (slot >= 0) && ((set_ >> slot) & 1);
+        }
+        /// Accessor for the value in the given slot; assumes it's set.
+        double get(int slot) const {
+            if (slot >= INLINE_ATTRIBUTE_SLOTS) { return *findOverflow(slot); }
+            return values_[slot];
+        }
+        /// Bitmask of the inline slots set
+        uint64_t setMask() const { return set_; }
+    };
+
+    /**
+     * A fasttrips::NamedWeights compiled for fasttrips::PathFinder::tallyLinkCost().
+     *
+     * Linear weights are kept as parallel slot and coefficient vectors so they're a tight
+     * multiply-add loop; the non-linear weights are kept separately by slot.
+     */
+    struct CompiledWeights {
+        std::vector<int>    linear_slots_;          ///< attribute slots for the linear weights
+        std::vector<double> linear_weights_;        ///< coefficients for the linear weights
+        std::vector<int>    nonlinear_slots_;       ///< attribute slots for the non-linear weights
+        std::vector<Weight> nonlinear_weights_;     ///< the non-linear weights
+        uint64_t            required_;              ///< bitmask of all the weighted inline slots
+        std::vector<int>    overflow_required_;     ///< the weighted slots past INLINE_ATTRIBUTE_SLOTS
+        bool                has_ivt_weight_;        ///< is there an in_vehicle_time_min weight (for fare)?
+        double              ivt_weight_;            ///< the in_vehicle_time_min weight
+
+        CompiledWeights() : required_(0), has_ivt_weight_(false), ivt_weight_(0) {}
+        /// Compile the given weights, interning their names in slots
+        CompiledWeights(const NamedWeights& named_weights, AttributeSlots& slots);
+
+        /// Does the given link have all the weighted attributes?
+        bool allSetIn(const LinkAttributes& attributes) const {
+            if ((attributes.setMask() & required_) != required_) { return false; }
+            for (std::vector<int>::const_iterator slot = overflow_required_.begin(); slot != overflow_required_.end(); ++slot) {
+                if (!attributes.has(*slot)) { return false; }
+            }
+            return true;
+        }
+    };
+
+    /// Weights for a supply mode, by name and compiled.
+    typedef struct {
+        NamedWeights    named_;
+        CompiledWeights compiled_;
+    } SupplyModeWeights;
+}
+
+#endif
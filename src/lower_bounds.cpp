@@ -0,0 +1,155 @@
+#include "lower_bounds.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace fasttrips {
+
+    /// Builds one direction of the stop graph in CSR form from stop id -> other stop id -> link
+    static void buildCSR(const std::map<int, std::map<int, BoundLink> >& stop_links, int max_stop_id,
+                         std::vector<int>& offsets, std::vector<BoundLink>& links)
+    {
+        offsets.assign(max_stop_id+2, 0);
+        for (std::map<int, std::map<int, BoundLink> >::const_iterator it = stop_links.begin(); it != stop_links.end(); ++it) {
+            offsets[it->first+1] = (int)it->second.size();
+        }
+        for (size_t idx = 1; idx < offsets.size(); ++idx) {
+            offsets[idx] += offsets[idx-1];
+        }
+        links.clear();
+        links.reserve(offsets.back());
+        for (std::map<int, std::map<int, BoundLink> >::const_iterator it = stop_links.begin(); it != stop_links.end(); ++it) {
+            for (std::map<int, BoundLink>::const_iterator link_it = it->second.begin(); link_it != it->second.end(); ++link_it) {
+                links.push_back(link_it->second);
+            }
+        }
+    }
+
+    /// Keeps the lesser in-vehicle and walk times for the link from_stop -> to_stop
+    static void addBoundLink(std::map<int, std::map<int, BoundLink> >& stop_links, int from_stop_id, int to_stop_id,
+                             double in_vehicle_min, double walk_min)
+    {
+        std::map<int, BoundLink>& links = stop_links[from_stop_id];
+        std::map<int, BoundLink>::iterator link_it = links.find(to_stop_id);
+        if (link_it == links.end()) {
+            BoundLink link = { to_stop_id, in_vehicle_min, walk_min };
+            links[to_stop_id] = link;
+        } else {
+            link_it->second.in_vehicle_min_ = std::min(link_it->second.in_vehicle_min_, in_vehicle_min);
+            link_it->second.walk_min_       = std::min(link_it->second.walk_min_,       walk_min);
+        }
+    }
+
+    void StopCostBounds::build(const TripStopTimes& trip_stop_times, const TransferLinks& transfer_links_o_d)
+    {
+        std::map<int, std::map<int, BoundLink> > forward, reverse;
+        int max_stop_id = transfer_links_o_d.maxStopId();
+
+        // consecutive stops on each trip.  Trips don't walk and transfers don't ride, so the other time is infinite;
+        // if a pair of stops has both, the link costs whichever is cheaper.
+        for (int trip_id = 0; trip_id <= trip_stop_times.maxTripId(); ++trip_id) {
+            TripStopTimeRange stop_times = trip_stop_times.forTrip(trip_id);
+            for (const TripStopTime* stt = stop_times.begin(); (stt != stop_times.end()) && (stt+1 != stop_times.end()); ++stt) {
+                const TripStopTime* next_stt = stt+1;
+                double in_vehicle_min = next_stt->arrive_time_ - stt->depart_time_;
+                // the schedule crossed midnight
+                if (in_vehicle_min < 0) { in_vehicle_min += 24*60; }
+                // no worse than a same-stop pair, but keep our bound honest if the data is odd
+                if (in_vehicle_min < 0) { in_vehicle_min = 0; }
+
+                addBoundLink(forward, stt->stop_id_, next_stt->stop_id_, in_vehicle_min, std::numeric_limits<double>::infinity());
+                addBoundLink(reverse, next_stt->stop_id_, stt->stop_id_, in_vehicle_min, std::numeric_limits<double>::infinity());
+                max_stop_id = std::max(max_stop_id, std::max(stt->stop_id_, next_stt->stop_id_));
+            }
+        }
+
+        // transfers
+        for (int stop_id = 0; stop_id <= transfer_links_o_d.maxStopId(); ++stop_id) {
+            TransferLinkRange transfer_range = transfer_links_o_d.linksFor(stop_id);
+            for (const TransferLink* transfer_it = transfer_range.begin(); transfer_it != transfer_range.end(); ++transfer_it) {
+                Attributes::const_iterator time_it = transfer_it->attributes_.find("time_min");
+                double walk_min = ((time_it == transfer_it->attributes_.end()) || (time_it->second < 0)) ? 0.0 : time_it->second;
+
+                addBoundLink(forward, stop_id, transfer_it->stop_id_, std::numeric_limits<double>::infinity(), walk_min);
+                addBoundLink(reverse, transfer_it->stop_id_, stop_id, std::numeric_limits<double>::infinity(), walk_min);
+                max_stop_id = std::max(max_stop_id, transfer_it->stop_id_);
+            }
+        }
+
+        buildCSR(forward, max_stop_id, forward_offsets_, forward_links_);
+        buildCSR(reverse, max_stop_id, reverse_offsets_, reverse_links_);
+        built_ = true;
+    }
+
+    std::shared_ptr<const CostBounds> StopCostBounds::calculate(const AccessEgressLinks& access_egress_links, const BoundKey& key) const
+    {
+        // outbound: bounds from the origin TAZ to each stop, so search forwards from its access stops
+        // inbound : bounds from each stop to the destination TAZ, so search backwards from its egress stops
+        const std::vector<int>&       offsets = key.outbound_ ? forward_offsets_ : reverse_offsets_;
+        const std::vector<BoundLink>& links   = key.outbound_ ? forward_links_   : reverse_links_;
+        std::shared_ptr<CostBounds>   bounds(new CostBounds(offsets.empty() ? 0 : offsets.size()-1, std::numeric_limits<double>::infinity()));
+
+        typedef std::pair<double, int> CostStop;
+        std::priority_queue<CostStop, std::vector<CostStop>, std::greater<CostStop> > queue;
+
+        // any stop with a link to the TAZ is a source; the link itself costs at least nothing
+        AccessEgressLinkRange taz_links = access_egress_links.linksFor(key.taz_id_);
+        for (const AccessEgressLinkEntry* iter_aelk = taz_links.begin(); iter_aelk != taz_links.end(); ++iter_aelk) {
+            int stop_id = iter_aelk->first.stop_id_;
+            if ((stop_id < 0) || (stop_id >= (int)bounds->size())) { continue; }
+            if ((*bounds)[stop_id] == 0) { continue; }
+            (*bounds)[stop_id] = 0;
+            queue.push(CostStop(0, stop_id));
+        }
+
+        while (!queue.empty()) {
+            CostStop cost_stop = queue.top();
+            queue.pop();
+            if (cost_stop.first > (*bounds)[cost_stop.second]) { continue; }  // already done for less
+
+            for (int idx = offsets[cost_stop.second]; idx < offsets[cost_stop.second+1]; ++idx) {
+                const BoundLink& link = links[idx];
+                // zero weights shouldn't turn an infinite time into a cost
+                double link_cost = std::min(link.in_vehicle_min_ == std::numeric_limits<double>::infinity() ? link.in_vehicle_min_ : key.in_vehicle_weight_*link.in_vehicle_min_,
+                                            link.walk_min_       == std::numeric_limits<double>::infinity() ? link.walk_min_       : key.walk_weight_      *link.walk_min_);
+                double cost = cost_stop.first + link_cost;
+                if (cost < (*bounds)[link.stop_id_]) {
+                    (*bounds)[link.stop_id_] = cost;
+                    queue.push(CostStop(cost, link.stop_id_));
+                }
+            }
+        }
+        return bounds;
+    }
+
+    std::shared_ptr<const CostBounds> StopCostBounds::boundsFor(
+        const TripStopTimes&      trip_stop_times,
+        const TransferLinks&      transfer_links_o_d,
+        const AccessEgressLinks&  access_egress_links,
+        const BoundKey&           key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!built_) { build(trip_stop_times, transfer_links_o_d); }
+
+        std::map<BoundKey, std::shared_ptr<const CostBounds>, struct BoundKeyCompare>::const_iterator bounds_it = bounds_.find(key);
+        if (bounds_it != bounds_.end()) { return bounds_it->second; }
+
+        std::shared_ptr<const CostBounds> bounds = calculate(access_egress_links, key);
+        bounds_[key] = bounds;
+        return bounds;
+    }
+
+    void StopCostBounds::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        forward_offsets_.clear();
+        forward_links_.clear();
+        reverse_offsets_.clear();
+        reverse_links_.clear();
+        bounds_.clear();
+        built_ = false;
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * \file lower_bounds.h
+ *
+ * Defines the time-independent lower bounds on the cost from each stop to a TAZ,
+ * which PathFinder::labelStops() can use to prune stop states that can't lead to a useful path.
+ *
+ * The bounds come from a stop graph with one link per pair of consecutive stops served by any trip,
+ * carrying the least in-vehicle time between them, plus the transfer links with their walk times.
+ * Waits, penalties, fares and the access/egress link itself are left out, so every real
+ * path costs at least as much as its bound.
+ */
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "access_egress.h"
+#include "network.h"
+#include "stop_times.h"
+
+#ifndef LOWER_BOUNDS_H
+#define LOWER_BOUNDS_H
+
+namespace fasttrips {
+
+    /// A link in the fasttrips::StopCostBounds stop graph
+    typedef struct {
+        int     stop_id_;           ///< The stop at the other end
+        double  in_vehicle_min_;    ///< Least in-vehicle time over the trips serving both stops consecutively
+        double  walk_min_;          ///< Transfer walk time
+    } BoundLink;
+
+    /// Identifies a set of bounds: which TAZ, which direction, and the weights in which they're costed
+    typedef struct {
+        int     taz_id_;
+        bool    outbound_;          ///< If true, bounds from the TAZ to each stop; otherwise from each stop to the TAZ
+        double  in_vehicle_weight_; ///< Cost per minute in vehicle
+        double  walk_weight_;       ///< Cost per minute walking between stops
+    } BoundKey;
+
+    struct BoundKeyCompare {
+        bool operator()(const BoundKey& bk1, const BoundKey& bk2) const {
+            if (bk1.taz_id_            < bk2.taz_id_           ) { return true;  }
+            if (bk1.taz_id_            > bk2.taz_id_           ) { return false; }
+            if (bk1.outbound_          < bk2.outbound_         ) { return true;  }
+            if (bk1.outbound_          > bk2.outbound_         ) { return false; }
+            if (bk1.in_vehicle_weight_ < bk2.in_vehicle_weight_) { return true;  }
+            if (bk1.in_vehicle_weight_ > bk2.in_vehicle_weight_) { return false; }
+            if (bk1.walk_weight_       < bk2.walk_weight_      ) { return true;  }
+            return false;
+        }
+    };
+
+    /// stop id -> lower bound on cost.  Stops that can't reach (or be reached from) the TAZ are infinite.
+    typedef std::vector<double> CostBounds;
+
+    /**
+     * Lower bounds on the cost between each stop and each TAZ.
+     *
+     * The stop graph is built once per supply, on first use, and each fasttrips::BoundKey's bounds are
+     * computed once, on first use, with a Dijkstra search out from (or back to) the TAZ's access/egress stops.
+     * Both are shared by all path finding threads, so lookups are locked; PathFinder::findPathSet() does one per query.
+     */
+    class StopCostBounds
+    {
+    private:
+        /// The stop graph in CSR form, stop id -> links to the following stops (forward) and from the preceding stops (reverse)
+        std::vector<int>        forward_offsets_;
+        std::vector<BoundLink>  forward_links_;
+        std::vector<int>        reverse_offsets_;
+        std::vector<BoundLink>  reverse_links_;
+        bool                    built_;
+
+        std::map<BoundKey, std::shared_ptr<const CostBounds>, struct BoundKeyCompare> bounds_;
+        std::mutex              mutex_;
+
+        /// Builds the stop graph from the given supply
+        void build(const TripStopTimes& trip_stop_times, const TransferLinks& transfer_links_o_d);
+        /// Calculates the bounds for the given key
+        std::shared_ptr<const CostBounds> calculate(const AccessEgressLinks& access_egress_links, const BoundKey& key) const;
+
+    public:
+        StopCostBounds() : built_(false) {}
+
+        /// The bounds for the given key, calculating them (and the stop graph, if need be) from the given supply if necessary
+        std::shared_ptr<const CostBounds> boundsFor(const TripStopTimes&      trip_stop_times,
+                                                    const TransferLinks&      transfer_links_o_d,
+                                                    const AccessEgressLinks&  access_egress_links,
+                                                    const BoundKey&           key);
+        /// Forgets the stop graph and bounds.  Call this when the supply changes.
+        void clear();
+    };
+}
+
+#endif
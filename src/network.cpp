@@ -0,0 +1,93 @@
+#include "network.h"
+#include "snapshot.h"
+
+#include <algorithm>
+
+namespace fasttrips {
+
+    static bool linkBeforeStop(const TransferLink& link, int stop_id) { return link.stop_id_ < stop_id; }
+
+    void TransferLinks::build(const StopStopToAttr& stop_stop_to_attr)
+    {
+        clear();
+        if (stop_stop_to_attr.empty()) { return; }
+
+        // the map is ordered so the last one is the max
+        int max_stop_id = stop_stop_to_attr.rbegin()->first;
+        offsets_.assign(max_stop_id+2, 0);
+
+        for (StopStopToAttr::const_iterator ssa_iter = stop_stop_to_attr.begin(); ssa_iter != stop_stop_to_attr.end(); ++ssa_iter) {
+            offsets_[ssa_iter->first+1] = (int)ssa_iter->second.size();
+        }
+        for (size_t idx = 1; idx < offsets_.size(); ++idx) {
+            offsets_[idx] += offsets_[idx-1];
+        }
+
+        // StopToAttr is ordered too, so each stop's links end up sorted by the other stop id
+        links_.reserve(offsets_.back());
+        for (StopStopToAttr::const_iterator ssa_iter = stop_stop_to_attr.begin(); ssa_iter != stop_stop_to_attr.end(); ++ssa_iter) {
+            for (StopToAttr::const_iterator sa_iter = ssa_iter->second.begin(); sa_iter != ssa_iter->second.end(); ++sa_iter) {
+                TransferLink link = { sa_iter->first, sa_iter->second, LinkAttributes() };
+                links_.push_back(link);
+            }
+        }
+    }
+
+    void TransferLinks::compileAttributes(const AttributeSlots& slots)
+    {
+        for (std::vector<TransferLink>::iterator it = links_.begin(); it != links_.end(); ++it) {
+            it->slots_ = LinkAttributes(it->attributes_, slots);
+        }
+    }
+
+    void TransferLinks::writeSnapshot(SnapshotWriter& writer) const
+    {
+        writer.writeTag("XFER");
+        writer.writeInts(offsets_);
+        writer.writeInt((int32_t)links_.size());
+        for (std::vector<TransferLink>::const_iterator it = links_.begin(); it != links_.end(); ++it) {
+            writer.writeInt(it->stop_id_);
+            writer.writeAttributes(it->attributes_);
+        }
+    }
+
+    void TransferLinks::readSnapshot(SnapshotReader& reader)
+    {
+        clear();
+        if (!reader.expectTag("XFER")) { return; }
+        reader.readInts(offsets_);
+        int num_links = reader.readInt();
+        if ((num_links < 0) || (offsets_.empty() ? (num_links != 0) : (offsets_.back() != num_links))) {
+            reader.markBad();
+        }
+        if (!reader.ok()) {
+            clear();
+            return;
+        }
+        links_.resize(num_links);
+        for (int link_num = 0; reader.ok() && (link_num < num_links); ++link_num) {
+            links_[link_num].stop_id_ = reader.readInt();
+            reader.readAttributes(links_[link_num].attributes_);
+        }
+    }
+
+    void TransferLinks::clear()
+    {
+        offsets_.clear();
+        links_.clear();
+    }
+
+    TransferLinkRange TransferLinks::linksFor(int stop_id) const
+    {
+        if ((stop_id < 0) || (stop_id+1 >= (int)offsets_.size())) { return TransferLinkRange(); }
+        return TransferLinkRange(links_.data() + offsets_[stop_id], links_.data() + offsets_[stop_id+1]);
+    }
+
+    const Attributes* TransferLinks::find(int stop_id, int other_stop_id) const
+    {
+        TransferLinkRange range = linksFor(stop_id);
+        const TransferLink* link = std::lower_bound(range.begin(), range.end(), other_stop_id, linkBeforeStop);
+        if ((link == range.end()) || (link->stop_id_ != other_stop_id)) { return NULL; }
+        return &(link->attributes_);
+    }
+}
@@ -0,0 +1,142 @@
+/**
+ * \file network.h
+ *
+ * Defines the compact, integer-indexed structures used to store the network supply.
+ *
+ * Fast-trips renumbers stops, trips, routes and modes to small consecutive integers,
+ * so the supply is stored in vectors indexed by those numbers rather than in maps.
+ */
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "access_egress.h"
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+namespace fasttrips {
+    class SnapshotReader;
+    class SnapshotWriter;
+
+    // Transfer information: stop id -> stop id -> attribute map
+    typedef std::map<int, Attributes> StopToAttr;
+    typedef std::map<int, StopToAttr> StopStopToAttr;
+
+    /**
+     * A map from non-negative integer ID to value, stored as a vector indexed by the ID.
+     *
+     * Lookups are an array read.  This is only appropriate for IDs that are dense,
+     * like the ID numbers fast-trips assigns.
+     */
+    template <typename T>
+    class IdVector
+    {
+    private:
+        std::vector<T>      values_;
+        std::vector<bool>   present_;
+        size_t              size_;
+
+    public:
+        IdVector() : size_(0) {}
+
+        /// Returns the value for the given ID, adding a default one if it's not here.  The ID must be non-negative.
+        T& operator[](int id) {
+            if (id >= (int)values_.size()) {
+                values_.resize(id+1, T());
+                present_.resize(id+1, false);
+            }
+            if (!present_[id]) {
+                present_[id] = true;
+                size_++;
+            }
+            return values_[id];
+        }
+
+        /// Returns the value for the given ID, or NULL if it's not here.
+        const T* find(int id) const {
+            if ((id < 0) || (id >= (int)values_.size()) || !present_[id]) { return NULL; }
+            return &values_[id];
+        }
+
+        /// Returns the value for the given ID, or NULL if it's not here.
+        T* find(int id) {
+            if ((id < 0) || (id >= (int)values_.size()) || !present_[id]) { return NULL; }
+            return &values_[id];
+        }
+
+        /// Number of IDs with values
+        size_t size() const { return size_; }
+        /// Largest ID that could have a value, for iterating.  -1 if empty.
+        int maxId() const { return (int)values_.size() - 1; }
+
+        /// Clears data
+        void clear() {
+            values_.clear();
+            present_.clear();
+            size_ = 0;
+        }
+    };
+
+    /// A transfer link to (or from) the given stop
+    typedef struct {
+        int             stop_id_;       ///< The stop at the other end of the transfer
+        Attributes      attributes_;    ///< Transfer link attributes
+        LinkAttributes  slots_;         ///< Transfer link attributes in slots; set by TransferLinks::compileAttributes()
+    } TransferLink;
+
+    /**
+     * A contiguous, read-only range of fasttrips::TransferLink instances.
+     * This points into the fasttrips::TransferLinks storage, so nothing is copied.
+     */
+    struct TransferLinkRange {
+        const TransferLink* begin_;
+        const TransferLink* end_;
+
+        TransferLinkRange() : begin_(NULL), end_(NULL) {}
+        TransferLinkRange(const TransferLink* b, const TransferLink* e) : begin_(b), end_(e) {}
+
+        const TransferLink* begin() const { return begin_; }
+        const TransferLink* end()   const { return end_;   }
+        size_t size()               const { return end_ - begin_; }
+        bool   empty()              const { return begin_ == end_; }
+    };
+
+    /**
+     * Transfer links in CSR form: the links for stop id s are at [offsets_[s], offsets_[s+1]) in links_,
+     * sorted by the stop id at the other end.
+     *
+     * The PathFinder keeps one of these keyed by origin stop and one keyed by destination stop.
+     */
+    class TransferLinks
+    {
+    private:
+        /// stop id -> index of its first link in links_.  Size is max stop id + 2.
+        std::vector<int>            offsets_;
+        /// links grouped by stop id
+        std::vector<TransferLink>   links_;
+
+    public:
+        /// Builds from the given stop id -> other stop id -> attributes map
+        void build(const StopStopToAttr& stop_stop_to_attr);
+        /// Sets the attribute slots for each link.  Call this once the weights are read.
+        void compileAttributes(const AttributeSlots& slots);
+        /// Write the links to a network snapshot
+        void writeSnapshot(SnapshotWriter& writer) const;
+        /// Read the links from a network snapshot.  Check the reader afterwards.
+        void readSnapshot(SnapshotReader& reader);
+        /// Clears data
+        void clear();
+        /// Number of links
+        size_t size() const { return links_.size(); }
+        /// Largest stop id that could have links, for iterating.  -1 if empty.
+        int maxStopId() const { return offsets_.empty() ? -1 : (int)offsets_.size() - 2; }
+
+        /// All the links for the given stop
+        TransferLinkRange linksFor(int stop_id) const;
+        /// The attributes of the link between the given stops, or NULL if there isn't one
+        const Attributes* find(int stop_id, int other_stop_id) const;
+    };
+}
+
+#endif
@@ -26,7 +26,8 @@ namespace fasttrips {
         cost_(0),
         capacity_problem_(false),
         initial_fare_(0),
-        initial_cost_(0)
+        initial_cost_(0),
+        signature_(0)
     {}
 
     Path::Path(bool outbound, bool enumerating) :
@@ -36,7 +37,8 @@ namespace fasttrips {
         cost_(0),
         capacity_problem_(false),
         initial_fare_(0),
-        initial_cost_(0)
+        initial_cost_(0),
+        signature_(0)
     {}
 
     Path::~Path()
@@ -73,6 +75,7 @@ namespace fasttrips {
     {
         links_.clear();
         boards_per_fareperiod_.clear();
+        signature_ = 0;
         cost_ = 0;
         capacity_problem_ = false;
     }
@@ -111,11 +114,10 @@ namespace fasttrips {
         return NULL;
     }
 
-    int Path::boardsForFarePeriod(const std::string& fare_period) const
+    int Path::boardsForFarePeriod(int fare_period_num) const
     {
-        std::map< std::string, int >::const_iterator iter = boards_per_fareperiod_.find(fare_period);
-        if (iter != boards_per_fareperiod_.end()) {
-            return iter->second;
+        if ((fare_period_num >= 0) && (fare_period_num < (int)boards_per_fareperiod_.size())) {
+            return boards_per_fareperiod_[fare_period_num];
         }
         return 0;
     }
@@ -142,6 +144,29 @@ namespace fasttrips {
         return false;
     }
 
+    size_t Path::signature() const
+    {
+        return signature_;
+    }
+
+    bool Path::sameLinks(const Path& path2) const
+    {
+        if (signature_ != path2.signature_) { return false; }
+        if (size() != path2.size()) { return false; }
+        for (size_t ind=0; ind<size(); ++ind) {
+            if (links_[ind].first                != path2[ind].first               ) { return false; }
+            if (links_[ind].second.deparr_mode_  != path2[ind].second.deparr_mode_ ) { return false; }
+            if (links_[ind].second.trip_id_      != path2[ind].second.trip_id_     ) { return false; }
+        }
+        return true;
+    }
+
+    /// Mixes the value into the hash
+    static inline void hashCombine(size_t& seed, int value)
+    {
+        seed ^= (size_t)value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
     // Add link to the path, modifying if necessary
     // Return feasibility (infeasible if two out of order trips)
     bool Path::addLink(int stop_id,
@@ -153,7 +178,7 @@ namespace fasttrips {
         // We'll likely modify this
         StopState new_link      = link;
         // for simplicity, don't need link to low cost path here.
-        new_link.low_cost_path_ = NULL;
+        new_link.low_cost_label_ = -1;
         bool feasible           = true;
 
         // if we already have liks
@@ -276,10 +301,15 @@ namespace fasttrips {
         fare_          += new_link.link_fare_;
         new_link.cost_  = cost_;
         links_.push_back( std::make_pair(stop_id, new_link) );
+        hashCombine(signature_, stop_id);
+        hashCombine(signature_, new_link.deparr_mode_);
+        hashCombine(signature_, new_link.trip_id_);
 
         // update boards_per_fareperiod_
         if (link.fare_period_) {
-            boards_per_fareperiod_[link.fare_period_->fare_period_] += 1;
+            int fare_period_num = link.fare_period_->fare_period_num_;
+            if (fare_period_num >= (int)boards_per_fareperiod_.size()) { boards_per_fareperiod_.resize(fare_period_num+1, 0); }
+            boards_per_fareperiod_[fare_period_num] += 1;
         }
 
         if (path_spec.trace_)
@@ -300,7 +330,7 @@ namespace fasttrips {
 
     // Returns the fare given the relevant fare period, adjusting for transfer from last fare period as applicable
     double Path::getFareWithTransfer(const PathFinder&  pf,
-                                     const std::string& last_fare_period,
+                                     int                last_fare_period_num,
                                      const FarePeriod*  fare_period) const
     {
         // no fare period --> no fare
@@ -310,12 +340,12 @@ namespace fasttrips {
 
         double fare = fare_period->price_;
         // no previous fare period -> no adjustment
-        if (last_fare_period == "") {
+        if (last_fare_period_num < 0) {
             return fare;
         }
 
         // get the transfer info
-        const FareTransfer* ft = pf.getFareTransfer(last_fare_period, fare_period->fare_period_);
+        const FareTransfer* ft = pf.getFareTransfer(last_fare_period_num, fare_period->fare_period_num_);
         if (ft == (const FareTransfer*)0) {
             return fare;
         }
@@ -370,11 +400,10 @@ namespace fasttrips {
 
         cost_               = 0;
         fare_               = 0;
-        std::string last_fare_period;
+        int last_fare_period_num = -1;
 
-        // for free transfer calculations -- fare_period -> (first board time, board count)
-        typedef std::map< std::string, std::pair<double,int> > FarePeriodForFreeTransfers;
-        FarePeriodForFreeTransfers fp_for_freexfers;
+        // for free transfer calculations -- fare period number -> (first board time, board count); count 0 means not boarded yet
+        std::vector< std::pair<double,int> > fp_for_freexfers;
 
         for (int index = start_ind; index != end_ind; index += inc)
         {
@@ -471,20 +500,23 @@ namespace fasttrips {
                 const FarePeriod* fp              = stop_state.fare_period_;
                 if (fp) {
                     // adjust fare
-                    stop_state.link_fare_         = getFareWithTransfer(pf, last_fare_period, fp);
+                    stop_state.link_fare_         = getFareWithTransfer(pf, last_fare_period_num, fp);
 
                     // check if free transfer based on fare attributes
-                    FarePeriodForFreeTransfers::iterator fpft_iter = fp_for_freexfers.find(fp->fare_period_);
-                    if (fpft_iter == fp_for_freexfers.end()) {
+                    if (fp->fare_period_num_ >= (int)fp_for_freexfers.size()) {
+                        fp_for_freexfers.resize(fp->fare_period_num_+1, std::make_pair(0.0, 0));
+                    }
+                    std::pair<double,int>& fp_freexfers = fp_for_freexfers[fp->fare_period_num_];
+                    if (fp_freexfers.second == 0) {
                         // initialize
-                        fp_for_freexfers[fp->fare_period_] = std::make_pair(trip_depart_time, 1);
+                        fp_freexfers = std::make_pair(trip_depart_time, 1);
                     } else {
                         // time since first board, in seconds
-                        double transfer_time_sec = (trip_depart_time - fp_for_freexfers[fp->fare_period_].first)*60.0;
+                        double transfer_time_sec = (trip_depart_time - fp_freexfers.first)*60.0;
 
                         // check if free transfer
                         if ((fp->transfers_ > 0) &&                                          // free transfer allowed
-                            (fp_for_freexfers[fp->fare_period_].second <= fp->transfers_) && // this one qualifies
+                            (fp_freexfers.second <= fp->transfers_) &&                       // this one qualifies
                             ((fp->transfer_duration_ < 0) ||                                 // no max transfer duration or
                              (transfer_time_sec <= fp->transfer_duration_)))                 //   transfer time <= transfer duration
                         {
@@ -492,14 +524,14 @@ namespace fasttrips {
                         }
 
                         // bump the count
-                        fp_for_freexfers[fp->fare_period_].second += 1;
+                        fp_freexfers.second += 1;
                     }
 
                     link_attr["fare"]             = stop_state.link_fare_;
                     // store last fare period
-                    last_fare_period              = fp->fare_period_;
+                    last_fare_period_num          = fp->fare_period_num_;
                 } else {
-                    last_fare_period              = "";
+                    last_fare_period_num          = -1;
                 }
 
                 stop_state.link_cost_             = pf.tallyLinkCost(supply_mode_num, path_spec, trace_file, *named_weights, link_attr, hush);
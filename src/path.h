@@ -3,6 +3,7 @@
  *
  * Defines Path class.
  */
+#include <cstddef>
 #include <iostream>
 #include <map>
 #include <vector>
@@ -21,7 +22,7 @@ namespace fasttrips {
     typedef struct {
         int     count_;             ///< Number of times this path was generated (for stochastic)
         double  probability_;       ///< Probability of this stop          (for stochastic)
-        int     prob_i_;            ///< Cumulative probability * INT_MULT (for stochastic)
+        double  cum_prob_;          ///< Cumulative probability            (for stochastic)
     } PathInfo;
 
     // Forward declarations
@@ -53,8 +54,11 @@ namespace fasttrips {
         /// and destination to origin order for inbound trips.
         std::vector< std::pair<int, StopState> > links_;
 
-        /// Boards per fare period.  Added by addLink()
-        std::map< std::string, int > boards_per_fareperiod_;
+        /// Boards per fare period number (see fasttrips::FarePeriod::fare_period_num_).  Added by addLink()
+        std::vector<int> boards_per_fareperiod_;
+
+        /// Hash of the (stop id, mode, trip id) sequence of links_.  Updated by addLink()
+        size_t  signature_;
 
     public:
         /// Default constructor
@@ -79,14 +83,19 @@ namespace fasttrips {
         const std::pair<int, StopState>& back() const;
               std::pair<int, StopState>& back();
         const std::pair<int, StopState>* lastAddedTrip() const;
-        int boardsForFarePeriod(const std::string& fare_period) const;
+        int boardsForFarePeriod(int fare_period_num) const;
 
         /// Comparison operator; determines ordering in PathSet
         bool operator<(const Path& other) const;
+        /// Hash of the (stop id, mode, trip id) sequence of the links, for finding duplicate paths
+        size_t signature() const;
+        /// Does the other path have the same (stop id, mode, trip id) sequence of links?
+        bool sameLinks(const Path& other) const;
 
-        /// Returns the fare given the relevant fare period, adjusting for transfer from last fare period as applicable
+        /// Returns the fare given the relevant fare period, adjusting for transfer from last fare period
+        /// (a fasttrips::FarePeriod::fare_period_num_, or -1 for none) as applicable
         double getFareWithTransfer(const PathFinder&  pf,
-                                   const std::string& last_fare_period,
+                                   int                last_fare_period_num,
                                    const FarePeriod*  fare_period) const;
 
         /// Add link to the path, modifying if necessary
@@ -0,0 +1,98 @@
+#include "path_results.h"
+
+namespace fasttrips {
+
+    void PathSetResults::build(const PathSet& pathset)
+    {
+        build(&pathset, 1);
+    }
+
+    void PathSetResults::build(const std::vector<PathSet>& pathsets)
+    {
+        build(pathsets.data(), pathsets.size());
+    }
+
+    void PathSetResults::build(const PathSet* pathsets, size_t num_pathsets)
+    {
+        // count first so each column is written once, in place
+        num_paths_ = 0;
+        num_links_ = 0;
+        pathset_paths_.assign(num_pathsets, 0);
+        pathset_links_.assign(num_pathsets, 0);
+        for (size_t ps_num = 0; ps_num < num_pathsets; ++ps_num) {
+            pathset_paths_[ps_num] = (int)pathsets[ps_num].size();
+            for (PathSet::const_iterator psi = pathsets[ps_num].begin(); psi != pathsets[ps_num].end(); ++psi) {
+                pathset_links_[ps_num] += (int)psi->first.size();
+            }
+            num_paths_ += pathset_paths_[ps_num];
+            num_links_ += pathset_links_[ps_num];
+        }
+
+        link_ints_.assign((size_t)NUM_LINK_INT_COLUMNS*num_links_, 0);
+        link_doubles_.assign((size_t)NUM_LINK_DOUBLE_COLUMNS*num_links_, 0.0);
+        path_doubles_.assign((size_t)NUM_PATH_DOUBLE_COLUMNS*num_paths_, 0.0);
+
+        // column starts
+        int*    path_num_col      = link_ints_.data();
+        int*    stop_id_col       = path_num_col      + num_links_;
+        int*    deparr_mode_col   = stop_id_col       + num_links_;
+        int*    trip_id_col       = deparr_mode_col   + num_links_;
+        int*    stop_succpred_col = trip_id_col       + num_links_;
+        int*    seq_col           = stop_succpred_col + num_links_;
+        int*    seq_succpred_col  = seq_col           + num_links_;
+
+        // label_ is column 0 and stays zero (TODO: label)
+        double* deparr_time_col   = link_doubles_.data() + num_links_;
+        double* link_time_col     = deparr_time_col   + num_links_;
+        double* link_fare_col     = link_time_col     + num_links_;
+        double* link_cost_col     = link_fare_col     + num_links_;
+        double* link_dist_col     = link_cost_col     + num_links_;
+        double* cost_col          = link_dist_col     + num_links_;
+        double* arrdep_time_col   = cost_col          + num_links_;
+
+        double* path_cost_col     = path_doubles_.data();
+        double* path_fare_col     = path_cost_col     + num_paths_;
+        double* probability_col   = path_fare_col     + num_paths_;
+        double* init_cost_col     = probability_col   + num_paths_;
+        double* init_fare_col     = init_cost_col     + num_paths_;
+
+        int ind      = 0;
+        int path_ind = 0;
+        for (size_t ps_num = 0; ps_num < num_pathsets; ++ps_num) {
+            int path_num = 0;
+            for (PathSet::const_iterator psi = pathsets[ps_num].begin(); psi != pathsets[ps_num].end(); ++psi) {
+                const Path& path = psi->first;
+
+                path_cost_col  [path_ind] = path.cost();
+                path_fare_col  [path_ind] = path.fare();
+                probability_col[path_ind] = psi->second.probability_;
+                init_cost_col  [path_ind] = path.initialCost();
+                init_fare_col  [path_ind] = path.initialFare();
+
+                for (size_t link_num = 0; link_num < path.size(); ++link_num) {
+                    const StopState& ss = path[link_num].second;
+
+                    path_num_col     [ind] = path_num;
+                    stop_id_col      [ind] = path[link_num].first;
+                    deparr_mode_col  [ind] = ss.deparr_mode_;
+                    trip_id_col      [ind] = ss.trip_id_;
+                    stop_succpred_col[ind] = ss.stop_succpred_;
+                    seq_col          [ind] = ss.seq_;
+                    seq_succpred_col [ind] = ss.seq_succpred_;
+
+                    deparr_time_col  [ind] = ss.deparr_time_;
+                    link_time_col    [ind] = ss.link_time_;
+                    link_fare_col    [ind] = ss.link_fare_;
+                    link_cost_col    [ind] = ss.link_cost_;
+                    link_dist_col    [ind] = ss.link_dist_;
+                    cost_col         [ind] = ss.cost_;
+                    arrdep_time_col  [ind] = ss.arrdep_time_;
+
+                    ind += 1;
+                }
+                path_num += 1;
+                path_ind += 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * \file path_results.h
+ *
+ * Defines the columnar buffer that path set results are returned to python in.
+ *
+ * The results for a batch of queries are written once, column by column, into memory that this
+ * object owns.  The extension hands that memory to numpy as Fortran-ordered arrays without copying,
+ * so each column (e.g. every link's trip id) is contiguous and the rows of one path set are a slice.
+ */
+#include <cstddef>
+#include <vector>
+
+#include "path.h"
+
+#ifndef PATH_RESULTS_H
+#define PATH_RESULTS_H
+
+namespace fasttrips {
+
+    /// Link int columns: path_num, stop_id, deparr_mode_, trip_id_, stop_succpred_, seq_, seq_succpred_
+    const int NUM_LINK_INT_COLUMNS    = 7;
+    /// Link double columns: label_, deparr_time_, link_time_, link_fare_, link_cost_, link_dist_, cost_, arrdep_time_
+    const int NUM_LINK_DOUBLE_COLUMNS = 8;
+    /// Path double columns: cost, fare, probability, initial cost, initial fare
+    const int NUM_PATH_DOUBLE_COLUMNS = 5;
+
+    /**
+     * Struct-of-arrays results for a batch of path sets, in batch order.
+     *
+     * Each column is stored contiguously, so column c of the link ints is
+     * linkInts()[c*numLinks() .. (c+1)*numLinks()).
+     */
+    class PathSetResults
+    {
+    private:
+        int                 num_paths_;
+        int                 num_links_;
+        /// path set index -> number of paths, number of links
+        std::vector<int>    pathset_paths_;
+        std::vector<int>    pathset_links_;
+
+        std::vector<int>    link_ints_;
+        std::vector<double> link_doubles_;
+        std::vector<double> path_doubles_;
+
+        void build(const PathSet* pathsets, size_t num_pathsets);
+
+    public:
+        PathSetResults() : num_paths_(0), num_links_(0) {}
+
+        /// Sizes the columns for the given path sets and fills them in
+        void build(const std::vector<PathSet>& pathsets);
+        /// Builds for a single path set
+        void build(const PathSet& pathset);
+
+        int numPaths() const { return num_paths_; }
+        int numLinks() const { return num_links_; }
+        /// Number of paths and links for the given path set
+        int numPaths(int pathset_num) const { return pathset_paths_[pathset_num]; }
+        int numLinks(int pathset_num) const { return pathset_links_[pathset_num]; }
+
+        /// Column-major, NUM_LINK_INT_COLUMNS x numLinks()
+        int*          linkInts()          { return link_ints_.data();    }
+        const int*    linkInts()    const { return link_ints_.data();    }
+        /// Column-major, NUM_LINK_DOUBLE_COLUMNS x numLinks()
+        double*       linkDoubles()       { return link_doubles_.data(); }
+        const double* linkDoubles() const { return link_doubles_.data(); }
+        /// Column-major, NUM_PATH_DOUBLE_COLUMNS x numPaths()
+        double*       pathDoubles()       { return path_doubles_.data(); }
+        const double* pathDoubles() const { return path_doubles_.data(); }
+    };
+}
+
+#endif
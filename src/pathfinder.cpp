@@ -1,4 +1,5 @@
 #include "pathfinder.h"
+#include "threadpool.h"
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -10,6 +11,7 @@
 
 #include <assert.h>
 #include <cmath>
+#include <cstdio>
 #include <ctime>
 #include <sstream>
 #include <ios>
@@ -17,6 +19,7 @@
 #include <iomanip>
 #include <stack>
 #include <string>
+#include <unordered_map>
 #include <math.h>
 #include <algorithm>
 
@@ -39,8 +42,17 @@ const char kPathSeparator =
 #  define D_LINKCOST(x) do {} while (0)
 #endif
 
-static std::ofstream label_file;
-static std::ofstream stopids_file;
+// Uncomment to record the LabelStopQueue operations in the trace log, for replaying with src/bench/label_stop_queue_bench.cpp
+// #define RECORD_LSQ
+
+#ifdef RECORD_LSQ
+#  define R_LSQ(x) do { if (path_spec.trace_) { x } } while (0)
+#else
+#  define R_LSQ(x) do {} while (0)
+#endif
+
+// Uncomment to track the lowest cost path to each link while labeling.  This is experimental; nothing uses it yet.
+// #define TRACK_LOW_COST_PATH
 
 namespace fasttrips {
 
@@ -50,8 +62,10 @@ namespace fasttrips {
     /**
      * This doesn't really do anything.
      */
-    PathFinder::PathFinder() : process_num_(-1), BUMP_BUFFER_(-1), STOCH_PATHSET_SIZE_(-1)
+    PathFinder::PathFinder() : process_num_(-1), BUMP_BUFFER_(-1), STOCH_PATHSET_SIZE_(-1), PRUNE_WITH_LOWER_BOUNDS_(false), LABELING_CACHE_(false), LABELING_CACHE_MB_(0), CONNECTION_SCAN_(false), ENUMERATION_THREADS_(0), num_fare_zones_(0)
     {
+        general_fare_periods_.begin_ = 0;
+        general_fare_periods_.end_   = 0;
     }
 
     void PathFinder::initializeParameters(
@@ -66,7 +80,12 @@ namespace fasttrips {
         bool       transfer_fare_ignore_pf,
         bool       transfer_fare_ignore_pe,
         int        max_num_paths,
-        double     min_path_probability)
+        double     min_path_probability,
+        bool       prune_with_lower_bounds,
+        bool       labeling_cache,
+        bool       connection_scan,
+        int        enumeration_threads,
+        int        labeling_cache_mb)
     {
         BUMP_BUFFER_                    = bump_buffer;
         DEPART_EARLY_ALLOWED_MIN_       = depart_early_allowed_min;
@@ -75,12 +94,57 @@ namespace fasttrips {
         STOCH_MAX_STOP_PROCESS_COUNT_   = stoch_max_stop_process_count;
         MAX_NUM_PATHS_                  = max_num_paths;
         MIN_PATH_PROBABILITY_           = min_path_probability;
+        PRUNE_WITH_LOWER_BOUNDS_        = prune_with_lower_bounds;
+        LABELING_CACHE_                 = labeling_cache;
+        LABELING_CACHE_MB_              = labeling_cache_mb;
+        CONNECTION_SCAN_                = connection_scan;
+        ENUMERATION_THREADS_            = enumeration_threads;
 
         Hyperlink::TIME_WINDOW_         = time_window;
         Hyperlink::STOCH_DISPERSION_    = stoch_dispersion;
         Hyperlink::UTILS_CONVERSION_    = utils_conversion;
         Hyperlink::TRANSFER_FARE_IGNORE_PATHFINDING_ = transfer_fare_ignore_pf;
         Hyperlink::TRANSFER_FARE_IGNORE_PATHENUM_    = transfer_fare_ignore_pe;
+
+        const double parameters[] = { time_window, bump_buffer, utils_conversion, depart_early_allowed_min,
+                                      arrive_late_allowed_min, (double)stoch_pathset_size, stoch_dispersion,
+                                      (double)stoch_max_stop_process_count, (double)transfer_fare_ignore_pf,
+                                      (double)transfer_fare_ignore_pe, (double)max_num_paths, min_path_probability,
+                                      (double)prune_with_lower_bounds, (double)labeling_cache,
+                                      (double)connection_scan, (double)enumeration_threads };
+        parameters_.assign(parameters, parameters + sizeof(parameters)/sizeof(double));
+
+        // cached labels are only good for the parameters they were labeled with.  The budget isn't one of those,
+        // so it's left out of parameters_ and changing it just drops what's over.
+        if (LABELING_CACHE_) {
+            labeling_cache_.setParameters(parameters_);
+            labeling_cache_.setMaxBytes((size_t)std::max(LABELING_CACHE_MB_, 0) * 1024 * 1024);
+        } else {
+            labeling_cache_.clear();
+        }
+
+        // only kept while it's used, since it's another copy of the stop times
+        if (!CONNECTION_SCAN_) {
+            connections_.clear();
+        } else if (connections_.empty()) {
+            connections_.build(trip_stop_times_);
+        }
+    }
+
+    void PathFinder::writeQueryCorpusHeader(std::ostream& ostr) const
+    {
+        writeCorpusParameters(ostr, parameters_);
+        writeCorpusStopTimes(ostr, trip_stop_times_);
+
+        std::vector<int>    bw_index;
+        std::vector<double> bw_data;
+        for (std::map<TripStop, double, struct TripStopCompare>::const_iterator bw_iter = bump_wait_.begin(); bw_iter != bump_wait_.end(); ++bw_iter) {
+            bw_index.push_back(bw_iter->first.trip_id_);
+            bw_index.push_back(bw_iter->first.seq_);
+            bw_index.push_back(bw_iter->first.stop_id_);
+            bw_data.push_back(bw_iter->second);
+        }
+        writeCorpusBumpWaits(ostr, bw_index, bw_data);
     }
 
     void PathFinder::readIntermediateFiles()
@@ -94,6 +158,7 @@ namespace fasttrips {
         readTransferLinks();
         readTripInfo();
         readWeights();
+        compileLinkCosts();
     }
 
     void PathFinder::readTripIds() {
@@ -214,6 +279,7 @@ namespace fasttrips {
         while (fare_period_file >> fare_id_num >> fp.fare_id_ >> fp.fare_period_ >> rsz.route_id_ >> rsz.origin_zone_ >> rsz.destination_zone_ >> fp.start_time_ >> fp.end_time_
                                 >> fp.price_ >> fp.transfers_ >> fp.transfer_duration_)
         {
+            fp.fare_period_num_ = farePeriodNum(fp.fare_period_);
             fare_periods_.insert(std::pair<RouteStopZone,FarePeriod>(rsz,fp));
         }
         if (process_num_ <= 1) {
@@ -237,6 +303,7 @@ namespace fasttrips {
             std::cout << "[" << string_xferamount << "]";
         }
 
+        FareTransferMap fare_transfer_rules;
         FareTransfer faretransfer;
         while (fare_transfer_file >> string_xferfrom >> string_xferto >> string_xfertype >> faretransfer.amount_) {
             if (string_xfertype == "transfer_free") {
@@ -249,12 +316,87 @@ namespace fasttrips {
                 std::cerr << "Don't understand transfer_fare_type [" << string_xfertype << "]" << std::endl;
                 exit(2);
             }
-            fare_transfer_rules_[ std::make_pair(string_xferfrom, string_xferto)] = faretransfer;
+            fare_transfer_rules[ std::make_pair(farePeriodNum(string_xferfrom), farePeriodNum(string_xferto))] = faretransfer;
         }
         if (process_num_ <= 1) {
-            std::cout << " => Read " << fare_transfer_rules_.size() << " fare transfer rules" << std::endl;
+            std::cout << " => Read " << fare_transfer_rules.size() << " fare transfer rules" << std::endl;
         }
         fare_transfer_file.close();
+
+        buildFareIndex(fare_transfer_rules);
+    }
+
+    int PathFinder::farePeriodNum(const std::string& fare_period)
+    {
+        std::map<std::string, int>::const_iterator fpn_iter = fare_period_nums_.find(fare_period);
+        if (fpn_iter != fare_period_nums_.end()) { return fpn_iter->second; }
+
+        int fare_period_num = (int)fare_period_names_.size();
+        fare_period_names_.push_back(fare_period);
+        fare_period_nums_[fare_period] = fare_period_num;
+        return fare_period_num;
+    }
+
+    void PathFinder::buildFareIndex(const FareTransferMap& fare_transfer_rules)
+    {
+        // fare transfer rules matrix
+        int num_fare_periods = (int)fare_period_names_.size();
+        FareTransfer no_transfer = { TRANSFER_NONE, 0.0 };
+        fare_transfer_rules_.assign(num_fare_periods*num_fare_periods, no_transfer);
+        for (FareTransferMap::const_iterator ftm_iter = fare_transfer_rules.begin(); ftm_iter != fare_transfer_rules.end(); ++ftm_iter) {
+            fare_transfer_rules_[ftm_iter->first.first*num_fare_periods + ftm_iter->first.second] = ftm_iter->second;
+        }
+
+        // the fare periods, grouped by key
+        fare_period_index_.clear();
+        fare_period_index_.reserve(fare_periods_.size());
+        for (FarePeriodMmap::const_iterator fp_iter = fare_periods_.begin(); fp_iter != fare_periods_.end(); ++fp_iter) {
+            fare_period_index_.push_back(&(fp_iter->second));
+        }
+
+        // size the tables
+        int max_route_id = -1;
+        num_fare_zones_  = 0;
+        for (FarePeriodMmap::const_iterator fp_iter = fare_periods_.begin(); fp_iter != fare_periods_.end(); ++fp_iter) {
+            max_route_id    = std::max(max_route_id,    fp_iter->first.route_id_);
+            num_fare_zones_ = std::max(num_fare_zones_, fp_iter->first.origin_zone_+1);
+            num_fare_zones_ = std::max(num_fare_zones_, fp_iter->first.destination_zone_+1);
+        }
+        FarePeriodRange no_fare_periods = { 0, 0 };
+        general_fare_periods_ = no_fare_periods;
+        route_fare_periods_.assign(max_route_id+1, no_fare_periods);
+        route_fare_zone_table_.assign(max_route_id+1, -1);
+        fare_zone_tables_.assign(num_fare_zones_*num_fare_zones_, no_fare_periods);
+
+        // fill them in, one key at a time
+        int num_zone_pairs = num_fare_zones_*num_fare_zones_;
+        int range_begin    = 0;
+        FarePeriodMmap::const_iterator fp_iter = fare_periods_.begin();
+        while (fp_iter != fare_periods_.end()) {
+            FarePeriodMmap::const_iterator range_end_iter = fare_periods_.upper_bound(fp_iter->first);
+            const RouteStopZone& rsz = fp_iter->first;
+            FarePeriodRange fp_range = { range_begin, range_begin + (int)std::distance(fp_iter, range_end_iter) };
+
+            bool has_route = (rsz.route_id_ >= 0);
+            bool has_zones = (rsz.origin_zone_ >= 0) && (rsz.destination_zone_ >= 0);
+            if (has_route && has_zones) {
+                if (route_fare_zone_table_[rsz.route_id_] < 0) {
+                    route_fare_zone_table_[rsz.route_id_] = (int)(fare_zone_tables_.size() / num_zone_pairs);
+                    fare_zone_tables_.resize(fare_zone_tables_.size() + num_zone_pairs, no_fare_periods);
+                }
+                fare_zone_tables_[route_fare_zone_table_[rsz.route_id_]*num_zone_pairs + rsz.origin_zone_*num_fare_zones_ + rsz.destination_zone_] = fp_range;
+            } else if (has_route && (rsz.origin_zone_ < 0) && (rsz.destination_zone_ < 0)) {
+                route_fare_periods_[rsz.route_id_] = fp_range;
+            } else if (!has_route && has_zones) {
+                fare_zone_tables_[rsz.origin_zone_*num_fare_zones_ + rsz.destination_zone_] = fp_range;
+            } else if (!has_route && (rsz.origin_zone_ < 0) && (rsz.destination_zone_ < 0)) {
+                general_fare_periods_ = fp_range;
+            }
+            // the lookup never searches for the rest (only one zone given)
+
+            range_begin = fp_range.end_;
+            fp_iter     = range_end_iter;
+        }
     }
 
     void PathFinder::readModeIds() {
@@ -315,14 +457,17 @@ namespace fasttrips {
             std::cout << "[" << string_attr_value        << "] ";
         }
         int attrs_read = 0;
+        StopStopToAttr transfer_links_o_d, transfer_links_d_o;
         while (transfer_file >> from_stop_id_num >> to_stop_id_num >> attr_name >> attr_value) {
             // o -> d -> attrs
-            transfer_links_o_d_[from_stop_id_num][to_stop_id_num][attr_name] = attr_value;
+            transfer_links_o_d[from_stop_id_num][to_stop_id_num][attr_name] = attr_value;
 
             // d -> o -> attrs
-            transfer_links_d_o_[to_stop_id_num][from_stop_id_num][attr_name] = attr_value;
+            transfer_links_d_o[to_stop_id_num][from_stop_id_num][attr_name] = attr_value;
             attrs_read++;
         }
+        transfer_links_o_d_.build(transfer_links_o_d);
+        transfer_links_d_o_.build(transfer_links_d_o);
         if (process_num_ <= 1) {
             std::cout << " => Read " << attrs_read << " lines" << std::endl;
         }
@@ -423,7 +568,7 @@ namespace fasttrips {
                 std::cerr << "Do not understand weight type [" << weight_type << "] in " << ss_weights.str() << std::endl;
                 exit(2);
             }
-            weight_lookup_[ucpm][supply_mode_num][weight_name] = the_weight;
+            weight_lookup_[ucpm][supply_mode_num].named_[weight_name] = the_weight;
             weights_read++;
         }
         if (process_num_ <= 1) {
@@ -432,6 +577,335 @@ namespace fasttrips {
         weights_file.close();
     }
 
+    void PathFinder::compileLinkCosts() {
+        attribute_slots_.clear();
+
+        for (WeightLookup::iterator iter_wl = weight_lookup_.begin(); iter_wl != weight_lookup_.end(); ++iter_wl) {
+            for (SupplyModeToWeights::iterator iter_s2w = iter_wl->second.begin(); iter_s2w != iter_wl->second.end(); ++iter_s2w) {
+                iter_s2w->second.compiled_ = CompiledWeights(iter_s2w->second.named_, attribute_slots_);
+            }
+        }
+        if (process_num_ <= 1) {
+            std::cout << "Compiled weights for " << attribute_slots_.size() << " attributes";
+            if (attribute_slots_.size() > INLINE_ATTRIBUTE_SLOTS) {
+                std::cout << "; the " << (attribute_slots_.size() - INLINE_ATTRIBUTE_SLOTS) << " past " << INLINE_ATTRIBUTE_SLOTS << " are costed more slowly";
+            }
+            std::cout << std::endl;
+        }
+
+        access_egress_links_.compileAttributes(attribute_slots_);
+        transfer_links_o_d_.compileAttributes(attribute_slots_);
+        transfer_links_d_o_.compileAttributes(attribute_slots_);
+        for (int trip_id_num = 0; trip_id_num <= trip_info_.maxId(); ++trip_id_num) {
+            TripInfo* trip_info = trip_info_.find(trip_id_num);
+            if (trip_info) { trip_info->trip_slots_ = LinkAttributes(trip_info->trip_attr_, attribute_slots_); }
+        }
+        zero_walk_transfer_slots_ = LinkAttributes(*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_, attribute_slots_);
+        // the transfer tables are costed with these
+        transfer_tables_.clear();
+    }
+
+    /// The network snapshot in the output directory
+    static const char* SNAPSHOT_FILE = "ft_intermediate_snapshot.bin";
+
+    /// Python's manifest of the intermediate files the network snapshot replaces.  See fasttrips.Assignment.write_snapshot_manifest()
+    static const char* SNAPSHOT_MANIFEST_FILE = "ft_intermediate_snapshot_manifest.txt";
+
+    bool PathFinder::readSnapshotManifest(std::string& manifest) const
+    {
+        std::ifstream file((output_dir_ + kPathSeparator + SNAPSHOT_MANIFEST_FILE).c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!file.is_open()) { return false; }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        manifest = contents.str();
+        return true;
+    }
+
+    bool PathFinder::writeSnapshot() const
+    {
+        std::string snapshot_file = output_dir_ + kPathSeparator + SNAPSHOT_FILE;
+        std::string manifest;
+        if (!readSnapshotManifest(manifest)) {
+            if (process_num_ <= 1) {
+                std::cout << "No " << SNAPSHOT_MANIFEST_FILE << " to check a network snapshot against; not writing one" << std::endl;
+            }
+            return false;
+        }
+        // write to a temporary file first so other processes never see a partial snapshot
+        std::ostringstream ss_tmp;
+        ss_tmp << snapshot_file << ".tmp" << process_num_;
+        std::string tmp_file = ss_tmp.str();
+
+        SnapshotWriter writer(tmp_file);
+        writer.writeTag("SRCS");
+        writer.writeString(manifest);
+
+        writer.writeTag("TRIP");
+        writer.writeInt((int32_t)trip_num_to_str_.size());
+        for (std::map<int, std::string>::const_iterator it = trip_num_to_str_.begin(); it != trip_num_to_str_.end(); ++it) {
+            writer.writeInt(it->first);
+            writer.writeString(it->second);
+        }
+
+        writer.writeTag("STOP");
+        writer.writeInt((int32_t)stop_num_to_stop_.size());
+        for (int stop_id_num = 0; stop_id_num <= stop_num_to_stop_.maxId(); ++stop_id_num) {
+            const Stop* stop = stop_num_to_stop_.find(stop_id_num);
+            if (stop == NULL) { continue; }
+            writer.writeInt(stop_id_num);
+            writer.writeString(stop->stop_str_);
+            writer.writeInt(stop->zone_num_);
+        }
+
+        writer.writeTag("ROUT");
+        writer.writeInt((int32_t)route_num_to_str_.size());
+        for (std::map<int, std::string>::const_iterator it = route_num_to_str_.begin(); it != route_num_to_str_.end(); ++it) {
+            writer.writeInt(it->first);
+            writer.writeString(it->second);
+        }
+
+        writer.writeTag("FARE");
+        writer.writeInt((int32_t)fare_periods_.size());
+        for (FarePeriodMmap::const_iterator it = fare_periods_.begin(); it != fare_periods_.end(); ++it) {
+            writer.writeInt   (it->first.route_id_          );
+            writer.writeInt   (it->first.origin_zone_       );
+            writer.writeInt   (it->first.destination_zone_  );
+            writer.writeString(it->second.fare_id_          );
+            writer.writeString(it->second.fare_period_      );
+            writer.writeDouble(it->second.start_time_       );
+            writer.writeDouble(it->second.end_time_         );
+            writer.writeDouble(it->second.price_            );
+            writer.writeInt   (it->second.transfers_        );
+            writer.writeDouble(it->second.transfer_duration_);
+        }
+        int num_fare_periods   = (int)fare_period_names_.size();
+        int num_fare_transfers = 0;
+        for (std::vector<FareTransfer>::const_iterator it = fare_transfer_rules_.begin(); it != fare_transfer_rules_.end(); ++it) {
+            if (it->type_ != TRANSFER_NONE) { num_fare_transfers++; }
+        }
+        writer.writeInt(num_fare_transfers);
+        for (int from_num = 0; from_num < num_fare_periods; ++from_num) {
+            for (int to_num = 0; to_num < num_fare_periods; ++to_num) {
+                const FareTransfer& ft = fare_transfer_rules_[from_num*num_fare_periods + to_num];
+                if (ft.type_ == TRANSFER_NONE) { continue; }
+                writer.writeString(fare_period_names_[from_num]);
+                writer.writeString(fare_period_names_[to_num]  );
+                writer.writeInt   (ft.type_  );
+                writer.writeDouble(ft.amount_);
+            }
+        }
+
+        writer.writeTag("MODE");
+        writer.writeInt((int32_t)mode_num_to_str_.size());
+        for (std::map<int, std::string>::const_iterator it = mode_num_to_str_.begin(); it != mode_num_to_str_.end(); ++it) {
+            writer.writeInt(it->first);
+            writer.writeString(it->second);
+        }
+
+        access_egress_links_.writeSnapshot(writer);
+        transfer_links_o_d_.writeSnapshot(writer);
+        transfer_links_d_o_.writeSnapshot(writer);
+
+        writer.writeTag("TINF");
+        writer.writeInt((int32_t)trip_info_.size());
+        for (int trip_id_num = 0; trip_id_num <= trip_info_.maxId(); ++trip_id_num) {
+            const TripInfo* trip_info = trip_info_.find(trip_id_num);
+            if (trip_info == NULL) { continue; }
+            writer.writeInt(trip_id_num);
+            writer.writeInt(trip_info->supply_mode_num_);
+            writer.writeInt(trip_info->route_id_);
+            writer.writeAttributes(trip_info->trip_attr_);
+        }
+
+        writer.writeTag("WGHT");
+        writer.writeInt((int32_t)weight_lookup_.size());
+        for (WeightLookup::const_iterator iter_wl = weight_lookup_.begin(); iter_wl != weight_lookup_.end(); ++iter_wl) {
+            writer.writeString(iter_wl->first.user_class_      );
+            writer.writeString(iter_wl->first.purpose_         );
+            writer.writeInt   (iter_wl->first.demand_mode_type_);
+            writer.writeString(iter_wl->first.demand_mode_     );
+            writer.writeInt((int32_t)iter_wl->second.size());
+            for (SupplyModeToWeights::const_iterator iter_s2w = iter_wl->second.begin(); iter_s2w != iter_wl->second.end(); ++iter_s2w) {
+                writer.writeInt(iter_s2w->first);
+                writer.writeInt((int32_t)iter_s2w->second.named_.size());
+                for (NamedWeights::const_iterator iter_nw = iter_s2w->second.named_.begin(); iter_nw != iter_s2w->second.named_.end(); ++iter_nw) {
+                    writer.writeName  (iter_nw->first);
+                    writer.writeInt   (iter_nw->second.type_        );
+                    writer.writeDouble(iter_nw->second.weight_      );
+                    writer.writeDouble(iter_nw->second.log_base_    );
+                    writer.writeDouble(iter_nw->second.logistic_max_);
+                    writer.writeDouble(iter_nw->second.logistic_mid_);
+                }
+            }
+        }
+        writer.writeTag("END.");
+
+        if (!writer.close()) {
+            std::cerr << "Failed to write network snapshot " << tmp_file << std::endl;
+            std::remove(tmp_file.c_str());
+            return false;
+        }
+#ifdef _WIN32
+        // rename won't replace an existing file on windows
+        std::remove(snapshot_file.c_str());
+#endif
+        if (std::rename(tmp_file.c_str(), snapshot_file.c_str()) != 0) {
+            std::cerr << "Failed to rename network snapshot " << tmp_file << " to " << snapshot_file << std::endl;
+            std::remove(tmp_file.c_str());
+            return false;
+        }
+        if (process_num_ <= 1) {
+            std::cout << "Wrote network snapshot " << snapshot_file << std::endl;
+        }
+        return true;
+    }
+
+    bool PathFinder::readSnapshot()
+    {
+        std::string snapshot_file = output_dir_ + kPathSeparator + SNAPSHOT_FILE;
+        SnapshotReader reader;
+        if (!reader.open(snapshot_file)) { return false; }
+        std::string manifest;
+        bool current = readSnapshotManifest(manifest) && reader.expectTag("SRCS") && (reader.readString() == manifest) && reader.ok();
+        if (!current) {
+            if (process_num_ <= 1) {
+                std::cout << "Network snapshot " << snapshot_file << " is out of date; reading intermediate files" << std::endl;
+            }
+            return false;
+        }
+
+        if (reader.expectTag("TRIP")) {
+            int num_trips = reader.readInt();
+            for (int trip_num = 0; reader.ok() && (trip_num < num_trips); ++trip_num) {
+                int trip_id_num = reader.readInt();
+                trip_num_to_str_.insert(trip_num_to_str_.end(), std::make_pair(trip_id_num, reader.readString()));
+            }
+        }
+
+        if (reader.expectTag("STOP")) {
+            int num_stops = reader.readInt();
+            for (int stop_num = 0; reader.ok() && (stop_num < num_stops); ++stop_num) {
+                int stop_id_num = reader.readInt();
+                if (stop_id_num < 0) { reader.markBad(); break; }
+                Stop& stop     = stop_num_to_stop_[stop_id_num];
+                stop.stop_str_ = reader.readString();
+                stop.zone_num_ = reader.readInt();
+            }
+        }
+
+        if (reader.expectTag("ROUT")) {
+            int num_routes = reader.readInt();
+            for (int route_num = 0; reader.ok() && (route_num < num_routes); ++route_num) {
+                int route_id_num = reader.readInt();
+                route_num_to_str_.insert(route_num_to_str_.end(), std::make_pair(route_id_num, reader.readString()));
+            }
+        }
+
+        if (reader.expectTag("FARE")) {
+            int num_fare_periods = reader.readInt();
+            RouteStopZone rsz;
+            FarePeriod fp;
+            for (int fp_num = 0; reader.ok() && (fp_num < num_fare_periods); ++fp_num) {
+                rsz.route_id_          = reader.readInt();
+                rsz.origin_zone_       = reader.readInt();
+                rsz.destination_zone_  = reader.readInt();
+                fp.fare_id_            = reader.readString();
+                fp.fare_period_        = reader.readString();
+                fp.start_time_         = reader.readDouble();
+                fp.end_time_           = reader.readDouble();
+                fp.price_              = reader.readDouble();
+                fp.transfers_          = reader.readInt();
+                fp.transfer_duration_  = reader.readDouble();
+                fp.fare_period_num_    = farePeriodNum(fp.fare_period_);
+                // written in order, so this keeps the order of fare periods with the same key
+                fare_periods_.insert(fare_periods_.end(), std::pair<RouteStopZone,FarePeriod>(rsz,fp));
+            }
+            int num_fare_transfers = reader.readInt();
+            FareTransferMap fare_transfer_rules;
+            for (int ft_num = 0; reader.ok() && (ft_num < num_fare_transfers); ++ft_num) {
+                std::string from_fare_period = reader.readString();
+                std::string to_fare_period   = reader.readString();
+                FareTransfer faretransfer;
+                faretransfer.type_   = (FareTransferType)reader.readInt();
+                faretransfer.amount_ = reader.readDouble();
+                fare_transfer_rules[ std::make_pair(farePeriodNum(from_fare_period), farePeriodNum(to_fare_period))] = faretransfer;
+            }
+            buildFareIndex(fare_transfer_rules);
+        }
+
+        if (reader.expectTag("MODE")) {
+            int num_modes = reader.readInt();
+            for (int mode_num = 0; reader.ok() && (mode_num < num_modes); ++mode_num) {
+                int supply_mode_num = reader.readInt();
+                std::string mode    = reader.readString();
+                mode_num_to_str_[supply_mode_num] = mode;
+                if (mode == "transfer") { transfer_supply_mode_ = supply_mode_num; }
+            }
+        }
+
+        access_egress_links_.readSnapshot(reader);
+        transfer_links_o_d_.readSnapshot(reader);
+        transfer_links_d_o_.readSnapshot(reader);
+
+        if (reader.expectTag("TINF")) {
+            int num_trip_infos = reader.readInt();
+            for (int trip_num = 0; reader.ok() && (trip_num < num_trip_infos); ++trip_num) {
+                int trip_id_num = reader.readInt();
+                if (trip_id_num < 0) { reader.markBad(); break; }
+                TripInfo& trip_info       = trip_info_[trip_id_num];
+                trip_info.supply_mode_num_ = reader.readInt();
+                trip_info.route_id_        = reader.readInt();
+                reader.readAttributes(trip_info.trip_attr_);
+            }
+        }
+
+        if (reader.expectTag("WGHT")) {
+            int num_ucpms = reader.readInt();
+            for (int ucpm_num = 0; reader.ok() && (ucpm_num < num_ucpms); ++ucpm_num) {
+                UserClassPurposeMode ucpm;
+                ucpm.user_class_       = reader.readString();
+                ucpm.purpose_          = reader.readString();
+                ucpm.demand_mode_type_ = (DemandModeType)reader.readInt();
+                ucpm.demand_mode_      = reader.readString();
+                SupplyModeToWeights& supply_mode_weights = weight_lookup_[ucpm];
+
+                int num_supply_modes = reader.readInt();
+                for (int sm_num = 0; reader.ok() && (sm_num < num_supply_modes); ++sm_num) {
+                    int supply_mode_num = reader.readInt();
+                    NamedWeights& named_weights = supply_mode_weights[supply_mode_num].named_;
+
+                    int num_weights = reader.readInt();
+                    for (int weight_num = 0; reader.ok() && (weight_num < num_weights); ++weight_num) {
+                        std::string weight_name = reader.readName();
+                        Weight the_weight;
+                        the_weight.type_         = (WeightType)reader.readInt();
+                        the_weight.weight_       = reader.readDouble();
+                        the_weight.log_base_     = reader.readDouble();
+                        the_weight.logistic_max_ = reader.readDouble();
+                        the_weight.logistic_mid_ = reader.readDouble();
+                        named_weights.insert(named_weights.end(), std::make_pair(weight_name, the_weight));
+                    }
+                }
+            }
+        }
+
+        if (!reader.expectTag("END.") || !reader.atEnd()) {
+            if (process_num_ <= 1) {
+                std::cout << "Network snapshot " << snapshot_file << " is corrupt; reading intermediate files" << std::endl;
+            }
+            // nothing else has been loaded yet, so this just drops what was read
+            reset();
+            return false;
+        }
+        if (process_num_ <= 1) {
+            std::cout << "Read network snapshot " << snapshot_file << ": ";
+            std::cout << trip_num_to_str_.size() << " trips, " << stop_num_to_stop_.size() << " stops, ";
+            std::cout << route_num_to_str_.size() << " routes, " << transfer_links_o_d_.size() << " transfers, ";
+            std::cout << weight_lookup_.size() << " weight sets" << std::endl;
+        }
+        return true;
+    }
+
     const NamedWeights* PathFinder::getNamedWeights(
         const std::string& user_class,
         const std::string& purpose,
@@ -442,10 +916,10 @@ namespace fasttrips {
         UserClassPurposeMode ucpm = { user_class, purpose, demand_mode_type, demand_mode};
         WeightLookup::const_iterator iter_wl = weight_lookup_.find(ucpm);
         if (iter_wl == weight_lookup_.end()) { return NULL; }
-        SupplyModeToNamedWeights::const_iterator iter_sm2nw = iter_wl->second.find(suppy_mode_num);
+        SupplyModeToWeights::const_iterator iter_sm2nw = iter_wl->second.find(suppy_mode_num);
         if (iter_sm2nw == iter_wl->second.end()) { return NULL; }
 
-        return &(iter_sm2nw->second);
+        return &(iter_sm2nw->second.named_);
     }
 
     const Attributes* PathFinder::getAccessAttributes(
@@ -461,34 +935,15 @@ namespace fasttrips {
         int origin_stop_id,
         int destination_stop_id) const
     {
-        if (PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_ == NULL) {
-            PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_ = new Attributes();
-            // TODO: make this configurable
-            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["walk_time_min"   ] = 0.0;
-            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["transfer_penalty"] = 0.1;
-            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["elevation_gain"  ] = 0.0;
-        }
-
         if (origin_stop_id == destination_stop_id) {
             return PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_;
         }
-        StopStopToAttr::const_iterator ssa_iter = transfer_links_o_d_.find(origin_stop_id);
-        if (ssa_iter == transfer_links_o_d_.end()) { return NULL; }
-
-        // ssa_iter->second is a StopToAttr
-        StopToAttr::const_iterator sa_iter = ssa_iter->second.find(destination_stop_id);
-        if (sa_iter == ssa_iter->second.end()) { return NULL; }
-
-        // sa_iter->second is Attributes
-        return &(sa_iter->second);
+        return transfer_links_o_d_.find(origin_stop_id, destination_stop_id);
     }
 
     const TripInfo* PathFinder::getTripInfo(int trip_id_num) const
     {
-        std::map<int, TripInfo>::const_iterator it = trip_info_.find(trip_id_num);
-        if (it == trip_info_.end()) { return NULL; }
-
-        return &(it->second);
+        return trip_info_.find(trip_id_num);
     }
 
     int PathFinder::getRouteIdForTripId(int trip_id_num) const
@@ -500,7 +955,7 @@ namespace fasttrips {
     // Accessor for TripStopTime for given trip id, stop sequence
     const TripStopTime& PathFinder::getTripStopTime(int trip_id, int stop_seq) const
     {
-        const TripStopTime& tst = trip_stop_times_.find(trip_id)->second[stop_seq-1];  // stop sequences start at 1
+        const TripStopTime& tst = trip_stop_times_.forTrip(trip_id).begin()[stop_seq-1];  // stop sequences start at 1
         if (tst.seq_ != stop_seq) {
             printf("getTripStopTime: this shouldn't happen!");
         }
@@ -512,22 +967,43 @@ namespace fasttrips {
         int         process_num,
         int*        stoptime_index,
         double*     stoptime_times,
-        int         num_stoptimes)
+        int         num_stoptimes,
+        bool        use_snapshot)
     {
         output_dir_  = output_dir;
         process_num_ = process_num;
-        if (trip_stop_times_.size() == 0)
+
+        // Set this up here rather than lazily in getTransferAttributes() so that
+        // findPathSet() can be called from multiple threads
+        if (PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_ == NULL) {
+            PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_ = new Attributes();
+            // TODO: make this configurable
+            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["walk_time_min"   ] = 0.0;
+            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["transfer_penalty"] = 0.1;
+            (*PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_)["elevation_gain"  ] = 0.0;
+        }
+
+        if (trip_stop_times_.empty())
         {
-            // nothing has run yet -- read intermediate files
-            readIntermediateFiles();
+            // nothing has run yet -- read the snapshot or the intermediate files
+            if (use_snapshot && readSnapshot()) {
+                compileLinkCosts();
+            } else {
+                readIntermediateFiles();
+                // the first process writes it for the rest
+                if (use_snapshot && (process_num_ <= 1)) { writeSnapshot(); }
+            }
         } else
         {
             // previous iterations have run so the network is still valid, but we need to update the stop times
             // reset these
             trip_stop_times_.clear();
-            stop_trip_times_.clear();
+            stop_time_index_.clear();
         }
 
+        std::vector<TripStopTime> all_stop_times;
+        all_stop_times.reserve(num_stoptimes);
+
         for (int i=0; i<num_stoptimes; ++i) {
             TripStopTime stt = {
                 stoptime_index[3*i],    // trip id
@@ -538,11 +1014,12 @@ namespace fasttrips {
                 stoptime_times[4*i+2],  // shape_dist_traveled
                 stoptime_times[4*i+3]   // overcap
             };
-            // verify the sequence number makes sense: sequential, starts with 1
-            assert(stt.sequence_ == trip_stop_times_[stt.trip_id_].size()+1);
-
-            trip_stop_times_[stt.trip_id_].push_back(stt);
-            stop_trip_times_[stt.stop_id_].push_back(stt);
+            // stop states only hold 16-bit sequences
+            if (stt.seq_ > MAX_STOP_SEQUENCE) {
+                std::cerr << "Trip " << tripStringForId(stt.trip_id_) << " has more than " << MAX_STOP_SEQUENCE << " stops; that's not supported." << std::endl;
+                exit(2);
+            }
+            all_stop_times.push_back(stt);
             // if (false && (process_num <= 1) && ((i<5) || (i>num_stoptimes-5))) {
             if (stt.overcap_ > 0) {
                 std::cerr << "stoptimes[" << tripStringForId(stt.trip_id_) << "," << stt.seq_ << "," << stopStringForId(stt.stop_id_) << "] = ";
@@ -553,25 +1030,120 @@ namespace fasttrips {
                 std::cerr << ", overcap:" << stt.overcap_ << std::endl;
             }
         }
+        // this verifies the sequence numbers make sense: sequential, starting with 1
+        trip_stop_times_.build(all_stop_times);
+        stop_time_index_.build(all_stop_times, trip_stop_times_);
+        if (CONNECTION_SCAN_) { connections_.build(trip_stop_times_); }
+        cost_bounds_.clear();
+        labeling_cache_.clear();
+    }
+
+    /**
+     * Flags the stops of the given trip in the dirty stops for LabelingCache::invalidate().
+     * A change anywhere on a trip can matter to any query that labeled one of its stops,
+     * since that's where labeling would have considered it.
+     */
+    static void markDirtyTrip(const TripStopTimes& trip_stop_times, int trip_id, std::vector<bool>& dirty_stops)
+    {
+        TripStopTimeRange trip_stops = trip_stop_times.forTrip(trip_id);
+        for (const TripStopTime* tst = trip_stops.begin(); tst != trip_stops.end(); ++tst) {
+            if (tst->stop_id_ >= (int)dirty_stops.size()) { dirty_stops.resize(tst->stop_id_+1, false); }
+            dirty_stops[tst->stop_id_] = true;
+        }
+    }
+
+    void PathFinder::updateStopTimes(
+        int*        stoptime_index,
+        double*     stoptime_times,
+        int         num_stoptimes)
+    {
+        std::vector< std::pair<TripStopTime, TripStopTime> > changes;
+        changes.reserve(num_stoptimes);
+
+        // look them all up before patching anything, so the old times are the ones the index is sorted by
+        for (int i=0; i<num_stoptimes; ++i) {
+            const TripStopTime* old_stt = trip_stop_times_.find(stoptime_index[3*i], stoptime_index[3*i+1]);
+            if ((old_stt == NULL) || (old_stt->stop_id_ != stoptime_index[3*i+2])) {
+                std::cerr << "updateStopTimes: stop time [" << stoptime_index[3*i] << "," << stoptime_index[3*i+1] << ",";
+                std::cerr << stoptime_index[3*i+2] << "] wasn't given to initializeSupply" << std::endl;
+                exit(2);
+            }
+            TripStopTime stt = *old_stt;
+            stt.arrive_time_     = stoptime_times[4*i];
+            stt.depart_time_     = stoptime_times[4*i+1];
+            stt.shape_dist_trav_ = stoptime_times[4*i+2];
+            stt.overcap_         = stoptime_times[4*i+3];
+            changes.push_back(std::make_pair(*old_stt, stt));
+        }
+
+        // the stop time index refers to these, so it only needs the stops whose times moved re-sorted
+        std::vector<int> moved_stops;
+        for (std::vector< std::pair<TripStopTime, TripStopTime> >::const_iterator it = changes.begin(); it != changes.end(); ++it) {
+            *trip_stop_times_.find(it->second.trip_id_, it->second.seq_) = it->second;
+            if ((it->first.arrive_time_ != it->second.arrive_time_) || (it->first.depart_time_ != it->second.depart_time_)) {
+                moved_stops.push_back(it->second.stop_id_);
+            }
+        }
+        stop_time_index_.update(moved_stops);
+        // the connections are sorted by the old times
+        if (CONNECTION_SCAN_) { connections_.build(trip_stop_times_); }
+        // the least in-vehicle times may have changed
+        cost_bounds_.clear();
+        if (PRUNE_WITH_LOWER_BOUNDS_) {
+            // and the labels were pruned with the old bounds, which may have changed anywhere
+            labeling_cache_.clear();
+        } else if (labeling_cache_.size() > 0) {
+            std::vector<bool> dirty_stops;
+            for (std::vector< std::pair<TripStopTime, TripStopTime> >::const_iterator it = changes.begin(); it != changes.end(); ++it) {
+                markDirtyTrip(trip_stop_times_, it->second.trip_id_, dirty_stops);
+            }
+            labeling_cache_.invalidate(dirty_stops);
+        }
+        if (process_num_ <= 1) {
+            std::cout << "Updated " << num_stoptimes << " stop times in place" << std::endl;
+        }
     }
 
     void PathFinder::setBumpWait(int*       bw_index,
                                  double*    bw_data,
                                  int        num_bw)
     {
+        std::vector<bool> dirty_stops;
         for (int i=0; i<num_bw; ++i) {
             TripStop ts = { bw_index[3*i], bw_index[3*i+1], bw_index[3*i+2] };
+            std::map<TripStop, double, struct TripStopCompare>::const_iterator bw_iter = bump_wait_.find(ts);
+            if ((bw_iter == bump_wait_.end()) || (bw_iter->second != bw_data[i])) { markDirtyTrip(trip_stop_times_, ts.trip_id_, dirty_stops); }
             bump_wait_[ts] = bw_data[i];
             if (true && (process_num_ <= 1) && ((i<5) || (i>num_bw-5))) {
                 printf("bump_wait[%6d %6d %6d] = %f\n",
                        bw_index[3*i], bw_index[3*i+1], bw_index[3*i+2], bw_data[i] );
             }
         }
+        if (!dirty_stops.empty()) { labeling_cache_.invalidate(dirty_stops); }
+    }
+
+    void PathFinder::updateBumpWait(int*    bw_index,
+                                    double* bw_data,
+                                    int     num_bw)
+    {
+        std::vector<bool> dirty_stops;
+        for (int i=0; i<num_bw; ++i) {
+            TripStop ts = { bw_index[3*i], bw_index[3*i+1], bw_index[3*i+2] };
+            markDirtyTrip(trip_stop_times_, ts.trip_id_, dirty_stops);
+            if (bw_data[i] < 0) {
+                bump_wait_.erase(ts);
+            } else {
+                bump_wait_[ts] = bw_data[i];
+            }
+        }
+        if (!dirty_stops.empty()) { labeling_cache_.invalidate(dirty_stops); }
     }
 
     void PathFinder::reset()
     {
+        transfer_tables_.clear();
         weight_lookup_.clear();
+        attribute_slots_.clear();
         access_egress_links_.clear();
 
         transfer_links_o_d_.clear();
@@ -579,10 +1151,21 @@ namespace fasttrips {
 
         trip_info_.clear();
         trip_stop_times_.clear();
-        stop_trip_times_.clear();
+        stop_time_index_.clear();
+        connections_.clear();
+        cost_bounds_.clear();
         route_fares_.clear();
         fare_periods_.clear();
+        fare_period_names_.clear();
+        fare_period_nums_.clear();
         fare_transfer_rules_.clear();
+        fare_period_index_.clear();
+        route_fare_periods_.clear();
+        fare_zone_tables_.clear();
+        route_fare_zone_table_.clear();
+        num_fare_zones_ = 0;
+        general_fare_periods_.begin_ = 0;
+        general_fare_periods_.end_   = 0;
 
         trip_num_to_str_.clear();
         stop_num_to_stop_.clear();
@@ -590,6 +1173,7 @@ namespace fasttrips {
         mode_num_to_str_.clear();
 
         bump_wait_.clear();
+        labeling_cache_.clear();
     }
 
     /// This doesn't really do anything because the instance variables are all STL structures
@@ -603,6 +1187,16 @@ namespace fasttrips {
         PathSpecification path_spec,
         PathSet           &pathset,
         PerformanceInfo   &performance_info) const
+    {
+        StopStates stop_states;
+        return findPathSet(path_spec, pathset, performance_info, stop_states);
+    }
+
+    int PathFinder::findPathSet(
+        PathSpecification path_spec,
+        PathSet           &pathset,
+        PerformanceInfo   &performance_info,
+        StopStates        &stop_states) const
     {
         // for now we'll just trace
         // if (!path_spec.trace_) { return; }
@@ -611,8 +1205,10 @@ namespace fasttrips {
             std::cerr << "Crashing to test" << std::endl;
             exit(2);
         }
+        clearQueryCounters();
 
-        std::ofstream trace_file;
+        PathFinderContext context(path_spec);
+        TraceStream& trace_file = context.trace_file_;
         if (path_spec.trace_) {
             std::ostringstream ss;
             ss << output_dir_ << kPathSeparator;
@@ -643,125 +1239,421 @@ namespace fasttrips {
             std::ostringstream ss2;
             ss2 << output_dir_ << kPathSeparator;
             ss2 << "fasttrips_labels_ids_" << path_spec.person_id_ << "-" << path_spec.person_trip_id_ << ".csv";
-            stopids_file.open(ss2.str().c_str(), omode);
-            stopids_file << "stop_id,stop_id_label_iter,is_trip,label_stop_cost" << std::endl;
+            context.stopids_file_.open(ss2.str().c_str(), omode);
+            context.stopids_file_ << "stop_id,stop_id_label_iter,is_trip,label_stop_cost" << std::endl;
         }
 
-        StopStates           stop_states;
-        LabelStopQueue       label_stop_queue;
+        switch ((path_spec.outbound_ ? 4 : 0) + (path_spec.hyperpath_ ? 2 : 0) + (path_spec.trace_ ? 1 : 0)) {
+            case 0: return findPathSetForMode< SearchMode<false, false, false> >(path_spec, context, pathset, performance_info, stop_states);
+            case 1: return findPathSetForMode< SearchMode<false, false, true > >(path_spec, context, pathset, performance_info, stop_states);
+            case 2: return findPathSetForMode< SearchMode<false, true,  false> >(path_spec, context, pathset, performance_info, stop_states);
+            case 3: return findPathSetForMode< SearchMode<false, true,  true > >(path_spec, context, pathset, performance_info, stop_states);
+            case 4: return findPathSetForMode< SearchMode<true,  false, false> >(path_spec, context, pathset, performance_info, stop_states);
+            case 5: return findPathSetForMode< SearchMode<true,  false, true > >(path_spec, context, pathset, performance_info, stop_states);
+            case 6: return findPathSetForMode< SearchMode<true,  true,  false> >(path_spec, context, pathset, performance_info, stop_states);
+            default:return findPathSetForMode< SearchMode<true,  true,  true > >(path_spec, context, pathset, performance_info, stop_states);
+        }
+    }
 
 #ifdef _WIN32
+    typedef LARGE_INTEGER   QueryClock;
+
+    static void readClock(QueryClock& now) { QueryPerformanceCounter(&now); }
+
+    static long millisecondsBetween(const QueryClock& start, const QueryClock& end)
+    {
         // QueryPerformanceFrequency reference: https://msdn.microsoft.com/en-us/library/windows/desktop/dn553408(v=vs.85).aspx
-        LARGE_INTEGER        frequency;
-        LARGE_INTEGER        labeling_start_time, labeling_end_time, pathfind_end_time;
-        LARGE_INTEGER        label_elapsed, pathfind_elapsed;
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        // To guard against loss-of-precision, we convert
+        // to milliseconds *before* dividing by ticks-per-second.
+        return (long)(((end.QuadPart - start.QuadPart)*1000)/frequency.QuadPart);
+    }
+
+    static long long microsecondsBetween(const QueryClock& start, const QueryClock& end)
+    {
+        LARGE_INTEGER frequency;
         QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&labeling_start_time);
+        return ((end.QuadPart - start.QuadPart)*1000000)/frequency.QuadPart;
+    }
+
+    static void readMemoryUsage(PerformanceInfo& performance_info)
+    {
+        PROCESS_MEMORY_COUNTERS_EX pmc;
+        if ( GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)) )
+        {
+            performance_info.workingset_bytes_   = pmc.WorkingSetSize;
+            performance_info.privateusage_bytes_ = pmc.PrivateUsage;
+            performance_info.mem_timestamp_      = (long)time((time_t*)0);
+        }
+    }
 #else
-        // using gettimeofday() since std::chrono is only c++11
-        struct timeval       labeling_start_time, labeling_end_time, pathfind_end_time;
-        gettimeofday(&labeling_start_time, NULL);
+    // using gettimeofday() since std::chrono is only c++11
+    typedef struct timeval  QueryClock;
+
+    static void readClock(QueryClock& now) { gettimeofday(&now, NULL); }
+
+    static long millisecondsBetween(const QueryClock& start, const QueryClock& end)
+    {
+        // microseconds
+        long int diff = (end.tv_usec   + 1000000*end.tv_sec) -
+                        (start.tv_usec + 1000000*start.tv_sec);
+        return (long)(0.001*diff);
+    }
+
+    static long long microsecondsBetween(const QueryClock& start, const QueryClock& end)
+    {
+        return (end.tv_usec + 1000000LL*end.tv_sec) - (start.tv_usec + 1000000LL*start.tv_sec);
+    }
+
+    static void readMemoryUsage(PerformanceInfo& performance_info) {}
 #endif
 
-        int pf_returnstatus = -1;
-        bool success = initializeStopStates(path_spec, trace_file, stop_states, label_stop_queue);
-        if (!success) {
-            pf_returnstatus = PathFinder::RET_FAIL_INIT_STOP_STATES;
-            if (path_spec.trace_) {
+    /// Packages the labels for LabelingCache::insert()
+    static std::shared_ptr<const CachedLabels> cachedLabels(int status, const StopStates& stop_states)
+    {
+        std::shared_ptr<CachedLabels> labels(new CachedLabels());
+        labels->status_ = status;
+        stop_states.save(labels->stop_states_);
+        return labels;
+    }
+
+    template <class Mode>
+    int PathFinder::labelPathSet(
+        const PathSpecification& path_spec,
+        PathFinderContext&       context,
+        PerformanceInfo          &performance_info,
+        StopStates               &stop_states) const
+    {
+        TraceStream& trace_file = context.trace_file_;
+
+        QueryClock start_time, initialized_time, labeled_time;
+        readClock(start_time);
+
+        // whatever the last query left in here is stale
+        stop_states.clear();
+        LabelStopQueue       label_stop_queue;
+
+        // traced queries always label, so the trace is complete
+        bool use_cache = LABELING_CACHE_ && !Mode::trace_;
+        if (use_cache) {
+            std::shared_ptr<const CachedLabels> cached = labeling_cache_.find(path_spec);
+            if (cached) {
+                if (cached->status_ == PathFinder::RET_SUCCESS) { stop_states.restore(cached->stop_states_, Mode::outbound_); }
+                performance_info.num_labeled_stops_ = stop_states.size();
+                performance_info.label_cache_hit_   = 1;
+                readClock(initialized_time);
+                countQuery(COUNT_US_INITIALIZING, microsecondsBetween(start_time, initialized_time));
+                return cached->status_;
+            }
+        }
+
+        context.cost_bounds_.reset();
+        if (PRUNE_WITH_LOWER_BOUNDS_) { context.cost_bounds_ = costBoundsFor(path_spec); }
+        context.transfer_table_ = transferTableFor(path_spec, trace_file);
+
+        if (!initializeStopStates<Mode>(path_spec, context, stop_states, label_stop_queue)) {
+            if (Mode::trace_) {
                 trace_file << "initializeStopStates() failed.  Skipping labeling." << std::endl;
             }
+            stop_states.clear();
+            if (use_cache) { labeling_cache_.insert(path_spec, cachedLabels(PathFinder::RET_FAIL_INIT_STOP_STATES, stop_states)); }
+            return PathFinder::RET_FAIL_INIT_STOP_STATES;
         }
 
         // These are the stops that are reachable from the final TAZ
         std::map<int, int> reachable_final_stops;
-        if (success) {
-            success = setReachableFinalStops(path_spec, trace_file, reachable_final_stops);
-            if (!success) {
-                pf_returnstatus = PathFinder::RET_FAIL_SET_REACHABLE;
-                if (path_spec.trace_) {
-                    trace_file << "setReachableFinalStops() failed.  Skipping labeling." << std::endl;
-                }
+        if (!setReachableFinalStops(path_spec, context, reachable_final_stops)) {
+            if (Mode::trace_) {
+                trace_file << "setReachableFinalStops() failed.  Skipping labeling." << std::endl;
             }
+            stop_states.clear();
+            if (use_cache) { labeling_cache_.insert(path_spec, cachedLabels(PathFinder::RET_FAIL_SET_REACHABLE, stop_states)); }
+            return PathFinder::RET_FAIL_SET_REACHABLE;
         }
 
-        // don't go further if we failed an earlier step
-        if (!success) {
-            stop_states.clear();
+        readClock(initialized_time);
+        countQuery(COUNT_US_INITIALIZING, microsecondsBetween(start_time, initialized_time));
 
-            if (path_spec.trace_) {
+        if (!Mode::hyperpath_ && CONNECTION_SCAN_) {
+            performance_info.label_iterations_ = scanConnections<Mode>(path_spec, context, reachable_final_stops,
+                                                                 stop_states, label_stop_queue);
+        } else {
+            performance_info.label_iterations_ = labelStops<Mode>(path_spec, context, reachable_final_stops,
+                                                            stop_states, label_stop_queue, performance_info.max_process_count_);
+        }
+        readClock(labeled_time);
+        countQuery(COUNT_US_LABELING, microsecondsBetween(initialized_time, labeled_time));
+        performance_info.num_labeled_stops_ = stop_states.size();
+        performance_info.num_pruned_states_ = context.num_pruned_;
+        // before enumeration, which updates link fares in place
+        if (use_cache) { labeling_cache_.insert(path_spec, cachedLabels(PathFinder::RET_SUCCESS, stop_states)); }
+        return PathFinder::RET_SUCCESS;
+    }
+
+    template <class Mode>
+    int PathFinder::findPathSetForMode(
+        const PathSpecification& path_spec,
+        PathFinderContext&       context,
+        PathSet                  &pathset,
+        PerformanceInfo          &performance_info,
+        StopStates               &stop_states) const
+    {
+        TraceStream& trace_file = context.trace_file_;
+
+        QueryClock labeling_start_time, labeling_end_time, pathfind_end_time;
+        readClock(labeling_start_time);
+
+        int pf_returnstatus = labelPathSet<Mode>(path_spec, context, performance_info, stop_states);
+
+        // don't go further if we failed an earlier step
+        if (pf_returnstatus != PathFinder::RET_SUCCESS) {
+            performance_info.counters_ = queryCounters();
+            if (Mode::trace_) {
                 trace_file.close();
-                label_file.close();
-                stopids_file.close();
+                context.label_file_.close();
+                context.stopids_file_.close();
             }
             return pf_returnstatus;
         }
 
-        performance_info.label_iterations_ = labelStops(path_spec, trace_file, reachable_final_stops,
-                                                        stop_states, label_stop_queue, performance_info.max_process_count_);
-        performance_info.num_labeled_stops_ = stop_states.size();
+        readClock(labeling_end_time);
 
-#ifdef _WIN32
-        QueryPerformanceCounter(&labeling_end_time);
-#else
-        gettimeofday(&labeling_end_time, NULL);
-#endif
+        pf_returnstatus = getPathSet(path_spec, context, stop_states, pathset);
 
-        pf_returnstatus = getPathSet(path_spec, trace_file, stop_states, pathset);
+        readClock(pathfind_end_time);
+        performance_info.milliseconds_labeling_    = millisecondsBetween(labeling_start_time, labeling_end_time);
+        performance_info.milliseconds_enumerating_ = millisecondsBetween(labeling_end_time,   pathfind_end_time);
+        performance_info.counters_                 = queryCounters();
+        readMemoryUsage(performance_info);
 
-#ifdef _WIN32
-        QueryPerformanceCounter(&pathfind_end_time);
+        // done with the stop states; their memory is kept for the next query on this thread
+        stop_states.clear();
+
+        if (Mode::trace_) {
+
+            trace_file << "        label iterations: " << performance_info.label_iterations_    << std::endl;
+            trace_file << "       max process count: " << performance_info.max_process_count_   << std::endl;
+            if (PRUNE_WITH_LOWER_BOUNDS_) {
+                trace_file << "   pruned by lower bound: " << performance_info.num_pruned_states_   << std::endl;
+            }
+            trace_file << "   milliseconds labeling: " << performance_info.milliseconds_labeling_    << std::endl;
+            trace_file << "milliseconds enumerating: " << performance_info.milliseconds_enumerating_ << std::endl;
+            const long long* counts = performance_info.counters_.counts_;
+            trace_file << "queue pushes/pops/merged: " << counts[COUNT_QUEUE_PUSHES] << "/" << counts[COUNT_QUEUE_POPS] << "/" << counts[COUNT_QUEUE_MERGES] << std::endl;
+            trace_file << "  links added/rej/pruned: " << counts[COUNT_LINKS_ADDED] << "/" << counts[COUNT_LINKS_REJECTED] << "/" << counts[COUNT_LINKS_PRUNED] << std::endl;
+            trace_file << "      trips scanned/used: " << counts[COUNT_TRIPS_SCANNED] << "/" << counts[COUNT_TRIPS_USED] << std::endl;
+            trace_file << "       path draws/unique: " << counts[COUNT_PATH_DRAWS] << "/" << counts[COUNT_UNIQUE_PATHS] << std::endl;
+            trace_file.close();
+            context.label_file_.close();
+            context.stopids_file_.close();
+        }
+        return pf_returnstatus;
+    }
+
+    void PathFinder::findPathSetGroup(
+        const std::vector<PathSpecification>& path_specs,
+        const std::vector<int>&               group,
+        std::vector<PathSet>&                 pathsets,
+        std::vector<PerformanceInfo>&         performance_infos,
+        std::vector<int>&                     pf_returnstatus,
+        StopStates&                           stop_states) const
+    {
+        if (group.empty()) { return; }
+
+        const PathSpecification& lead_spec = path_specs[group.front()];
+        if ((group.size() == 1) || lead_spec.trace_) {
+            for (std::vector<int>::const_iterator spec_num = group.begin(); spec_num != group.end(); ++spec_num) {
+                pf_returnstatus[*spec_num] = findPathSet(path_specs[*spec_num], pathsets[*spec_num],
+                                                         performance_infos[*spec_num], stop_states);
+            }
+            return;
+        }
+
+        if (lead_spec.user_class_ == "crash") {
+            std::cerr << "Crashing to test" << std::endl;
+            exit(2);
+        }
+
+        switch ((lead_spec.outbound_ ? 2 : 0) + (lead_spec.hyperpath_ ? 1 : 0)) {
+            case 0: findPathSetGroupForMode< SearchMode<false, false, false> >(path_specs, group, pathsets, performance_infos, pf_returnstatus, stop_states); break;
+            case 1: findPathSetGroupForMode< SearchMode<false, true,  false> >(path_specs, group, pathsets, performance_infos, pf_returnstatus, stop_states); break;
+            case 2: findPathSetGroupForMode< SearchMode<true,  false, false> >(path_specs, group, pathsets, performance_infos, pf_returnstatus, stop_states); break;
+            default:findPathSetGroupForMode< SearchMode<true,  true,  false> >(path_specs, group, pathsets, performance_infos, pf_returnstatus, stop_states); break;
+        }
+    }
+
+    template <class Mode>
+    void PathFinder::findPathSetGroupForMode(
+        const std::vector<PathSpecification>& path_specs,
+        const std::vector<int>&               group,
+        std::vector<PathSet>&                 pathsets,
+        std::vector<PerformanceInfo>&         performance_infos,
+        std::vector<int>&                     pf_returnstatus,
+        StopStates&                           stop_states) const
+    {
+        const PathSpecification& lead_spec = path_specs[group.front()];
+        PerformanceInfo&         lead_info = performance_infos[group.front()];
+        PathFinderContext        lead_context(lead_spec);
+
+        QueryClock labeling_start_time, labeling_end_time;
+        readClock(labeling_start_time);
+        clearQueryCounters();
+        int label_status = labelPathSet<Mode>(lead_spec, lead_context, lead_info, stop_states);
+        readClock(labeling_end_time);
+
+        if (label_status != PathFinder::RET_SUCCESS) {
+            lead_info.counters_ = queryCounters();
+            for (std::vector<int>::const_iterator spec_num = group.begin(); spec_num != group.end(); ++spec_num) {
+                pf_returnstatus[*spec_num] = label_status;
+            }
+            return;
+        }
+        lead_info.milliseconds_labeling_ = millisecondsBetween(labeling_start_time, labeling_end_time);
+
+        // enumeration updates link fares in place, so each path spec starts from the labels as they were
+        StopStatesCopy labels;
+        stop_states.save(labels);
 
-        label_elapsed.QuadPart                = labeling_end_time.QuadPart - labeling_start_time.QuadPart;
-        pathfind_elapsed.QuadPart             = pathfind_end_time.QuadPart - labeling_end_time.QuadPart;
+        for (std::vector<int>::const_iterator spec_num = group.begin(); spec_num != group.end(); ++spec_num) {
+            // each path spec gets its own context, so its own random number stream for enumeration
+            PathFinderContext context(path_specs[*spec_num]);
 
-        // We now have the elapsed number of ticks, along with the
-        // number of ticks-per-second. We use these values
-        // to convert to the number of elapsed milliseconds.
-        // To guard against loss-of-precision, we convert
-        // to microseconds *before* dividing by ticks-per-second.
-        label_elapsed.QuadPart    *= 1000;
-        label_elapsed.QuadPart    /= frequency.QuadPart;
-        pathfind_elapsed.QuadPart *= 1000;
-        pathfind_elapsed.QuadPart /= frequency.QuadPart;
+            // the lead's counters also include the labeling
+            if (spec_num != group.begin()) {
+                clearQueryCounters();
+                stop_states.restore(labels, Mode::outbound_);
+            }
 
-        performance_info.milliseconds_labeling_    = (long)label_elapsed.QuadPart;
-        performance_info.milliseconds_enumerating_ = (long)pathfind_elapsed.QuadPart;
+            QueryClock pathfind_start_time, pathfind_end_time;
+            readClock(pathfind_start_time);
+            pf_returnstatus[*spec_num] = getPathSet(path_specs[*spec_num], context, stop_states, pathsets[*spec_num]);
+            readClock(pathfind_end_time);
 
-        PROCESS_MEMORY_COUNTERS_EX pmc;
-        if ( GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)) )
-        {
-            performance_info.workingset_bytes_   = pmc.WorkingSetSize;
-            performance_info.privateusage_bytes_ = pmc.PrivateUsage;
-            performance_info.mem_timestamp_      = (long)time((time_t*)0);
+            performance_infos[*spec_num].milliseconds_enumerating_ = millisecondsBetween(pathfind_start_time, pathfind_end_time);
+            performance_infos[*spec_num].counters_                 = queryCounters();
+            readMemoryUsage(performance_infos[*spec_num]);
         }
-#else
-        gettimeofday(&pathfind_end_time, NULL);
 
-        // microseconds
-        long int diff = (labeling_end_time.tv_usec   + 1000000*labeling_end_time.tv_sec) -
-                        (labeling_start_time.tv_usec + 1000000*labeling_start_time.tv_sec);
-        performance_info.milliseconds_labeling_ = 0.001*diff;
+        // done with the stop states; their memory is kept for the next query on this thread
+        stop_states.clear();
+    }
 
-        diff = (pathfind_end_time.tv_usec   + 1000000*pathfind_end_time.tv_sec) -
-               (labeling_end_time.tv_usec   + 1000000*labeling_end_time.tv_sec);
-        performance_info.milliseconds_enumerating_ = 0.001*diff;
-#endif
+    /// The linear weight for the given attribute, or zero if it's non-linear, negative or missing
+    static double linearWeight(const NamedWeights& weights, const std::string& attr_name)
+    {
+        NamedWeights::const_iterator iter_weight = weights.find(attr_name);
+        if ((iter_weight == weights.end()) || (iter_weight->second.type_ != WEIGHT_LINEAR)) { return 0.0; }
+        return std::max(0.0, iter_weight->second.weight_);
+    }
 
-        // clear stop states since they have path pointers
-        stop_states.clear();
+    std::shared_ptr<const CostBounds> PathFinder::costBoundsFor(const PathSpecification& path_spec) const
+    {
+        // deterministic costs are just minutes
+        BoundKey key = { path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_, path_spec.outbound_, 1.0, 1.0 };
 
-        if (path_spec.trace_) {
+        if (path_spec.hyperpath_) {
+            key.in_vehicle_weight_ = 0.0;
+            key.walk_weight_       = 0.0;
+
+            UserClassPurposeMode transit_ucpm = { path_spec.user_class_, path_spec.purpose_, MODE_TRANSIT, path_spec.transit_mode_ };
+            WeightLookup::const_iterator iter_transit_wl = weight_lookup_.find(transit_ucpm);
+            if ((iter_transit_wl != weight_lookup_.end()) && !iter_transit_wl->second.empty()) {
+                key.in_vehicle_weight_ = MAX_COST;
+                for (SupplyModeToWeights::const_iterator iter_s2w = iter_transit_wl->second.begin(); iter_s2w != iter_transit_wl->second.end(); ++iter_s2w) {
+                    key.in_vehicle_weight_ = std::min(key.in_vehicle_weight_, linearWeight(iter_s2w->second.named_, "in_vehicle_time_min"));
+                }
+            }
 
-            trace_file << "        label iterations: " << performance_info.label_iterations_    << std::endl;
-            trace_file << "       max process count: " << performance_info.max_process_count_   << std::endl;
-            trace_file << "   milliseconds labeling: " << performance_info.milliseconds_labeling_    << std::endl;
-            trace_file << "milliseconds enumerating: " << performance_info.milliseconds_enumerating_ << std::endl;
-            trace_file.close();
-            label_file.close();
-            stopids_file.close();
+            UserClassPurposeMode transfer_ucpm = { path_spec.user_class_, path_spec.purpose_, MODE_TRANSFER, "transfer" };
+            WeightLookup::const_iterator iter_transfer_wl = weight_lookup_.find(transfer_ucpm);
+            if (iter_transfer_wl != weight_lookup_.end()) {
+                SupplyModeToWeights::const_iterator iter_transfer_s2w = iter_transfer_wl->second.find(transfer_supply_mode_);
+                if (iter_transfer_s2w != iter_transfer_wl->second.end()) {
+                    // transfer walk_time_min is the transfer link time_min
+                    key.walk_weight_ = linearWeight(iter_transfer_s2w->second.named_, "walk_time_min");
+                }
+            }
+        }
+        return cost_bounds_.boundsFor(trip_stop_times_, transfer_links_o_d_, access_egress_links_, key);
+    }
+
+    std::shared_ptr<const TransferTable> PathFinder::transferTableFor(const PathSpecification& path_spec, std::ostream& trace_file) const
+    {
+        TransferTableKey key = { path_spec.user_class_, path_spec.purpose_, path_spec.hyperpath_, path_spec.outbound_ };
+        std::shared_ptr<const TransferTable> table = transfer_tables_.find(key);
+        if (table) { return table; }
+
+        // TODO: not having transfer weights means no transfers, silently.  We should have zero weights if we don't want to penalize.
+        UserClassPurposeMode transfer_ucpm = { path_spec.user_class_, path_spec.purpose_, MODE_TRANSFER, "transfer" };
+        WeightLookup::const_iterator iter_transfer_wl = weight_lookup_.find(transfer_ucpm);
+        if (iter_transfer_wl == weight_lookup_.end()) { return table; }
+        SupplyModeToWeights::const_iterator iter_transfer_s2w = iter_transfer_wl->second.find(transfer_supply_mode_);
+        if (iter_transfer_s2w == iter_transfer_wl->second.end()) { return table; }
+        const SupplyModeWeights& transfer_weights = iter_transfer_s2w->second;
+
+        std::shared_ptr<TransferTable> built(new TransferTable());
+        built->weights_        = &transfer_weights;
+        built->zero_walk_time_ = PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_->find("walk_time_min")->second;
+        built->zero_walk_cost_ = path_spec.hyperpath_ ?
+            tallyLinkCost(transfer_supply_mode_, path_spec, trace_file, transfer_weights, zero_walk_transfer_slots_) :
+            built->zero_walk_time_;
+
+        // outbound searches backwards, so transfers TO each stop; inbound transfers FROM each stop
+        const TransferLinks& transfer_links = (path_spec.outbound_ ? transfer_links_d_o_ : transfer_links_o_d_);
+        built->offsets_.assign(transfer_links.maxStopId()+2, 0);
+        built->hops_.reserve(transfer_links.size());
+        for (int stop_id = 0; stop_id <= transfer_links.maxStopId(); ++stop_id) {
+            TransferLinkRange transfer_range = transfer_links.linksFor(stop_id);
+            for (const TransferLink* transfer_it = transfer_range.begin(); transfer_it != transfer_range.end(); ++transfer_it) {
+                TransferHop hop = { transfer_it->stop_id_,
+                                    transfer_it->attributes_.find("time_min")->second,
+                                    transfer_it->attributes_.find("dist")->second,
+                                    0, NULL };
+                hop.cost_ = hop.time_;
+                if (path_spec.hyperpath_) {
+                    LinkAttributes link_attr = transfer_it->slots_;
+                    link_attr.set(SLOT_TRANSFER_PENALTY, 1.0); // TODO: make configurable or base off of IVT coefficient
+                    // fares are costed with the query's value of time
+                    if (link_attr.has(SLOT_FARE)) { hop.link_ = transfer_it; }
+                    hop.cost_ = tallyLinkCost(transfer_supply_mode_, path_spec, trace_file, transfer_weights, link_attr);
+                }
+                built->hops_.push_back(hop);
+            }
+            built->offsets_[stop_id+1] = (int)built->hops_.size();
+        }
+        return transfer_tables_.insert(key, built);
+    }
+
+#ifdef DEBUG_LINKCOST
+    /// Trace the cost of one weighted attribute.
+    static void traceWeightedAttribute(
+        std::ostream& trace_file,
+        const Weight& the_weight,
+        double attr_value,
+        double cost_part)
+    {
+        if (the_weight.type_ == WEIGHT_LINEAR) {
+            trace_file << std::setw(13) << std::setprecision(4) << std::fixed << the_weight.weight_;
+            trace_file << " x " << attr_value << " = " << cost_part << " (constant)" << std::endl;
+        } else if (the_weight.type_ == WEIGHT_EXPONENTIAL) {
+            trace_file << std::setw(13) << std::setprecision(4) << cost_part;
+            trace_file << " (exponential on " << attr_value << " with weight " << std::fixed << the_weight.weight_;
+            trace_file << ")" << std::endl;
+        } else if (the_weight.type_ == WEIGHT_LOGARITHMIC) {
+            trace_file << std::setw(13) << std::setprecision(4) << cost_part;
+            trace_file << " (logarithmic on " << attr_value << " with weight " << std::fixed << the_weight.weight_;
+            trace_file << ", log_base " << the_weight.log_base_;
+            trace_file << ")" << std::endl;
+        } else if (the_weight.type_ == WEIGHT_LOGISTIC) {
+            trace_file << std::setw(13) << std::setprecision(4) << cost_part;
+            trace_file << " (logistic on " << attr_value << " with weight " << std::setprecision(4) << std::fixed << the_weight.weight_;
+            trace_file << ", logistic_mid " << the_weight.logistic_mid_;
+            trace_file << ", logistic_max " << the_weight.logistic_max_;
+            trace_file << ")" << std::endl;
         }
-        return pf_returnstatus;
     }
+#endif
 
     double PathFinder::tallyLinkCost(
         const int supply_mode_num,
@@ -771,6 +1663,7 @@ namespace fasttrips {
         const Attributes& attributes,
         bool hush) const
     {
+        countQuery(COUNT_LINK_COST_TALLIES);
         // iterate through the weights
         double cost = 0;
         D_LINKCOST(
@@ -804,44 +1697,11 @@ namespace fasttrips {
                 continue;
             }
 
-            double cost_part = 0.0;
-            const Weight& the_weight = iter_weights->second;
-
             // handle constant and non constant weights
-            if (the_weight.type_ == WEIGHT_LINEAR) {
-                cost_part = the_weight.weight_ * iter_attr->second;
-                D_LINKCOST(
-                    trace_file << std::setw(13) << std::setprecision(4) << std::fixed << the_weight.weight_;
-                    trace_file << " x " << iter_attr->second << " = " << cost_part << " (constant)" << std::endl;
-                );
-            } else if (the_weight.type_ == WEIGHT_EXPONENTIAL) {
-                cost_part = (std::pow(1.0+the_weight.weight_, iter_attr->second) - 1.0) / std::log(1.0 + the_weight.weight_);
-                D_LINKCOST(
-                    trace_file << std::setw(13) << std::setprecision(4) << cost_part;
-                    trace_file << " (exponential on " << iter_attr->second << " with weight " << std::fixed << the_weight.weight_;
-                    trace_file << ")" << std::endl;
-                );
-            } else if (the_weight.type_ == WEIGHT_LOGARITHMIC) {
-                cost_part = the_weight.weight_ * ((1.0 + iter_attr->second) * std::log(1.0 + iter_attr->second) - iter_attr->second) / std::log(the_weight.log_base_);
-                D_LINKCOST(
-                    trace_file << std::setw(13) << std::setprecision(4) << cost_part;
-                    trace_file << " (logarithmic on " << iter_attr->second << " with weight " << std::fixed << the_weight.weight_;
-                    trace_file << ", log_base " << the_weight.log_base_;
-                    trace_file << ")" << std::endl;
-                );
-            } else if (the_weight.type_ == WEIGHT_LOGISTIC) {
-                double max_integral = (the_weight.logistic_max_ / the_weight.weight_) * std::log(std::exp(the_weight.weight_ * iter_attr->second) + std::exp(the_weight.weight_ * the_weight.logistic_mid_));
-                double min_integral = (the_weight.logistic_max_ / the_weight.weight_) * std::log(1.0 + std::exp(the_weight.weight_ * the_weight.logistic_mid_));
-
-                cost_part = max_integral - min_integral;
-                D_LINKCOST(
-                    trace_file << std::setw(13) << std::setprecision(4) << cost_part;
-                    trace_file << " (logistic on " << iter_attr->second << " with weight " << std::setprecision(4) << std::fixed << the_weight.weight_;
-                    trace_file << ", logistic_mid " << the_weight.logistic_mid_;
-                    trace_file << ", logistic_max " << the_weight.logistic_max_;
-                    trace_file << ")" << std::endl;
-                );
-            }
+            double cost_part = weightedAttribute(iter_weights->second, iter_attr->second);
+            D_LINKCOST(
+                traceWeightedAttribute(trace_file, iter_weights->second, iter_attr->second, cost_part);
+            );
             // cost needs to be positive and within bounds
             if ((cost_part >= 0) && (cost_part <= MAX_COST)) {
                 cost += cost_part;
@@ -859,7 +1719,7 @@ namespace fasttrips {
 
             D_LINKCOST(
                 trace_file << std::setw(26) << std::setfill(' ') << std::right << "fare" << ":  + ";
-                trace_file << std::setw(13) << std::setprecision(4) << std::fixed << (ivt_weight->second*60.0/path_spec.value_of_time_);
+                trace_file << std::setw(13) << std::setprecision(4) << std::fixed << (ivt_weight->second.weight_*60.0/path_spec.value_of_time_);
                 trace_file << " x " << fare_attr->second << std::endl;
             );
         }
@@ -870,47 +1730,151 @@ namespace fasttrips {
         return cost;
     }
 
+    double PathFinder::tallyLinkCost(
+        const int supply_mode_num,
+        const PathSpecification& path_spec,
+        std::ostream& trace_file,
+        const SupplyModeWeights& weights,
+        const LinkAttributes& attributes) const
+    {
+        countQuery(COUNT_LINK_COST_TALLIES);
+        const CompiledWeights& compiled = weights.compiled_;
+
+        // missing attributes are unusual; report them the slow way
+        if (!compiled.allSetIn(attributes)) {
+            for (NamedWeights::const_iterator iter_weights = weights.named_.begin(); iter_weights != weights.named_.end(); ++iter_weights) {
+                if (attributes.has(attribute_slots_.find(iter_weights->first))) { continue; }
+                if (path_spec.trace_) {
+                    trace_file << " => NO ATTRIBUTE CALLED " << iter_weights->first << " for " << modeStringForNum(supply_mode_num) << std::endl;
+                }
+                std::cerr << " => NO ATTRIBUTE CALLED " << iter_weights->first << " for " << modeStringForNum(supply_mode_num) << std::endl;
+            }
+        }
+
+        double cost = 0;
+        D_LINKCOST(
+            trace_file << "Link cost for " << std::setw(15) << std::setfill(' ') << std::left << modeStringForNum(supply_mode_num);
+            trace_file << std::setw(15) << std::setfill(' ') << std::right << "weight" << " x attribute" <<std::endl;
+        );
+
+        // linear weights: multiply-add; zero attributes contribute zero
+        const size_t num_linear = compiled.linear_slots_.size();
+        for (size_t idx = 0; idx < num_linear; ++idx) {
+            int slot = compiled.linear_slots_[idx];
+            if (!attributes.has(slot)) { continue; }
+
+            double cost_part = compiled.linear_weights_[idx] * attributes.get(slot);
+            D_LINKCOST(
+                trace_file << std::setw(26) << std::setfill(' ') << std::right << attribute_slots_.name(slot) << ":  + ";
+                trace_file << std::setw(13) << std::setprecision(4) << std::fixed << compiled.linear_weights_[idx];
+                trace_file << " x " << attributes.get(slot) << " = " << cost_part << " (constant)" << std::endl;
+            );
+            // cost needs to be positive and within bounds
+            if ((cost_part >= 0) && (cost_part <= MAX_COST)) {
+                cost += cost_part;
+            }
+        }
+
+        // non-linear weights
+        const size_t num_nonlinear = compiled.nonlinear_slots_.size();
+        for (size_t idx = 0; idx < num_nonlinear; ++idx) {
+            int slot = compiled.nonlinear_slots_[idx];
+            if (!attributes.has(slot)) { continue; }
+
+            double attr_value = attributes.get(slot);
+            if (attr_value == 0.0) { continue; }
+
+            double cost_part = weightedAttribute(compiled.nonlinear_weights_[idx], attr_value);
+            D_LINKCOST(
+                trace_file << std::setw(26) << std::setfill(' ') << std::right << attribute_slots_.name(slot) << ":  + ";
+                traceWeightedAttribute(trace_file, compiled.nonlinear_weights_[idx], attr_value, cost_part);
+            );
+            // cost needs to be positive and within bounds
+            if ((cost_part >= 0) && (cost_part <= MAX_COST)) {
+                cost += cost_part;
+            }
+        }
+
+        // fare is first converted to minutes using vot and then into utils using IVT weight
+        if (attributes.has(SLOT_FARE) && compiled.has_ivt_weight_) {
+            //       (60 min/hour)*(hours/vot currency)*(ivt_weight) x (currency)
+            cost += (60.0/path_spec.value_of_time_) * compiled.ivt_weight_ * attributes.get(SLOT_FARE);
+
+            D_LINKCOST(
+                trace_file << std::setw(26) << std::setfill(' ') << std::right << "fare" << ":  + ";
+                trace_file << std::setw(13) << std::setprecision(4) << std::fixed << (compiled.ivt_weight_*60.0/path_spec.value_of_time_);
+                trace_file << " x " << attributes.get(SLOT_FARE) << std::endl;
+            );
+        }
+        D_LINKCOST(
+            trace_file << std::setw(26) << std::setfill(' ') << "final cost" << ":  = ";
+            trace_file << std::setw(13) << std::setprecision(4) << std::fixed << cost << std::endl;
+        );
+        return cost;
+    }
+
+    template <class Mode>
     void PathFinder::addStopState(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         const int stop_id,
         const StopState& ss,
         const Hyperlink* prev_link,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue) const
     {
+        TraceStream& trace_file = context.trace_file_;
+
+        // prune it if even the best case from here to the end TAZ is past the cutoff.  The final links to the end TAZ have no bound.
+        if (context.cost_bounds_ && (stop_id < (int)context.cost_bounds_->size()) &&
+            (ss.deparr_mode_ != (Mode::outbound_ ? MODE_ACCESS : MODE_EGRESS)) &&
+            (ss.cost_ + (*context.cost_bounds_)[stop_id] > context.prune_cost_)) {
+            context.num_pruned_ += 1;
+            if (Mode::trace_) {
+                trace_file << "  + pruned stop " << stopStringForId(stop_id) << " cost " << ss.cost_;
+                trace_file << " + bound " << (*context.cost_bounds_)[stop_id] << " > " << context.prune_cost_ << std::endl;
+            }
+            return;
+        }
+
         // do we even want to incorporate this link to our stop state?
         bool rejected = false;
 
         // initialize the hyperlink if we need to
-        if (stop_states.find(stop_id) == stop_states.end()) {
-            Hyperlink h(stop_id, path_spec.outbound_);
-            stop_states[stop_id] = h;
-        }
-
-        Hyperlink& hyperlink = stop_states[stop_id];
+        Hyperlink& hyperlink = stop_states.add(stop_id, Mode::outbound_);
 
         // keep track if the state changed (label or time window)
         // if so, we'll want to trigger dealing with the effects by adding it to the queue
-        bool update_state = hyperlink.addLink(ss, prev_link, rejected, trace_file, path_spec, *this);
+        bool update_state = hyperlink.addLink<Mode>(ss, prev_link, rejected, trace_file, path_spec, *this);
+        countQuery(rejected ? COUNT_LINKS_REJECTED : COUNT_LINKS_ADDED);
+
+#ifdef TRACK_LOW_COST_PATH
+        if (!rejected) {
+            const StopStateKey ssk = { ss.deparr_mode_, ss.trip_id_, ss.stop_succpred_, ss.seq_, ss.seq_succpred_ };
+            hyperlink.updateLowCostPath(ssk, prev_link, stop_states, trace_file, path_spec, *this);
+        }
+#endif
 
         if (update_state) {
             LabelStop ls = { hyperlink.hyperpathCost(isTrip(ss.deparr_mode_)), stop_id, isTrip(ss.deparr_mode_) };
 
             // push this stop and it's departure time / arrival time for processing
             label_stop_queue.push( ls );
+            R_LSQ(
+                std::streamsize precision = trace_file.precision(17);
+                trace_file << "LSQ push " << ls.stop_id_ << " " << ls.is_trip_ << " " << ls.label_ << std::endl;
+                trace_file.precision(precision);
+            );
         }
 
         // the rest is for debugging
-        if (!path_spec.trace_) { return; }
+        if (!Mode::trace_) { return; }
 
         if (rejected) { return; }
 
-        static int link_num = 1;        // unique ID for the link
-        static int last_iter = -1;   // last stop id that got numbered
-
+        TraceStream& label_file = context.label_file_;
         if (!label_file.is_open()) {
-            link_num = 1;  // reset
+            context.label_link_num_ = 1;  // reset
 
             std::ostringstream ss;
             ss << output_dir_ << kPathSeparator;
@@ -923,7 +1887,7 @@ namespace fasttrips {
         for (int o_d = 0; o_d < 2; ++o_d) {
             // print it into the labels file
             label_file << ss.iteration_ << ",";
-            label_file << link_num      << ",";
+            label_file << context.label_link_num_ << ",";
 
             if (o_d == 0) { label_file << stopStringForId(stop_id) << ","; }
             else          { label_file << stopStringForId(ss.stop_succpred_) << ","; }
@@ -944,23 +1908,25 @@ namespace fasttrips {
             label_file << ss.link_time_ << ",";
             label_file << ss.link_cost_ << ",";
             label_file << std::fixed << ss.cost_ << ",";
-            if      ( path_spec.outbound_ && o_d == 0) { label_file << "A" << std::endl; }
-            else if (!path_spec.outbound_ && o_d == 1) { label_file << "A" << std::endl; }
+            if      ( Mode::outbound_ && o_d == 0) { label_file << "A" << std::endl; }
+            else if (!Mode::outbound_ && o_d == 1) { label_file << "A" << std::endl; }
             else                                       { label_file << "B" << std::endl; }
         }
-        ++link_num;
+        ++context.label_link_num_;
     }
 
+    template <class Mode>
     bool PathFinder::initializeStopStates(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue) const
     {
-        int     start_taz_id = path_spec.outbound_ ? path_spec.destination_taz_id_ : path_spec.origin_taz_id_;
-        double  dir_factor   = path_spec.outbound_ ? 1.0 : -1.0;
+        TraceStream& trace_file = context.trace_file_;
+        int     start_taz_id = Mode::outbound_ ? path_spec.destination_taz_id_ : path_spec.origin_taz_id_;
+        const double dir_factor   = Mode::dirFactor();
         // the stretch pref time -- allow late arrival or early departure
-        double  pref_time    = path_spec.outbound_ ? path_spec.preferred_time_ + ARRIVE_LATE_ALLOWED_MIN_ : path_spec.preferred_time_ - DEPART_EARLY_ALLOWED_MIN_;
+        double  pref_time    = Mode::outbound_ ? path_spec.preferred_time_ + ARRIVE_LATE_ALLOWED_MIN_ : path_spec.preferred_time_ - DEPART_EARLY_ALLOWED_MIN_;
 
         // are there any egress/access links for this TAZ?
         if (access_egress_links_.hasLinksForTaz(start_taz_id) == false) {
@@ -971,60 +1937,58 @@ namespace fasttrips {
         UserClassPurposeMode ucpm = {
             path_spec.user_class_,
             path_spec.purpose_,
-            path_spec.outbound_ ? MODE_EGRESS: MODE_ACCESS,
-            path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
+            Mode::outbound_ ? MODE_EGRESS: MODE_ACCESS,
+            Mode::outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
         };
         WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucpm);
         if (iter_weights == weight_lookup_.end()) {
             std::cerr << "Couldn't find any weights configured for user class/purpose (1) [" << path_spec.user_class_ << "/" << path_spec.purpose_ << "], ";
-            std::cerr << (path_spec.outbound_ ? "egress mode [" : "access mode [");
-            std::cerr << (path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_) << "] for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
+            std::cerr << (Mode::outbound_ ? "egress mode [" : "access mode [");
+            std::cerr << (Mode::outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_) << "] for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
             return false;
         }
 
-        if (path_spec.trace_) {
+        if (Mode::trace_) {
             // stop_id,stop_id_label_iter,is_trip,label_stop_cost
-            stopids_file << stopStringForId(start_taz_id) << ",0,0,0" << std::endl;
+            context.stopids_file_ << stopStringForId(start_taz_id) << ",0,0,0" << std::endl;
         }
 
         // Iterate through valid supply modes
-        SupplyModeToNamedWeights::const_iterator iter_s2w;
+        SupplyModeToWeights::const_iterator iter_s2w;
         for (iter_s2w  = iter_weights->second.begin();
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
 
-            if (path_spec.trace_) {
+            if (Mode::trace_) {
                 trace_file << "Weights exist for supply mode " << supply_mode_num << " => ";
                 trace_file << mode_num_to_str_.find(supply_mode_num)->second << std::endl;
             }
 
-            for (AccessEgressLinkAttr::const_iterator iter_aelk  = access_egress_links_.lower_bound(start_taz_id, supply_mode_num);
-                                                      iter_aelk != access_egress_links_.upper_bound(start_taz_id, supply_mode_num); ++iter_aelk)
+            // require preferrd_time_ in [start_time_, end_time)
+            // We could check the stretch pref time but I think we might as well check the actual preferred time since it's the goal
+            AccessEgressLinkPtrRange valid_links = access_egress_links_.linksAt(start_taz_id, supply_mode_num, path_spec.preferred_time_);
+            for (const AccessEgressLinkEntry* const* valid_it = valid_links.begin(); valid_it != valid_links.end(); ++valid_it)
             {
-
+                const AccessEgressLinkEntry* iter_aelk = *valid_it;
                 const AccessEgressLinkKey& aelk = iter_aelk->first;
 
-                // require preferrd_time_ in [start_time_, end_time)
-                // We could check the stretch pref time but I think we might as well check the actual preferred time since it's the goal
-                if (aelk.start_time_ >  path_spec.preferred_time_) continue;
-                if (aelk.end_time_   <= path_spec.preferred_time_) continue;
-
                 int stop_id = aelk.stop_id_;
-                Attributes link_attr = iter_aelk->second;
-                double attr_time = link_attr.find("time_min")->second;
-                double attr_dist = link_attr.find("dist")->second;
+                const Attributes& named_attr = iter_aelk->second.attributes_;
+                double attr_time = named_attr.find("time_min")->second;
+                double attr_dist = named_attr.find("dist")->second;
 
                 // outbound: departure time = destination - access
                 // inbound:  arrival time   = origin      + access
                 double deparr_time = pref_time - (attr_time*dir_factor);
                 // we start out with no delay
-                link_attr["depart_late_min"]    = 0;
-                link_attr["arrive_early_min"]   = 0;
-                link_attr["depart_early_min"]   = 0.0;
-                link_attr["arrive_late_min"]    = 0.0;
+                LinkAttributes link_attr = iter_aelk->second.slots_;
+                link_attr.set(SLOT_DEPART_LATE_MIN,  0.0);
+                link_attr.set(SLOT_ARRIVE_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_DEPART_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_ARRIVE_LATE_MIN,  0.0);
 
                 double cost;
-                if (path_spec.hyperpath_) {
+                if (Mode::hyperpath_) {
                     cost = tallyLinkCost(supply_mode_num, path_spec, trace_file, iter_s2w->second, link_attr);
                 } else {
                     cost = attr_time;
@@ -1032,7 +1996,7 @@ namespace fasttrips {
 
                 StopState ss(
                     deparr_time,                                                                // departure/arrival time
-                    path_spec.outbound_ ? MODE_EGRESS : MODE_ACCESS,                            // departure/arrival mode
+                    Mode::outbound_ ? MODE_EGRESS : MODE_ACCESS,                            // departure/arrival mode
                     supply_mode_num,                                                            // trip id
                     start_taz_id,                                                               // successor/predecessor
                     -1,                                                                         // sequence
@@ -1046,7 +2010,7 @@ namespace fasttrips {
                     path_spec.preferred_time_,                                                  // arrival/departure time
                     0.0                                                                         // link ivt weight
                 );
-                addStopState(path_spec, trace_file, stop_id, ss, NULL, stop_states, label_stop_queue);
+                addStopState<Mode>(path_spec, context, stop_id, ss, NULL, stop_states, label_stop_queue);
 
             } // end iteration through links for the given supply mode
         } // end iteration through valid supply modes
@@ -1061,15 +2025,17 @@ namespace fasttrips {
      * *label_stop_queue*, this method will iterate through transfers to (for outbound) or
      * from (for inbound) the current stop and update the next stop given the current stop state.
      **/
+    template <class Mode>
     void PathFinder::updateStopStatesForTransfers(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
         int label_iteration,
         const LabelStop& current_label_stop) const
     {
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        TraceStream& trace_file = context.trace_file_;
+        const double dir_factor = Mode::dirFactor();
 
         // current_stop_state is a hyperlink
         // It should have trip-states in it, because otherwise it wouldn't have come up in the label stop queue to process
@@ -1077,23 +2043,20 @@ namespace fasttrips {
         double current_deparr_time     = current_stop_state.latestDepartureEarliestArrival(true);
         double nonwalk_label           = current_stop_state.hyperpathCost(true);
 
-        // Lookup transfer weights
-        // TODO: returning here is probably terrible and we shouldn't be silent... We should have zero weights if we don't want to penalize.
-        const NamedWeights* transfer_weights = getNamedWeights(path_spec.user_class_, path_spec.purpose_, MODE_TRANSFER, "transfer", transfer_supply_mode_);
-        if (transfer_weights == NULL) { return; }
+        // the transfers with their costs for this user class, purpose and direction
+        const TransferTable* transfer_table = context.transfer_table_.get();
+        if (transfer_table == NULL) { return; }
 
         // add zero-walk transfer to this stop
         int               xfer_stop_id  = current_label_stop.stop_id_;
-        const Attributes* zerowalk_xfer = getTransferAttributes(xfer_stop_id, xfer_stop_id);
-        double            transfer_time = zerowalk_xfer->find("walk_time_min")->second;  // todo: make this a different time?
+        double            transfer_time = transfer_table->zero_walk_time_;  // todo: make this a different time?
         double            deparr_time   = current_deparr_time - (transfer_time*dir_factor);
-        double            link_cost, cost, transfer_dist;
-        if (path_spec.hyperpath_)
+        double            link_cost     = transfer_table->zero_walk_cost_;
+        double            cost, transfer_dist;
+        if (Mode::hyperpath_)
         {
-            link_cost = tallyLinkCost(transfer_supply_mode_, path_spec, trace_file, *transfer_weights, *zerowalk_xfer);
             cost      = nonwalk_label + link_cost;
         } else {
-            link_cost = transfer_time;
             cost      = current_label_stop.label_ + link_cost;
         }
         // addStopState will handle logic of updating total cost
@@ -1113,33 +2076,30 @@ namespace fasttrips {
             current_deparr_time,            // arrival/departure time
       0.0                             // link ivt weight
         );
-        addStopState(path_spec, trace_file, xfer_stop_id, ss, &current_stop_state, stop_states, label_stop_queue);
+        addStopState<Mode>(path_spec, context, xfer_stop_id, ss, &current_stop_state, stop_states, label_stop_queue);
 
         // are there other relevant transfers?
         // if outbound, going backwards, so transfer TO this current stop
         // if inbound, going forwards, so transfer FROM this current stop
-        const StopStopToAttr&          transfer_links  = (path_spec.outbound_ ? transfer_links_d_o_ : transfer_links_o_d_);
-        StopStopToAttr::const_iterator transfer_map_it = transfer_links.find(current_label_stop.stop_id_);
-        bool                           found_transfers = (transfer_map_it != transfer_links.end());
-
-        if (!found_transfers) { return; }
-
-        for (StopToAttr::const_iterator transfer_it = transfer_map_it->second.begin();
-             transfer_it != transfer_map_it->second.end(); ++transfer_it)
+        const TransferHop* transfer_end = transfer_table->end(current_label_stop.stop_id_);
+        for (const TransferHop* transfer_it = transfer_table->begin(current_label_stop.stop_id_); transfer_it != transfer_end; ++transfer_it)
         {
-            xfer_stop_id    = transfer_it->first;
-            transfer_time   = transfer_it->second.find("time_min")->second;
-            transfer_dist   = transfer_it->second.find("dist")->second;
+            xfer_stop_id    = transfer_it->stop_id_;
+            transfer_time   = transfer_it->time_;
+            transfer_dist   = transfer_it->dist_;
             // outbound: departure time = latest departure - transfer
             //  inbound: arrival time   = earliest arrival + transfer
             deparr_time     = current_deparr_time - (transfer_time*dir_factor);
 
             // stochastic/hyperpath: cost update
-            if (path_spec.hyperpath_)
+            if (Mode::hyperpath_)
             {
-                Attributes link_attr            = transfer_it->second;
-                link_attr["transfer_penalty"]   = 1.0; // TODO: make configurable or base off of IVT coefficient
-                link_cost                       = tallyLinkCost(transfer_supply_mode_, path_spec, trace_file, *transfer_weights, link_attr);
+                link_cost                       = transfer_it->cost_;
+                if (transfer_it->link_) {
+                    LinkAttributes link_attr    = transfer_it->link_->slots_;
+                    link_attr.set(SLOT_TRANSFER_PENALTY, 1.0);
+                    link_cost                   = tallyLinkCost(transfer_supply_mode_, path_spec, trace_file, *transfer_table->weights_, link_attr);
+                }
                 cost                            = nonwalk_label + link_cost;
             }
             // deterministic: label = cost = total time, just additive
@@ -1151,7 +2111,7 @@ namespace fasttrips {
                 // check (departure mode, stop) if someone's waiting already
                 // curious... this only applies to OUTBOUND
                 // TODO: capacity stuff
-                if (path_spec.outbound_)
+                if (Mode::outbound_)
                 {
                     int current_trip = current_stop_state.lowestCostStopState(true).trip_id_;
                     TripStop ts = { current_trip, current_stop_state.lowestCostStopState(true).seq_, current_label_stop.stop_id_ };
@@ -1187,7 +2147,7 @@ namespace fasttrips {
                 current_deparr_time,            // arrival/departure time
         0.0                             // link ivt weight
             );
-            addStopState(path_spec, trace_file, xfer_stop_id, ss, &current_stop_state, stop_states, label_stop_queue);
+            addStopState<Mode>(path_spec, context, xfer_stop_id, ss, &current_stop_state, stop_states, label_stop_queue);
         }
     }
 
@@ -1196,9 +2156,10 @@ namespace fasttrips {
      * *label_stop_queue*, this method will iterate through access links to (for outbound) or
      * egress links from (for inbound) the current stop and update the next stop given the current stop state.
      */
+    template <class Mode>
     void PathFinder::updateStopStatesForFinalLinks(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         const std::map<int, int>& reachable_final_stops,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
@@ -1206,6 +2167,7 @@ namespace fasttrips {
         const LabelStop& current_label_stop,
         double& est_max_path_cost) const
     {
+        TraceStream& trace_file = context.trace_file_;
         // shortcut -- nothing to do if this isn't reachable to end taz
         if (reachable_final_stops.count(current_label_stop.stop_id_) == 0) {
             return;
@@ -1217,12 +2179,12 @@ namespace fasttrips {
         double current_deparr_time     = current_stop_state.latestDepartureEarliestArrival(true);
         double nonwalk_label           = current_stop_state.hyperpathCost(true);
 
-        int    end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        int    end_taz_id = Mode::outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        const double dir_factor = Mode::dirFactor();
 
         double earliest_dep_latest_arr = PathFinder::MAX_DATETIME;
-        if (path_spec.hyperpath_) {
-            earliest_dep_latest_arr = current_stop_state.earliestDepartureLatestArrival(path_spec.outbound_, true);
+        if (Mode::hyperpath_) {
+            earliest_dep_latest_arr = current_stop_state.earliestDepartureLatestArrival(Mode::outbound_, true);
         } else {
             earliest_dep_latest_arr = current_stop_state.lowestCostStopState(true).deparr_time_;
         }
@@ -1239,26 +2201,26 @@ namespace fasttrips {
         UserClassPurposeMode ucpm = {
             path_spec.user_class_,
             path_spec.purpose_,
-            path_spec.outbound_ ? MODE_ACCESS: MODE_EGRESS,
-            path_spec.outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_
+            Mode::outbound_ ? MODE_ACCESS: MODE_EGRESS,
+            Mode::outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_
         };
         WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucpm);
         if (iter_weights == weight_lookup_.end()) {
             // this shouldn't happen because of the shortcut
             std::cerr << "Couldn't find any weights configured for user class/purpose (2) [" << path_spec.user_class_ << "/" << path_spec.purpose_ << "], ";
-            std::cerr << (path_spec.outbound_ ? "access mode [" : "egress mode [");
-            std::cerr << (path_spec.outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_) << "] for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
+            std::cerr << (Mode::outbound_ ? "access mode [" : "egress mode [");
+            std::cerr << (Mode::outbound_ ? path_spec.access_mode_ : path_spec.egress_mode_) << "] for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
             return;
         }
 
         // Iterate through valid supply modes
-        SupplyModeToNamedWeights::const_iterator iter_s2w;
+        SupplyModeToWeights::const_iterator iter_s2w;
         for (iter_s2w  = iter_weights->second.begin();
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
 
-            for (AccessEgressLinkAttr::const_iterator iter_aelk  = access_egress_links_.lower_bound(end_taz_id, supply_mode_num, current_label_stop.stop_id_);
-                                                      iter_aelk != access_egress_links_.upper_bound(end_taz_id, supply_mode_num, current_label_stop.stop_id_); ++iter_aelk)
+            AccessEgressLinkRange stop_links = access_egress_links_.linksFor(end_taz_id, supply_mode_num, current_label_stop.stop_id_);
+            for (const AccessEgressLinkEntry* iter_aelk = stop_links.begin(); iter_aelk != stop_links.end(); ++iter_aelk)
             {
 
                 const AccessEgressLinkKey& aelk = iter_aelk->first;
@@ -1267,17 +2229,17 @@ namespace fasttrips {
                 if (aelk.start_time_ >  earliest_dep_latest_arr_024) continue;
                 if (aelk.end_time_   <= earliest_dep_latest_arr_024) continue;
 
-                Attributes link_attr            = iter_aelk->second;
-                link_attr["depart_late_min"]    = 0;
-                link_attr["arrive_early_min"]   = 0;
-                link_attr["depart_early_min"]   = 0.0;
-                link_attr["arrive_late_min"]    = 0.0;
+                LinkAttributes link_attr        = iter_aelk->second.slots_;
+                link_attr.set(SLOT_DEPART_LATE_MIN,  0.0);
+                link_attr.set(SLOT_ARRIVE_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_DEPART_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_ARRIVE_LATE_MIN,  0.0);
 
-                double  access_time             = link_attr.find("time_min")->second;
-                double  access_dist             = link_attr.find("dist")->second;
+                double  access_time             = iter_aelk->second.attributes_.find("time_min")->second;
+                double  access_dist             = iter_aelk->second.attributes_.find("dist")->second;
                 double  deparr_time, link_cost, cost;
 
-                if (path_spec.hyperpath_)
+                if (Mode::hyperpath_)
                 {
                     deparr_time     = earliest_dep_latest_arr - (access_time*dir_factor);
 
@@ -1293,7 +2255,7 @@ namespace fasttrips {
                     cost        = current_stop_state.lowestCostStopState(true).cost_ + link_cost;
 
                     // capacity check
-                    if (path_spec.outbound_)
+                    if (Mode::outbound_)
                     {
                         TripStop ts = { current_stop_state.lowestCostStopState(true).deparr_mode_, current_stop_state.lowestCostStopState(true).seq_, current_label_stop.stop_id_ };
                         std::map<TripStop, double, struct TripStopCompare>::const_iterator bwi = bump_wait_.find(ts);
@@ -1312,7 +2274,7 @@ namespace fasttrips {
 
                 StopState ts(
                     deparr_time,                                                                // departure/arrival time
-                    path_spec.outbound_ ? MODE_ACCESS : MODE_EGRESS,                            // departure/arrival mode
+                    Mode::outbound_ ? MODE_ACCESS : MODE_EGRESS,                            // departure/arrival mode
                     supply_mode_num,                                                            // trip id
                     current_label_stop.stop_id_,                                                // successor/predecessor
                     -1,                                                                         // sequence
@@ -1326,7 +2288,7 @@ namespace fasttrips {
                     earliest_dep_latest_arr,                                                    // arrival/departure time
           0.0                                                                         // link ivt weight
                 );
-                addStopState(path_spec, trace_file, end_taz_id, ts, &current_stop_state, stop_states, label_stop_queue);
+                addStopState<Mode>(path_spec, context, end_taz_id, ts, &current_stop_state, stop_states, label_stop_queue);
 
                 // set label_cutoff
                 double low_cost = stop_states[end_taz_id].hyperpathCost(false);
@@ -1339,16 +2301,18 @@ namespace fasttrips {
         } // end iteration through valid supply modes
      }
 
+    template <class Mode>
     void PathFinder::updateStopStatesForTrips(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
         int label_iteration,
         const LabelStop& current_label_stop,
         std::unordered_set<int>& trips_done) const
     {
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        TraceStream& trace_file = context.trace_file_;
+        const double dir_factor = Mode::dirFactor();
 
         // for weight lookup
         UserClassPurposeMode ucpm = { path_spec.user_class_, path_spec.purpose_, MODE_TRANSIT, path_spec.transit_mode_};
@@ -1363,44 +2327,44 @@ namespace fasttrips {
         double     latest_dep_earliest_arr  = current_stop_state.latestDepartureEarliestArrival(false);
 
         // Update by trips
-        std::vector<TripStopTime> relevant_trips;
-        getTripsWithinTime(current_label_stop.stop_id_, path_spec.outbound_, latest_dep_earliest_arr, relevant_trips);
-        for (std::vector<TripStopTime>::const_iterator it=relevant_trips.begin(); it != relevant_trips.end(); ++it) {
+        TripStopTimeRefRange relevant_trips = getTripsWithinTime(current_label_stop.stop_id_, Mode::outbound_, latest_dep_earliest_arr);
+        countQuery(COUNT_TRIPS_SCANNED, (long long)relevant_trips.size());
+        for (TripStopTimeRefRange::const_iterator it=relevant_trips.begin(); it != relevant_trips.end(); ++it) {
 
             // the trip info for this trip
-            const TripInfo& trip_info = trip_info_.find(it->trip_id_)->second;
+            const TripInfo& trip_info = *trip_info_.find(it->trip_id_);
             // the trip stop time for this trip
             const TripStopTime& tst = getTripStopTime(it->trip_id_, it->seq_);
 
             // get the weights applicable for this trip
-            SupplyModeToNamedWeights::const_iterator iter_sm2nw = iter_weights->second.find(trip_info.supply_mode_num_);
+            SupplyModeToWeights::const_iterator iter_sm2nw = iter_weights->second.find(trip_info.supply_mode_num_);
             if (iter_sm2nw == iter_weights->second.end()) {
                 // this supply mode isn't allowed for the userclass/demand mode
                 continue;
             }
-            const NamedWeights& named_weights = iter_sm2nw->second;
+            const SupplyModeWeights& trip_weights = iter_sm2nw->second;
 
-            if (true && path_spec.trace_) {
+            if (true && Mode::trace_) {
                 trace_file << "valid trips: " << trip_num_to_str_.find(it->trip_id_)->second << " " << it->seq_ << " ";
-                printTime(trace_file, path_spec.outbound_ ? it->arrive_time_ : it->depart_time_);
+                printTime(trace_file, Mode::outbound_ ? it->arrive_time_ : it->depart_time_);
                 trace_file << std::endl;
             }
 
             // trip arrival time (outbound) / trip departure time (inbound)
-            double arrdep_time                = path_spec.outbound_ ? it->arrive_time_ : it->depart_time_;
+            double arrdep_time                = Mode::outbound_ ? it->arrive_time_ : it->depart_time_;
             // this is our best guess link in the current_stop_state hyperlink that's relevant
-            const  StopState& best_guess_link = current_stop_state.bestGuessLink(path_spec.outbound_, arrdep_time);
+            const  StopState& best_guess_link = current_stop_state.bestGuessLink(Mode::outbound_, arrdep_time);
             double wait_time                  = (best_guess_link.deparr_time_ - arrdep_time)*dir_factor;
             if (wait_time < 0) {
                 std::cerr << "wait_time < 0 -- this shouldn't happen!" << std::endl;
-                if (path_spec.trace_) { trace_file << "wait_time < 0 -- this shouldn't happen!" << std::endl; }
+                if (Mode::trace_) { trace_file << "wait_time < 0 -- this shouldn't happen!" << std::endl; }
             }
 
             // deterministic path-finding: check capacities
-            if (!path_spec.hyperpath_) {
+            if (!Mode::hyperpath_) {
                 TripStop check_for_bump_wait;
                 double arrive_time;
-                if (path_spec.outbound_) {
+                if (Mode::outbound_) {
                     // if outbound, this trip loop is possible trips *before* the current trip
                     // checking that we get here in time for the current trip
                     check_for_bump_wait.trip_id_ = current_stop_state.lowestCostStopState(false).trip_id_;
@@ -1421,7 +2385,7 @@ namespace fasttrips {
                 if (bwi != bump_wait_.end()) {
                     // time a bumped passenger started waiting
                     double latest_time = bwi->second;
-                    if (path_spec.trace_) {
+                    if (Mode::trace_) {
                         trace_file << "checking latest_time ";
                         printTime(trace_file, latest_time);
                         trace_file << " vs arrive_time ";
@@ -1430,36 +2394,35 @@ namespace fasttrips {
                     }
                     if ((arrive_time + 0.01 >= latest_time) &&
                         (current_stop_state.lowestCostStopState(false).trip_id_ != it->trip_id_)) {
-                        if (path_spec.trace_) { trace_file << "Continuing" << std::endl; }
+                        if (Mode::trace_) { trace_file << "Continuing" << std::endl; }
                         continue;
                     }
                 }
             }
 
             // get the TripStopTimes for this trip
-            std::map<int, std::vector<TripStopTime> >::const_iterator tstiter = trip_stop_times_.find(it->trip_id_);
-            assert(tstiter != trip_stop_times_.end());
-            const std::vector<TripStopTime>& possible_stops = tstiter->second;
+            countQuery(COUNT_TRIPS_USED);
+            TripStopTimeRange possible_stops = trip_stop_times_.forTrip(it->trip_id_);
+            assert(!possible_stops.empty());
 
             // these are the relevant potential trips/stops; iterate through them
-            unsigned int start_seq = path_spec.outbound_ ? 1 : it->seq_+1;
-            unsigned int end_seq   = path_spec.outbound_ ? it->seq_-1 : possible_stops.size();
+            unsigned int start_seq = Mode::outbound_ ? 1 : it->seq_+1;
+            unsigned int end_seq   = Mode::outbound_ ? it->seq_-1 : possible_stops.size();
             for (unsigned int seq_num = start_seq; seq_num <= end_seq; ++seq_num) {
                 // possible board for outbound / alight for inbound
-                const TripStopTime& possible_board_alight = possible_stops.at(seq_num-1);
+                const TripStopTime& possible_board_alight = possible_stops.begin()[seq_num-1];
 
                 // new label = length of trip so far if the passenger boards/alights at this stop
                 int board_alight_stop = possible_board_alight.stop_id_;
-                StopStates::const_iterator possible_stop_state_iter = stop_states.find(board_alight_stop);
 
-                double  deparr_time     = path_spec.outbound_ ? possible_board_alight.depart_time_ : possible_board_alight.arrive_time_;
+                double  deparr_time     = Mode::outbound_ ? possible_board_alight.depart_time_ : possible_board_alight.arrive_time_;
                 // the schedule crossed midnight
-                if (path_spec.outbound_ && arrdep_time < deparr_time) {
+                if (Mode::outbound_ && arrdep_time < deparr_time) {
                     deparr_time -= 24*60;
-                    if (path_spec.trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
-                } else if (!path_spec.outbound_ && deparr_time < arrdep_time) {
+                    if (Mode::trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
+                } else if (!Mode::outbound_ && deparr_time < arrdep_time) {
                     deparr_time += 24*60;
-                    if (path_spec.trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
+                    if (Mode::trace_) { trace_file << "trip crossed midnight; adjusting deparr_time" << std::endl; }
                 }
                 double  in_vehicle_time = (arrdep_time - deparr_time)*dir_factor;
                 double  cost      = 0;
@@ -1471,24 +2434,24 @@ namespace fasttrips {
 
                 if (in_vehicle_time < 0) {
                     printf("in_vehicle_time < 0 -- this shouldn't happen\n");
-                    if (path_spec.trace_) { trace_file << "in_vehicle_time < 0 -- this shouldn't happen!" << std::endl; }
+                    if (Mode::trace_) { trace_file << "in_vehicle_time < 0 -- this shouldn't happen!" << std::endl; }
                 }
 
                 // stochastic/hyperpath: cost update
-                if (path_spec.hyperpath_) {
+                if (Mode::hyperpath_) {
 
-                    double overcap     = path_spec.outbound_ ? possible_board_alight.overcap_ : tst.overcap_;
+                    double overcap     = Mode::outbound_ ? possible_board_alight.overcap_ : tst.overcap_;
                     double at_capacity = (overcap >= 0 ? 1.0 : 0.0);  // binary, 0 means at capacity
                     if (overcap < 0) { overcap = 0; } // make it non-negative
                     fp = getFarePeriod(trip_info.route_id_,
-                                       path_spec.outbound_ ? possible_board_alight.stop_id_ : current_label_stop.stop_id_,
-                                       path_spec.outbound_ ? current_label_stop.stop_id_ : possible_board_alight.stop_id_,
-                                       path_spec.outbound_ ? deparr_time : arrdep_time);
+                                       Mode::outbound_ ? possible_board_alight.stop_id_ : current_label_stop.stop_id_,
+                                       Mode::outbound_ ? current_label_stop.stop_id_ : possible_board_alight.stop_id_,
+                                       Mode::outbound_ ? deparr_time : arrdep_time);
                     // this is where it gets painful... if we have a fareperiod, try to check transfer fare rules and guess the right fare
                     if (fp) { fare     = current_stop_state.getFareWithTransfer(path_spec, trace_file, *this, *fp, stop_states); }
 
-                    if (false && path_spec.trace_) {
-                        if (path_spec.outbound_) {
+                    if (false && Mode::trace_) {
+                        if (Mode::outbound_) {
                             trace_file << "trip " << tripStringForId(possible_board_alight.trip_id_)
                                        << ", stop " << stopStringForId(possible_board_alight.stop_id_)
                                        << ", seq " << possible_board_alight.seq_
@@ -1509,66 +2472,64 @@ namespace fasttrips {
                     }
 
                     //update link ivtwt so that it is available when fares/fare-utils calculations are updated
-                    static const std::string ivt_str("in_vehicle_time_min");
-                    NamedWeights::const_iterator ivt_weight = named_weights.find(ivt_str);
-                    if (ivt_weight != named_weights.end()) ivtwt = ivt_weight->second.weight_;
+                    if (trip_weights.compiled_.has_ivt_weight_) ivtwt = trip_weights.compiled_.ivt_weight_;
 
                     // start with trip info attributes
-                    Attributes link_attr = trip_info.trip_attr_;
-                    link_attr["in_vehicle_time_min"] = in_vehicle_time;
-                    link_attr["wait_time_min"      ] = wait_time;
-                    link_attr["overcap"            ] = overcap;
-                    link_attr["at_capacity"        ] = at_capacity;
-                    link_attr["fare"               ] = fare;
+                    LinkAttributes link_attr = trip_info.trip_slots_;
+                    link_attr.set(SLOT_IN_VEHICLE_TIME_MIN, in_vehicle_time);
+                    link_attr.set(SLOT_WAIT_TIME_MIN,       wait_time);
+                    link_attr.set(SLOT_OVERCAP,             overcap);
+                    link_attr.set(SLOT_AT_CAPACITY,         at_capacity);
+                    link_attr.set(SLOT_FARE,                fare);
 
                     link_cost = 0;
                     // If outbound, and the current link is egress, then it's as late as possible and the wait time isn't accurate.
                     // It should be a preferred delay time instead
                     // ditto for inbound and access
-                    if (( path_spec.outbound_ && best_guess_link.deparr_mode_ == MODE_EGRESS) ||
-                        (!path_spec.outbound_ && best_guess_link.deparr_mode_ == MODE_ACCESS)) {
-                        link_attr["wait_time_min"      ] = 0;
+                    if (( Mode::outbound_ && best_guess_link.deparr_mode_ == MODE_EGRESS) ||
+                        (!Mode::outbound_ && best_guess_link.deparr_mode_ == MODE_ACCESS)) {
+                        link_attr.set(SLOT_WAIT_TIME_MIN, 0);
 
 
                         // TODO: this is awkward... setting this all up again.  Plus we don't have all the attributes set.  Cache something?
-                        Attributes delay_attr;
-                        delay_attr["time_min"             ] = 0;
-                        delay_attr["drive_time_min"       ] = 0;
-                        delay_attr["walk_time_min"        ] = 0;
-                        delay_attr["elevation_gain"       ] = 0;
+                        LinkAttributes delay_attr;
+                        delay_attr.set(SLOT_TIME_MIN,       0);
+                        delay_attr.set(SLOT_DRIVE_TIME_MIN, 0);
+                        delay_attr.set(SLOT_WALK_TIME_MIN,  0);
+                        delay_attr.set(SLOT_ELEVATION_GAIN, 0);
 
-                        if (path_spec.outbound_) {
+                        if (Mode::outbound_) {
                           // outbound: if the wait_time < ARRIVE_LATE_ALLOWED_MIN_ then we've arrived later than our preferred time (by ARRIVE_LATE_ALLOWED_MIN_ - wait_time)
                           //           otherwise, we've arrive before our preferred time (by wait_time - ARRIVE_LATE_MIN_)
                           //           so ideal with wait_time = ARRIVE_LATE_ALLOWED_MIN_
                           if (wait_time < ARRIVE_LATE_ALLOWED_MIN_) {
-                            delay_attr["arrive_late_min"      ] = ARRIVE_LATE_ALLOWED_MIN_ - wait_time;
-                            delay_attr["arrive_early_min"     ] = 0;
+                            delay_attr.set(SLOT_ARRIVE_LATE_MIN,  ARRIVE_LATE_ALLOWED_MIN_ - wait_time);
+                            delay_attr.set(SLOT_ARRIVE_EARLY_MIN, 0);
                           } else {
-                            delay_attr["arrive_late_min"      ] = 0;
-                            delay_attr["arrive_early_min"     ] = wait_time - ARRIVE_LATE_ALLOWED_MIN_;
+                            delay_attr.set(SLOT_ARRIVE_LATE_MIN,  0);
+                            delay_attr.set(SLOT_ARRIVE_EARLY_MIN, wait_time - ARRIVE_LATE_ALLOWED_MIN_);
                           }
                         } else {
                           // inbound: if the wait_time < DEPART_EARLY_ALLOWED_MIN_ then we've departed earlier than our preferred time (by DEPART_EARLY_ALLOWED_MIN_ - wait_time)
                           //           otherwise, we've depart before our preferred time (by wait_time - DEPART_EARLY_MIN_)
                           //           so ideal with wait_time = DEPART_EARLY_ALLOWED_MIN_
                           if (wait_time < DEPART_EARLY_ALLOWED_MIN_) {
-                            delay_attr["depart_early_min"] = DEPART_EARLY_ALLOWED_MIN_ - wait_time;
-                            delay_attr["depart_late_min"      ] = 0;
+                            delay_attr.set(SLOT_DEPART_EARLY_MIN, DEPART_EARLY_ALLOWED_MIN_ - wait_time);
+                            delay_attr.set(SLOT_DEPART_LATE_MIN,  0);
                           } else {
-                            delay_attr["depart_early_min"] = 0 ;
-                            delay_attr["depart_late_min"      ] = wait_time - DEPART_EARLY_ALLOWED_MIN_;
+                            delay_attr.set(SLOT_DEPART_EARLY_MIN, 0);
+                            delay_attr.set(SLOT_DEPART_LATE_MIN,  wait_time - DEPART_EARLY_ALLOWED_MIN_);
                           }
                         }
 
                         UserClassPurposeMode delay_ucpm = {
                             path_spec.user_class_, path_spec.purpose_,
-                            path_spec.outbound_ ? MODE_EGRESS: MODE_ACCESS,
-                            path_spec.outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
+                            Mode::outbound_ ? MODE_EGRESS: MODE_ACCESS,
+                            Mode::outbound_ ? path_spec.egress_mode_ : path_spec.access_mode_
                         };
                         WeightLookup::const_iterator delay_iter_weights = weight_lookup_.find(delay_ucpm);
                         if (delay_iter_weights != weight_lookup_.end()) {
-                            SupplyModeToNamedWeights::const_iterator delay_iter_s2w = delay_iter_weights->second.find(best_guess_link.trip_id_);
+                            SupplyModeToWeights::const_iterator delay_iter_s2w = delay_iter_weights->second.find(best_guess_link.trip_id_);
                             if (delay_iter_s2w != delay_iter_weights->second.end()) {
                                 link_cost = tallyLinkCost(best_guess_link.trip_id_, path_spec, trace_file, delay_iter_s2w->second, delay_attr);
                             }
@@ -1579,12 +2540,12 @@ namespace fasttrips {
                     // I think we can't do this as it's problematic
                     // TODO: devise test to demonstrate
                     if ((best_guess_link.deparr_mode_ == MODE_ACCESS) || (best_guess_link.deparr_mode_ == MODE_EGRESS)) {
-                        link_attr["transfer_penalty"] = 0.0;
+                        link_attr.set(SLOT_TRANSFER_PENALTY, 0.0);
                     } else {
-                        link_attr["transfer_penalty"] = 1.0; //TODO: make configurable or based off of IVT coeff
+                        link_attr.set(SLOT_TRANSFER_PENALTY, 1.0); //TODO: make configurable or based off of IVT coeff
                     }
 
-                    link_cost = link_cost + tallyLinkCost(trip_info.supply_mode_num_, path_spec, trace_file, named_weights, link_attr);
+                    link_cost = link_cost + tallyLinkCost(trip_info.supply_mode_num_, path_spec, trace_file, trip_weights, link_attr);
                     cost      = current_stop_state.hyperpathCost(false) + link_cost;
 
                 }
@@ -1611,25 +2572,183 @@ namespace fasttrips {
           ivtwt,                          // link ivt weight
                     fp                              // fare period
                 );
-                addStopState(path_spec, trace_file, board_alight_stop, ss, &current_stop_state, stop_states, label_stop_queue);
+                addStopState<Mode>(path_spec, context, board_alight_stop, ss, &current_stop_state, stop_states, label_stop_queue);
 
             }
             trips_done.insert(it->trip_id_);
         }
     }
 
+    template <class Mode>
+    int PathFinder::scanConnections(
+        const PathSpecification& path_spec,
+        PathFinderContext& context,
+        const std::map<int,int>& reachable_final_stops,
+        StopStates& stop_states,
+        LabelStopQueue& label_stop_queue) const
+    {
+        TraceStream& trace_file = context.trace_file_;
+        int label_iterations = 1;
+        const double dir_factor = Mode::dirFactor();
+        const int end_taz_id = Mode::outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+        // costs are minutes from here
+        const double scan_start = Mode::outbound_ ? path_spec.preferred_time_ + ARRIVE_LATE_ALLOWED_MIN_ : path_spec.preferred_time_ - DEPART_EARLY_ALLOWED_MIN_;
+
+        double est_max_path_cost = MAX_COST;
+
+        UserClassPurposeMode ucpm = { path_spec.user_class_, path_spec.purpose_, MODE_TRANSIT, path_spec.transit_mode_};
+        WeightLookup::const_iterator iter_weights = weight_lookup_.find(ucpm);
+
+        // one per trip, kept with the stop states and reset lazily for each query
+        std::vector<TripHop>& trip_hops = stop_states.tripHops(trip_stop_times_.maxTripId()+1);
+        const unsigned int epoch = stop_states.epoch();
+
+        const Connection* conn     = Mode::outbound_ ? connections_.arrivingBy(scan_start) : connections_.departingFrom(scan_start);
+        const Connection* conn_end = Mode::outbound_ ? connections_.arrivingEnd()          : connections_.departingEnd();
+        for (;; ++conn) {
+            const Connection* next   = (conn == conn_end) ? NULL : conn;
+            const Hyperlink*  taz    = stop_states.find(end_taz_id);
+            double  taz_cost         = (taz && taz->size(false) > 0) ? taz->hyperpathCost(false) : MAX_COST;
+            // nothing from this connection on can be labeled for less than this
+            double  scan_cost        = next ? (scan_start - (Mode::outbound_ ? next->arrive_time_ : next->depart_time_))*dir_factor : MAX_COST;
+
+            // trip states the scan has passed are final: transfer and go to the end TAZ from them
+            while (!label_stop_queue.empty() && (label_stop_queue.top().label_ <= scan_cost) && (label_stop_queue.top().label_ < taz_cost)) {
+                LabelStop current_label_stop = label_stop_queue.pop_top(stop_num_to_stop_, Mode::trace_, trace_file);
+                // non-trip states are boarded from (inbound) or alighted to (outbound) as the scan gets to them
+                if (!current_label_stop.is_trip_) { continue; }
+
+                if (Mode::trace_) {
+                    trace_file << "Pulling from label_stop_queue (iteration " << std::setw( 6) << std::setfill(' ') << label_iterations;
+                    trace_file << ", stop " << stopStringForId(current_label_stop.stop_id_);
+                    trace_file << ", is_trip " << current_label_stop.is_trip_;
+                    trace_file << ", est_max_path_cost " << est_max_path_cost;
+                    trace_file << ") :======" << std::endl;
+                    stop_states[current_label_stop.stop_id_].print(trace_file, path_spec, *this);
+                    trace_file << "==============================" << std::endl;
+
+                    context.stopids_file_ << stopStringForId(current_label_stop.stop_id_) << "," << label_iterations << ",";
+                    context.stopids_file_ << current_label_stop.is_trip_ << "," << current_label_stop.label_ << std::endl;
+                }
+                updateStopStatesForTransfers<Mode>(path_spec, context, stop_states, label_stop_queue, label_iterations, current_label_stop);
+                updateStopStatesForFinalLinks<Mode>(path_spec, context, reachable_final_stops, stop_states, label_stop_queue,
+                                                    label_iterations, current_label_stop, est_max_path_cost);
+                context.prune_cost_ = 2*est_max_path_cost;
+                label_iterations += 1;
+
+                taz      = stop_states.find(end_taz_id);
+                taz_cost = (taz && taz->size(false) > 0) ? taz->hyperpathCost(false) : MAX_COST;
+            }
+
+            if (next == NULL) { break; }
+            if (scan_cost >= taz_cost) {
+                if (Mode::trace_) {
+                    trace_file << "ENDING CONNECTION SCAN.  Can't improve on the end TAZ. scan cost = " << scan_cost << " >= " << taz_cost << std::endl;
+                }
+                break;
+            }
+
+            countQuery(COUNT_TRIPS_SCANNED);
+            TripHop& hop = trip_hops[conn->trip_id_];
+            if (hop.epoch_ != epoch) {
+                hop.epoch_     = epoch;
+                hop.on_        = false;
+                hop.allowed_   = (iter_weights != weight_lookup_.end()) &&
+                                 (iter_weights->second.find(trip_info_.find(conn->trip_id_)->supply_mode_num_) != iter_weights->second.end());
+            }
+            // this supply mode isn't allowed for the userclass/demand mode
+            if (!hop.allowed_) { continue; }
+
+            // scanning from (inbound: the departure) to (inbound: the arrival)
+            const int    from_stop_id = Mode::outbound_ ? conn->arrive_stop_id_ : conn->depart_stop_id_;
+            const int    to_stop_id   = Mode::outbound_ ? conn->depart_stop_id_ : conn->arrive_stop_id_;
+            const int    from_index   = Mode::outbound_ ? conn->depart_index_+1 : conn->depart_index_;
+            const int    to_index     = Mode::outbound_ ? conn->depart_index_   : conn->depart_index_+1;
+            const double from_time    = Mode::outbound_ ? conn->arrive_time_    : conn->depart_time_;
+            const double to_time      = Mode::outbound_ ? conn->depart_time_    : conn->arrive_time_;
+            TripStopTimeRange trip_stops = trip_stop_times_.forTrip(conn->trip_id_);
+
+            // board (inbound) or alight (outbound) here, if it's the cheapest place on the trip so far
+            const Hyperlink* from_state = stop_states.find(from_stop_id);
+            if (from_state && (from_state->size(false) > 0)) {
+                const StopState& nt_state = from_state->lowestCostStopState(false);
+                double wait_time = (nt_state.deparr_time_ - from_time)*dir_factor;
+                bool   hop_here  = (wait_time >= 0) && (wait_time < Hyperlink::TIME_WINDOW_) &&
+                                   (!hop.on_ || (nt_state.cost_ < hop.nt_cost_));
+
+                // check capacities, as PathFinder::updateStopStatesForTrips() does
+                if (hop_here && !bump_wait_.empty()) {
+                    TripStop check_for_bump_wait;
+                    check_for_bump_wait.trip_id_ = Mode::outbound_ ? nt_state.trip_id_ : conn->trip_id_;
+                    check_for_bump_wait.seq_     = Mode::outbound_ ? nt_state.seq_     : trip_stops.begin()[from_index].seq_;
+                    check_for_bump_wait.stop_id_ = from_stop_id;
+                    double arrive_time           = Mode::outbound_ ? from_time : nt_state.deparr_time_;
+                    std::map<TripStop, double, struct TripStopCompare>::const_iterator bwi = bump_wait_.find(check_for_bump_wait);
+                    if ((bwi != bump_wait_.end()) && (arrive_time + 0.01 >= bwi->second) && (nt_state.trip_id_ != conn->trip_id_)) {
+                        if (Mode::trace_) { trace_file << "Bumped from trip " << tripStringForId(conn->trip_id_) << " at " << stopStringForId(from_stop_id) << std::endl; }
+                        hop_here = false;
+                    }
+                }
+                if (hop_here) {
+                    countQuery(COUNT_TRIPS_USED);
+                    hop.on_             = true;
+                    hop.stop_index_     = from_index;
+                    hop.deparr_time_    = from_time;
+                    hop.nt_deparr_time_ = nt_state.deparr_time_;
+                    hop.nt_cost_        = nt_state.cost_;
+                    if (Mode::trace_) {
+                        trace_file << (Mode::outbound_ ? "alight " : "board ") << tripStringForId(conn->trip_id_) << " at " << stopStringForId(from_stop_id) << " ";
+                        printTime(trace_file, from_time);
+                        trace_file << std::endl;
+                    }
+                }
+            }
+            if (!hop.on_) { continue; }
+
+            // deterministic: label = cost = total time, just additive
+            double link_time = (hop.nt_deparr_time_ - to_time)*dir_factor;
+            double cost      = hop.nt_cost_ + link_time;
+            const Hyperlink* to_state = stop_states.find(to_stop_id);
+            if (to_state && (to_state->size(true) > 0) && (to_state->hyperpathCost(true) <= cost)) { continue; }
+
+            const TripStopTime& hop_stt = trip_stops.begin()[hop.stop_index_];
+            const TripStopTime& to_stt  = trip_stops.begin()[to_index];
+            StopState ss(
+                to_time,                        // departure/arrival time
+                MODE_TRANSIT,                   // departure/arrival mode
+                conn->trip_id_,                 // trip id
+                hop_stt.stop_id_,               // successor/predecessor
+                to_stt.seq_,                    // sequence
+                hop_stt.seq_,                   // sequence succ/pred
+                link_time,                      // link time
+                0,                              // link fare
+                link_time,                      // link cost
+                dir_factor*(hop_stt.shape_dist_trav_ - to_stt.shape_dist_trav_), // link distance
+                cost,                           // cost
+                label_iterations,               // label iteration
+                hop.deparr_time_,               // arrival/departure time
+                0                               // link ivt weight
+            );
+            addStopState<Mode>(path_spec, context, to_stop_id, ss, stop_states.find(hop_stt.stop_id_), stop_states, label_stop_queue);
+        }
+
+        return label_iterations;
+    }
+
+    template <class Mode>
     int PathFinder::labelStops(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         const std::map<int,int>& reachable_final_stops,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
         int& max_process_count) const
     {
+        TraceStream& trace_file = context.trace_file_;
         int label_iterations = 1;
         std::unordered_set<int> stop_done;
         std::unordered_set<int> trips_done;
-        double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
+        const double dir_factor = Mode::dirFactor();
         LabelStop last_label_stop;
 
         // we'll use this to stop labeling when we're past useful paths
@@ -1648,17 +2767,18 @@ namespace fasttrips {
             *                     from stop *predecessor*
             *                     and the total cost from the origin TAZ to the *stop_id* is *label*
             **************************************************************************************/
-            LabelStop current_label_stop = label_stop_queue.pop_top(stop_num_to_stop_, path_spec.trace_, trace_file);
+            LabelStop current_label_stop = label_stop_queue.pop_top(stop_num_to_stop_, Mode::trace_, trace_file);
+            R_LSQ( trace_file << "LSQ pop" << std::endl; );
 
             // if we just processed this one, then skip since it'll be a no-op
             if ((current_label_stop.stop_id_ == last_label_stop.stop_id_) && (current_label_stop.is_trip_ == last_label_stop.is_trip_)) { continue; }
 
             // hyperpath only
-            if (path_spec.hyperpath_) {
+            if (Mode::hyperpath_) {
                 // have we hit the configured limit?
                 if ((STOCH_MAX_STOP_PROCESS_COUNT_ > 0) &&
                     (stop_states[current_label_stop.stop_id_].processCount(current_label_stop.is_trip_) == STOCH_MAX_STOP_PROCESS_COUNT_)) {
-                    if (path_spec.trace_) {
+                    if (Mode::trace_) {
                         trace_file << "Pulling from label_stop_queue but stop " << stopStringForId(current_label_stop.stop_id_);
                         trace_file << " is_trip " << current_label_stop.is_trip_;
                         trace_file << " has been processed the limit " << STOCH_MAX_STOP_PROCESS_COUNT_ << " times so skipping." << std::endl;
@@ -1673,11 +2793,11 @@ namespace fasttrips {
             // current_stop_state is a hyperlink
             Hyperlink& current_stop_state = stop_states[current_label_stop.stop_id_];
 
-            if (path_spec.trace_) {
+            if (Mode::trace_) {
                 trace_file << "Pulling from label_stop_queue (iteration " << std::setw( 6) << std::setfill(' ') << label_iterations;
                 trace_file << ", stop " << stopStringForId(current_label_stop.stop_id_);
                 trace_file << ", is_trip " << current_label_stop.is_trip_;
-                if (path_spec.hyperpath_) {
+                if (Mode::hyperpath_) {
                     trace_file << ", label ";
                     trace_file << std::setprecision(6) << current_label_stop.label_;
                 }
@@ -1687,34 +2807,36 @@ namespace fasttrips {
                 trace_file << "==============================" << std::endl;
 
                 // stop_id,stop_id_label_iter,is_trip,label_stop_cost
-                stopids_file << stopStringForId(current_label_stop.stop_id_) << "," << label_iterations << ",";
-                stopids_file << current_label_stop.is_trip_ << "," << current_label_stop.label_ << std::endl;
+                context.stopids_file_ << stopStringForId(current_label_stop.stop_id_) << "," << label_iterations << ",";
+                context.stopids_file_ << current_label_stop.is_trip_ << "," << current_label_stop.label_ << std::endl;
             }
 
             // if the low cost is trip ids, process transfers
             if (current_label_stop.is_trip_)
             {
-                updateStopStatesForTransfers(path_spec,
-                                             trace_file,
+                updateStopStatesForTransfers<Mode>(path_spec,
+                                             context,
                                              stop_states,
                                              label_stop_queue,
                                              label_iterations,
                                              current_label_stop);
 
-                updateStopStatesForFinalLinks(path_spec,
-                                              trace_file,
+                updateStopStatesForFinalLinks<Mode>(path_spec,
+                                              context,
                                               reachable_final_stops,
                                               stop_states,
                                               label_stop_queue,
                                               label_iterations,
                                               current_label_stop,
                                               est_max_path_cost);
+                // labelling stops past this, so states that can't get under it are no use
+                context.prune_cost_ = 2*est_max_path_cost;
             }
             // else the low cost is walk links, so process trips
             else
             {
-                updateStopStatesForTrips(path_spec,
-                                         trace_file,
+                updateStopStatesForTrips<Mode>(path_spec,
+                                         context,
                                          stop_states,
                                          label_stop_queue,
                                          label_iterations,
@@ -1729,7 +2851,7 @@ namespace fasttrips {
 
             // Should we call it a day?
             if (current_label_stop.label_ > 2*est_max_path_cost) {
-                if (path_spec.trace_) {
+                if (Mode::trace_) {
                     trace_file << "ENDING LABELING LOOP.  Maximum cost search range met. label = " << current_label_stop.label_ << " > 2*est_max_path_cost = " << est_max_path_cost << std::endl;
                 }
                 break;
@@ -1737,7 +2859,7 @@ namespace fasttrips {
 
             // Leave loop if encounter a negative cost because it isn't healthy.
             if (current_label_stop.label_ < 0) {
-                if (path_spec.trace_) {
+                if (Mode::trace_) {
                     trace_file << "ENDING LABELING LOOP.  Negative cost encountered. stop_id " <<  current_label_stop.stop_id_ << " label = " <<  current_label_stop.label_  << std::endl;
                 }
                 std::cerr << "ENDING LABELING LOOP.  Negative cost encountered. stop_id = " <<  current_label_stop.stop_id_ << " label = " <<  current_label_stop.label_  << std::endl;
@@ -1751,9 +2873,10 @@ namespace fasttrips {
     // Returns false if no stops are reachable
     bool PathFinder::setReachableFinalStops(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         std::map<int, int>& reachable_final_stops) const
     {
+        TraceStream& trace_file = context.trace_file_;
         int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
         double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
 
@@ -1779,7 +2902,7 @@ namespace fasttrips {
         }
 
         // Iterate through valid supply modes
-        SupplyModeToNamedWeights::const_iterator iter_s2w;
+        SupplyModeToWeights::const_iterator iter_s2w;
         for (iter_s2w  = iter_weights->second.begin();
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
@@ -1789,8 +2912,8 @@ namespace fasttrips {
                 trace_file << mode_num_to_str_.find(supply_mode_num)->second << std::endl;
             }
 
-            for (AccessEgressLinkAttr::const_iterator iter_aelk  = access_egress_links_.lower_bound(end_taz_id, supply_mode_num);
-                                                      iter_aelk != access_egress_links_.upper_bound(end_taz_id, supply_mode_num); ++iter_aelk)
+            AccessEgressLinkRange mode_links = access_egress_links_.linksFor(end_taz_id, supply_mode_num);
+            for (const AccessEgressLinkEntry* iter_aelk = mode_links.begin(); iter_aelk != mode_links.end(); ++iter_aelk)
             {
 
                 // Iterate through the links for the given supply mode
@@ -1815,11 +2938,12 @@ namespace fasttrips {
     /*
     bool PathFinder::finalizeTazState(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         StopStates& stop_states,
         LabelStopQueue& label_stop_queue,
         int label_iteration) const
     {
+        TraceStream& trace_file = context.trace_file_;
         int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
         double dir_factor = path_spec.outbound_ ? 1.0 : -1.0;
 
@@ -1845,11 +2969,11 @@ namespace fasttrips {
 
         if (path_spec.trace_) {
             // stop_id,stop_id_label_iter,is_trip,label_stop_cost
-            stopids_file << stopStringForId(end_taz_id) << "," << label_iteration << ",0,";
+            context.stopids_file_ << stopStringForId(end_taz_id) << "," << label_iteration << ",0,";
         }
 
         // Iterate through valid supply modes
-        SupplyModeToNamedWeights::const_iterator iter_s2w;
+        SupplyModeToWeights::const_iterator iter_s2w;
         for (iter_s2w  = iter_weights->second.begin();
              iter_s2w != iter_weights->second.end(); ++iter_s2w) {
             int supply_mode_num = iter_s2w->first;
@@ -1860,8 +2984,8 @@ namespace fasttrips {
             }
 
             // Are there any egress/access links for the supply mode?
-            for (AccessEgressLinkAttr::const_iterator iter_aelk  = access_egress_links_.lower_bound(end_taz_id, supply_mode_num);
-                                                      iter_aelk != access_egress_links_.upper_bound(end_taz_id, supply_mode_num); ++iter_aelk)
+            AccessEgressLinkRange mode_links = access_egress_links_.linksFor(end_taz_id, supply_mode_num);
+            for (const AccessEgressLinkEntry* iter_aelk = mode_links.begin(); iter_aelk != mode_links.end(); ++iter_aelk)
             {
                 int     stop_id                 = iter_aelk->first.stop_id_;
                 double  earliest_dep_latest_arr = PathFinder::MAX_DATETIME;
@@ -1871,20 +2995,20 @@ namespace fasttrips {
                 if (aelk.start_time_ >  earliest_dep_latest_arr) continue;
                 if (aelk.end_time_   <= earliest_dep_latest_arr) continue;
 
-                Attributes link_attr            = iter_aelk->second;
-                link_attr["depart_late_min"]    = 0;
-                link_attr["arrive_early_min"]   = 0;
-                link_attr["depart_early_min"]   = 0.0;
-                link_attr["arrive_late_min" ]   = 0.0;
+                LinkAttributes link_attr        = iter_aelk->second.slots_;
+                link_attr.set(SLOT_DEPART_LATE_MIN,  0.0);
+                link_attr.set(SLOT_ARRIVE_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_DEPART_EARLY_MIN, 0.0);
+                link_attr.set(SLOT_ARRIVE_LATE_MIN,  0.0);
 
-                double  access_time             = link_attr.find("time_min")->second;
-                double  access_dist             = link_attr.find("dist")->second;
+                double  access_time             = iter_aelk->second.attributes_.find("time_min")->second;
+                double  access_dist             = iter_aelk->second.attributes_.find("dist")->second;
                 double  deparr_time, link_cost, cost;
 
-                StopStates::const_iterator stop_states_iter = stop_states.find(stop_id);
-                if (stop_states_iter == stop_states.end()) { continue; }
+                const Hyperlink* stop_hyperlink = stop_states.find(stop_id);
+                if (stop_hyperlink == NULL) { continue; }
 
-                const Hyperlink& current_stop_state = stop_states_iter->second;
+                const Hyperlink& current_stop_state = *stop_hyperlink;
                 // if there are no trip links, this isn't viable
                 if (current_stop_state.size(true) == 0) { continue; }
 
@@ -1950,7 +3074,7 @@ namespace fasttrips {
                     earliest_dep_latest_arr,                                                    // arrival/departure time
           0.0                                                                         // link ivt weight
                 );
-                addStopState(path_spec, trace_file, end_taz_id, ts, &current_stop_state, stop_states, label_stop_queue);
+                addStopState(path_spec, context, end_taz_id, ts, &current_stop_state, stop_states, label_stop_queue);
 
             } // end iteration through links for the given supply mode
         } // end iteration through valid supply modes
@@ -1959,24 +3083,25 @@ namespace fasttrips {
 
     bool PathFinder::hyperpathGeneratePath(
         const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         StopStates& stop_states,
         Path& path) const
     {
+        TraceStream& trace_file = context.trace_file_;
         int    start_state_id   = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
         double dir_factor       = path_spec.outbound_ ? 1 : -1;
 
-        Hyperlink& taz_state    = stop_states.find(start_state_id)->second;
+        Hyperlink& taz_state    = *stop_states.find(start_state_id);
         double taz_label        = taz_state.hyperpathCost(false);
 
         // setup access/egress probabilities
-        int maxcumi = taz_state.setupProbabilities(path_spec, trace_file, *this, false);
-        if (maxcumi == 0) { return false; }
+        int num_choices = taz_state.setupProbabilities(path_spec, trace_file, *this, false);
+        if (num_choices == 0) { return false; }
 
         // choose the state and store it
         if (path_spec.trace_) { trace_file << " -> Chose access/egress " << std::endl; }
         path.addLink(start_state_id,
-                     taz_state.chooseState(path_spec, trace_file),
+                     taz_state.chooseState(path_spec, trace_file, context.rng_),
                      trace_file, path_spec, *this);
 
         // trip_id shouldn't repeat
@@ -1988,8 +3113,8 @@ namespace fasttrips {
             StopState& ss = path.back().second;
             int current_stop_id = ss.stop_succpred_;
 
-            StopStates::iterator ssi = stop_states.find(current_stop_id);
-            if (ssi == stop_states.end()) { return false; }
+            Hyperlink* ssi = stop_states.find(current_stop_id);
+            if (ssi == NULL) { return false; }
 
             if (path_spec.trace_) {
                 trace_file << "current_stop=" << stopStringForId(current_stop_id);
@@ -2001,15 +3126,15 @@ namespace fasttrips {
             }
 
             // setup probabilities
-            Hyperlink& current_hyperlink = ssi->second;
-            maxcumi = current_hyperlink.setupProbabilities(path_spec, trace_file, *this, !isTrip(ss.deparr_mode_), &path);
+            Hyperlink& current_hyperlink = *ssi;
+            num_choices = current_hyperlink.setupProbabilities(path_spec, trace_file, *this, !isTrip(ss.deparr_mode_), &path);
 
-            if (maxcumi == 0) { return false; }
+            if (num_choices == 0) { return false; }
 
             // choose next link and add it to the path
             if (path_spec.trace_) { trace_file << " -> Chose stop link " << std::endl; }
             path.addLink(current_stop_id,
-                         current_hyperlink.chooseState(path_spec, trace_file, &ss),
+                         current_hyperlink.chooseState(path_spec, trace_file, context.rng_, &ss),
                          trace_file, path_spec, *this);
 
             // are we done?
@@ -2026,50 +3151,180 @@ namespace fasttrips {
         return true;
     }
 
+    bool PathFinder::hyperpathDrawPath(
+        const PathSpecification& path_spec,
+        const StopStates& stop_states,
+        RandomNumberGenerator& rng,
+        LinkChoices& choices,
+        Path& path,
+        std::ostream& trace_file) const
+    {
+        int start_state_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
+
+        // choose the access/egress link
+        const Hyperlink& taz_state = *stop_states.find(start_state_id);
+        if (taz_state.setupChoices(path_spec, trace_file, *this, false, NULL, choices) == 0) { return false; }
+        path.addLink(start_state_id,
+                     taz_state.chooseState(path_spec, trace_file, rng, false, choices),
+                     trace_file, path_spec, *this);
+
+        while (true)
+        {
+            const StopState& ss = path.back().second;
+            int  current_stop_id = ss.stop_succpred_;
+            bool trip_linkset    = !isTrip(ss.deparr_mode_);
+
+            const Hyperlink* ssi = stop_states.find(current_stop_id);
+            if (ssi == NULL) { return false; }
+
+            // choose next link and add it to the path
+            if (ssi->setupChoices(path_spec, trace_file, *this, trip_linkset, &path, choices) == 0) { return false; }
+            path.addLink(current_stop_id,
+                         ssi->chooseState(path_spec, trace_file, rng, trip_linkset, choices),
+                         trace_file, path_spec, *this);
+
+            // are we done?
+            if (( path_spec.outbound_ && path.back().second.deparr_mode_ == MODE_EGRESS) ||
+                (!path_spec.outbound_ && path.back().second.deparr_mode_ == MODE_ACCESS)) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    /// The index of the path in found_paths with the same links as path, or found_paths.size() if there isn't one
+    static size_t findSamePath(const std::vector< std::pair<Path, PathInfo> >& found_paths,
+                               const std::unordered_multimap<size_t, size_t>&  found_path_index,
+                               const Path&                                     path)
+    {
+        std::pair< std::unordered_multimap<size_t, size_t>::const_iterator,
+                   std::unordered_multimap<size_t, size_t>::const_iterator > same_signature = found_path_index.equal_range(path.signature());
+        for (std::unordered_multimap<size_t, size_t>::const_iterator fpi = same_signature.first; fpi != same_signature.second; ++fpi) {
+            if (found_paths[fpi->second].first.sameLinks(path)) { return fpi->second; }
+        }
+        return found_paths.size();
+    }
+
+    void PathFinder::drawPathBlocks(
+        const PathSpecification&                    path_spec,
+        PathFinderContext&                          context,
+        const StopStates&                           stop_states,
+        std::vector< std::pair<Path, PathInfo> >&   found_paths,
+        std::unordered_multimap<size_t, size_t>&    found_path_index,
+        double&                                     logsum) const
+    {
+        // these queries aren't traced, so the threads don't write anything to it
+        std::ostream& trace_file = context.trace_file_;
+        int num_blocks = (STOCH_PATHSET_SIZE_ + ENUMERATION_BLOCK_DRAWS - 1) / ENUMERATION_BLOCK_DRAWS;
+
+        // the distinct paths drawn in each block, in the order drawn, with their counts
+        std::vector< std::vector< std::pair<Path, PathInfo> > > block_paths(num_blocks);
+        // what each block counted, added to this thread's counters after the blocks are done
+        std::vector<QueryCounters> block_counters(num_blocks);
+
+        // a multithreaded batch already has the cores busy, so don't nest more threads inside its queries.
+        // the blocks still draw the same paths on this thread
+        int num_threads = std::min(ENUMERATION_THREADS_, num_blocks);
+        if (WorkStealingPool::enclosingThreads() > 1) { num_threads = 1; }
+
+        WorkStealingPool pool(num_threads);
+        pool.run(num_blocks, [&](int block_num, int /* thread_num */) {
+            // the pool threads don't run the query, so count the block apart (this may be the query's own thread)
+            QueryCounters                              thread_counters = queryCounters();
+            clearQueryCounters();
+
+            RandomNumberGenerator                      rng(path_spec, (uint32_t)block_num);
+            LinkChoices                                choices;
+            std::vector< std::pair<Path, PathInfo> >&  paths = block_paths[block_num];
+            std::unordered_multimap<size_t, size_t>    path_index;
+
+            int end_draw = std::min(STOCH_PATHSET_SIZE_, (block_num + 1)*ENUMERATION_BLOCK_DRAWS);
+            for (int draw = block_num*ENUMERATION_BLOCK_DRAWS; draw < end_draw; ++draw)
+            {
+                Path new_path(path_spec.outbound_, true);
+                if (!hyperpathDrawPath(path_spec, stop_states, rng, choices, new_path, trace_file)) { continue; }
+
+                size_t found_num = findSamePath(paths, path_index, new_path);
+                if (found_num < paths.size()) {
+                    paths[found_num].second.count_ += 1;
+                    continue;
+                }
+                // only new paths need their cost calculated
+                new_path.calculateCost(trace_file, path_spec, *this);
+                PathInfo pi = { 1, 0, 0 };  // count is 1
+                path_index.insert(std::make_pair(new_path.signature(), paths.size()));
+                paths.push_back(std::make_pair(new_path, pi));
+            }
+
+            block_counters[block_num] = queryCounters();
+            queryCounters()           = thread_counters;
+        });
+        for (int block_num = 0; block_num < num_blocks; ++block_num) {
+            addQueryCounters(block_counters[block_num]);
+        }
+        countQuery(COUNT_PATH_DRAWS, STOCH_PATHSET_SIZE_);
+
+        // merge in block order
+        for (int block_num = 0; block_num < num_blocks; ++block_num) {
+            for (std::vector< std::pair<Path, PathInfo> >::const_iterator bpi = block_paths[block_num].begin(); bpi != block_paths[block_num].end(); ++bpi) {
+                size_t found_num = findSamePath(found_paths, found_path_index, bpi->first);
+                if (found_num < found_paths.size()) {
+                    found_paths[found_num].second.count_ += bpi->second.count_;
+                    continue;
+                }
+                countQuery(COUNT_UNIQUE_PATHS);
+                found_path_index.insert(std::make_pair(bpi->first.signature(), found_num));
+                found_paths.push_back(*bpi);
+                logsum += exp(-1.0*bpi->first.cost()/Hyperlink::STOCH_DISPERSION_);
+            }
+        }
+    }
+
     Path PathFinder::choosePath(const PathSpecification& path_spec,
-        std::ofstream& trace_file,
+        PathFinderContext& context,
         PathSet& paths,
-        int max_prob_i) const
+        double max_cum_prob) const
     {
-        int random_num = rand();
-        if (path_spec.trace_) { trace_file << "random_num " << random_num << " -> "; }
-
-        // mod it by max prob
-        random_num = random_num % max_prob_i;
-        if (path_spec.trace_) { trace_file << random_num << std::endl; }
+        TraceStream& trace_file = context.trace_file_;
+        double random_num = context.rng_.uniform() * max_cum_prob;
+        if (path_spec.trace_) { trace_file << "random_num " << random_num << std::endl; }
 
         for (PathSet::const_iterator psi = paths.begin(); psi != paths.end(); ++psi)
         {
-            if (psi->second.prob_i_==0) { continue; }
-            if (random_num <= psi->second.prob_i_) { return psi->first; }
+            if (random_num < psi->second.cum_prob_) { return psi->first; }
         }
         // shouldn't get here
         printf("PathFinder::choosePath() This should never happen!\n");
+        return paths.begin()->first;
     }
 
     // Returns PathFinder::RET_SUCCESS, etc.
     int PathFinder::getPathSet(
         const PathSpecification&    path_spec,
-        std::ofstream&              trace_file,
+        PathFinderContext&          context,
         StopStates&                 stop_states,
         PathSet&                    pathset) const
     {
+        TraceStream& trace_file = context.trace_file_;
         int end_taz_id = path_spec.outbound_ ? path_spec.origin_taz_id_ : path_spec.destination_taz_id_;
 
         // no taz states -> no path found
-        StopStates::const_iterator ssi_iter = stop_states.find(end_taz_id);
-        if (ssi_iter == stop_states.end()) { return RET_FAIL_END_NOT_FOUND; }
+        const Hyperlink* taz_hyperlink = stop_states.find(end_taz_id);
+        if (taz_hyperlink == NULL) { return RET_FAIL_END_NOT_FOUND; }
 
-        const Hyperlink& taz_state = ssi_iter->second;
+        const Hyperlink& taz_state = *taz_hyperlink;
         if (taz_state.size() == 0) { return RET_FAIL_END_NOT_FOUND; }
 
+        QueryClock start_time, drawn_time, finalized_time;
+        readClock(start_time);
+
         // experimental-- look at the low cost path?
         if (false && path_spec.trace_)
         {
-            const Path* low_cost_path = taz_state.getLowCostPath(false); // ends in non-trip
-            if (low_cost_path) {
-                trace_file << "Low cost path: " << low_cost_path->cost() << std::endl;
-                low_cost_path->print(trace_file, path_spec, *this);
+            Path low_cost_path(path_spec.outbound_, false);
+            if (taz_state.getLowCostPath(false, stop_states, low_cost_path, trace_file, path_spec, *this)) { // ends in non-trip
+                trace_file << "Low cost path: " << low_cost_path.cost() << std::endl;
+                low_cost_path.print(trace_file, path_spec, *this);
                 trace_file << std::endl;
             } else { trace_file <<  "Low cost path: " << "None" << std::endl; }
         }
@@ -2077,37 +3332,51 @@ namespace fasttrips {
         if (path_spec.hyperpath_)
         {
             double logsum = 0;
-            // random seed -- possible todo: make this a function of more meaningful attributes, like o/d/time/outbound/userclass/purpose ?
-            // srand(path_spec.path_id_);
-            srand(42);
+            // the distinct paths found so far, in the order found, and their index by Path::signature()
+            std::vector< std::pair<Path, PathInfo> >   found_paths;
+            std::unordered_multimap<size_t, size_t>    found_path_index;
+            // traces are of the draws one by one, so traced queries aren't split up
+            bool draw_in_blocks = (ENUMERATION_THREADS_ > 0) && !path_spec.trace_;
+            if (draw_in_blocks) {
+                drawPathBlocks(path_spec, context, stop_states, found_paths, found_path_index, logsum);
+            }
+            // context.rng_ is seeded by person id and person trip id
+            // possible todo: make this a function of more meaningful attributes, like o/d/time/outbound/userclass/purpose ?
             // find a *set of Paths*
-            for (int attempts = 1; attempts <= STOCH_PATHSET_SIZE_; ++attempts)
+            for (int attempts = 1; !draw_in_blocks && (attempts <= STOCH_PATHSET_SIZE_); ++attempts)
             {
                 Path new_path(path_spec.outbound_, true);
-                bool path_found = hyperpathGeneratePath(path_spec, trace_file, stop_states, new_path);
+                bool path_found = hyperpathGeneratePath(path_spec, context, stop_states, new_path);
+                countQuery(COUNT_PATH_DRAWS);
 
                 if (path_found) {
-                    // we have to calculate the cost in order to find it, since it's ordered by cost also
-                    new_path.calculateCost(trace_file, path_spec, *this);
+                    // do we already have this?  if so, increment
+                    size_t found_num = findSamePath(found_paths, found_path_index, new_path);
+                    bool is_new = (found_num == found_paths.size());
+
+                    if (is_new) {
+                        countQuery(COUNT_UNIQUE_PATHS);
+                        // only new paths need their cost calculated
+                        new_path.calculateCost(trace_file, path_spec, *this);
+
+                        PathInfo pi = { 1, 0, 0 };  // count is 1
+                        found_paths.push_back(std::make_pair(new_path, pi));
+                        found_path_index.insert(std::make_pair(new_path.signature(), found_num));
+
+                        logsum += exp(-1.0*new_path.cost()/Hyperlink::STOCH_DISPERSION_);
+                    } else {
+                        found_paths[found_num].second.count_ += 1;
+                    }
 
                     if (path_spec.trace_) {
+                        const Path& found_path = found_paths[found_num].first;
                         trace_file << "----> Found path " << attempts << " ";
-                        new_path.printCompat(trace_file, path_spec, *this);
+                        found_path.printCompat(trace_file, path_spec, *this);
                         trace_file << std::endl;
-                        new_path.print(trace_file, path_spec, *this);
+                        found_path.print(trace_file, path_spec, *this);
                         trace_file << std::endl;
+                        trace_file << "pathsset size = " << found_paths.size() << " new? " << is_new << std::endl;
                     }
-                    // do we already have this?  if so, increment
-                    PathSet::iterator paths_iter = pathset.find(new_path);
-                    if (paths_iter != pathset.end()) {
-                        paths_iter->second.count_ += 1;
-                    } else {
-                        PathInfo pi = { 1, 0, 0 };  // count is 1
-                        pathset[new_path] = pi;
-
-                        logsum += exp(-1.0*new_path.cost()/Hyperlink::STOCH_DISPERSION_);
-                    }
-                    if (path_spec.trace_) { trace_file << "pathsset size = " << pathset.size() << " new? " << (paths_iter == pathset.end()) << std::endl; }
                 } else {
                     if (path_spec.trace_) {
                         trace_file << "----> No path found" << std::endl;
@@ -2115,10 +3384,17 @@ namespace fasttrips {
                 }
             }
 
+            readClock(drawn_time);
+            countQuery(COUNT_US_ENUMERATING, microsecondsBetween(start_time, drawn_time));
+
             if (logsum == 0) { return PathFinder::RET_FAIL_NO_PATHS_GEN; } // fail
 
-            // for integerized probability*1000000
-            int cum_prob    = 0;
+            // order them by cost
+            for (std::vector< std::pair<Path, PathInfo> >::const_iterator fpi = found_paths.begin(); fpi != found_paths.end(); ++fpi) {
+                pathset.insert(*fpi);
+            }
+
+            double cum_prob = 0;
             const Path* real_low_cost_path = NULL;
             // calculate the probabilities for those paths
 
@@ -2141,16 +3417,13 @@ namespace fasttrips {
                     trunc_iter = paths_iter;
                 }
 
-                // why?  :p
-                int prob_i = static_cast<int>(floor(fasttrips::INT_MULT*paths_iter->second.probability_ + 0.5));
-
-                cum_prob += prob_i;
-                paths_iter->second.prob_i_ = cum_prob;
+                cum_prob += paths_iter->second.probability_;
+                paths_iter->second.cum_prob_ = cum_prob;
 
                 if (path_spec.trace_)
                 {
                     trace_file << "-> probability " << std::setfill(' ') << std::setw(8) << paths_iter->second.probability_;
-                    trace_file << "; prob_i " << std::setw(8) << paths_iter->second.prob_i_;
+                    trace_file << "; cum_prob " << std::setw(8) << paths_iter->second.cum_prob_;
                     trace_file << "; count " << std::setw(4) << paths_iter->second.count_;
                     trace_file << "; cost " << std::setw(8) << paths_iter->first.cost();
                     // trace_file << "; cap bad? " << std::setw(2) << paths_iter->first.capacity_problem_;
@@ -2167,7 +3440,9 @@ namespace fasttrips {
                 }
             }
 
-            if (cum_prob == 0) { return RET_FAIL_NO_PATH_PROB; } // fail
+            readClock(finalized_time);
+            countQuery(COUNT_US_FINALIZING, microsecondsBetween(drawn_time, finalized_time));
+            if (!(cum_prob > 0)) { return RET_FAIL_NO_PATH_PROB; } // fail
 
             // if we have more than the max num paths AND some are low probability, truncate
             if (trunc_iter != pathset.end()) {
@@ -2182,10 +3457,10 @@ namespace fasttrips {
             // experimental-- verify lowest cost path is low?
             if (false && real_low_cost_path)
             {
-                const Path* low_cost_path = taz_state.getLowCostPath(false); // ends in non-trip
-                if (low_cost_path == NULL) {
+                Path low_cost_path(path_spec.outbound_, false);
+                if (!taz_state.getLowCostPath(false, stop_states, low_cost_path, trace_file, path_spec, *this)) { // ends in non-trip
                     std::cerr << "No low cost path found for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
-                } else if (real_low_cost_path->cost() < low_cost_path->cost()) {
+                } else if (real_low_cost_path->cost() < low_cost_path.cost()) {
                     std::cerr << "Real low cost path not found for person " << path_spec.person_id_ << " trip " << path_spec.person_trip_id_ << std::endl;
                 } else {
                     std::cerr << "Real low cost path found" << std::endl;
@@ -2193,7 +3468,7 @@ namespace fasttrips {
             }
 
             // choose path
-            // path = choosePath(path_spec, trace_file, pathsset, cum_prob);
+            // path = choosePath(path_spec, context, pathsset, cum_prob);
             // path_info = paths[path];
             return RET_SUCCESS;
         }
@@ -2210,9 +3485,9 @@ namespace fasttrips {
             {
                 const StopState& last_link = path.back().second;
                 int stop_id = last_link.stop_succpred_;
-                StopStates::const_iterator ssi = stop_states.find(stop_id);
+                const Hyperlink* ssi = stop_states.find(stop_id);
                 path.addLink(stop_id,
-                             ssi->second.lowestCostStopState(!isTrip(last_link.deparr_mode_)),
+                             ssi->lowestCostStopState(!isTrip(last_link.deparr_mode_)),
                              trace_file,
                              path_spec, *this);
 
@@ -2220,6 +3495,10 @@ namespace fasttrips {
             PathInfo pi = { 1, 1, 0 };  // count is 1
             path.calculateCost(trace_file, path_spec, *this);
             pathset[path] = pi;
+            countQuery(COUNT_PATH_DRAWS);
+            countQuery(COUNT_UNIQUE_PATHS);
+            readClock(drawn_time);
+            countQuery(COUNT_US_ENUMERATING, microsecondsBetween(start_time, drawn_time));
             if (path_spec.trace_)
             {
                 trace_file << "Final path" << std::endl;
@@ -2235,15 +3514,14 @@ namespace fasttrips {
      */
     double PathFinder::getScheduledDeparture(int trip_id, int stop_id, int sequence) const
     {
-        std::map<int, std::vector<TripStopTime> >::const_iterator tsti = trip_stop_times_.find(trip_id);
-        if (tsti == trip_stop_times_.end()) { return -1; }
+        TripStopTimeRange trip_stops = trip_stop_times_.forTrip(trip_id);
 
-        for (size_t stt_index = 0; stt_index < tsti->second.size(); ++stt_index)
+        for (const TripStopTime* tst = trip_stops.begin(); tst != trip_stops.end(); ++tst)
         {
-            if (tsti->second[stt_index].stop_id_ != stop_id) { continue; }
+            if (tst->stop_id_ != stop_id) { continue; }
             // trip id matches and stop id matches -- does sequence match or is it unspecified?
-            if ((sequence < 0) || (sequence == tsti->second[stt_index].seq_)) {
-                return tsti->second[stt_index].depart_time_;
+            if ((sequence < 0) || (sequence == tst->seq_)) {
+                return tst->depart_time_;
             }
         }
         return -1;
@@ -2254,81 +3532,72 @@ namespace fasttrips {
      */
     const FarePeriod* PathFinder::getFarePeriod(int route_id, int board_stop_id, int alight_stop_id, double trip_depart_time) const
     {
-        int board_stop_zone  = stop_num_to_stop_.find(board_stop_id)->second.zone_num_;
-        int alight_stop_zone = stop_num_to_stop_.find(alight_stop_id)->second.zone_num_;
-        RouteStopZone rsz;
+        countQuery(COUNT_FARE_LOOKUPS);
+        int board_stop_zone  = stop_num_to_stop_.find(board_stop_id)->zone_num_;
+        int alight_stop_zone = stop_num_to_stop_.find(alight_stop_id)->zone_num_;
+        // zones that aren't in any fare period don't match anything
+        bool has_zones       = (board_stop_zone  >= 0) && (board_stop_zone  < num_fare_zones_) &&
+                               (alight_stop_zone >= 0) && (alight_stop_zone < num_fare_zones_);
+        int zone_pair        = has_zones ? board_stop_zone*num_fare_zones_ + alight_stop_zone : -1;
+        bool has_route       = (route_id >= 0) && (route_id < (int)route_fare_periods_.size());
+        const FarePeriod* fp = NULL;
+
+        // search for route + origin zone, dest zone
+        if (has_route && has_zones && (route_fare_zone_table_[route_id] >= 0)) {
+            fp = findFarePeriod(fare_zone_tables_[route_fare_zone_table_[route_id]*num_fare_zones_*num_fare_zones_ + zone_pair], trip_depart_time);
+            if (fp) { return fp; }
+        }
+        // search for route only
+        if (has_route) {
+            fp = findFarePeriod(route_fare_periods_[route_id], trip_depart_time);
+            if (fp) { return fp; }
+        }
+        // search for origin zone, dest zone
+        if (has_zones) {
+            fp = findFarePeriod(fare_zone_tables_[zone_pair], trip_depart_time);
+            if (fp) { return fp; }
+        }
+        // search for general fare
+        return findFarePeriod(general_fare_periods_, trip_depart_time);
+    }
 
-        for (int search_type = 0; search_type < 4; ++search_type) {
-            // search for route + origin zone, dest zone
-            if (search_type == 0) {
-                if (board_stop_zone  < 0) { continue; }
-                if (alight_stop_zone < 0) { continue; }
-                rsz.route_id_         = route_id;
-                rsz.origin_zone_      = board_stop_zone;
-                rsz.destination_zone_ = alight_stop_zone;
-            } else if (search_type == 1) {
-                // search for route only
-                rsz.route_id_         = route_id;
-                rsz.origin_zone_      = -1;
-                rsz.destination_zone_ = -1;
-            } else if (search_type == 2) {
-                if (board_stop_zone  < 0) { continue; }
-                if (alight_stop_zone < 0) { continue; }
-                // search for origin zone, dest zone
-                rsz.route_id_         = -1;
-                rsz.origin_zone_      = board_stop_zone;
-                rsz.destination_zone_ = alight_stop_zone;
-            } else if (search_type == 3) {
-                // search for general fare
-                rsz.route_id_         = -1;
-                rsz.origin_zone_      = -1;
-                rsz.destination_zone_ = -1;
-            }
-
-            // find the right fare period
-            std::pair<FarePeriodMmap::const_iterator, FarePeriodMmap::const_iterator> iter_range = fare_periods_.equal_range(rsz);
-            FarePeriodMmap::const_iterator fp_iter = iter_range.first;
-            while (fp_iter != iter_range.second) {
-                if ((trip_depart_time >= fp_iter->second.start_time_) && (trip_depart_time < fp_iter->second.end_time_)) {
-                    return &(fp_iter->second);
-                }
-                ++fp_iter;
+    const FarePeriod* PathFinder::findFarePeriod(const FarePeriodRange& fp_range, double trip_depart_time) const
+    {
+        // there are only a few, and they're in the order they were read; the first one that matches wins
+        for (int fp_index = fp_range.begin_; fp_index < fp_range.end_; ++fp_index) {
+            const FarePeriod* fp = fare_period_index_[fp_index];
+            if ((trip_depart_time >= fp->start_time_) && (trip_depart_time < fp->end_time_)) {
+                return fp;
             }
         }
-        return (const FarePeriod*)0;
+        return NULL;
     }
 
     /**
      * Returns the fare transfer given two fare periods.
      */
-    const FareTransfer* PathFinder::getFareTransfer(const std::string from_fare_period, const std::string to_fare_period) const
+    const FareTransfer* PathFinder::getFareTransfer(int from_fare_period_num, int to_fare_period_num) const
     {
-        FareTransferMap::const_iterator ftm_iter = fare_transfer_rules_.find( std::make_pair(from_fare_period, to_fare_period) );
-        if (ftm_iter != fare_transfer_rules_.end()) {
-            return &(ftm_iter->second);
-        }
-        return (const FareTransfer*)0;
+        countQuery(COUNT_FARE_LOOKUPS);
+        int num_fare_periods = (int)fare_period_names_.size();
+        if ((from_fare_period_num < 0) || (from_fare_period_num >= num_fare_periods)) { return (const FareTransfer*)0; }
+        if ((to_fare_period_num   < 0) || (to_fare_period_num   >= num_fare_periods)) { return (const FareTransfer*)0; }
+
+        const FareTransfer& ft = fare_transfer_rules_[from_fare_period_num*num_fare_periods + to_fare_period_num];
+        if (ft.type_ == TRANSFER_NONE) { return (const FareTransfer*)0; }
+        return &ft;
     }
 
     /**
      * If outbound, then we're searching backwards, so this returns trips that arrive at the stop in time to depart at timepoint (timepoint-TIME_WINDOW_, timepoint]
      * If inbound,  then we're searching forwards,  so this returns trips that depart at the stop time after timepoint           [timepoint, timepoint+TIME_WINDOW_)
      */
-    void PathFinder::getTripsWithinTime(int stop_id, bool outbound, double timepoint, std::vector<TripStopTime>& return_trips) const
+    TripStopTimeRefRange PathFinder::getTripsWithinTime(int stop_id, bool outbound, double timepoint) const
     {
-        // are there any trips for this stop?
-        std::map<int, std::vector<TripStopTime> >::const_iterator mapiter = stop_trip_times_.find(stop_id);
-        if (mapiter == stop_trip_times_.end()) {
-            return;
-        }
-        for (std::vector<TripStopTime>::const_iterator it  = mapiter->second.begin();
-                                                       it != mapiter->second.end();   ++it) {
-            if (outbound && (it->arrive_time_ <= timepoint) && (it->arrive_time_ > timepoint-Hyperlink::TIME_WINDOW_)) {
-                return_trips.push_back(*it);
-            } else if (!outbound && (it->depart_time_ >= timepoint) && (it->depart_time_ < timepoint+Hyperlink::TIME_WINDOW_)) {
-                return_trips.push_back(*it);
-            }
+        if (outbound) {
+            return stop_time_index_.arrivingWithin(stop_id, timepoint-Hyperlink::TIME_WINDOW_, timepoint);
         }
+        return stop_time_index_.departingWithin(stop_id, timepoint, timepoint+Hyperlink::TIME_WINDOW_);
     }
 
     /*
@@ -2391,7 +3660,7 @@ namespace fasttrips {
             ostr << std::setw(13) << std::setfill(' ') << "Transfer";
         } else if (mode == MODE_TRANSIT) {
             // show the supply mode
-            int supply_mode_num = trip_info_.find(trip_id)->second.supply_mode_num_;
+            int supply_mode_num = trip_info_.find(trip_id)->supply_mode_num_;
             ostr << std::setw(13) << std::setfill(' ') << mode_num_to_str_.find(supply_mode_num)->second;
         } else {
             // trip
@@ -6,6 +6,7 @@
 
 #include <ctime>
 #include <map>
+#include <memory>
 #include <vector>
 #include <queue>
 #include <iostream>
@@ -13,10 +14,21 @@
 #include <string>
 #include "pathspec.h"
 #include "access_egress.h"
+#include "connection_scan.h"
 #include "LabelStopQueue.h"
+#include "network.h"
 #include "hyperlink.h"
+#include "labeling_cache.h"
+#include "lower_bounds.h"
 #include "path.h"
-
+#include "query_corpus.h"
+#include "query_counters.h"
+#include "snapshot.h"
+#include "stop_times.h"
+#include "transfer_table.h"
+#include "trace_sink.h"
+
+#include <unordered_map>
 #include <unordered_set>
 
 namespace fasttrips {
@@ -45,31 +57,10 @@ namespace fasttrips {
         }
     };
 
-    enum WeightType {
-        WEIGHT_LINEAR      = 0,  // default
-        WEIGHT_EXPONENTIAL = 1,
-        WEIGHT_LOGARITHMIC = 2,
-        WEIGHT_LOGISTIC    = 3
-    };
-
-    typedef struct  {
-      WeightType type_;          // the type of weight
-      double     weight_;        // this is the primary part -- the weight itself
-      double     log_base_;      // only for WEIGHT_LOGARITHMIC
-      double     logistic_max_;  // oly for WEIGHT_LOGISTIC
-      double     logistic_mid_;  // oly for WEIGHT_LOGISTIC
-    } Weight;
-
     // This is a lot of naming but it does make iterator construction easier
-    typedef std::map<std::string, Weight> NamedWeights;
-    typedef std::map<int, NamedWeights> SupplyModeToNamedWeights;
-    typedef std::map< UserClassPurposeMode, SupplyModeToNamedWeights, struct fasttrips::UCPMCompare > WeightLookup;
-
-
+    typedef std::map<int, SupplyModeWeights> SupplyModeToWeights;
+    typedef std::map< UserClassPurposeMode, SupplyModeToWeights, struct fasttrips::UCPMCompare > WeightLookup;
 
-    // Transfer information: stop id -> stop id -> attribute map
-    typedef std::map<int, Attributes> StopToAttr;
-    typedef std::map<int, StopToAttr> StopStopToAttr;
 
 
     /// Supply data: access/egress time and cost between TAZ and stops
@@ -84,19 +75,9 @@ namespace fasttrips {
         int        supply_mode_num_;
         int        route_id_;
         Attributes trip_attr_;
+        LinkAttributes trip_slots_;     ///< trip_attr_ in attribute slots
     } TripInfo;
 
-    /// Supply data: Transit vehicle schedules
-    typedef struct {
-        int     trip_id_;         /// trip ID
-        int     seq_;             /// stop sequence, starts at 1
-        int     stop_id_;         /// stop ID
-        double  arrive_time_;     /// minutes after midnight
-        double  depart_time_;     /// minutes after midnight
-        double  shape_dist_trav_; /// shape distance traveled
-        double  overcap_;         /// number of passengers overcap
-    } TripStopTime;
-
     /// For capacity lookups: TripStop definition
     typedef struct {
         int     trip_id_;
@@ -135,6 +116,7 @@ namespace fasttrips {
     struct FarePeriod {
         std::string fare_id_;           ///< Fare ID
         std::string fare_period_;       ///< Name of the fare period
+        int         fare_period_num_;   ///< Number for the name of the fare period; see PathFinder::farePeriodNum()
         double      start_time_;        ///< Start time of the fare period
         double      end_time_;          ///< End time of the fare period
         double      price_;             ///< Currency unspecified but matches value_of_time_
@@ -145,8 +127,15 @@ namespace fasttrips {
     /// Maps route id + origin zone + dest zone (any of these may be NA, or -1) => FarePeriod
     typedef std::multimap<RouteStopZone, struct FarePeriod, struct RouteStopZoneCompare> FarePeriodMmap;
 
+    /// The fare periods for a fasttrips::RouteStopZone: [begin_, end_) in PathFinder::fare_period_index_
+    typedef struct {
+        int         begin_;
+        int         end_;
+    } FarePeriodRange;
+
     /// Fare transfer types
     enum FareTransferType {
+      TRANSFER_NONE     = 0,            ///< no transfer rule
       TRANSFER_FREE     = 1,            ///< free transfer
       TRANSFER_DISCOUNT = 2,            ///< discount transfer
       TRANSFER_COST     = 3             ///< set price transfer
@@ -158,23 +147,49 @@ namespace fasttrips {
       double            amount_;          ///< fare transfer type
     } FareTransfer;
 
-    /// Fare Transfer Rules
-    typedef std::map< std::pair<std::string,std::string>, FareTransfer> FareTransferMap;
+    /// Fare Transfer Rules by (from fare period number, to fare period number), for reading them
+    typedef std::map< std::pair<int,int>, FareTransfer> FareTransferMap;
 
     /** Performance information to return. */
     typedef struct {
         int     label_iterations_;              ///< Number of label iterations performed
         int     num_labeled_stops_;             ///< Number of stops labeled
         int     max_process_count_;             ///< Maximum number of times a stop was processed
+        int     num_pruned_states_;             ///< Number of stop states pruned by the lower bounds (see PathFinder::PRUNE_WITH_LOWER_BOUNDS_)
+        int     label_cache_hit_;               ///< 1 if the labels were reused from an earlier query (see PathFinder::LABELING_CACHE_), else 0
         long    milliseconds_labeling_;         ///< Number of seconds spent in labeling
         long    milliseconds_enumerating_;      ///< Number of seconds spent in enumerating
         long    workingset_bytes_;              ///< Working set size, in bytes
         long    privateusage_bytes_;            ///< Private memory usage, in bytes
         long    mem_timestamp_;                 ///< Time of memory query, in seconds since epoch
+        QueryCounters counters_;                ///< Hot path counts and the time split, indexed by fasttrips::QueryCounter
     } PerformanceInfo;
 
+    /**
+     * Per-query state for PathFinder::findPathSet().
+     *
+     * Everything a query changes lives here (or on its stack) rather than in the PathFinder
+     * or in globals, so that one PathFinder and its supply can be shared by many concurrent queries.
+     */
+    struct PathFinderContext {
+        TraceStream                 trace_file_;        ///< Trace log; only open if the path spec is traced
+        TraceStream                 label_file_;        ///< Labels csv for tracing; opened by PathFinder::addStopState()
+        TraceStream                 stopids_file_;      ///< Label stop ids csv for tracing
+        int                         label_link_num_;    ///< Unique ID for the link in label_file_
+        RandomNumberGenerator       rng_;               ///< For path enumeration
+        std::shared_ptr<const CostBounds> cost_bounds_; ///< Lower bounds on the cost from each stop to the end TAZ, if pruning
+        std::shared_ptr<const TransferTable> transfer_table_; ///< The transfers costed for the path spec, or empty if it has no transfer weights
+        double                      prune_cost_;        ///< Stop states whose cost plus bound exceed this are pruned
+        int                         num_pruned_;        ///< Number of stop states pruned
+
+        PathFinderContext(const PathSpecification& path_spec) : label_link_num_(1), rng_(path_spec), prune_cost_(MAX_COST), num_pruned_(0) {}
+    };
+
     /**
     * This is the class that does all the work.  Setup the network supply first.
+    *
+    * Once the supply and parameters are initialized, PathFinder::findPathSet() doesn't modify
+    * the PathFinder so it may be called from multiple threads.
     */
     class PathFinder
     {
@@ -202,10 +217,29 @@ namespace fasttrips {
 
         /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.MIN_PATH_PROBABILITY">fasttrips.Assignment.MIN_PATH_PROBABILITY</a>
         double MIN_PATH_PROBABILITY_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.PRUNE_WITH_LOWER_BOUNDS">fasttrips.Assignment.PRUNE_WITH_LOWER_BOUNDS</a>
+        bool PRUNE_WITH_LOWER_BOUNDS_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.LABELING_CACHE">fasttrips.Assignment.LABELING_CACHE</a>
+        bool LABELING_CACHE_;
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.LABELING_CACHE_MB">fasttrips.Assignment.LABELING_CACHE_MB</a>
+        int LABELING_CACHE_MB_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.CONNECTION_SCAN">fasttrips.Assignment.CONNECTION_SCAN</a>
+        bool CONNECTION_SCAN_;
+
+        /// See <a href="_generated/fasttrips.Assignment.html#fasttrips.Assignment.ENUMERATION_THREADS">fasttrips.Assignment.ENUMERATION_THREADS</a>
+        int ENUMERATION_THREADS_;
+
+        /// The PathFinder::initializeParameters() arguments, in order, for the labeling cache and query corpora
+        std::vector<double> parameters_;
         ///@}
 
         /// Access this through getTransferAttributes()
         static Attributes* ZERO_WALK_TRANSFER_ATTRIBUTES_;
+        /// PathFinder::ZERO_WALK_TRANSFER_ATTRIBUTES_ in attribute slots
+        LinkAttributes zero_walk_transfer_slots_;
 
         /// directory in which to write trace files
         std::string output_dir_;
@@ -215,30 +249,60 @@ namespace fasttrips {
 
         /// (User class, demand_mode_type, demand_mode) -> supply_mode -> weight_map
         WeightLookup weight_lookup_;
+        /// Slots for the weighted attribute names.  Set by PathFinder::compileLinkCosts().
+        AttributeSlots attribute_slots_;
 
         // ================ Network supply ================
         /// Access/Egress information: taz id -> supply_mode -> stop id -> (start time, end time) -> attribute map
         AccessEgressLinks access_egress_links_;
 
-        /// Transfer information: stop id -> stop id -> attributes
-        StopStopToAttr transfer_links_o_d_;
-        StopStopToAttr transfer_links_d_o_;
+        /// Transfer information: origin stop id -> destination stop id -> attributes
+        TransferLinks transfer_links_o_d_;
+        /// Transfer information: destination stop id -> origin stop id -> attributes
+        TransferLinks transfer_links_d_o_;
         /// Trip information: trip id -> Trip Info
-        std::map<int, TripInfo> trip_info_;
-        /// Trip information: trip id -> vector of [trip id, sequence, stop id, arrival time, departure time, overcap]
-        std::map<int, std::vector<TripStopTime> > trip_stop_times_;
-        /// Stop information: stop id -> vector of [trip id, sequence, stop id, arrival time, departure time, overcap]
-        std::map<int, std::vector<TripStopTime> > stop_trip_times_;
+        IdVector<TripInfo> trip_info_;
+        /// Trip information: trip id -> [trip id, sequence, stop id, arrival time, departure time, overcap] in sequence order
+        TripStopTimes trip_stop_times_;
+        /// Stop information: stop id -> positions in trip_stop_times_, sorted by arrival and by departure
+        StopTimeIndex stop_time_index_;
+        /// The trip hops between consecutive stops in time order, for PathFinder::scanConnections().  Only built if PathFinder::CONNECTION_SCAN_.
+        ConnectionTimetable connections_;
+        /// Lower bounds on the cost between stops and TAZs, for pruning.  Filled in lazily by PathFinder::costBoundsFor().
+        mutable StopCostBounds cost_bounds_;
+        /// The transfers with their costs precomputed for each user class, purpose and direction.  Filled in lazily by PathFinder::transferTableFor().
+        mutable TransferTables transfer_tables_;
+        /// Labels from earlier queries, if PathFinder::LABELING_CACHE_.  Entries are dropped as the supply they depend on changes,
+        /// and the least recently used past PathFinder::LABELING_CACHE_MB_.
+        mutable LabelingCache labeling_cache_;
         // Fare information: route id -> fare id
-        std::map<int, int> route_fares_;
+        IdVector<int> route_fares_;
         // Fare information: route/origin zone/dest zone -> fare period
         FarePeriodMmap fare_periods_;
-        // Fare transfer rules: (from_fare_period,to_fare_period) -> FareTransfer
-        FareTransferMap fare_transfer_rules_;
+        // Fare period names by fare period number, and the reverse
+        std::vector<std::string>    fare_period_names_;
+        std::map<std::string, int>  fare_period_nums_;
+        // Fare transfer rules: from fare period number * number of fare periods + to fare period number -> FareTransfer
+        std::vector<FareTransfer>   fare_transfer_rules_;
+
+        // ============ Fare period lookup, built by buildFareIndex() ============
+        // Pointers into fare_periods_, grouped by key in multimap order
+        std::vector<const FarePeriod*>  fare_period_index_;
+        // Fare periods for any route and zones
+        FarePeriodRange                 general_fare_periods_;
+        // route id -> fare periods for the route and any zones
+        std::vector<FarePeriodRange>    route_fare_periods_;
+        // Number of fare zones; zone numbers in the fare periods are less than this
+        int                             num_fare_zones_;
+        // num_fare_zones_ x num_fare_zones_ tables: origin zone * num_fare_zones_ + destination zone -> fare periods.
+        // The first one is for any route; the rest are for routes with route and zone specific fare periods.
+        std::vector<FarePeriodRange>    fare_zone_tables_;
+        // route id -> its table in fare_zone_tables_, or -1 if none
+        std::vector<int>                route_fare_zone_table_;
 
         // ================ ID numbers to ID strings ===============
         std::map<int, std::string> trip_num_to_str_;
-        std::map<int, Stop>        stop_num_to_stop_;
+        IdVector<Stop>             stop_num_to_stop_;
         std::map<int, std::string> route_num_to_str_;
         std::map<int, std::string> mode_num_to_str_; // supply modes
         int transfer_supply_mode_;
@@ -262,14 +326,57 @@ namespace fasttrips {
         void readStopIds();
         void readRouteIds();
         void readFarePeriods();
+        /// Returns the number for the given fare period name, adding it if it's new
+        int  farePeriodNum(const std::string& fare_period);
+        /// Sets PathFinder::fare_transfer_rules_ and builds the fare period lookup.  Call this once fare_periods_ is read.
+        void buildFareIndex(const FareTransferMap& fare_transfer_rules);
+        /// The first fare period in the range that includes the given time, or NULL
+        const FarePeriod* findFarePeriod(const FarePeriodRange& fp_range, double trip_depart_time) const;
         void readModeIds();
         void readAccessLinks();
         void readTransferLinks();
         void readTripInfo();
         void readWeights();
 
+        /**
+         * Read the supply that PathFinder::readIntermediateFiles() reads from the network snapshot instead.
+         * The snapshot records the manifest python wrote of the intermediate files it was made from (their sizes
+         * and content hashes, once per run), and it's only used if the manifest still matches.  Not the modification
+         * times: python writes the intermediate files at the start of every run, mostly unchanged.
+         *
+         * @return true if the snapshot was read; false if it's missing, out of date or corrupt.  In that last case
+         *         the supply read so far is dropped, so the intermediate files can be read instead.
+         */
+        bool readSnapshot();
+        /// The contents of python's manifest of the intermediate files, or false if there isn't one
+        bool readSnapshotManifest(std::string& manifest) const;
+
+        /**
+         * Once the supply and weights are read, intern the weighted attribute names,
+         * compile the weights and set the slots for the supply link attributes.
+         */
+        void compileLinkCosts();
+
+        /**
+         * The lower bounds on the cost from each stop to the end TAZ for the given path spec, for
+         * PathFinder::PRUNE_WITH_LOWER_BOUNDS_.  The time bounds are costed at the least in-vehicle time weight
+         * of the path spec's transit supply modes and its transfer walk time weight; non-linear weights count as zero.
+         */
+        std::shared_ptr<const CostBounds> costBoundsFor(const PathSpecification& path_spec) const;
+
+        /**
+         * The transfers for the given path spec's user class, purpose and direction, with their costs, building them on first use.
+         * Empty if there are no transfer weights for the user class and purpose, in which case transfers aren't used.
+         */
+        std::shared_ptr<const TransferTable> transferTableFor(const PathSpecification& path_spec, std::ostream& trace_file) const;
+
+        /**
+         * The labeling methods below are templated on a fasttrips::SearchMode so the direction,
+         * hyperpath and trace checks in their inner loops are resolved at compile time.
+         */
+        template <class Mode>
         void addStopState(const PathSpecification& path_spec,
-                          std::ofstream& trace_file,
+                          PathFinderContext& context,
                           const int stop_id,
                           const StopState& ss,
                           const Hyperlink* prev_link,
@@ -282,8 +389,9 @@ namespace fasttrips {
          *
          * @return success.  This method will only fail if there are no access/egress links for the starting TAZ.
          */
+        template <class Mode>
         bool initializeStopStates(const PathSpecification& path_spec,
-                                  std::ofstream& trace_file,
+                                  PathFinderContext& context,
                                   StopStates& stop_states,
                                   LabelStopQueue& cost_stop_queue) const;
 
@@ -292,8 +400,9 @@ namespace fasttrips {
          * *current_label_stop* and update the *stop_states* with information about how
          * accessible those stops are as a transfer to/from the *current_label_stop*.
          */
+        template <class Mode>
         void updateStopStatesForTransfers(const PathSpecification& path_spec,
-                                  std::ofstream& trace_file,
+                                  PathFinderContext& context,
                                   StopStates& stop_states,
                                   LabelStopQueue& label_stop_queue,
                                   int label_iteration,
@@ -304,8 +413,9 @@ namespace fasttrips {
          * *label_stop_queue*, this method will iterate through access links to (for outbound) or
          * egress links from (for inbound) the current stop and update the next stop given the current stop state.
          */
+        template <class Mode>
         void updateStopStatesForFinalLinks(const PathSpecification& path_spec,
-                                  std::ofstream& trace_file,
+                                  PathFinderContext& context,
                                   const std::map<int, int>& reachable_final_stops,
                                   StopStates& stop_states,
                                   LabelStopQueue& label_stop_queue,
@@ -320,8 +430,9 @@ namespace fasttrips {
          * with information about how accessible those stops are as a transit trip to/from
          * the *current_label_stop*.
          */
+        template <class Mode>
         void updateStopStatesForTrips(const PathSpecification& path_spec,
-                                  std::ofstream& trace_file,
+                                  PathFinderContext& context,
                                   StopStates& stop_states,
                                   LabelStopQueue& label_stop_queue,
                                   int label_iteration,
@@ -338,13 +449,71 @@ namespace fasttrips {
          * Assume we're done if we've reached the final TAZ already and the current cost is some percent bigger than
          * threshhold based on the lowest cost and the minimum probability.
          */
+        template <class Mode>
         int labelStops(const PathSpecification& path_spec,
-                       std::ofstream& trace_file,
+                       PathFinderContext& context,
                        const std::map<int,int>& reachable_final_stops,
                        StopStates& stop_states,
                        LabelStopQueue& label_stop_queue,
                        int& max_process_count) const;
 
+        /**
+         * Label stops for deterministic path finding by scanning the connections in PathFinder::connections_ in time order
+         * from the preferred time, rather than expanding trips from the stops pulled off the *label_stop_queue*
+         * (PathFinder::updateStopStatesForTrips()).  A trip is boarded (inbound) or alighted (outbound) at a stop whose
+         * walk link allows it, within the time window and bump waits as in PathFinder::updateStopStatesForTrips(),
+         * and labels the stops after (inbound) or before (outbound) it as the scan reaches them.
+         *
+         * The *label_stop_queue* then only holds trip states waiting for the scan to pass them, at which point
+         * they're final and the transfers and final links from them are added as in PathFinder::labelStops().
+         * Deterministic costs are the time from the preferred time, so this finds the same least cost paths.
+         * The scan stops once it can't improve on the end TAZ.
+         *
+         * @return the number of trip states processed, like PathFinder::labelStops()'s label iterations.
+         */
+        template <class Mode>
+        int scanConnections(const PathSpecification& path_spec,
+                            PathFinderContext& context,
+                            const std::map<int,int>& reachable_final_stops,
+                            StopStates& stop_states,
+                            LabelStopQueue& label_stop_queue) const;
+
+        /**
+         * Labels the stop states for the path_spec: PathFinder::initializeStopStates(),
+         * PathFinder::setReachableFinalStops() and PathFinder::labelStops().  Fills in the labeling
+         * counts in performance_info but not the timing.  With PathFinder::LABELING_CACHE_, untraced queries
+         * reuse the labels in PathFinder::labeling_cache_ if they're there, and save them there if not.
+         *
+         * @return PathFinder::RET_SUCCESS, or the failure code, in which case the stop states are cleared.
+         */
+        template <class Mode>
+        int labelPathSet(const PathSpecification& path_spec,
+                         PathFinderContext& context,
+                         PerformanceInfo& performance_info,
+                         StopStates& stop_states) const;
+
+        /**
+         * Does the work of PathFinder::findPathSet() once it's picked the fasttrips::SearchMode
+         * for the path_spec and opened any trace files.
+         */
+        template <class Mode>
+        int findPathSetForMode(const PathSpecification& path_spec,
+                               PathFinderContext& context,
+                               PathSet& pathset,
+                               PerformanceInfo& performance_info,
+                               StopStates& stop_states) const;
+
+        /**
+         * Does the work of PathFinder::findPathSetGroup() once it's picked the fasttrips::SearchMode.
+         */
+        template <class Mode>
+        void findPathSetGroupForMode(const std::vector<PathSpecification>& path_specs,
+                                     const std::vector<int>& group,
+                                     std::vector<PathSet>& pathsets,
+                                     std::vector<PerformanceInfo>& performance_infos,
+                                     std::vector<int>& pf_returnstatus,
+                                     StopStates& stop_states) const;
+
         /**
          * This fills the reachable_final_stops map with stop_id -> number of supply links between
          * the final stop and the final TAZ.
@@ -352,7 +521,7 @@ namespace fasttrips {
          * @return True if some final stops are reachable, False if there are none
          */
         bool setReachableFinalStops(const PathSpecification& path_spec,
-                                    std::ofstream& trace_file,
+                                    PathFinderContext& context,
                                     std::map<int, int>& reachable_final_stops) const;
 
         /**
@@ -363,7 +532,7 @@ namespace fasttrips {
          * @return sucess.
          */
         bool finalizeTazState(const PathSpecification& path_spec,
-                              std::ofstream& trace_file,
+                              PathFinderContext& context,
                               StopStates& stop_states,
                               LabelStopQueue& label_stop_queue,
                               int label_iteration) const;
@@ -376,35 +545,71 @@ namespace fasttrips {
          * @return success
          */
         bool hyperpathGeneratePath(const PathSpecification& path_spec,
-                                  std::ofstream& trace_file,
+                                  PathFinderContext& context,
                                   StopStates& stop_states,
                                   Path& path) const;
 
+        /**
+         * Like PathFinder::hyperpathGeneratePath() but without modifying the stop states, so that paths can be drawn
+         * from them on several threads at once.  The link choices at each stop go in choices instead.
+         * Not for traced queries.
+         *
+         * @return success
+         */
+        bool hyperpathDrawPath(const PathSpecification& path_spec,
+                               const StopStates& stop_states,
+                               RandomNumberGenerator& rng,
+                               LinkChoices& choices,
+                               Path& path,
+                               std::ostream& trace_file) const;
+
+        /**
+         * Draws the STOCH_PATHSET_SIZE_ paths for PathFinder::getPathSet() across ENUMERATION_THREADS_ threads.
+         * The draws are split into blocks of ENUMERATION_BLOCK_DRAWS, each with its own random number stream,
+         * and the distinct paths from each block are merged in block order, so the path set is the same
+         * however many threads there are.  Inside a multithreaded batch, the blocks are drawn on the query's
+         * own thread rather than nesting more threads in each of the batch's.
+         *
+         * Adds the distinct paths to found_paths and found_path_index, and their exponentiated costs to logsum.
+         */
+        void drawPathBlocks(const PathSpecification&                    path_spec,
+                            PathFinderContext&                          context,
+                            const StopStates&                           stop_states,
+                            std::vector< std::pair<Path, PathInfo> >&   found_paths,
+                            std::unordered_multimap<size_t, size_t>&    found_path_index,
+                            double&                                     logsum) const;
+
         /**
          * Given a set of paths, randomly selects one based on the cumulative
-         * probability (fasttrips::PathInfo.prob_i_)
+         * probability (fasttrips::PathInfo.cum_prob_)
          *
          * Returns a reference to that path, which is stored in paths.
          */
         Path choosePath(const PathSpecification& path_spec,
-                        std::ofstream& trace_file,
+                        PathFinderContext& context,
                         PathSet& paths,
-                        int max_prob_i) const;
+                        double max_cum_prob) const;
 
         int getPathSet(const PathSpecification&      path_spec,
-                       std::ofstream&                trace_file,
+                       PathFinderContext&            context,
                        StopStates&                   stop_states,
                        PathSet&                      pathset) const;
 
         /**
          * If outbound, then we're searching backwards, so this returns trips that arrive at the given stop in time to depart at timepoint.
          * If inbound,  then we're searching forwards,  so this returns trips that depart at the given stop time after timepoint
+         *
+         * The returned range points into PathFinder::stop_time_index_ and refers to PathFinder::trip_stop_times_,
+         * ordered by the arrival time (outbound) or departure time (inbound).
          */
-        void getTripsWithinTime(int stop_id, bool outbound, double timepoint, std::vector<TripStopTime>& return_trips) const;
+        TripStopTimeRefRange getTripsWithinTime(int stop_id, bool outbound, double timepoint) const;
 
     public:
         const static int MAX_DATETIME   = 48*60; // 48 hours in minutes
 
+        /// Paths drawn per random number stream by PathFinder::drawPathBlocks()
+        const static int ENUMERATION_BLOCK_DRAWS = 50;
+
         /** Return statuses for PathFinder::findPathSet() **/
         const static int RET_SUCCESS               = 0;    ///< Success. Paths found
         const static int RET_FAIL_INIT_STOP_STATES = 1;    ///< PathFinder::initializeStopStates() failed
@@ -417,6 +622,8 @@ namespace fasttrips {
         PathFinder();
 
         int processNumber() const { return process_num_; }
+        /// For a process forked from the one that called PathFinder::initializeSupply(), which shares its supply
+        void setProcessNumber(int process_num) { process_num_ = process_num; }
         /// This is the transfer supply mode number
         int transferSupplyMode() const { return transfer_supply_mode_; }
         /// Accessor for access link attributes
@@ -440,6 +647,17 @@ namespace fasttrips {
                              const Attributes& attributes,
                              bool  hush = false) const;
 
+        /**
+         * Tally the link cost using the compiled weights and attribute slots.
+         * This is the version used during labeling, since it doesn't do any string lookups.
+         * @return the cost.
+         */
+        double tallyLinkCost(const int supply_mode_num,
+                             const PathSpecification& path_spec,
+                             std::ostream& trace_file,
+                             const SupplyModeWeights& weights,
+                             const LinkAttributes& attributes) const;
+
         /**
          * Access the named weights given user/link information.
          * Returns NULL if not found.
@@ -463,7 +681,12 @@ namespace fasttrips {
                                   bool       transfer_fare_ignore_pf,
                                   bool       transfer_fare_ignore_pe,
                                   int        max_num_paths,
-                                  double     min_path_probability);
+                                  double     min_path_probability,
+                                  bool       prune_with_lower_bounds = false,
+                                  bool       labeling_cache = false,
+                                  bool       connection_scan = false,
+                                  int        enumeration_threads = 0,
+                                  int        labeling_cache_mb = 256);
 
         /**
          * Setup the network supply.  This should happen once, before any pathfinding.
@@ -475,12 +698,40 @@ namespace fasttrips {
          * @param stoptime_times    For populating PathFinder::trip_stop_times_, this array contains
          *                          transit vehicle arrival times, departure times, and overcap pax at a stop.
          * @param num_stoptimes     The number of stop times described in the previous two arrays.
+         * @param use_snapshot      Read the rest of the supply from the network snapshot in output_dir if it's
+         *                          current, rather than the intermediate text files.  If it's not, the first process
+         *                          reads the text files and then writes the snapshot.  See PathFinder::readSnapshot().
          */
         void initializeSupply(const char*   output_dir,
                               int           process_num,
                               int*          stoptime_index,
                               double*       stoptime_times,
-                              int           num_stoptimes);
+                              int           num_stoptimes,
+                              bool          use_snapshot = false);
+
+        /**
+         * Write the network supply read from the intermediate files to a snapshot in the output directory,
+         * so other processes can load it with PathFinder::readSnapshot().  The stop times and bump wait aren't included
+         * since those come from python every iteration.
+         *
+         * @return success.
+         */
+        bool writeSnapshot() const;
+
+        /**
+         * Update the stop times given to PathFinder::initializeSupply() in place, for the next iteration.
+         * Only the stop times that changed need to be passed; the arrays are in the same form as for
+         * PathFinder::initializeSupply().  This patches the times, shape distance and overcap without
+         * reallocating or rebuilding the stop time structures.
+         *
+         * @param stoptime_index    Trip IDs, sequence numbers, stop IDs of the changed stop times
+         * @param stoptime_times    Transit vehicle arrival times, departure times, shape_dist_traveled and
+         *                          overcap pax at a stop for the changed stop times
+         * @param num_stoptimes     The number of stop times described in the previous two arrays.
+         */
+        void updateStopTimes(int*       stoptime_index,
+                             double*    stoptime_times,
+                             int        num_stoptimes);
 
         /**
          * Setup the information for bumped passengers.
@@ -496,6 +747,26 @@ namespace fasttrips {
                          double*    bw_data,
                          int        num_bw);
 
+        /**
+         * Update the information for bumped passengers in place.  This is the delta form of
+         * PathFinder::setBumpWait(); trip stops with a negative arrival time are removed, and the rest
+         * are added or updated.  Trip stops that aren't passed are left alone.
+         *
+         * @param bw_index          The fasttrips::TripStop fields of the changed trip stops.
+         * @param bw_data           The arrival time of the first would-be waiting passenger, or negative to remove.
+         * @param num_bw            The number of trip stops described in the previous two arrays.
+         */
+        void updateBumpWait(int*    bw_index,
+                            double* bw_data,
+                            int     num_bw);
+
+        /**
+         * Write the start of a query corpus (see query_corpus.h) for the current parameters, stop times and
+         * bump waits, so the queries made from here on can be appended with fasttrips::writeCorpusQuery() and
+         * replayed against the same supply.
+         */
+        void writeQueryCorpusHeader(std::ostream& ostr) const;
+
         /// Reset - clear state
         void reset();
 
@@ -518,11 +789,49 @@ namespace fasttrips {
             PathSet           &pathset,
             PerformanceInfo   &performance_info) const;
 
+        /**
+         * Find the path set using the given stop states for labeling.  This is the same as the
+         * version above, but a thread that runs many queries should keep one fasttrips::StopStates
+         * and pass it in each time so its memory is reused rather than reallocated for every query.
+         * The stop states must not be shared between concurrent queries.
+         */
+        int findPathSet(
+            PathSpecification path_spec,
+            PathSet           &pathset,
+            PerformanceInfo   &performance_info,
+            StopStates        &stop_states) const;
+
+        /**
+         * Find the path sets for a group of path specifications that label identically
+         * (see fasttrips::LabelingSignatureCompare), labeling once for the whole group.
+         * The first path specification in the group is labeled, and then each path specification's path set
+         * is enumerated from those stop states with its own fasttrips::RandomNumberGenerator, so
+         * the results are per path specification as with PathFinder::findPathSet().
+         * The labeling performance is reported for the first path specification only.
+         *
+         * Groups of one, or led by a traced path specification, are just found with PathFinder::findPathSet().
+         *
+         * @param path_specs        The path specifications; only those indexed by group are used
+         * @param group             Indices into path_specs (and the other vectors) making up the group
+         * @param pathsets          Path set results, by path specification index
+         * @param performance_infos Performance results, by path specification index
+         * @param pf_returnstatus   Return codes, by path specification index
+         * @param stop_states       Labeling memory; see PathFinder::findPathSet()
+         */
+        void findPathSetGroup(
+            const std::vector<PathSpecification>& path_specs,
+            const std::vector<int>&               group,
+            std::vector<PathSet>&                 pathsets,
+            std::vector<PerformanceInfo>&         performance_infos,
+            std::vector<int>&                     pf_returnstatus,
+            StopStates&                           stop_states) const;
+
         double getScheduledDeparture(int trip_id, int stop_id, int sequence) const;
 
         const FarePeriod* getFarePeriod(int route_id, int board_stop_id, int alight_stop_id, double trip_depart_time) const;
 
-        const FareTransfer* getFareTransfer(const std::string from_fare_period, const std::string to_fare_period) const;
+        /// The fare transfer rule between the given fare period numbers (see fasttrips::FarePeriod::fare_period_num_), or NULL if none
+        const FareTransfer* getFareTransfer(int from_fare_period_num, int to_fare_period_num) const;
 
         void printTimeDuration(std::ostream& ostr, const double& timedur) const;
 
@@ -531,7 +840,7 @@ namespace fasttrips {
         void printMode(std::ostream& ostr, const int& mode, const int& trip_id) const;
 
         /// Accessor for stop strings.  Assumes valid stop id.
-        const std::string& stopStringForId(int stop_id) const { return stop_num_to_stop_.find(stop_id)->second.stop_str_; }
+        const std::string& stopStringForId(int stop_id) const { return stop_num_to_stop_.find(stop_id)->stop_str_; }
         /// Accessor for trip strings.  Assumes valid trip id.
         const std::string& tripStringForId(int trip_id) const { return trip_num_to_str_.find(trip_id)->second; }
         /// Accessor for mode strings.  Assumes valid mode number.
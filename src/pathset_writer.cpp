@@ -0,0 +1,139 @@
+#include "pathset_writer.h"
+
+namespace fasttrips {
+
+    /// Every path set stream starts with this
+    static const char    PATHSET_STREAM_MAGIC[8]    = { 'F','T','P','S','T','R','M','\0' };
+    /// Written natively so a reader can tell the byte order
+    static const int32_t PATHSET_STREAM_BYTE_ORDER  = 0x01020304;
+
+    static size_t padded(size_t num_bytes) { return (num_bytes + 7) & ~(size_t)7; }
+
+    /// Bytes written by PathSetStreamWriter::writeStrings()
+    static size_t stringsBytes(const std::vector<std::string>& values)
+    {
+        size_t num_bytes = 0;
+        for (size_t idx = 0; idx < values.size(); ++idx) { num_bytes += values[idx].size(); }
+        return padded((values.size()+2)*sizeof(int32_t)) + padded(num_bytes);
+    }
+
+    PathSetStreamWriter::PathSetStreamWriter(const std::string& filename, int max_buffered_chunks) :
+        file_(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc),
+        max_buffered_chunks_(max_buffered_chunks < 1 ? 1 : max_buffered_chunks),
+        closing_(false),
+        failed_(false)
+    {
+        if (!file_.is_open()) { return; }
+        file_.write(PATHSET_STREAM_MAGIC, sizeof(PATHSET_STREAM_MAGIC));
+        file_.write(reinterpret_cast<const char*>(&PATHSET_STREAM_VERSION),    sizeof(int32_t));
+        file_.write(reinterpret_cast<const char*>(&PATHSET_STREAM_BYTE_ORDER), sizeof(int32_t));
+        flush_thread_ = std::thread(&PathSetStreamWriter::flush, this);
+    }
+
+    PathSetStreamWriter::~PathSetStreamWriter()
+    {
+        close();
+    }
+
+    void PathSetStreamWriter::append(const PathSetChunk& chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunk_written_.wait(lock, [this] { return chunks_.size() < max_buffered_chunks_; });
+        chunks_.push_back(chunk);
+        chunk_ready_.notify_one();
+    }
+
+    bool PathSetStreamWriter::close()
+    {
+        if (flush_thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                closing_ = true;
+            }
+            chunk_ready_.notify_one();
+            flush_thread_.join();
+        }
+        if (file_.is_open()) {
+            file_.close();
+            if (file_.fail()) { failed_ = true; }
+        }
+        return !failed_;
+    }
+
+    void PathSetStreamWriter::flush()
+    {
+        while (true) {
+            const PathSetChunk* chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                chunk_ready_.wait(lock, [this] { return closing_ || !chunks_.empty(); });
+                if (chunks_.empty()) { return; }  // closing, and everything's written
+                // appending to a deque doesn't move the other elements, and it stays queued (and counted) until written
+                chunk = &chunks_.front();
+            }
+            // write without the lock so the next batch can be queued meanwhile
+            writeChunk(*chunk);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                chunks_.pop_front();
+                if (!file_.good()) { failed_ = true; }
+            }
+            chunk_written_.notify_one();
+        }
+    }
+
+    void PathSetStreamWriter::writePadded(const void* data, size_t num_bytes)
+    {
+        static const char zeros[8] = { 0 };
+        if (num_bytes > 0) { file_.write(static_cast<const char*>(data), num_bytes); }
+        file_.write(zeros, padded(num_bytes) - num_bytes);
+    }
+
+    void PathSetStreamWriter::writeStrings(const std::vector<std::string>& values)
+    {
+        // total bytes then offsets, then the bytes
+        std::vector<int32_t> header(values.size()+2, 0);
+        std::string          bytes;
+        for (size_t idx = 0; idx < values.size(); ++idx) {
+            bytes += values[idx];
+            header[idx+2] = (int32_t)bytes.size();
+        }
+        header[0] = (int32_t)bytes.size();
+        writePadded(header.data(), header.size()*sizeof(int32_t));
+        writePadded(bytes.data(),  bytes.size());
+    }
+
+    void PathSetStreamWriter::writeChunk(const PathSetChunk& chunk)
+    {
+        const PathSetResults& results = *chunk.results_;
+        int32_t num_specs = (int32_t)chunk.person_ids_.size();
+        int32_t num_paths = results.numPaths();
+        int32_t num_links = results.numLinks();
+
+        std::vector<int32_t> spec_paths(num_specs), spec_links(num_specs);
+        for (int32_t spec_num = 0; spec_num < num_specs; ++spec_num) {
+            spec_paths[spec_num] = results.numPaths(spec_num);
+            spec_links[spec_num] = results.numLinks(spec_num);
+        }
+
+        int64_t chunk_bytes = stringsBytes(chunk.person_ids_) + stringsBytes(chunk.person_trip_ids_) +
+                              3*padded(num_specs*sizeof(int32_t)) +
+                              padded((size_t)NUM_PATH_DOUBLE_COLUMNS*num_paths*sizeof(double)) +
+                              padded((size_t)NUM_LINK_INT_COLUMNS   *num_links*sizeof(int32_t)) +
+                              padded((size_t)NUM_LINK_DOUBLE_COLUMNS*num_links*sizeof(double));
+
+        int32_t header[5] = { num_specs, num_paths, num_links, chunk.iteration_, chunk.pathfinding_iteration_ };
+        file_.write("CHNK", 4);
+        file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file_.write(reinterpret_cast<const char*>(&chunk_bytes), sizeof(chunk_bytes));
+
+        writeStrings(chunk.person_ids_);
+        writeStrings(chunk.person_trip_ids_);
+        writePadded(chunk.pathfinding_status_.data(), num_specs*sizeof(int32_t));
+        writePadded(spec_paths.data(),                num_specs*sizeof(int32_t));
+        writePadded(spec_links.data(),                num_specs*sizeof(int32_t));
+        writePadded(results.pathDoubles(), (size_t)NUM_PATH_DOUBLE_COLUMNS*num_paths*sizeof(double));
+        writePadded(results.linkInts(),    (size_t)NUM_LINK_INT_COLUMNS   *num_links*sizeof(int32_t));
+        writePadded(results.linkDoubles(), (size_t)NUM_LINK_DOUBLE_COLUMNS*num_links*sizeof(double));
+    }
+}
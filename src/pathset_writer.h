@@ -0,0 +1,94 @@
+/**
+ * \file pathset_writer.h
+ *
+ * Defines the PathSetStreamWriter, which appends path set results to a columnar file as batches complete.
+ *
+ * The file is a header followed by one chunk per batch.  Each chunk is
+ *
+ *     "CHNK", int32 num_specs, num_paths, num_links, iteration, pathfinding_iteration, int64 chunk bytes following
+ *     person_id strings, person_trip_id strings   (int32 total bytes, int32 offsets x num_specs+1, bytes)
+ *     int32 pathfinding status, num paths, num links   (num_specs each)
+ *     the fasttrips::PathSetResults blocks: path doubles, link ints, link doubles   (column-major)
+ *
+ * in native byte order, with every column padded to a multiple of 8 bytes.  Since the sizes are in the
+ * chunk header, a reader can find any column without parsing the others, or skip a chunk entirely.
+ */
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "path_results.h"
+
+#ifndef PATHSET_WRITER_H
+#define PATHSET_WRITER_H
+
+namespace fasttrips {
+
+    /// Bump this whenever the stream layout changes
+    const int32_t PATHSET_STREAM_VERSION = 1;
+
+    /// The results of one batch of queries, plus what's needed to identify them
+    struct PathSetChunk {
+        int                                     iteration_;
+        int                                     pathfinding_iteration_;
+        std::vector<std::string>                person_ids_;
+        std::vector<std::string>                person_trip_ids_;
+        std::vector<int>                        pathfinding_status_;
+        /// Shared with the numpy arrays handed back to python; neither side modifies it
+        std::shared_ptr<const PathSetResults>   results_;
+    };
+
+    /**
+     * Writes fasttrips::PathSetChunk instances to a file on a background thread.
+     *
+     * At most max_buffered_chunks are held waiting for the disk; append() blocks beyond that,
+     * so memory use is bounded regardless of how many batches are written.
+     * Write errors are sticky and reported by close().
+     */
+    class PathSetStreamWriter
+    {
+    private:
+        std::ofstream               file_;
+        size_t                      max_buffered_chunks_;
+
+        std::deque<PathSetChunk>    chunks_;
+        bool                        closing_;
+        bool                        failed_;
+        std::mutex                  mutex_;
+        /// Signalled when a chunk is queued or we're closing
+        std::condition_variable     chunk_ready_;
+        /// Signalled when a chunk is written
+        std::condition_variable     chunk_written_;
+        std::thread                 flush_thread_;
+
+        /// The background thread's loop
+        void flush();
+        /// Writes one chunk to file_
+        void writeChunk(const PathSetChunk& chunk);
+        /// Writes the given bytes followed by zeros up to a multiple of 8
+        void writePadded(const void* data, size_t num_bytes);
+        void writeStrings(const std::vector<std::string>& values);
+
+    public:
+        /// Opens the file, writes the header and starts the flush thread
+        PathSetStreamWriter(const std::string& filename, int max_buffered_chunks);
+        /// Closes if that hasn't been done
+        ~PathSetStreamWriter();
+
+        /// Was the file opened successfully?
+        bool isOpen() const { return file_.is_open(); }
+
+        /// Queues the chunk for writing, waiting if max_buffered_chunks are already queued
+        void append(const PathSetChunk& chunk);
+        /// Writes the remaining chunks and closes the file.  Returns false if anything failed.
+        bool close();
+    };
+}
+
+#endif
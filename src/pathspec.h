@@ -3,6 +3,9 @@
  *
  * Defines the specification for a path.
  */
+#include <cmath>
+#include <stdint.h>
+#include <string>
 
 #ifndef PATHSPEC_H
 #define PATHSPEC_H
@@ -31,6 +34,66 @@ namespace fasttrips {
         std::string egress_mode_;       ///< Egress demand mode
     } PathSpecification;
 
+    /**
+     * Orders path specifications by everything the labeling depends on, so two specifications compare
+     * equivalent exactly when labeling for one would produce the stop states for the other.
+     * The iteration, person and trace fields don't affect labeling so they're ignored.
+     * See PathFinder::findPathSetGroup().
+     */
+    struct LabelingSignatureCompare {
+        /// Preferred times in the same bucket of this many minutes are considered the same; 0 requires them to be equal
+        double time_bucket_min_;
+
+        LabelingSignatureCompare(double time_bucket_min = 0) : time_bucket_min_(time_bucket_min) {}
+
+        double timeBucket(const PathSpecification& ps) const {
+            return (time_bucket_min_ > 0) ? floor(ps.preferred_time_/time_bucket_min_) : ps.preferred_time_;
+        }
+
+        // less than
+        bool operator()(const PathSpecification& ps1, const PathSpecification& ps2) const {
+            if (ps1.origin_taz_id_      < ps2.origin_taz_id_     ) { return true;  }
+            if (ps1.origin_taz_id_      > ps2.origin_taz_id_     ) { return false; }
+            if (ps1.destination_taz_id_ < ps2.destination_taz_id_) { return true;  }
+            if (ps1.destination_taz_id_ > ps2.destination_taz_id_) { return false; }
+            if (ps1.outbound_           < ps2.outbound_          ) { return true;  }
+            if (ps1.outbound_           > ps2.outbound_          ) { return false; }
+            if (ps1.hyperpath_          < ps2.hyperpath_         ) { return true;  }
+            if (ps1.hyperpath_          > ps2.hyperpath_         ) { return false; }
+            if (timeBucket(ps1)         < timeBucket(ps2)        ) { return true;  }
+            if (timeBucket(ps1)         > timeBucket(ps2)        ) { return false; }
+            if (ps1.value_of_time_      < ps2.value_of_time_     ) { return true;  }
+            if (ps1.value_of_time_      > ps2.value_of_time_     ) { return false; }
+            if (ps1.user_class_         < ps2.user_class_        ) { return true;  }
+            if (ps1.user_class_         > ps2.user_class_        ) { return false; }
+            if (ps1.purpose_            < ps2.purpose_           ) { return true;  }
+            if (ps1.purpose_            > ps2.purpose_           ) { return false; }
+            if (ps1.access_mode_        < ps2.access_mode_       ) { return true;  }
+            if (ps1.access_mode_        > ps2.access_mode_       ) { return false; }
+            if (ps1.transit_mode_       < ps2.transit_mode_      ) { return true;  }
+            if (ps1.transit_mode_       > ps2.transit_mode_      ) { return false; }
+            if (ps1.egress_mode_        < ps2.egress_mode_       ) { return true;  }
+            if (ps1.egress_mode_        > ps2.egress_mode_       ) { return false; }
+            return false;
+        }
+    };
+
+    /**
+     * Compile-time version of the PathSpecification flags that the labeling loop branches on.
+     *
+     * The labeling functions are templated on one of these, so in the inner loops the direction and
+     * search mode tests are constants, and with TRACE false the tracing code is compiled out entirely.
+     * PathFinder::findPathSet() picks the instantiation matching the PathSpecification once per query.
+     */
+    template <bool OUTBOUND, bool HYPERPATH, bool TRACE>
+    struct SearchMode {
+        static const bool outbound_  = OUTBOUND;     ///< See PathSpecification::outbound_
+        static const bool hyperpath_ = HYPERPATH;    ///< See PathSpecification::hyperpath_
+        static const bool trace_     = TRACE;        ///< See PathSpecification::trace_
+        /// 1 for outbound (labeling backwards in time), -1 for inbound
+        static double dirFactor() { return OUTBOUND ? 1.0 : -1.0; }
+    };
+
     /**
      * The pathfinding algorithm is a labeling algorithm which associates each stop with a state (or link), encapsulated
      * here.  If the sought path is outbound, then the preferred time is an arrival time
@@ -91,61 +154,69 @@ namespace fasttrips {
     };
 
     // forward dec
-    class Path;
     struct FarePeriod;
 
+    /// The largest stop sequence a fasttrips::StopState holds.  Sequences count up from 1 along each trip
+    /// (see PathFinder::getTripStopTime()), so this is the most stops a trip may have.
+    const int MAX_STOP_SEQUENCE = INT16_MAX;
+
     /** Stop states are basically links in a hyperpath.
       * Note that the time fields (deparr_time_ and arrdep_time_) are based around the preferred arrival or departure time
       * and can be negative or over 24*60 if the travel crosses the midnight boundary.
       * For example, if the preferred arrival time is 12:10a then links before it might have negative values.
+      *
+      * Every hyperlink and path link holds these by value, so the fields are ordered without padding holes,
+      * with the ones labeling touches first.  The stop sequences are 16 bits so the ints pack into whole
+      * 8-byte words; see fasttrips::MAX_STOP_SEQUENCE.
       **/
     struct StopState {
+        // what labeling compares and updates, in the first cache line
+        double  cost_;                  ///< Cost from previous link(s) and this link together.
         double  deparr_time_;           ///< Departure time for outbound, arrival time for inbound
+        double  arrdep_time_;           ///< Arrival time for outbound, departure time for inbound
+        double  link_cost_;             ///< Link generalized cost.
+        double  link_time_;             ///< Link time.  For trips, includes wait time. Just walk time for others.
+        double  link_fare_;             ///< Link fare. Financial cost of the link.
         int     deparr_mode_;           ///< Departure mode for outbound, arrival mode for inbound.
                                         ///< One of fasttrips::MODE_ACCESS, fasttrips::MODE_EGRESS,
                                         ///< fasttrips::MODE_TRANSFER, or fasttrips::MODE_TRANSIT
         int     trip_id_;               ///< Trip ID if deparr_mode_ is fasttrips::MODE_TRANSIT,
                                         ///< or the supply_mode_num for access, egress
         int     stop_succpred_;         ///< Successor stop for outbound, predecessor stop for inbound
-        int     seq_;                   ///< The sequence number of this stop on this trip. (-1 if not trip)
-        int     seq_succpred_;          ///< The sequence number of the successor/predecessor stop
-        double  link_time_;             ///< Link time.  For trips, includes wait time. Just walk time for others.
-        double  link_fare_;             ///< Link fare. Financial cost of the link.
-        double  link_cost_;             ///< Link generalized cost.
-        double  link_ivtwt_;            ///< Link in-vehicle time path weight.
-        double  link_dist_;             ///< Link distance, in units of shape_dist_traveled.
-        double  cost_;                  ///< Cost from previous link(s) and this link together.
         int     iteration_;             ///< Labeling iteration that generated this stop state.
-        double  arrdep_time_;           ///< Arrival time for outbound, departure time for inbound
-
-        const FarePeriod* fare_period_; ///< Trip links may have a FarePeriod
+        int     low_cost_label_;        ///< Index of the lowest cost path to this link in the fasttrips::StopStates low cost labels,
+                                        ///< or -1.  Only set in labeling, with TRACK_LOW_COST_PATH.
+        int16_t seq_;                   ///< The sequence number of this stop on this trip. (-1 if not trip)
+        int16_t seq_succpred_;          ///< The sequence number of the successor/predecessor stop
 
         // previously in ProbabilityStopState
         double  probability_;           ///< The probability of this link
-        int     cum_prob_i_;            ///< Cumulative integer version of probability
-
+        double  cum_prob_;              ///< Cumulative probability, in cost order; -1 if the link can't be chosen
 
-        Path*   low_cost_path_;         ///< Lowest cost path that includes this link.  Only set in labeling.
+        // only for fares and the path's link attributes
+        double  link_ivtwt_;            ///< Link in-vehicle time path weight.
+        double  link_dist_;             ///< Link distance, in units of shape_dist_traveled.
+        const FarePeriod* fare_period_; ///< Trip links may have a FarePeriod
 
         StopState() :
+            cost_         (0),
             deparr_time_  (0),
+            arrdep_time_  (0),
+            link_cost_    (0),
+            link_time_    (0),
+            link_fare_    (0),
             deparr_mode_  (0),
             trip_id_      (0),
             stop_succpred_(0),
+            iteration_    (-1),
+            low_cost_label_(-1),
             seq_          (0),
             seq_succpred_ (0),
-            link_time_    (0),
-            link_fare_    (0),
-            link_cost_    (0),
-			link_ivtwt_   (0),
-            link_dist_    (0),
-            cost_         (0),
-            iteration_    (-1),
-            arrdep_time_  (0),
-            fare_period_  (NULL),
             probability_  (0),
-            cum_prob_i_   (0),
-            low_cost_path_(NULL) {}
+            cum_prob_     (0),
+            link_ivtwt_   (0),
+            link_dist_    (0),
+            fare_period_  (NULL) {}
 
         StopState(
             double deparr_time,
@@ -163,24 +234,24 @@ namespace fasttrips {
             double arrdep_time,
 			double link_ivtwt,
             const FarePeriod* fp=NULL) :
+            cost_         (cost),
             deparr_time_  (deparr_time),
+            arrdep_time_  (arrdep_time),
+            link_cost_    (link_cost),
+            link_time_    (link_time),
+            link_fare_    (link_fare),
             deparr_mode_  (deparr_mode),
             trip_id_      (trip_id),
             stop_succpred_(stop_succpred),
-            seq_          (seq),
-            seq_succpred_ (seq_succpred),
-            link_time_    (link_time),
-            link_fare_    (link_fare),
-            link_cost_    (link_cost),
-			link_ivtwt_   (link_ivtwt),
-            link_dist_    (link_dist),
-            cost_         (cost),
             iteration_    (iteration),
-            arrdep_time_  (arrdep_time),
-            fare_period_  (fp),
+            low_cost_label_(-1),
+            seq_          ((int16_t)seq),
+            seq_succpred_ ((int16_t)seq_succpred),
             probability_  (0),
-            cum_prob_i_   (0),
-            low_cost_path_(NULL) {}
+            cum_prob_     (0),
+            link_ivtwt_   (link_ivtwt),
+            link_dist_    (link_dist),
+            fare_period_  (fp) {}
     };
 }
 
@@ -0,0 +1,168 @@
+#include "query_corpus.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace fasttrips {
+
+    /// Splits the line into its tab-separated fields
+    static void splitFields(const std::string& line, std::vector<std::string>& fields)
+    {
+        fields.clear();
+        std::istringstream iss(line);
+        std::string field;
+        while (std::getline(iss, field, '\t')) { fields.push_back(field); }
+    }
+
+    /// Reads the next line and checks it's "<keyword>\t<count>"
+    static bool readSection(std::istream& istr, const char* keyword, int& count)
+    {
+        std::string line;
+        std::vector<std::string> fields;
+        if (!std::getline(istr, line)) { return false; }
+        splitFields(line, fields);
+        if ((fields.size() != 2) || (fields[0] != keyword)) { return false; }
+        count = atoi(fields[1].c_str());
+        return (count >= 0);
+    }
+
+    /// So doubles read back exactly
+    static void writeExactly(std::ostream& ostr)
+    {
+        ostr.precision(std::numeric_limits<double>::digits10 + 2);
+    }
+
+    void writeCorpusParameters(std::ostream& ostr, const std::vector<double>& parameters)
+    {
+        writeExactly(ostr);
+        ostr << "ftqueries\t" << QUERY_CORPUS_VERSION << "\n";
+        ostr << "parameters";
+        for (size_t idx = 0; idx < parameters.size(); ++idx) { ostr << "\t" << parameters[idx]; }
+        ostr << "\n";
+    }
+
+    void writeCorpusStopTimes(std::ostream& ostr, const TripStopTimes& trip_stop_times)
+    {
+        writeExactly(ostr);
+        int num_stoptimes = 0;
+        for (int trip_id = 0; trip_id <= trip_stop_times.maxTripId(); ++trip_id) {
+            num_stoptimes += (int)trip_stop_times.forTrip(trip_id).size();
+        }
+        ostr << "stop_times\t" << num_stoptimes << "\n";
+        for (int trip_id = 0; trip_id <= trip_stop_times.maxTripId(); ++trip_id) {
+            TripStopTimeRange range = trip_stop_times.forTrip(trip_id);
+            for (const TripStopTime* stt = range.begin(); stt != range.end(); ++stt) {
+                ostr << stt->trip_id_ << "\t" << stt->seq_ << "\t" << stt->stop_id_ << "\t" << stt->arrive_time_ << "\t"
+                     << stt->depart_time_ << "\t" << stt->shape_dist_trav_ << "\t" << stt->overcap_ << "\n";
+            }
+        }
+    }
+
+    void writeCorpusBumpWaits(std::ostream& ostr, const std::vector<int>& bw_index, const std::vector<double>& bw_data)
+    {
+        writeExactly(ostr);
+        ostr << "bump_waits\t" << bw_data.size() << "\n";
+        for (size_t idx = 0; idx < bw_data.size(); ++idx) {
+            ostr << bw_index[3*idx] << "\t" << bw_index[3*idx+1] << "\t" << bw_index[3*idx+2] << "\t" << bw_data[idx] << "\n";
+        }
+    }
+
+    void writeCorpusQuery(std::ostream& ostr, const PathSpecification& path_spec)
+    {
+        writeExactly(ostr);
+        ostr << "query\t"   << path_spec.iteration_        << "\t" << path_spec.pathfinding_iteration_ << "\t"
+             << (path_spec.hyperpath_ ? 1 : 0)             << "\t" << path_spec.origin_taz_id_ << "\t"
+             << path_spec.destination_taz_id_              << "\t" << (path_spec.outbound_ ? 1 : 0) << "\t"
+             << path_spec.preferred_time_                  << "\t" << path_spec.value_of_time_ << "\t"
+             << path_spec.person_id_    << "\t" << path_spec.person_trip_id_ << "\t" << path_spec.user_class_   << "\t"
+             << path_spec.purpose_      << "\t" << path_spec.access_mode_    << "\t" << path_spec.transit_mode_ << "\t"
+             << path_spec.egress_mode_  << "\n";
+    }
+
+    bool readQueryCorpus(const std::string& filename, QueryCorpus& corpus)
+    {
+        std::ifstream file(filename.c_str());
+        if (!file.is_open()) {
+            std::cerr << "Couldn't open query corpus " << filename << std::endl;
+            return false;
+        }
+
+        std::string line;
+        std::vector<std::string> fields;
+        int version;
+        if (!readSection(file, "ftqueries", version) || (version != QUERY_CORPUS_VERSION)) {
+            std::cerr << filename << " isn't a version " << QUERY_CORPUS_VERSION << " query corpus" << std::endl;
+            return false;
+        }
+
+        corpus.parameters_.clear();
+        std::getline(file, line);
+        splitFields(line, fields);
+        if (fields.empty() || (fields[0] != "parameters")) {
+            std::cerr << filename << ": expected parameters" << std::endl;
+            return false;
+        }
+        for (size_t idx = 1; idx < fields.size(); ++idx) { corpus.parameters_.push_back(atof(fields[idx].c_str())); }
+
+        int num_stoptimes;
+        if (!readSection(file, "stop_times", num_stoptimes)) {
+            std::cerr << filename << ": expected stop_times" << std::endl;
+            return false;
+        }
+        corpus.stoptime_index_.resize(3*num_stoptimes);
+        corpus.stoptime_times_.resize(4*num_stoptimes);
+        for (int i = 0; i < num_stoptimes; ++i) {
+            file >> corpus.stoptime_index_[3*i] >> corpus.stoptime_index_[3*i+1] >> corpus.stoptime_index_[3*i+2]
+                 >> corpus.stoptime_times_[4*i] >> corpus.stoptime_times_[4*i+1] >> corpus.stoptime_times_[4*i+2]
+                 >> corpus.stoptime_times_[4*i+3];
+        }
+        file >> std::ws;
+
+        int num_bw;
+        if (!file || !readSection(file, "bump_waits", num_bw)) {
+            std::cerr << filename << ": expected bump_waits after " << num_stoptimes << " stop times" << std::endl;
+            return false;
+        }
+        corpus.bw_index_.resize(3*num_bw);
+        corpus.bw_data_.resize(num_bw);
+        for (int i = 0; i < num_bw; ++i) {
+            file >> corpus.bw_index_[3*i] >> corpus.bw_index_[3*i+1] >> corpus.bw_index_[3*i+2] >> corpus.bw_data_[i];
+        }
+        file >> std::ws;
+        if (file.fail()) {
+            std::cerr << filename << ": couldn't read " << num_bw << " bump waits" << std::endl;
+            return false;
+        }
+
+        corpus.queries_.clear();
+        while (std::getline(file, line)) {
+            if (line.empty()) { continue; }
+            splitFields(line, fields);
+            if ((fields.size() != 16) || (fields[0] != "query")) {
+                std::cerr << filename << ": bad query line " << line << std::endl;
+                return false;
+            }
+            PathSpecification path_spec;
+            path_spec.iteration_              = atoi(fields[1].c_str());
+            path_spec.pathfinding_iteration_  = atoi(fields[2].c_str());
+            path_spec.hyperpath_              = (atoi(fields[3].c_str()) != 0);
+            path_spec.origin_taz_id_          = atoi(fields[4].c_str());
+            path_spec.destination_taz_id_     = atoi(fields[5].c_str());
+            path_spec.outbound_               = (atoi(fields[6].c_str()) != 0);
+            path_spec.preferred_time_         = atof(fields[7].c_str());
+            path_spec.value_of_time_          = atof(fields[8].c_str());
+            path_spec.trace_                  = false;
+            path_spec.person_id_              = fields[9];
+            path_spec.person_trip_id_         = fields[10];
+            path_spec.user_class_             = fields[11];
+            path_spec.purpose_                = fields[12];
+            path_spec.access_mode_            = fields[13];
+            path_spec.transit_mode_           = fields[14];
+            path_spec.egress_mode_            = fields[15];
+            corpus.queries_.push_back(path_spec);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * \file query_corpus.h
+ *
+ * Defines the recorded query corpus, which captures what the fasttrips::PathFinder was given besides the
+ * network supply in the output directory, so the queries can be replayed outside of python
+ * (see src/bench/pathfinder_bench.cpp).
+ *
+ * A corpus is a tab-separated text file:
+ *
+ *     ftqueries     <version>
+ *     parameters    <the PathFinder::initializeParameters() arguments, in order>
+ *     stop_times    <count>
+ *     <trip id> <sequence> <stop id> <arrival time> <departure time> <shape dist traveled> <overcap>   (count lines)
+ *     bump_waits    <count>
+ *     <trip id> <sequence> <stop id> <bump wait time>                                                   (count lines)
+ *     query         <iteration> <pathfinding iteration> <hyperpath> <origin taz id> <destination taz id> <outbound>
+ *                   <preferred time> <value of time> <person id> <person trip id> <user class> <purpose>
+ *                   <access mode> <transit mode> <egress mode>                                          (any number)
+ *
+ * Doubles are written with enough precision to read back exactly.
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pathspec.h"
+#include "stop_times.h"
+
+#ifndef QUERY_CORPUS_H
+#define QUERY_CORPUS_H
+
+namespace fasttrips {
+
+    /// Bump this whenever the corpus layout changes
+    const int QUERY_CORPUS_VERSION = 3;
+
+    /// A query corpus read back in, with the supply arrays in the form PathFinder takes them
+    struct QueryCorpus {
+        /// PathFinder::initializeParameters() arguments, in order
+        std::vector<double>             parameters_;
+        /// For PathFinder::initializeSupply(): trip id, sequence, stop id per stop time
+        std::vector<int>                stoptime_index_;
+        /// For PathFinder::initializeSupply(): arrival time, departure time, shape dist traveled, overcap per stop time
+        std::vector<double>             stoptime_times_;
+        /// For PathFinder::setBumpWait(): trip id, sequence, stop id per bump wait
+        std::vector<int>                bw_index_;
+        /// For PathFinder::setBumpWait(): bump wait time
+        std::vector<double>             bw_data_;
+        /// The recorded queries, in the order they were made
+        std::vector<PathSpecification>  queries_;
+
+        int numStopTimes() const { return (int)stoptime_times_.size()/4; }
+        int numBumpWaits() const { return (int)bw_data_.size(); }
+    };
+
+    /// Writes the corpus header line and the given parameters
+    void writeCorpusParameters(std::ostream& ostr, const std::vector<double>& parameters);
+    /// Writes the stop times section
+    void writeCorpusStopTimes(std::ostream& ostr, const TripStopTimes& trip_stop_times);
+    /// Writes the bump waits section, given the trip id, sequence, stop id and time of each
+    void writeCorpusBumpWaits(std::ostream& ostr, const std::vector<int>& bw_index, const std::vector<double>& bw_data);
+    /// Writes one query line.  The trace flag isn't recorded.
+    void writeCorpusQuery(std::ostream& ostr, const PathSpecification& path_spec);
+
+    /**
+     * Reads the given corpus file.
+     *
+     * @return success.  On failure, the reason is written to std::cerr.
+     */
+    bool readQueryCorpus(const std::string& filename, QueryCorpus& corpus);
+}
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * \file query_counters.h
+ *
+ * Defines the hot path counters reported for each path finding query in fasttrips::PerformanceInfo.
+ *
+ * They're counted in the supply lookups and hyperlink updates, deep in calls that don't see the
+ * fasttrips::PathFinderContext, so each thread keeps its own set (see fasttrips::queryCounters()).
+ * A query runs on one thread from start to finish, so PathFinder::findPathSet() clears them when it starts and copies
+ * them out when it's done; the blocks of draws PathFinder::drawPathBlocks() hands to other threads are counted
+ * separately and added back with addQueryCounters().  Counting is an add to thread local memory, cheap enough to leave on.
+ */
+#include <cstring>
+
+#ifndef QUERY_COUNTERS_H
+#define QUERY_COUNTERS_H
+
+namespace fasttrips {
+
+    /// Indices into QueryCounters::counts_.  The python side lists these in the same order; see Performance.py.
+    enum QueryCounter {
+        COUNT_QUEUE_PUSHES          = 0,    ///< fasttrips::LabelStopQueue pushes
+        COUNT_QUEUE_POPS,                   ///< fasttrips::LabelStopQueue pops
+        COUNT_QUEUE_MERGES,                 ///< pushes for a stop that was already queued, which would have been stale pops
+        COUNT_LINKS_ADDED,                  ///< links added or updated by Hyperlink::addLink()
+        COUNT_LINKS_REJECTED,               ///< links rejected by Hyperlink::addLink()
+        COUNT_LINKS_PRUNED,                 ///< links removed by Hyperlink::pruneWindow()
+        COUNT_TRIPS_SCANNED,                ///< trip stop times returned by PathFinder::getTripsWithinTime(), or connections scanned by PathFinder::scanConnections()
+        COUNT_TRIPS_USED,                   ///< of those, the ones labeled from (or boarded/alighted, for connections)
+        COUNT_LINK_COST_TALLIES,            ///< PathFinder::tallyLinkCost() calls
+        COUNT_FARE_LOOKUPS,                 ///< PathFinder::getFarePeriod() and PathFinder::getFareTransfer() calls
+        COUNT_PATH_DRAWS,                   ///< paths drawn in PathFinder::getPathSet()
+        COUNT_UNIQUE_PATHS,                 ///< of those, the distinct ones
+        COUNT_US_INITIALIZING,              ///< microseconds initializing the stop states and reachable final stops
+        COUNT_US_LABELING,                  ///< microseconds in PathFinder::labelStops() or PathFinder::scanConnections()
+        COUNT_US_FINALIZING,                ///< microseconds finalizing the TAZ state, in PathFinder::getPathSet()
+        COUNT_US_ENUMERATING,               ///< microseconds drawing and costing paths, in PathFinder::getPathSet()
+        NUM_QUERY_COUNTERS
+    };
+
+    /// The counters for one query
+    typedef struct {
+        long long counts_[NUM_QUERY_COUNTERS];
+    } QueryCounters;
+
+    /// The counters for the query running on this thread
+    inline QueryCounters& queryCounters()
+    {
+        static thread_local QueryCounters counters;
+        return counters;
+    }
+
+    /// Adds to one of the counters for the query running on this thread
+    inline void countQuery(QueryCounter counter, long long amount = 1)
+    {
+        queryCounters().counts_[counter] += amount;
+    }
+
+    /// Zeros the counters for the query running on this thread
+    inline void clearQueryCounters()
+    {
+        memset(queryCounters().counts_, 0, sizeof(queryCounters().counts_));
+    }
+
+    /// Adds counts from part of the query that ran elsewhere to the counters for the query running on this thread
+    inline void addQueryCounters(const QueryCounters& counters)
+    {
+        for (int counter = 0; counter < NUM_QUERY_COUNTERS; ++counter) {
+            queryCounters().counts_[counter] += counters.counts_[counter];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * \file rng.h
+ *
+ * Defines the RandomNumberGenerator used for choosing links and paths during path enumeration.
+ */
+#include <stdint.h>
+#include <string>
+
+#include "pathspec.h"
+
+#ifndef RNG_H
+#define RNG_H
+
+namespace fasttrips {
+
+    /**
+     * Random number generator for a single path finding query.
+     *
+     * This replaces srand()/rand(), which share one global state across all queries.
+     * It's seeded from the person ID and person trip ID so that each pathset is reproducible
+     * on its own, regardless of which thread or process finds it or in what order.
+     *
+     * The generator is xoshiro256**: 32 bytes of state, so it's cheap to seed for every query, and a
+     * few operations per draw.  Its 64 bit output gives uniform doubles with the full 53 bits of precision.
+     */
+    class RandomNumberGenerator
+    {
+    private:
+        uint64_t state_[4];
+
+        static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+        /// Expands the seed into the state; xoshiro's state shouldn't be all (or mostly) zero
+        static uint64_t splitMix64(uint64_t& x)
+        {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+    public:
+        /// Constructor; seeds using RandomNumberGenerator::seedFor()
+        RandomNumberGenerator(const PathSpecification& path_spec)
+        {
+            uint64_t x = seedFor(path_spec);
+            for (int idx = 0; idx < 4; ++idx) { state_[idx] = splitMix64(x); }
+        }
+
+        /**
+         * Constructor for one of several independent streams for the same query, so that it can be drawn from on
+         * several threads and still be reproducible.  Stream 0 is the stream from the other constructor.
+         */
+        RandomNumberGenerator(const PathSpecification& path_spec, uint32_t stream_num)
+        {
+            uint64_t x = ((uint64_t)stream_num << 32) | seedFor(path_spec);
+            for (int idx = 0; idx < 4; ++idx) { state_[idx] = splitMix64(x); }
+        }
+
+        /// Returns a random 64 bit number
+        uint64_t next()
+        {
+            uint64_t result = rotl(state_[1] * 5, 7) * 9;
+            uint64_t t      = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= t;
+            state_[3]  = rotl(state_[3], 45);
+            return result;
+        }
+
+        /// Returns a random number in [0, 1)
+        double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+        /// Seed for the given path specification: FNV-1a hash of the person ID and person trip ID.
+        /// (std::hash isn't used since it may differ by platform.)
+        static uint32_t seedFor(const PathSpecification& path_spec)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t idx = 0; idx < path_spec.person_id_.size(); ++idx) {
+                hash = (hash ^ (unsigned char)path_spec.person_id_[idx]) * 16777619u;
+            }
+            hash = (hash ^ (unsigned char)'-') * 16777619u;
+            for (size_t idx = 0; idx < path_spec.person_trip_id_.size(); ++idx) {
+                hash = (hash ^ (unsigned char)path_spec.person_trip_id_[idx]) * 16777619u;
+            }
+            return hash;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "snapshot.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+namespace fasttrips {
+
+    /// Every snapshot starts with this
+    static const char    SNAPSHOT_MAGIC[8]   = { 'F','T','S','N','A','P','S','H' };
+    /// Written natively so a snapshot from a machine with the other byte order is rejected
+    static const int32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+    SnapshotWriter::SnapshotWriter(const std::string& filename) :
+        file_(filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc)
+    {
+        file_.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        writeInt(SNAPSHOT_VERSION);
+        writeInt(SNAPSHOT_BYTE_ORDER);
+    }
+
+    bool SnapshotWriter::close()
+    {
+        file_.close();
+        return !file_.fail();
+    }
+
+    void SnapshotWriter::writeTag(const char* tag)
+    {
+        file_.write(tag, 4);
+    }
+
+    void SnapshotWriter::writeInt(int32_t value)
+    {
+        file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void SnapshotWriter::writeInt64(int64_t value)
+    {
+        file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void SnapshotWriter::writeDouble(double value)
+    {
+        file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void SnapshotWriter::writeString(const std::string& value)
+    {
+        writeInt((int32_t)value.size());
+        file_.write(value.data(), value.size());
+    }
+
+    void SnapshotWriter::writeInts(const std::vector<int>& values)
+    {
+        writeInt((int32_t)values.size());
+        if (!values.empty()) {
+            file_.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(int));
+        }
+    }
+
+    void SnapshotWriter::writeName(const std::string& name)
+    {
+        // the first time, the name itself follows a -1.  After that, just its index.
+        std::map<std::string, int>::const_iterator it = names_.find(name);
+        if (it != names_.end()) {
+            writeInt(it->second);
+            return;
+        }
+        int index = (int)names_.size();
+        names_[name] = index;
+        writeInt(-1);
+        writeString(name);
+    }
+
+    void SnapshotWriter::writeAttributes(const Attributes& attributes)
+    {
+        writeInt((int32_t)attributes.size());
+        for (Attributes::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+            writeName(it->first);
+            writeDouble(it->second);
+        }
+    }
+
+    SnapshotReader::SnapshotReader() :
+        data_(NULL), size_(0), pos_(0), ok_(false),
+#ifdef _WIN32
+        file_handle_(INVALID_HANDLE_VALUE), mapping_handle_(NULL)
+#else
+        fd_(-1)
+#endif
+    {}
+
+    SnapshotReader::~SnapshotReader()
+    {
+        close();
+    }
+
+    bool SnapshotReader::open(const std::string& filename)
+    {
+        close();
+#ifdef _WIN32
+        file_handle_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_handle_ == INVALID_HANDLE_VALUE) { return false; }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle_, &file_size) || (file_size.QuadPart == 0)) { close(); return false; }
+        mapping_handle_ = CreateFileMappingA(file_handle_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_handle_ == NULL) { close(); return false; }
+        data_ = (const char*)MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0);
+        if (data_ == NULL) { close(); return false; }
+        size_ = (size_t)file_size.QuadPart;
+#else
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) { return false; }
+        struct stat file_stat;
+        if ((fstat(fd_, &file_stat) != 0) || (file_stat.st_size == 0)) { close(); return false; }
+        void* mapped = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapped == MAP_FAILED) { close(); return false; }
+        data_ = (const char*)mapped;
+        size_ = (size_t)file_stat.st_size;
+#endif
+        pos_ = 0;
+        ok_  = true;
+
+        const char* magic = take(sizeof(SNAPSHOT_MAGIC));
+        if (!magic || (memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) ||
+            (readInt() != SNAPSHOT_VERSION) || (readInt() != SNAPSHOT_BYTE_ORDER) || !ok_) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void SnapshotReader::close()
+    {
+#ifdef _WIN32
+        if (data_)                                  { UnmapViewOfFile(data_);     }
+        if (mapping_handle_ != NULL)                { CloseHandle(mapping_handle_); }
+        if (file_handle_ != INVALID_HANDLE_VALUE)   { CloseHandle(file_handle_);  }
+        mapping_handle_ = NULL;
+        file_handle_    = INVALID_HANDLE_VALUE;
+#else
+        if (data_)      { munmap((void*)data_, size_); }
+        if (fd_ >= 0)   { ::close(fd_); }
+        fd_ = -1;
+#endif
+        data_ = NULL;
+        size_ = 0;
+        pos_  = 0;
+        ok_   = false;
+        names_.clear();
+    }
+
+    const char* SnapshotReader::take(size_t num_bytes)
+    {
+        if (!ok_ || (num_bytes > size_ - pos_)) {
+            ok_ = false;
+            return NULL;
+        }
+        const char* bytes = data_ + pos_;
+        pos_ += num_bytes;
+        return bytes;
+    }
+
+    bool SnapshotReader::expectTag(const char* tag)
+    {
+        const char* bytes = take(4);
+        if (!bytes || (memcmp(bytes, tag, 4) != 0)) {
+            ok_ = false;
+        }
+        return ok_;
+    }
+
+    // these memcpy rather than cast since the value may not be aligned
+    int32_t SnapshotReader::readInt()
+    {
+        int32_t value = 0;
+        const char* bytes = take(sizeof(value));
+        if (bytes) { memcpy(&value, bytes, sizeof(value)); }
+        return value;
+    }
+
+    int64_t SnapshotReader::readInt64()
+    {
+        int64_t value = 0;
+        const char* bytes = take(sizeof(value));
+        if (bytes) { memcpy(&value, bytes, sizeof(value)); }
+        return value;
+    }
+
+    double SnapshotReader::readDouble()
+    {
+        double value = 0;
+        const char* bytes = take(sizeof(value));
+        if (bytes) { memcpy(&value, bytes, sizeof(value)); }
+        return value;
+    }
+
+    std::string SnapshotReader::readString()
+    {
+        int32_t length = readInt();
+        if (length < 0) { ok_ = false; }
+        const char* bytes = take(ok_ ? (size_t)length : 0);
+        if (!bytes) { return std::string(); }
+        return std::string(bytes, (size_t)length);
+    }
+
+    void SnapshotReader::readInts(std::vector<int>& values)
+    {
+        values.clear();
+        int32_t length = readInt();
+        if (length < 0) { ok_ = false; }
+        const char* bytes = take(ok_ ? (size_t)length*sizeof(int) : 0);
+        if (!bytes || (length == 0)) { return; }
+        values.resize(length);
+        memcpy(values.data(), bytes, (size_t)length*sizeof(int));
+    }
+
+    std::string SnapshotReader::readName()
+    {
+        int32_t index = readInt();
+        if (index == -1) {
+            names_.push_back(readString());
+            return names_.back();
+        }
+        if ((index < 0) || (index >= (int32_t)names_.size())) {
+            ok_ = false;
+            return std::string();
+        }
+        return names_[index];
+    }
+
+    void SnapshotReader::readAttributes(Attributes& attributes)
+    {
+        int32_t num_attributes = readInt();
+        for (int32_t attr_num = 0; ok_ && (attr_num < num_attributes); ++attr_num) {
+            std::string name  = readName();
+            double      value = readDouble();
+            // they're written in order
+            attributes.insert(attributes.end(), std::make_pair(name, value));
+        }
+    }
+}
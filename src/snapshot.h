@@ -0,0 +1,121 @@
+/**
+ * \file snapshot.h
+ *
+ * Defines the reader and writer for binary network snapshots.
+ *
+ * A snapshot holds the supply that PathFinder::readIntermediateFiles() otherwise parses from the
+ * ft_intermediate_*.txt files, in a versioned binary form.  It's read through a memory map, so there's
+ * no text parsing, and the processes on a node share the file's pages through the OS page cache.
+ *
+ * The format is a header followed by tagged sections of native-endian integers, doubles and
+ * length-prefixed strings.  Names (attribute and weight names) are interned as they're written,
+ * so each distinct name is stored once.  See PathFinder::writeSnapshot() for the sections.
+ */
+#include <fstream>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "link_cost.h"
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+namespace fasttrips {
+
+    /// Bump this whenever the snapshot layout changes; snapshots with a different version are ignored.
+    const int32_t SNAPSHOT_VERSION = 3;
+
+    /**
+     * Writes a binary snapshot file.  Errors are sticky; check good() at the end.
+     */
+    class SnapshotWriter
+    {
+    private:
+        std::ofstream               file_;
+        /// Interned names -> index
+        std::map<std::string, int>  names_;
+
+    public:
+        /// Opens the file and writes the header
+        SnapshotWriter(const std::string& filename);
+
+        /// Was everything written successfully?
+        bool good() const { return file_.good(); }
+        /// Closes the file.  Returns good().
+        bool close();
+
+        /// Writes a four character section tag
+        void writeTag(const char* tag);
+        void writeInt(int32_t value);
+        void writeInt64(int64_t value);
+        void writeDouble(double value);
+        void writeString(const std::string& value);
+        /// Writes an array of ints with its length
+        void writeInts(const std::vector<int>& values);
+        /// Writes a name, interning it
+        void writeName(const std::string& name);
+        /// Writes named attributes
+        void writeAttributes(const Attributes& attributes);
+    };
+
+    /**
+     * Reads a binary snapshot file through a memory map.
+     *
+     * Reading past the end of the file or finding an unexpected tag marks the reader bad, and after that
+     * the reads return zeros and empty strings; so callers can read a section and check ok() once.
+     */
+    class SnapshotReader
+    {
+    private:
+        const char*                 data_;
+        size_t                      size_;
+        size_t                      pos_;
+        bool                        ok_;
+        /// Interned names, by index
+        std::vector<std::string>    names_;
+
+#ifdef _WIN32
+        void*                       file_handle_;
+        void*                       mapping_handle_;
+#else
+        int                         fd_;
+#endif
+
+        /// Returns a pointer to the next num_bytes, or NULL (and marks us bad) if there aren't that many
+        const char* take(size_t num_bytes);
+
+    public:
+        SnapshotReader();
+        ~SnapshotReader();
+
+        /// Maps the given file and checks the header.  Returns false if it's not there or it's not a snapshot of this version.
+        bool open(const std::string& filename);
+        /// Unmaps the file
+        void close();
+
+        /// Is everything read so far ok?
+        bool ok() const { return ok_; }
+        /// Marks the reader bad, for callers that find the data inconsistent
+        void markBad() { ok_ = false; }
+        /// Are we at the end of the file?
+        bool atEnd() const { return pos_ == size_; }
+
+        /// Reads the given four character section tag.  Returns false (and marks us bad) if it's not there.
+        bool expectTag(const char* tag);
+        int32_t     readInt();
+        int64_t     readInt64();
+        double      readDouble();
+        std::string readString();
+        /// Reads an array of ints written by SnapshotWriter::writeInts()
+        void        readInts(std::vector<int>& values);
+        /// Reads a name written by SnapshotWriter::writeName()
+        std::string readName();
+        /// Reads named attributes written by SnapshotWriter::writeAttributes()
+        void        readAttributes(Attributes& attributes);
+    };
+}
+
+#endif
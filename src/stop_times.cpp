@@ -0,0 +1,169 @@
+#include "stop_times.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace fasttrips {
+
+    /// Orders positions in the stop times by arrival time
+    struct CompareArrival {
+        const TripStopTime* rows_;
+        bool operator()(int idx1, int idx2) const { return rows_[idx1].arrive_time_ < rows_[idx2].arrive_time_; }
+        bool operator()(double time, int idx) const { return time < rows_[idx].arrive_time_; }
+    };
+
+    /// Orders positions in the stop times by departure time
+    struct CompareDeparture {
+        const TripStopTime* rows_;
+        bool operator()(int idx1, int idx2) const { return rows_[idx1].depart_time_ < rows_[idx2].depart_time_; }
+        bool operator()(int idx, double time) const { return rows_[idx].depart_time_ < time; }
+    };
+
+    static bool compareSequence(const TripStopTime& tst1, const TripStopTime& tst2) {
+        return tst1.seq_ < tst2.seq_;
+    }
+
+    void TripStopTimes::build(const std::vector<TripStopTime>& stop_times)
+    {
+        clear();
+
+        int max_trip_id = -1;
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            max_trip_id = std::max(max_trip_id, it->trip_id_);
+        }
+
+        // counting sort by trip id
+        offsets_.assign(max_trip_id+2, 0);
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            offsets_[it->trip_id_+1] += 1;
+        }
+        for (size_t idx = 1; idx < offsets_.size(); ++idx) {
+            offsets_[idx] += offsets_[idx-1];
+        }
+        stop_times_.resize(stop_times.size());
+        std::vector<int> next(offsets_.begin(), offsets_.end()-1);
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            stop_times_[next[it->trip_id_]++] = *it;
+        }
+
+        for (int trip_id = 0; trip_id <= max_trip_id; ++trip_id) {
+            std::sort(stop_times_.begin() + offsets_[trip_id], stop_times_.begin() + offsets_[trip_id+1], compareSequence);
+#ifndef NDEBUG
+            // verify the sequence numbers make sense: sequential, starts with 1
+            for (int idx = offsets_[trip_id]; idx < offsets_[trip_id+1]; ++idx) {
+                assert(stop_times_[idx].seq_ == idx - offsets_[trip_id] + 1);
+            }
+#endif
+        }
+    }
+
+    void TripStopTimes::clear()
+    {
+        offsets_.clear();
+        stop_times_.clear();
+    }
+
+    TripStopTimeRange TripStopTimes::forTrip(int trip_id) const
+    {
+        if ((trip_id < 0) || (trip_id+1 >= (int)offsets_.size())) { return TripStopTimeRange(); }
+        return TripStopTimeRange(stop_times_.data() + offsets_[trip_id], stop_times_.data() + offsets_[trip_id+1]);
+    }
+
+    TripStopTime* TripStopTimes::find(int trip_id, int seq)
+    {
+        int idx = indexOf(trip_id, seq);
+        return (idx < 0) ? NULL : &stop_times_[idx];
+    }
+
+    int TripStopTimes::indexOf(int trip_id, int seq) const
+    {
+        if ((trip_id < 0) || (trip_id+1 >= (int)offsets_.size())) { return -1; }
+        if ((seq < 1) || (seq > offsets_[trip_id+1] - offsets_[trip_id])) { return -1; }
+        return offsets_[trip_id] + seq - 1;
+    }
+
+    void StopTimeIndex::build(const std::vector<TripStopTime>& stop_times, const TripStopTimes& trip_stop_times)
+    {
+        clear();
+        trip_stop_times_ = &trip_stop_times;
+
+        int max_stop_id = -1;
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            max_stop_id = std::max(max_stop_id, it->stop_id_);
+        }
+
+        // counting sort by stop id; this keeps the input order within each stop
+        offsets_.assign(max_stop_id+2, 0);
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            offsets_[it->stop_id_+1] += 1;
+        }
+        for (size_t idx = 1; idx < offsets_.size(); ++idx) {
+            offsets_[idx] += offsets_[idx-1];
+        }
+        by_arrival_.resize(stop_times.size());
+        std::vector<int> next(offsets_.begin(), offsets_.end()-1);
+        for (std::vector<TripStopTime>::const_iterator it = stop_times.begin(); it != stop_times.end(); ++it) {
+            by_arrival_[next[it->stop_id_]++] = trip_stop_times.indexOf(it->trip_id_, it->seq_);
+            assert(by_arrival_[next[it->stop_id_]-1] >= 0);
+        }
+        by_departure_ = by_arrival_;
+
+        // stable, so ties stay in input order
+        CompareArrival   compare_arrival   = { trip_stop_times.data() };
+        CompareDeparture compare_departure = { trip_stop_times.data() };
+        for (int stop_id = 0; stop_id <= max_stop_id; ++stop_id) {
+            std::stable_sort(by_arrival_.begin()   + offsets_[stop_id], by_arrival_.begin()   + offsets_[stop_id+1], compare_arrival);
+            std::stable_sort(by_departure_.begin() + offsets_[stop_id], by_departure_.begin() + offsets_[stop_id+1], compare_departure);
+        }
+    }
+
+    void StopTimeIndex::clear()
+    {
+        trip_stop_times_ = NULL;
+        offsets_.clear();
+        by_arrival_.clear();
+        by_departure_.clear();
+    }
+
+    void StopTimeIndex::update(const std::vector<int>& stop_ids)
+    {
+        std::vector<int> updated_stops(stop_ids);
+        std::sort(updated_stops.begin(), updated_stops.end());
+        updated_stops.erase(std::unique(updated_stops.begin(), updated_stops.end()), updated_stops.end());
+
+        // the slices are nearly sorted; stable so ties stay in their previous order
+        CompareArrival   compare_arrival   = { trip_stop_times_->data() };
+        CompareDeparture compare_departure = { trip_stop_times_->data() };
+        for (std::vector<int>::const_iterator it = updated_stops.begin(); it != updated_stops.end(); ++it) {
+            if ((*it < 0) || (*it+1 >= (int)offsets_.size())) { continue; }
+            std::stable_sort(by_arrival_.begin()   + offsets_[*it], by_arrival_.begin()   + offsets_[*it+1], compare_arrival);
+            std::stable_sort(by_departure_.begin() + offsets_[*it], by_departure_.begin() + offsets_[*it+1], compare_departure);
+        }
+    }
+
+    TripStopTimeRefRange StopTimeIndex::arrivingWithin(int stop_id, double earliest, double latest) const
+    {
+        if ((stop_id < 0) || (stop_id+1 >= (int)offsets_.size())) { return TripStopTimeRefRange(); }
+
+        const int* stop_begin = by_arrival_.data() + offsets_[stop_id];
+        const int* stop_end   = by_arrival_.data() + offsets_[stop_id+1];
+
+        CompareArrival compare_arrival = { trip_stop_times_->data() };
+        const int* range_begin = std::upper_bound(stop_begin,  stop_end, earliest, compare_arrival);
+        const int* range_end   = std::upper_bound(range_begin, stop_end, latest,   compare_arrival);
+        return TripStopTimeRefRange(range_begin, range_end, trip_stop_times_->data());
+    }
+
+    TripStopTimeRefRange StopTimeIndex::departingWithin(int stop_id, double earliest, double latest) const
+    {
+        if ((stop_id < 0) || (stop_id+1 >= (int)offsets_.size())) { return TripStopTimeRefRange(); }
+
+        const int* stop_begin = by_departure_.data() + offsets_[stop_id];
+        const int* stop_end   = by_departure_.data() + offsets_[stop_id+1];
+
+        CompareDeparture compare_departure = { trip_stop_times_->data() };
+        const int* range_begin = std::lower_bound(stop_begin,  stop_end, earliest, compare_departure);
+        const int* range_end   = std::lower_bound(range_begin, stop_end, latest,   compare_departure);
+        return TripStopTimeRefRange(range_begin, range_end, trip_stop_times_->data());
+    }
+}
@@ -0,0 +1,154 @@
+/**
+ * \file stop_times.h
+ *
+ * Defines the transit vehicle schedule structures, including the time-sorted stop index
+ * used to find the trips serving a stop within the time window.
+ *
+ * Each fasttrips::TripStopTime is stored once, in fasttrips::TripStopTimes; the stop index refers to those rows
+ * by their position, so it's two ints per stop time rather than two more copies.
+ */
+#include <cstddef>
+#include <vector>
+
+#ifndef STOP_TIMES_H
+#define STOP_TIMES_H
+
+namespace fasttrips {
+
+    /// Supply data: Transit vehicle schedules
+    typedef struct {
+        int     trip_id_;         /// trip ID
+        int     seq_;             /// stop sequence, starts at 1
+        int     stop_id_;         /// stop ID
+        double  arrive_time_;     /// minutes after midnight
+        double  depart_time_;     /// minutes after midnight
+        double  shape_dist_trav_; /// shape distance traveled
+        double  overcap_;         /// number of passengers overcap
+    } TripStopTime;
+
+    /**
+     * A contiguous, read-only range of fasttrips::TripStopTime instances.
+     * This points into the storage of whatever returned it, so nothing is copied.
+     */
+    struct TripStopTimeRange {
+        const TripStopTime* begin_;
+        const TripStopTime* end_;
+
+        TripStopTimeRange() : begin_(NULL), end_(NULL) {}
+        TripStopTimeRange(const TripStopTime* b, const TripStopTime* e) : begin_(b), end_(e) {}
+
+        const TripStopTime* begin() const { return begin_; }
+        const TripStopTime* end()   const { return end_;   }
+        size_t size()               const { return end_ - begin_; }
+        bool   empty()              const { return begin_ == end_; }
+    };
+
+    /**
+     * The stop times for each trip, stored contiguously in CSR form: the stop times for trip id t are at
+     * [offsets_[t], offsets_[t+1]) in stop_times_, in stop sequence order.  Since stop sequences
+     * start at 1 and are consecutive, the stop time for (t, seq) is at offsets_[t] + seq - 1.
+     */
+    class TripStopTimes
+    {
+    private:
+        /// trip id -> index of its first stop time in stop_times_.  Size is max trip id + 2.
+        std::vector<int>          offsets_;
+        /// stop times grouped by trip id, sorted by stop sequence within each trip
+        std::vector<TripStopTime> stop_times_;
+
+    public:
+        /// Builds from the given stop times, which can be in any order.
+        void build(const std::vector<TripStopTime>& stop_times);
+        /// Clears data
+        void clear();
+        /// Are there any stop times?
+        bool empty() const { return stop_times_.empty(); }
+        /// Largest trip id that could have stop times, for iterating.  -1 if empty.
+        int maxTripId() const { return offsets_.empty() ? -1 : (int)offsets_.size() - 2; }
+
+        /// The stop times for the given trip, in sequence order
+        TripStopTimeRange forTrip(int trip_id) const;
+        /// The stop time for the given trip and stop sequence, or NULL if there isn't one.  This is for updating in place.
+        TripStopTime* find(int trip_id, int seq);
+        /// Position of the stop time for the given trip and stop sequence in data(), or -1 if there isn't one.
+        int indexOf(int trip_id, int seq) const;
+        /// All the stop times, for referring to them by position
+        const TripStopTime* data() const { return stop_times_.data(); }
+    };
+
+    /**
+     * A contiguous, read-only range of positions in fasttrips::TripStopTimes::data(), which iterates like
+     * the fasttrips::TripStopTime instances they refer to.  Nothing is copied.
+     */
+    struct TripStopTimeRefRange {
+        const int*          begin_;
+        const int*          end_;
+        const TripStopTime* rows_;
+
+        /// Forward iterator over the referred stop times
+        class const_iterator {
+        private:
+            const int*          ref_;
+            const TripStopTime* rows_;
+        public:
+            const_iterator(const int* ref, const TripStopTime* rows) : ref_(ref), rows_(rows) {}
+            const TripStopTime& operator*()  const { return rows_[*ref_]; }
+            const TripStopTime* operator->() const { return rows_ + *ref_; }
+            const_iterator& operator++() { ++ref_; return *this; }
+            bool operator==(const const_iterator& rhs) const { return ref_ == rhs.ref_; }
+            bool operator!=(const const_iterator& rhs) const { return ref_ != rhs.ref_; }
+        };
+
+        TripStopTimeRefRange() : begin_(NULL), end_(NULL), rows_(NULL) {}
+        TripStopTimeRefRange(const int* b, const int* e, const TripStopTime* rows) : begin_(b), end_(e), rows_(rows) {}
+
+        const_iterator begin() const { return const_iterator(begin_, rows_); }
+        const_iterator end()   const { return const_iterator(end_,   rows_); }
+        size_t size()          const { return end_ - begin_; }
+        bool   empty()         const { return begin_ == end_; }
+    };
+
+    /**
+     * Index of the stop times at each stop, sorted by arrival time and by departure time.
+     *
+     * This is stored in CSR form: the stop times for stop id s are at
+     * [offsets_[s], offsets_[s+1]) in each of by_arrival_ and by_departure_, so a time window
+     * query is two binary searches within that slice.  The entries are positions in the
+     * fasttrips::TripStopTimes the index was built on, which must outlive it and not be rebuilt under it.
+     */
+    class StopTimeIndex
+    {
+    private:
+        /// The stop times the entries refer to
+        const TripStopTimes*      trip_stop_times_;
+        /// stop id -> index of its first stop time in by_arrival_ and by_departure_.  Size is max stop id + 2.
+        std::vector<int>          offsets_;
+        /// positions of the stop times, grouped by stop id, sorted by arrival time within each stop
+        std::vector<int>          by_arrival_;
+        /// positions of the stop times, grouped by stop id, sorted by departure time within each stop
+        std::vector<int>          by_departure_;
+
+    public:
+        StopTimeIndex() : trip_stop_times_(NULL) {}
+
+        /**
+         * Builds the index from the given stop times, which can be in any order, referring to them in trip_stop_times,
+         * which must have been built from the same stop times.  Ties keep the given order.
+         */
+        void build(const std::vector<TripStopTime>& stop_times, const TripStopTimes& trip_stop_times);
+        /// Clears the index
+        void clear();
+        /**
+         * Re-sorts the given stops after the times of their stop times were updated in place in the
+         * fasttrips::TripStopTimes, without reallocating.  Ties stay in their previous order.
+         */
+        void update(const std::vector<int>& stop_ids);
+
+        /// Stop times at the given stop arriving in (earliest, latest], in order of arrival time
+        TripStopTimeRefRange arrivingWithin(int stop_id, double earliest, double latest) const;
+        /// Stop times at the given stop departing in [earliest, latest), in order of departure time
+        TripStopTimeRefRange departingWithin(int stop_id, double earliest, double latest) const;
+    };
+}
+
+#endif
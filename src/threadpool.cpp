@@ -0,0 +1,145 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace fasttrips {
+
+    /// The size of the pool running a task on this thread; see WorkStealingPool::enclosingThreads()
+    static thread_local int enclosing_threads = 0;
+
+    int WorkStealingPool::enclosingThreads()
+    {
+        return enclosing_threads;
+    }
+
+    static int resolveNumThreads(int num_threads)
+    {
+        if (num_threads >= 1) { return num_threads; }
+        int hw = (int)std::thread::hardware_concurrency();
+        return (hw >= 1) ? hw : 1;
+    }
+
+    WorkStealingPool::WorkStealingPool(int num_threads) :
+        num_threads_(resolveNumThreads(num_threads)),
+        queues_(num_threads_),
+        worker_stats_(num_threads_)
+    {
+    }
+
+    bool WorkStealingPool::popLocal(int thread_num, int& task)
+    {
+        WorkQueue& wq = queues_[thread_num];
+        std::lock_guard<std::mutex> lock(wq.mutex_);
+        if (wq.tasks_.empty()) { return false; }
+        task = wq.tasks_.front();
+        wq.tasks_.pop_front();
+        return true;
+    }
+
+    bool WorkStealingPool::steal(int thread_num, int& task)
+    {
+        // start with our neighbor so the thieves spread out
+        for (int offset = 1; offset < num_threads_; ++offset) {
+            WorkQueue& wq = queues_[(thread_num + offset) % num_threads_];
+            std::lock_guard<std::mutex> lock(wq.mutex_);
+            if (wq.tasks_.empty()) { continue; }
+            task = wq.tasks_.back();
+            wq.tasks_.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    static long long microsecondsSince(const std::chrono::steady_clock::time_point& start)
+    {
+        return (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void WorkStealingPool::work(int thread_num, const TaskFunction& task_function)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        WorkerStats& stats = worker_stats_[thread_num];
+        stats.num_tasks_ = 0;
+        stats.busy_us_   = 0;
+        // thread 0 is the caller, which may itself be running a task for an outer pool
+        int outer_threads = enclosing_threads;
+        enclosing_threads = num_threads_;
+
+        int task;
+        // tasks are never added during a run, so once everything is empty we're done
+        while (popLocal(thread_num, task) || steal(thread_num, task)) {
+            std::chrono::steady_clock::time_point task_start = std::chrono::steady_clock::now();
+            try {
+                task_function(task, thread_num);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex_);
+                if (!error_) { error_ = std::current_exception(); }
+            }
+            stats.num_tasks_ += 1;
+            stats.busy_us_   += microsecondsSince(task_start);
+        }
+        enclosing_threads = outer_threads;
+        stats.finish_us_ = microsecondsSince(start);
+    }
+
+    void WorkStealingPool::deal(int num_tasks, const std::vector<double>* task_costs)
+    {
+        for (int thread_num = 0; thread_num < num_threads_; ++thread_num) {
+            WorkQueue& wq = queues_[thread_num];
+            std::lock_guard<std::mutex> lock(wq.mutex_);
+            wq.tasks_.clear();
+        }
+
+        if (task_costs == NULL) {
+            // deal out contiguous blocks
+            for (int thread_num = 0; thread_num < num_threads_; ++thread_num) {
+                int block_start = (int)(((long long)num_tasks *  thread_num   ) / num_threads_);
+                int block_end   = (int)(((long long)num_tasks * (thread_num+1)) / num_threads_);
+                WorkQueue& wq = queues_[thread_num];
+                std::lock_guard<std::mutex> lock(wq.mutex_);
+                for (int task = block_start; task < block_end; ++task) {
+                    wq.tasks_.push_back(task);
+                }
+            }
+            return;
+        }
+
+        // most expensive first, each to the thread with the least so far
+        std::vector<int> order(num_tasks);
+        for (int task = 0; task < num_tasks; ++task) { order[task] = task; }
+        std::stable_sort(order.begin(), order.end(), [task_costs](int t1, int t2) { return (*task_costs)[t1] > (*task_costs)[t2]; });
+
+        std::vector<double> dealt_cost(num_threads_, 0.0);
+        for (std::vector<int>::const_iterator task = order.begin(); task != order.end(); ++task) {
+            int thread_num = (int)(std::min_element(dealt_cost.begin(), dealt_cost.end()) - dealt_cost.begin());
+            dealt_cost[thread_num] += std::max((*task_costs)[*task], 0.0);
+            WorkQueue& wq = queues_[thread_num];
+            std::lock_guard<std::mutex> lock(wq.mutex_);
+            wq.tasks_.push_back(*task);
+        }
+    }
+
+    void WorkStealingPool::run(int num_tasks, const TaskFunction& task_function, const std::vector<double>* task_costs)
+    {
+        error_ = std::exception_ptr();
+        deal(num_tasks, task_costs);
+
+        std::vector<std::thread> threads;
+        for (int thread_num = 1; thread_num < num_threads_; ++thread_num) {
+            threads.push_back(std::thread(&WorkStealingPool::work, this, thread_num, std::cref(task_function)));
+        }
+        work(0, task_function);
+        for (size_t idx = 0; idx < threads.size(); ++idx) {
+            threads[idx].join();
+        }
+
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = std::exception_ptr();
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * \file threadpool.h
+ *
+ * Defines the WorkStealingPool class used to run batches of path finding queries
+ * on multiple threads within a single process.
+ */
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+namespace fasttrips {
+
+    /**
+     * A simple work-stealing thread pool.
+     *
+     * Tasks are integer indices which are handed out in contiguous blocks to each thread's deque.
+     * Each thread works from the front of its own deque, and when that is empty, it steals
+     * from the back of the other threads' deques.  This keeps the locality of a static
+     * partition while balancing queries (like those to major hubs) that take much longer than others.
+     *
+     * The threads only live for the duration of WorkStealingPool::run(); a pathfinding batch
+     * is coarse enough that thread creation is negligible.
+     *
+     * Given predicted task costs, WorkStealingPool::run() deals the most expensive tasks first instead,
+     * each to the thread with the least predicted work so far, so each thread starts on its most expensive
+     * and thieves take the cheapest at the end.  Either way it keeps WorkStealingPool::WorkerStats for reporting
+     * how busy each thread was and how long the batch waited on its slowest thread.
+     */
+    class WorkStealingPool
+    {
+    public:
+        /// Task function: called with (task index, thread index)
+        typedef std::function<void(int, int)> TaskFunction;
+
+        /// What one thread did in the last WorkStealingPool::run()
+        typedef struct {
+            int         num_tasks_;     ///< Tasks run, including stolen ones
+            long long   busy_us_;       ///< Microseconds running tasks
+            long long   finish_us_;     ///< Microseconds from the start of the run to when this thread ran out of tasks
+        } WorkerStats;
+
+    private:
+        /// One of these per thread
+        struct WorkQueue {
+            std::mutex      mutex_;
+            std::deque<int> tasks_;
+        };
+
+        /// Number of threads to use
+        int num_threads_;
+
+        /// The work queues, one per thread
+        std::vector<WorkQueue> queues_;
+
+        /// Per thread stats for the last run; each thread only writes its own
+        std::vector<WorkerStats> worker_stats_;
+
+        /// The first exception thrown by a task, if any.  Rethrown by run().
+        std::exception_ptr     error_;
+        std::mutex             error_mutex_;
+
+        /// Pop a task from the front of this thread's queue.  Returns false if it's empty.
+        bool popLocal(int thread_num, int& task);
+        /// Steal a task from the back of another thread's queue.  Returns false if they're all empty.
+        bool steal(int thread_num, int& task);
+        /// The loop each thread runs.
+        void work(int thread_num, const TaskFunction& task_function);
+        /// Deal the tasks in [0, num_tasks) to the threads' queues, in contiguous blocks unless there are task costs
+        void deal(int num_tasks, const std::vector<double>* task_costs);
+
+    public:
+        /// Constructor.  If num_threads < 1, uses the hardware concurrency.
+        WorkStealingPool(int num_threads);
+
+        /// Accessor for the number of threads.
+        int numThreads() const { return num_threads_; }
+
+        /**
+         * The number of threads in the pool whose task is running on the calling thread, or 0 outside
+         * of any WorkStealingPool::run().  Tasks that could start a pool of their own use this to avoid
+         * multiplying the threads of the one they're in.
+         */
+        static int enclosingThreads();
+
+        /**
+         * Runs task_function for each task in [0, num_tasks) and returns when they're all complete.
+         * The calling thread is used as thread 0.  If a task throws, the remaining tasks are
+         * still run and the first exception is rethrown here.
+         *
+         * If task_costs is given, it has the predicted cost of each task, in any consistent unit.
+         */
+        void run(int num_tasks, const TaskFunction& task_function, const std::vector<double>* task_costs = NULL);
+
+        /// Accessor for the stats of each thread in the last run.
+        const std::vector<WorkerStats>& workerStats() const { return worker_stats_; }
+    };
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "trace_sink.h"
+
+#include <iostream>
+
+namespace fasttrips {
+
+    TraceSink& TraceSink::instance()
+    {
+        static TraceSink sink;
+        return sink;
+    }
+
+    TraceSink::TraceSink() :
+        queued_bytes_(0),
+        writing_(false),
+        closing_(false)
+    {
+        write_thread_ = std::thread(&TraceSink::write, this);
+    }
+
+    TraceSink::~TraceSink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+        }
+        chunk_ready_.notify_all();
+        if (write_thread_.joinable()) { write_thread_.join(); }
+    }
+
+    void TraceSink::append(TraceChunk& chunk)
+    {
+        size_t num_bytes = chunk.data_.size();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // let a chunk through if nothing's queued, however big it is
+            chunk_written_.wait(lock, [this, num_bytes] { return chunks_.empty() || (queued_bytes_ + num_bytes <= MAX_QUEUED_BYTES); });
+            chunks_.push_back(TraceChunk());
+            chunks_.back().filename_ = chunk.filename_;
+            chunks_.back().truncate_ = chunk.truncate_;
+            chunks_.back().close_    = chunk.close_;
+            chunks_.back().data_.swap(chunk.data_);
+            queued_bytes_ += num_bytes;
+        }
+        chunk_ready_.notify_one();
+    }
+
+    void TraceSink::flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunk_written_.wait(lock, [this] { return chunks_.empty() && !writing_; });
+    }
+
+    void TraceSink::write()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            chunk_ready_.wait(lock, [this] { return closing_ || !chunks_.empty(); });
+            if (chunks_.empty()) { break; }  // closing and nothing left
+
+            TraceChunk chunk;
+            chunk.filename_ = chunks_.front().filename_;
+            chunk.truncate_ = chunks_.front().truncate_;
+            chunk.close_    = chunks_.front().close_;
+            chunk.data_.swap(chunks_.front().data_);
+            chunks_.pop_front();
+            writing_ = true;
+
+            lock.unlock();
+            writeChunk(chunk);
+            lock.lock();
+
+            writing_ = false;
+            queued_bytes_ -= chunk.data_.size();
+            chunk_written_.notify_all();
+        }
+        // the trace streams that are still open at exit
+        for (std::map<std::string, std::shared_ptr<std::ofstream> >::iterator it = files_.begin(); it != files_.end(); ++it) {
+            it->second->close();
+        }
+        files_.clear();
+    }
+
+    void TraceSink::writeChunk(const TraceChunk& chunk)
+    {
+        // only this thread uses files_
+        std::shared_ptr<std::ofstream>& file = files_[chunk.filename_];
+        if (!file) {
+            file = std::make_shared<std::ofstream>(chunk.filename_.c_str(), chunk.truncate_ ? std::ios_base::out : std::ios_base::out | std::ios_base::app);
+            if (!file->is_open()) {
+                std::cerr << "TraceSink failed to open " << chunk.filename_ << std::endl;
+            }
+        }
+        if (file->is_open()) {
+            file->write(chunk.data_.data(), chunk.data_.size());
+        }
+        if (chunk.close_) {
+            file->close();
+            files_.erase(chunk.filename_);
+        }
+    }
+
+    TraceBuf::TraceBuf() :
+        open_(false),
+        truncate_(false)
+    {
+        // nowhere to write until it's opened
+        setp(NULL, NULL);
+    }
+
+    void TraceBuf::open(const std::string& filename, bool truncate)
+    {
+        if (open_) { close(); }
+        filename_ = filename;
+        truncate_ = truncate;
+        open_     = true;
+        // most queries aren't traced, so only those that are pay for a buffer
+        if (buffer_.empty()) { buffer_.resize(BUFFER_BYTES); }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    void TraceBuf::close()
+    {
+        if (!open_) { return; }
+        handOff(true);
+        open_ = false;
+        setp(NULL, NULL);
+    }
+
+    TraceBuf::int_type TraceBuf::overflow(int_type ch)
+    {
+        if (!open_) { return traits_type::eof(); }
+        handOff(false);
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    void TraceBuf::handOff(bool close)
+    {
+        TraceChunk chunk;
+        chunk.filename_ = filename_;
+        chunk.truncate_ = truncate_;
+        chunk.close_    = close;
+        chunk.data_.assign(pbase(), pptr());
+        TraceSink::instance().append(chunk);
+        // later chunks add to the file
+        truncate_ = false;
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    void TraceStream::open(const char* filename, std::ios_base::openmode mode)
+    {
+        buf_.open(filename, (mode & std::ios_base::app) == 0);
+        clear();
+    }
+
+    void TraceStream::close()
+    {
+        buf_.close();
+    }
+}
@@ -0,0 +1,125 @@
+/**
+ * \file trace_sink.h
+ *
+ * Defines the TraceStream that traced queries write their logs and label csvs to, and the TraceSink that writes them.
+ *
+ * Tracing writes a line (and flushes with std::endl) for nearly every label and link considered, so writing
+ * straight to an std::ofstream puts a system call in the middle of the labeling loop and stalls the path finding
+ * thread on the disk.  A TraceStream instead formats into a memory buffer and hands it off in large chunks,
+ * and the TraceSink's background thread does the file I/O, so other threads in the process are unaffected
+ * and the traced one only waits if the disk falls far behind.
+ */
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef TRACE_SINK_H
+#define TRACE_SINK_H
+
+namespace fasttrips {
+
+    /// A piece of one trace file, in the order it was written
+    struct TraceChunk {
+        std::string     filename_;
+        bool            truncate_;      ///< Set on the first chunk if the file should be started over
+        bool            close_;         ///< Set on the last chunk
+        std::string     data_;
+    };
+
+    /**
+     * Writes fasttrips::TraceChunk instances to their files on a background thread, shared by the whole process.
+     *
+     * At most MAX_QUEUED_BYTES are held waiting for the disk; append() blocks beyond that.
+     * The thread is started on first use and finishes the queue before the process exits.
+     */
+    class TraceSink
+    {
+    public:
+        static const size_t MAX_QUEUED_BYTES = 64*1024*1024;
+
+        /// The process's sink
+        static TraceSink& instance();
+
+        /// Queues the chunk for writing, waiting if too much is already queued
+        void append(TraceChunk& chunk);
+        /// Waits until everything queued so far has been written
+        void flush();
+
+        ~TraceSink();
+
+    private:
+        std::deque<TraceChunk>          chunks_;
+        size_t                          queued_bytes_;
+        bool                            writing_;       ///< The background thread is working on a chunk it took off chunks_
+        bool                            closing_;
+        std::map<std::string, std::shared_ptr<std::ofstream> > files_;
+        std::mutex                      mutex_;
+        /// Signalled when a chunk is queued or we're closing
+        std::condition_variable         chunk_ready_;
+        /// Signalled when a chunk is written
+        std::condition_variable         chunk_written_;
+        std::thread                     write_thread_;
+
+        TraceSink();
+        /// The background thread's loop
+        void write();
+        /// Writes one chunk to its file, opening or closing it as needed
+        void writeChunk(const TraceChunk& chunk);
+    };
+
+    /// The buffer behind a fasttrips::TraceStream; full buffers go to the fasttrips::TraceSink
+    class TraceBuf : public std::streambuf
+    {
+    public:
+        static const size_t BUFFER_BYTES = 64*1024;
+
+        TraceBuf();
+        void open(const std::string& filename, bool truncate);
+        bool isOpen() const { return open_; }
+        /// Hands off what's buffered as the file's last chunk
+        void close();
+
+    protected:
+        virtual int_type overflow(int_type ch);
+        /// Nothing to do; std::endl shouldn't cost a write
+        virtual int sync() { return 0; }
+
+    private:
+        std::vector<char>   buffer_;
+        std::string         filename_;
+        bool                open_;
+        bool                truncate_;
+
+        /// Hands off what's buffered
+        void handOff(bool close);
+    };
+
+    /**
+     * An output stream for trace files with the parts of the std::ofstream interface that tracing uses.
+     * Output shows up in the file some time after it's written, and by TraceSink::flush() at the latest.
+     */
+    class TraceStream : public std::ostream
+    {
+    private:
+        TraceBuf    buf_;
+
+    public:
+        TraceStream() : std::ostream(&buf_) {}
+        /// Opens the file; the std::ios_base::app bit of mode says whether to add to it or start over
+        void open(const char* filename, std::ios_base::openmode mode = std::ios_base::out);
+        bool is_open() const { return buf_.isOpen(); }
+        void close();
+        /// Closes the file if that hasn't been done
+        ~TraceStream() { close(); }
+    };
+}
+
+#endif
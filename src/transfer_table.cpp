@@ -0,0 +1,24 @@
+#include "transfer_table.h"
+
+namespace fasttrips {
+
+    std::shared_ptr<const TransferTable> TransferTables::find(const TransferTableKey& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<TransferTableKey, std::shared_ptr<const TransferTable>, struct TransferTableKeyCompare>::const_iterator it = tables_.find(key);
+        if (it == tables_.end()) { return std::shared_ptr<const TransferTable>(); }
+        return it->second;
+    }
+
+    std::shared_ptr<const TransferTable> TransferTables::insert(const TransferTableKey& key, const std::shared_ptr<const TransferTable>& table)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return tables_.insert(std::make_pair(key, table)).first->second;
+    }
+
+    void TransferTables::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tables_.clear();
+    }
+}
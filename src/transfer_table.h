@@ -0,0 +1,97 @@
+/**
+ * \file transfer_table.h
+ *
+ * Defines the transfer tables that PathFinder::updateStopStatesForTransfers() relaxes transfers from.
+ *
+ * A transfer's walk time, distance and generalized cost only depend on its static attributes and the transfer
+ * weights, so each table has them precomputed for one user class and purpose, in one search direction.
+ * Tables are built on first use and shared by every query (and every path finding thread) that costs transfers the same way.
+ */
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "link_cost.h"
+#include "network.h"
+
+#ifndef TRANSFER_TABLE_H
+#define TRANSFER_TABLE_H
+
+namespace fasttrips {
+
+    /// A transfer in a fasttrips::TransferTable
+    typedef struct {
+        int                 stop_id_;   ///< The stop at the other end of the transfer
+        double              time_;      ///< Transfer time_min
+        double              dist_;      ///< Transfer dist
+        double              cost_;      ///< Generalized cost for hyperpath path finding; the time for deterministic
+        const TransferLink* link_;      ///< The link this was made from if its cost depends on the query (it has a fare), or NULL
+    } TransferHop;
+
+    /// Identifies a fasttrips::TransferTable: the transfer weights and the direction
+    typedef struct {
+        std::string user_class_;
+        std::string purpose_;
+        bool        hyperpath_;         ///< Deterministic costs are just the time
+        bool        outbound_;          ///< If true, the transfers to each stop; otherwise the transfers from each stop
+    } TransferTableKey;
+
+    struct TransferTableKeyCompare {
+        bool operator()(const TransferTableKey& ttk1, const TransferTableKey& ttk2) const {
+            if (ttk1.user_class_ < ttk2.user_class_) { return true;  }
+            if (ttk1.user_class_ > ttk2.user_class_) { return false; }
+            if (ttk1.purpose_    < ttk2.purpose_   ) { return true;  }
+            if (ttk1.purpose_    > ttk2.purpose_   ) { return false; }
+            if (ttk1.hyperpath_  < ttk2.hyperpath_ ) { return true;  }
+            if (ttk1.hyperpath_  > ttk2.hyperpath_ ) { return false; }
+            if (ttk1.outbound_   < ttk2.outbound_  ) { return true;  }
+            return false;
+        }
+    };
+
+    /**
+     * The transfers in CSR form: the transfers for stop id s are at [offsets_[s], offsets_[s+1]) in hops_,
+     * in the same order as fasttrips::TransferLinks::linksFor().
+     */
+    struct TransferTable {
+        /// stop id -> index of its first transfer in hops_.  Size is max stop id + 2.
+        std::vector<int>            offsets_;
+        std::vector<TransferHop>    hops_;
+        double                      zero_walk_time_;    ///< Time of the zero-walk transfer at a stop
+        double                      zero_walk_cost_;    ///< Cost of the zero-walk transfer at a stop
+        const SupplyModeWeights*    weights_;           ///< The transfer weights, for costing the transfers with fares
+
+        /// The transfers for the given stop
+        const TransferHop* begin(int stop_id) const {
+            if ((stop_id < 0) || (stop_id+1 >= (int)offsets_.size())) { return NULL; }
+            return hops_.data() + offsets_[stop_id];
+        }
+        const TransferHop* end(int stop_id) const {
+            if ((stop_id < 0) || (stop_id+1 >= (int)offsets_.size())) { return NULL; }
+            return hops_.data() + offsets_[stop_id+1];
+        }
+    };
+
+    /**
+     * The transfer tables built so far.  These are shared by all path finding threads, so lookups are locked;
+     * PathFinder::labelPathSet() does one per query.
+     */
+    class TransferTables
+    {
+    private:
+        std::map<TransferTableKey, std::shared_ptr<const TransferTable>, struct TransferTableKeyCompare> tables_;
+        std::mutex  mutex_;
+
+    public:
+        /// The table for the given key, or an empty pointer if it hasn't been built
+        std::shared_ptr<const TransferTable> find(const TransferTableKey& key);
+        /// Keeps the given table for the key, unless another thread got there first.  Returns the one kept.
+        std::shared_ptr<const TransferTable> insert(const TransferTableKey& key, const std::shared_ptr<const TransferTable>& table);
+        /// Forgets the tables.  Call this when the transfers or weights change.
+        void clear();
+    };
+}
+
+#endif
@@ -0,0 +1,61 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, PathSet, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 5
+
+
+@pytest.mark.basic
+def test_connection_scan():
+    """
+    Test that labeling deterministic path finding with the connection scan still finds paths for everyone.
+    Compare the cost and arrival time of each person trip's chosen path from the two runs.
+    """
+    trip_cols = [Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID]
+    chosen    = {}
+    for connection_scan in [False, True]:
+        output_folder = "test_connection_scan_%s" % ("scan" if connection_scan else "labelstops")
+        r = Run.run_fasttrips(
+            input_network_dir       = INPUT_NETWORK,
+            input_demand_dir        = INPUT_DEMAND,
+            run_config              = CONFIG_FILE,
+            input_weights           = INPUT_WEIGHTS,
+            output_dir              = OUTPUT_DIR,
+            output_folder           = output_folder,
+            pathfinding_type        = "deterministic",
+            connection_scan         = connection_scan,
+            iters                   = 1,
+            num_trips               = test_size )
+
+        assert test_size == r["passengers_arrived"]
+
+        # the cost and the arrival at the end of the last link of each chosen path; ties may pick different trips
+        paths = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, "chosenpaths_paths.csv"), usecols=trip_cols + [PathSet.PATH_KEY_COST])
+        paths = paths.groupby(trip_cols).last().reset_index()
+        links = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, "chosenpaths_links.csv"),
+                            usecols=trip_cols + [Passenger.PF_COL_LINK_NUM, Passenger.PF_COL_PAX_B_TIME],
+                            parse_dates=[Passenger.PF_COL_PAX_B_TIME])
+        links = links.sort_values(by=trip_cols + [Passenger.PF_COL_LINK_NUM]).groupby(trip_cols).last().reset_index()
+        chosen[connection_scan] = pd.merge(left=paths, right=links[trip_cols + [Passenger.PF_COL_PAX_B_TIME]],
+                                           on=trip_cols, how="outer").sort_values(by=trip_cols).reset_index(drop=True)
+
+    pd.testing.assert_frame_equal(chosen[False][trip_cols], chosen[True][trip_cols])
+    pd.testing.assert_series_equal(chosen[False][PathSet.PATH_KEY_COST], chosen[True][PathSet.PATH_KEY_COST], check_exact=False)
+    arrival_diff = (chosen[False][Passenger.PF_COL_PAX_B_TIME] - chosen[True][Passenger.PF_COL_PAX_B_TIME]).abs()
+    assert (arrival_diff < pd.Timedelta(seconds=1)).all()
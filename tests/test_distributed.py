@@ -0,0 +1,51 @@
+import multiprocessing
+import os
+import pytest
+from fasttrips import Distributed, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size    = 5
+ADDRESS      = ("localhost", 50123)
+AUTHKEY      = "fasttrips_test"
+
+
+@pytest.mark.basic
+def test_distributed():
+    """
+    Test that path finding on a pathfinding node finds paths for everyone.  The node is a local process
+    started before the run, and the second iteration gets only the supply that changed.
+    """
+    node = multiprocessing.Process(target=Distributed.run_pathfinding_node, args=(ADDRESS, AUTHKEY.encode(), 2))
+    node.start()
+
+    output_folder = "test_distributed"
+    r = Run.run_fasttrips(
+        input_network_dir   = INPUT_NETWORK,
+        input_demand_dir    = INPUT_DEMAND,
+        run_config          = CONFIG_FILE,
+        input_weights       = INPUT_WEIGHTS,
+        output_dir          = OUTPUT_DIR,
+        output_folder       = output_folder,
+        pathfinding_type    = "stochastic",
+        distributed_address = "%s:%d" % ADDRESS,
+        distributed_authkey = AUTHKEY,
+        iters               = 2,
+        num_trips           = test_size,
+        dispersion          = 0.50 )
+
+    node.join(60)
+    assert not node.is_alive()
+    assert node.exitcode == 0
+    assert test_size == r["passengers_arrived"]
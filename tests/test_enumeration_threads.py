@@ -0,0 +1,52 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 5
+
+
+@pytest.mark.basic
+def test_enumeration_threads():
+    """
+    Test that drawing the stochastic pathsets in blocks, on one thread or several, still finds paths for everyone,
+    and that the pathset paths and links don't depend on the number of threads.
+    """
+    pathsets = {}
+    for enumeration_threads in [1, 3]:
+        output_folder = "test_enumeration_threads_%d" % enumeration_threads
+        r = Run.run_fasttrips(
+            input_network_dir       = INPUT_NETWORK,
+            input_demand_dir        = INPUT_DEMAND,
+            run_config              = CONFIG_FILE,
+            input_weights           = INPUT_WEIGHTS,
+            output_dir              = OUTPUT_DIR,
+            output_folder           = output_folder,
+            pathfinding_type        = "stochastic",
+            enumeration_threads     = enumeration_threads,
+            iters                   = 1,
+            num_trips               = test_size )
+
+        assert test_size == r["passengers_arrived"]
+
+        pathsets[enumeration_threads] = [
+            pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, Passenger.PATHSET_PATHS_CSV)),
+            pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, Passenger.PATHSET_LINKS_CSV)) ]
+
+    for one_thread_df, three_threads_df in zip(pathsets[1], pathsets[3]):
+        pd.testing.assert_frame_equal(one_thread_df, three_threads_df)
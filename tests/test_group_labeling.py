@@ -0,0 +1,70 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_pathfinding_types = ["stochastic", "deterministic"]
+test_size              = 5
+
+@pytest.fixture(scope='module', params=test_pathfinding_types)
+def pathfinding_type(request):
+    return request.param
+
+
+def read_pathsets(output_folder):
+    """
+    Returns the pathset paths and links from the given run, sorted by person trip, since grouping changes the order they're found in.
+    """
+    pathsets = []
+    for (pathset_file, sort_cols) in [(Passenger.PATHSET_PATHS_CSV, [Passenger.PF_COL_PATH_NUM]),
+                                      (Passenger.PATHSET_LINKS_CSV, [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM])]:
+        pathset_df = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, pathset_file))
+        pathset_df = pathset_df.sort_values(by=[Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID] + sort_cols)
+        pathsets.append(pathset_df.reset_index(drop=True))
+    return pathsets
+
+
+@pytest.mark.basic
+def test_group_labeling(pathfinding_type):
+    """
+    Test that labeling once per group of identically labeled person trips gives each person trip the same pathset
+    as labeling it alone.
+    """
+    pathsets = {}
+    for group_labeling in [False, True]:
+        output_folder = "test_group_labeling_%s_%s" % (pathfinding_type, "group" if group_labeling else "alone")
+        r = Run.run_fasttrips(
+            input_network_dir          = INPUT_NETWORK,
+            input_demand_dir           = INPUT_DEMAND,
+            run_config                 = CONFIG_FILE,
+            input_weights              = INPUT_WEIGHTS,
+            output_dir                 = OUTPUT_DIR,
+            output_folder              = output_folder,
+            pathfinding_type           = pathfinding_type,
+            number_of_threads          = 2,
+            group_labeling             = group_labeling,
+            group_labeling_time_bucket = 0,
+            iters                      = 1,
+            num_trips                  = test_size,
+            dispersion                 = 0.50 )
+
+        assert test_size == r["passengers_arrived"]
+        pathsets[group_labeling] = read_pathsets(output_folder)
+
+    for (alone_df, group_df) in zip(pathsets[False], pathsets[True]):
+        pd.testing.assert_frame_equal(alone_df, group_df)
@@ -0,0 +1,67 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Performance, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_pathfinding_types = ["stochastic", "deterministic"]
+test_size              = 5
+
+RESULT_FILES        = [Passenger.PATHSET_PATHS_CSV, Passenger.PATHSET_LINKS_CSV, 'chosenpaths_paths.csv', 'chosenpaths_links.csv']
+
+@pytest.fixture(scope='module', params=test_pathfinding_types)
+def pathfinding_type(request):
+    return request.param
+
+
+def run_labeling_cache(pathfinding_type, labeling_cache):
+    output_folder = "test_labeling_cache_%s_%s" % (pathfinding_type, "cached" if labeling_cache else "uncached")
+    r = Run.run_fasttrips(
+        input_network_dir = INPUT_NETWORK,
+        input_demand_dir  = INPUT_DEMAND,
+        run_config        = CONFIG_FILE,
+        input_weights     = INPUT_WEIGHTS,
+        output_dir        = OUTPUT_DIR,
+        output_folder     = output_folder,
+        pathfinding_type  = pathfinding_type,
+        number_of_threads = 2,
+        labeling_cache    = labeling_cache,
+        iters             = 2,
+        num_trips         = test_size,
+        dispersion        = 0.50 )
+
+    assert test_size == r["passengers_arrived"]
+    return os.path.join(OUTPUT_DIR, output_folder)
+
+
+@pytest.mark.basic
+def test_labeling_cache(pathfinding_type):
+    """
+    Test that the second iteration reuses labels from the first, per the label cache hit column
+    in the pathfinding performance output, and that the results are the same as without the cache.
+    """
+    cached_dir   = run_labeling_cache(pathfinding_type, True)
+    uncached_dir = run_labeling_cache(pathfinding_type, False)
+
+    performance_df = pd.read_csv(os.path.join(cached_dir, Performance.OUTPUT_PERFORMANCE_PF_FILE))
+    second_iteration_df = performance_df.loc[performance_df[Performance.PERFORMANCE_PF_COL_ITERATION] == 2]
+    assert len(second_iteration_df) > 0
+    assert second_iteration_df[Performance.PERFORMANCE_PF_COL_LABEL_CACHE_HIT].sum() > 0
+
+    for result_file in RESULT_FILES:
+        pd.testing.assert_frame_equal(pd.read_csv(os.path.join(cached_dir,   result_file)),
+                                      pd.read_csv(os.path.join(uncached_dir, result_file)))
@@ -0,0 +1,98 @@
+import os
+
+import pandas as pd
+import pytest
+
+import _fasttrips
+from fasttrips import Assignment, Passenger, Route, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+OUTPUT_FOLDER       = 'test_network_snapshot'
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 5
+
+SNAPSHOT_FILE       = os.path.join(OUTPUT_DIR, OUTPUT_FOLDER, 'ft_intermediate_snapshot.bin')
+RESULT_FILES        = [Passenger.PATHSET_PATHS_CSV, Passenger.PATHSET_LINKS_CSV, 'chosenpaths_paths.csv', 'chosenpaths_links.csv']
+
+
+def run_with_snapshot():
+    r = Run.run_fasttrips(
+        input_network_dir       = INPUT_NETWORK,
+        input_demand_dir        = INPUT_DEMAND,
+        run_config              = CONFIG_FILE,
+        input_weights           = INPUT_WEIGHTS,
+        output_dir              = OUTPUT_DIR,
+        output_folder           = OUTPUT_FOLDER,
+        pathfinding_type        = "stochastic",
+        network_snapshot        = True,
+        iters                   = 1,
+        num_trips               = test_size )
+
+    assert test_size == r["passengers_arrived"]
+    return dict((result_file, pd.read_csv(os.path.join(OUTPUT_DIR, OUTPUT_FOLDER, result_file))) for result_file in RESULT_FILES)
+
+
+def initialize_supply(capfd):
+    _fasttrips.reset()
+    _fasttrips.initialize_supply(os.path.join(OUTPUT_DIR, OUTPUT_FOLDER), 0,
+                                 Assignment.extension_stoptime_index, Assignment.extension_stoptime_times, 1)
+    return capfd.readouterr().out
+
+
+@pytest.mark.basic
+def test_network_snapshot(capfd):
+    """
+    Test that the first run with the network snapshot writes it and the second reads it, with the same results,
+    and that it's rewritten once an intermediate file changes or if it can't be read.
+    """
+    if os.path.exists(SNAPSHOT_FILE):
+        os.remove(SNAPSHOT_FILE)
+
+    first_results = run_with_snapshot()
+    out = capfd.readouterr().out
+    assert "Wrote network snapshot" in out
+    assert os.path.exists(SNAPSHOT_FILE)
+
+    # python writes the same intermediate files again, so the snapshot still matches them
+    second_results = run_with_snapshot()
+    out = capfd.readouterr().out
+    assert "Read network snapshot" in out
+    assert "Wrote network snapshot" not in out
+    for result_file in RESULT_FILES:
+        pd.testing.assert_frame_equal(first_results[result_file], second_results[result_file])
+
+    # change an intermediate file, record it in the manifest as the next run would, and load the supply again
+    # as a worker process would
+    with open(os.path.join(OUTPUT_DIR, OUTPUT_FOLDER, Route.OUTPUT_ROUTE_ID_NUM_FILE), 'a') as route_id_file:
+        route_id_file.write("99999 test_network_snapshot_route\n")
+    Assignment.write_snapshot_manifest(os.path.join(OUTPUT_DIR, OUTPUT_FOLDER))
+    for expect_rewrite in [True, False]:
+        out = initialize_supply(capfd)
+        if expect_rewrite:
+            assert "is out of date" in out
+            assert "Wrote network snapshot" in out
+        else:
+            assert "Read network snapshot" in out
+            assert "Wrote network snapshot" not in out
+
+    # cut off the end of the snapshot; it's read from the text files and rewritten
+    with open(SNAPSHOT_FILE, 'rb') as snapshot:
+        snapshot_bytes = snapshot.read()
+    with open(SNAPSHOT_FILE, 'wb') as snapshot:
+        snapshot.write(snapshot_bytes[:-16])
+    out = initialize_supply(capfd)
+    assert "is corrupt" in out
+    assert "Wrote network snapshot" in out
+    out = initialize_supply(capfd)
+    assert "Read network snapshot" in out
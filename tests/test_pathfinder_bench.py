@@ -0,0 +1,62 @@
+import os
+import subprocess
+import sys
+
+import pytest
+
+from fasttrips import Assignment, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+OUTPUT_FOLDER       = 'test_pathfinder_bench'
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 5
+
+
+@pytest.mark.basic
+def test_pathfinder_bench():
+    """
+    Test that a query corpus recorded from the Springfield example replays in the native benchmark
+    built by ``python setup.py build_bench``, finding paths for the same person trips.
+    """
+    r = Run.run_fasttrips(
+        input_network_dir       = INPUT_NETWORK,
+        input_demand_dir        = INPUT_DEMAND,
+        run_config              = CONFIG_FILE,
+        input_weights           = INPUT_WEIGHTS,
+        output_dir              = OUTPUT_DIR,
+        output_folder           = OUTPUT_FOLDER,
+        pathfinding_type        = "stochastic",
+        record_queries          = True,
+        iters                   = 1,
+        num_trips               = test_size )
+
+    assert test_size == r["passengers_arrived"]
+
+    output_dir  = os.path.join(OUTPUT_DIR, OUTPUT_FOLDER)
+    corpus_file = os.path.join(output_dir, Assignment.QUERY_RECORD_FILE % (1, 1))
+    assert os.path.exists(corpus_file)
+
+    bench_dir = os.path.join(output_dir, 'bench')
+    subprocess.check_call([sys.executable, 'setup.py', 'build_bench', '--build-dir', bench_dir])
+
+    bench  = os.path.join(bench_dir, 'pathfinder_bench' + ('.exe' if sys.platform == 'win32' else ''))
+    report = subprocess.check_output([bench, output_dir, corpus_file, '2']).decode().splitlines()
+    print('\n'.join(report))
+
+    # everyone was sought and found in the first pathfinding iteration, and each is replayed twice
+    # (the lines before that are from loading the supply)
+    assert 'Replaying %d queries x 2' % test_size in report
+    all_results = [line.split() for line in report if line.startswith('all ')][0]
+    assert int(all_results[1]) == 2*test_size
+    assert int(all_results[2]) == 2*test_size
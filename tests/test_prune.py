@@ -0,0 +1,81 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Performance, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_pathfinding_types = ["stochastic", "deterministic"]
+test_size              = 5
+
+@pytest.fixture(scope='module', params=test_pathfinding_types)
+def pathfinding_type(request):
+    return request.param
+
+# the chosen path links that should be the same with pruning, for deterministic pathfinding
+CHOSEN_LINK_COLUMNS = [Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID,
+                       Passenger.PF_COL_LINK_NUM, Passenger.PF_COL_LINK_MODE, Passenger.PF_COL_TRIP_ID,
+                       'A_id', 'B_id', Passenger.PF_COL_PAX_A_TIME, Passenger.PF_COL_PAX_B_TIME]
+
+
+@pytest.mark.basic
+def test_prune_with_lower_bounds(pathfinding_type):
+    """
+    Test that pruning the labeling with lower bounds still finds paths for everyone.
+    Compare the num labeled stops and num pruned states in the pathfinding performance output of the two runs.
+    """
+    performance  = {}
+    chosen_links = {}
+    for prune in [False, True]:
+        output_folder = "test_prune_%s_%s" % (pathfinding_type, "prune" if prune else "noprune")
+        r = Run.run_fasttrips(
+            input_network_dir       = INPUT_NETWORK,
+            input_demand_dir        = INPUT_DEMAND,
+            run_config              = CONFIG_FILE,
+            input_weights           = INPUT_WEIGHTS,
+            output_dir              = OUTPUT_DIR,
+            output_folder           = output_folder,
+            pathfinding_type        = pathfinding_type,
+            prune_with_lower_bounds = prune,
+            iters                   = 1,
+            num_trips               = test_size,
+            dispersion              = 0.50 )
+
+        assert test_size == r["passengers_arrived"]
+
+        performance[prune]  = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, Performance.OUTPUT_PERFORMANCE_PF_FILE))
+        chosen_links[prune] = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, "chosenpaths_links.csv"), usecols=CHOSEN_LINK_COLUMNS)
+
+    # the same person trips were sought in each pathfinding iteration
+    perf_df = pd.merge(left    =performance[False],
+                       right   =performance[True],
+                       on      =[Performance.PERFORMANCE_PF_COL_ITERATION, Performance.PERFORMANCE_PF_COL_PATHFINDING_ITERATION,
+                                 Performance.PERFORMANCE_PF_COL_PERSON_ID, Performance.PERFORMANCE_PF_COL_PERSON_TRIP_ID],
+                       how     ="outer",
+                       suffixes=["_noprune", "_prune"],
+                       indicator=True)
+    assert (perf_df["_merge"] == "both").all()
+
+    # pruning only takes labels away, and it took some
+    labeled_stops = Performance.PERFORMANCE_PF_COL_NUM_LABELED_STOPS
+    pruned_states = Performance.PERFORMANCE_PF_COL_NUM_PRUNED_STATES
+    assert (perf_df[labeled_stops + "_prune"] <= perf_df[labeled_stops + "_noprune"]).all()
+    assert perf_df[pruned_states + "_noprune"].sum() == 0
+    assert perf_df[pruned_states + "_prune"  ].sum() > 0
+
+    # the lower bounds are admissible, so the deterministic best paths don't change
+    if pathfinding_type == "deterministic":
+        pd.testing.assert_frame_equal(chosen_links[False], chosen_links[True])
@@ -0,0 +1,92 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Performance, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size    = 5
+test_threads = 2
+
+# result file -> the columns that order it within a person trip
+RESULT_FILES = [(Passenger.PATHSET_PATHS_CSV,  [Passenger.PF_COL_PATH_NUM]),
+                (Passenger.PATHSET_LINKS_CSV,  [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM])]
+
+ITERATION_COLS = [Performance.PERFORMANCE_PF_COL_ITERATION, Performance.PERFORMANCE_PF_COL_PATHFINDING_ITERATION]
+
+
+def run_schedule_by_cost(schedule_by_cost):
+    """
+    Runs two iterations on threads and returns the output directory.
+    """
+    output_folder = "test_schedule_by_cost_%s" % ("by_cost" if schedule_by_cost else "in_order")
+    r = Run.run_fasttrips(
+        input_network_dir = INPUT_NETWORK,
+        input_demand_dir  = INPUT_DEMAND,
+        run_config        = CONFIG_FILE,
+        input_weights     = INPUT_WEIGHTS,
+        output_dir        = OUTPUT_DIR,
+        output_folder     = output_folder,
+        pathfinding_type  = "stochastic",
+        number_of_threads = test_threads,
+        schedule_by_cost  = schedule_by_cost,
+        iters             = 2,
+        num_trips         = test_size,
+        dispersion        = 0.50 )
+
+    assert test_size == r["passengers_arrived"]
+    return os.path.join(OUTPUT_DIR, output_folder)
+
+
+def read_pathsets(output_dir):
+    """
+    Returns the pathset paths and links, sorted by person trip, since the threads finish them in any order.
+    """
+    pathsets = {}
+    for (pathset_file, sort_cols) in RESULT_FILES:
+        pathset_df = pd.read_csv(os.path.join(output_dir, pathset_file))
+        pathset_df = pathset_df.sort_values(by=[Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID] + sort_cols)
+        pathsets[pathset_file] = pathset_df.reset_index(drop=True)
+    return pathsets
+
+
+@pytest.mark.basic
+def test_schedule_by_cost():
+    """
+    Test that scheduling threaded path finding by the last iteration's cost finds the same pathsets as scheduling
+    in order, and that the worker utilization gets written: a row per thread per batch, with the tasks adding up
+    to the person trips sought.  The second iteration is the one scheduled by cost.
+    """
+    by_cost_dir  = run_schedule_by_cost(True)
+    in_order_dir = run_schedule_by_cost(False)
+
+    worker_df = pd.read_csv(os.path.join(by_cost_dir, Performance.OUTPUT_PERFORMANCE_PF_WORKERS_FILE))
+    assert len(worker_df) > 0
+    for (batch, batch_df) in worker_df.groupby(ITERATION_COLS + [Performance.PERFORMANCE_PF_COL_BATCH]):
+        assert sorted(batch_df[Performance.PERFORMANCE_PF_COL_WORKER_THREAD].tolist()) == list(range(test_threads))
+    assert (worker_df[Performance.PERFORMANCE_PF_COL_UTILIZATION] >  0).all()
+    assert (worker_df[Performance.PERFORMANCE_PF_COL_UTILIZATION] <= 1).all()
+
+    # at this size each pathfinding iteration is one batch, so its tasks are the person trips it looked for
+    performance_df = pd.read_csv(os.path.join(by_cost_dir, Performance.OUTPUT_PERFORMANCE_PF_FILE))
+    num_tasks      = worker_df.groupby(ITERATION_COLS)[Performance.PERFORMANCE_PF_COL_NUM_TASKS].sum()
+    num_trips      = performance_df.groupby(ITERATION_COLS).size()
+    assert num_tasks.to_dict() == num_trips.to_dict()
+
+    by_cost_pathsets  = read_pathsets(by_cost_dir)
+    in_order_pathsets = read_pathsets(in_order_dir)
+    for (pathset_file, _) in RESULT_FILES:
+        pd.testing.assert_frame_equal(by_cost_pathsets[pathset_file], in_order_pathsets[pathset_file])
@@ -0,0 +1,70 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 10
+
+# result file -> the columns that order it within a person trip
+RESULT_FILES = [(Passenger.PATHSET_PATHS_CSV,  [Passenger.PF_COL_PATH_NUM]),
+                (Passenger.PATHSET_LINKS_CSV,  [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM]),
+                ('chosenpaths_paths.csv',      [Passenger.PF_COL_PATH_NUM]),
+                ('chosenpaths_links.csv',      [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM])]
+
+
+def run_share_supply(share_supply):
+    """
+    Runs two iterations on two worker processes and returns the pathsets and chosen paths, sorted by person trip,
+    since the workers finish them in any order.
+    """
+    output_folder = "test_share_supply_%s" % ("shared" if share_supply else "unshared")
+    r = Run.run_fasttrips(
+        input_network_dir       = INPUT_NETWORK,
+        input_demand_dir        = INPUT_DEMAND,
+        run_config              = CONFIG_FILE,
+        input_weights           = INPUT_WEIGHTS,
+        output_dir              = OUTPUT_DIR,
+        output_folder           = output_folder,
+        number_of_processes     = 2,
+        share_supply            = share_supply,
+        iters                   = 2,
+        num_trips               = test_size )
+
+    assert test_size == r["passengers_arrived"]
+
+    results = {}
+    for (result_file, sort_cols) in RESULT_FILES:
+        result_df = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, result_file))
+        iteration_cols = [col for col in ["iteration"] if col in result_df.columns]
+        result_df = result_df.sort_values(by=iteration_cols + [Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID] + sort_cols)
+        results[result_file] = result_df.reset_index(drop=True)
+    return results
+
+
+@pytest.mark.basic
+def test_share_supply():
+    """
+    Test that worker processes forked with the network supply already in the extension find paths for everyone,
+    over two iterations so the stop times and bump waits change in between, with the same pathsets and chosen paths
+    as worker processes that read the supply themselves.
+    """
+    shared_results   = run_share_supply(True)
+    unshared_results = run_share_supply(False)
+
+    for (result_file, _) in RESULT_FILES:
+        pd.testing.assert_frame_equal(shared_results[result_file], unshared_results[result_file])
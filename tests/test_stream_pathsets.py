@@ -0,0 +1,80 @@
+import os
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import _fasttrips
+from fasttrips import Assignment, Passenger, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_size              = 5
+
+
+def run_threaded(output_folder, stream_pathsets):
+    return Run.run_fasttrips(
+        input_network_dir       = INPUT_NETWORK,
+        input_demand_dir        = INPUT_DEMAND,
+        run_config              = CONFIG_FILE,
+        input_weights           = INPUT_WEIGHTS,
+        output_dir              = OUTPUT_DIR,
+        output_folder           = output_folder,
+        pathfinding_type        = "stochastic",
+        number_of_threads       = 2,
+        stream_pathsets         = stream_pathsets,
+        iters                   = 1,
+        num_trips               = test_size )
+
+
+@pytest.mark.basic
+def test_stream_pathsets(monkeypatch):
+    """
+    Test that the pathset stream reads back as the arrays the extension returned for each batch,
+    and that choosing from the stream gives the same pathsets as keeping them in memory.
+    """
+    # keep what the extension returns for each batch
+    returned = []
+    find_pathsets_batch = _fasttrips.find_pathsets_batch
+    def recording_find_pathsets_batch(*args):
+        results = find_pathsets_batch(*args)
+        returned.append(results)
+        return results
+    monkeypatch.setattr(_fasttrips, "find_pathsets_batch", recording_find_pathsets_batch)
+
+    r = run_threaded("test_stream_pathsets", True)
+    assert test_size == r["passengers_arrived"]
+
+    chunks = []
+    for pathfinding_iteration in range(1, Assignment.MAX_PF_ITERATIONS+1):
+        stream_file = os.path.join(OUTPUT_DIR, "test_stream_pathsets", Assignment.PATHSET_STREAM_FILE % (1, pathfinding_iteration))
+        if os.path.exists(stream_file):
+            chunks.extend(Assignment.read_pathset_stream(stream_file))
+
+    assert len(chunks) > 0
+    assert len(chunks) == len(returned)
+    for (chunk, (ret_ints, ret_doubles, path_costs, ret_perf, process_num, ret_workers)) in zip(chunks, returned):
+        np.testing.assert_array_equal(chunk["num_paths"  ], ret_perf[:, 9])
+        np.testing.assert_array_equal(chunk["num_links"  ], ret_perf[:,10])
+        np.testing.assert_array_equal(chunk["path_costs" ], path_costs)
+        np.testing.assert_array_equal(chunk["ret_ints"   ], ret_ints)
+        np.testing.assert_array_equal(chunk["ret_doubles"], ret_doubles)
+
+    monkeypatch.undo()
+    r = run_threaded("test_stream_pathsets_in_memory", False)
+    assert test_size == r["passengers_arrived"]
+
+    for pathset_file in [Passenger.PATHSET_PATHS_CSV, Passenger.PATHSET_LINKS_CSV]:
+        pd.testing.assert_frame_equal(pd.read_csv(os.path.join(OUTPUT_DIR, "test_stream_pathsets",           pathset_file)),
+                                      pd.read_csv(os.path.join(OUTPUT_DIR, "test_stream_pathsets_in_memory", pathset_file)))
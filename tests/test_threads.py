@@ -0,0 +1,70 @@
+import os
+
+import pandas as pd
+import pytest
+
+from fasttrips import Passenger, Run
+
+EXAMPLE_DIR    = os.path.join(os.getcwd(), 'fasttrips', 'Examples', 'Springfield')
+
+# DIRECTORY LOCATIONS
+INPUT_NETWORK       = os.path.join(EXAMPLE_DIR, 'networks', 'vermont')
+INPUT_DEMAND        = os.path.join(EXAMPLE_DIR, 'demand', 'general')
+INPUT_CONFIG        = os.path.join(EXAMPLE_DIR, 'configs', 'A')
+OUTPUT_DIR          = os.path.join(EXAMPLE_DIR, 'output')
+
+# INPUT FILE LOCATIONS
+CONFIG_FILE         = os.path.join(INPUT_CONFIG, 'config_ft.txt')
+INPUT_WEIGHTS       = os.path.join(INPUT_CONFIG, 'pathweight_ft.txt')
+
+# TEST PARAMETERS
+test_threads = [1, 2, 4]
+test_size    = 5
+
+# result file -> the columns that order it within a person trip
+RESULT_FILES = [(Passenger.PATHSET_PATHS_CSV,  [Passenger.PF_COL_PATH_NUM]),
+                (Passenger.PATHSET_LINKS_CSV,  [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM]),
+                ('chosenpaths_paths.csv',      [Passenger.PF_COL_PATH_NUM]),
+                ('chosenpaths_links.csv',      [Passenger.PF_COL_PATH_NUM, Passenger.PF_COL_LINK_NUM])]
+
+
+def read_results(output_folder):
+    """
+    Returns the pathsets and chosen paths from the given run, sorted by person trip, since threads finish them in any order.
+    """
+    results = {}
+    for (result_file, sort_cols) in RESULT_FILES:
+        result_df = pd.read_csv(os.path.join(OUTPUT_DIR, output_folder, result_file))
+        result_df = result_df.sort_values(by=[Passenger.TRIP_LIST_COLUMN_PERSON_ID, Passenger.TRIP_LIST_COLUMN_PERSON_TRIP_ID] + sort_cols)
+        results[result_file] = result_df.reset_index(drop=True)
+    return results
+
+
+@pytest.mark.basic
+def test_threads():
+    """
+    Test that path finding using threads in the extension (rather than processes) finds paths for everyone,
+    with the same pathsets and chosen paths for any number of threads.
+    """
+    results = {}
+    for num_threads in test_threads:
+        output_folder = "test_threads_%d" % num_threads
+        r = Run.run_fasttrips(
+            input_network_dir = INPUT_NETWORK,
+            input_demand_dir  = INPUT_DEMAND,
+            run_config        = CONFIG_FILE,
+            input_weights     = INPUT_WEIGHTS,
+            output_dir        = OUTPUT_DIR,
+            output_folder     = output_folder,
+            pathfinding_type  = "stochastic",
+            number_of_threads = num_threads,
+            iters             = 1,
+            num_trips         = test_size,
+            dispersion        = 0.50 )
+
+        assert test_size == r["passengers_arrived"]
+        results[num_threads] = read_results(output_folder)
+
+    for num_threads in test_threads[1:]:
+        for (result_file, _) in RESULT_FILES:
+            pd.testing.assert_frame_equal(results[test_threads[0]][result_file], results[num_threads][result_file])